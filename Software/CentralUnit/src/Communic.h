@@ -35,8 +35,13 @@
 
 typedef void (*f_ScktDataProc)( char * i_pszFrame ) ;
 typedef void (*f_PostResProc)( char C* i_pszResExt, BOOL i_bLastCall ) ;
+                                       /* stream producer : fill <o_pszBuf> with data */
+                                       /* from <i_dwOffset>, return written size. A size */
+                                       /* lower than <i_wSize> ends the stream */
+typedef WORD (*f_StreamProd)( DWORD i_dwOffset, char * o_pszBuf, WORD i_wSize ) ;
 
 void sfrm_Init( void ) ;
+void sfrm_TaskCyc( void ) ;
 
 
 /*----------------------------------------------------------------------------*/
@@ -49,6 +54,105 @@ typedef void (*f_htmlCgi)( DWORD i_dwParam1, DWORD i_dwParam2, char C* i_pszValu
 void html_Init( void ) ;
 
 
+/*----------------------------------------------------------------------------*/
+/* Transac.c                                                                  */
+/*----------------------------------------------------------------------------*/
+
+typedef struct                         /* transaction policy of a link (const) */
+{
+   DWORD dwTimeout ;                   /* response timeout, ms */
+   BYTE byMaxRetry ;                   /* retries number before failure */
+   WORD wBackoffMin ;                  /* first retry backoff delay, ms */
+   WORD wBackoffMax ;                  /* maximum retry backoff delay, ms */
+   BYTE byStarvMax ;                   /* consecutive commands sent before one of the */
+                                       /* last queue (0 : strict priority) */
+} s_trsPolicy ;
+
+typedef struct                         /* queued command header, first member */
+{                                      /* of the link queue item */
+   BYTE byCmdIdx ;                     /* command index (statistics, link tables) */
+   DWORD dwTick ;                      /* queuing time, ms */
+} s_trsItem ;
+
+typedef struct                         /* command queue (ring FIFO of link items) */
+{
+   BYTE * pbyItems ;                   /* items table */
+   WORD wItemSize ;                    /* item size, bytes (starts with s_trsItem) */
+   BYTE byNbItem ;                     /* items number of table (one is kept free) */
+   BYTE byIdxIn ;                      /* input index */
+   BYTE byIdxOut ;                     /* output index */
+   DWORD dwNbCoalesced ;               /* commands skipped or merged by the link */
+   DWORD dwNbDropped ;                 /* commands dropped (full queue) */
+   DWORD dwLatLast ;                   /* last queuing to sending delay, ms */
+   DWORD dwLatMax ;                    /* maximum queuing to sending delay, ms */
+} s_trsQueue ;
+
+#define TRS_HIST_NB           8        /* latency histogram buckets number */
+
+typedef struct                         /* statistics of one command */
+{
+   WORD awHist [TRS_HIST_NB] ;         /* response latency histogram (see Transac.c) */
+   WORD wNbTimeout ;                   /* timeouts number */
+   WORD wNbRetry ;                     /* retries number */
+} s_trsCmdStat ;
+
+typedef enum                           /* end of transaction */
+{
+   TRS_END_OK = 0,                     /* valid response */
+   TRS_END_RETRY,                      /* error, the command has to be sent again */
+   TRS_END_FAIL,                       /* error, all retries have failed */
+} e_trsEnd ;
+
+typedef struct                         /* transaction data of a link */
+{
+   s_trsPolicy C* pPolicy ;            /* link policy */
+   BOOL bPending ;                     /* transaction in progress */
+   BYTE byNbRetry ;                    /* current retry number */
+   WORD wBackoff ;                     /* current retry backoff delay, ms */
+   DWORD dwTmpTimeout ;                /* response timeout temporisation */
+   DWORD dwTmpBackoff ;                /* retry backoff temporisation */
+   DWORD dwStartTick ;                 /* transaction start time, ms */
+   DWORD dwNbStart ;                   /* transactions number (including retries) */
+   DWORD dwNbOk ;                      /* valid responses number */
+   DWORD dwNbErr ;                     /* errors number (including timeouts) */
+   DWORD dwNbTimeout ;                 /* timeouts number */
+   DWORD dwNbFail ;                    /* failures number (all retries failed) */
+   DWORD dwLatLast ;                   /* last response latency, ms */
+   DWORD dwLatMax ;                    /* maximum response latency, ms */
+   s_trsCmdStat * aCmdStat ;           /* per command statistics */
+   BYTE byNbCmd ;                      /* commands number */
+   BYTE byCmdIdx ;                     /* index of current command */
+   s_trsQueue * aQueue ;               /* command queues, by decreasing priority */
+   BYTE byNbQueue ;                    /* queues number */
+   BOOL bSelect ;                      /* current command is selected (output item */
+                                       /* of byQueueCur), until its transaction end */
+   BYTE byQueueCur ;                   /* queue of current command */
+   BYTE byNbPrioSent ;                 /* consecutive commands sent before last queue */
+} s_trsLink ;
+
+void trs_InitQueue( s_trsQueue * o_pQueue, void * i_pItems, WORD i_wItemSize,
+                    BYTE i_byNbItem ) ;
+void trs_Init( s_trsLink * o_pTrs, s_trsPolicy C* i_pPolicy,
+               s_trsCmdStat * i_aCmdStat, BYTE i_byNbCmd,
+               s_trsQueue * i_aQueue, BYTE i_byNbQueue ) ;
+void trs_Reset( s_trsLink * io_pTrs ) ;
+void trs_Flush( s_trsLink * io_pTrs ) ;
+void * trs_Push( s_trsLink * io_pTrs, BYTE i_byQueue, BYTE i_byCmdIdx ) ;
+void * trs_Find( s_trsLink * io_pTrs, BYTE i_byQueue, BYTE i_byCmdIdx, BOOL i_bSkipCur ) ;
+void * trs_GetLast( s_trsLink * io_pTrs, BYTE i_byQueue, BOOL i_bSkipCur ) ;
+BOOL trs_IsQueued( s_trsLink C* i_pTrs, BYTE i_byNbQueue ) ;
+BYTE trs_GetQueueDepth( s_trsLink C* i_pTrs ) ;
+void * trs_Select( s_trsLink * io_pTrs, BYTE i_byNbQueue ) ;
+BOOL trs_IsSelected( s_trsLink C* i_pTrs ) ;
+BOOL trs_IsReady( s_trsLink * io_pTrs ) ;
+void trs_Start( s_trsLink * io_pTrs, BYTE i_byCmdIdx ) ;
+BOOL trs_IsTimeout( s_trsLink * io_pTrs ) ;
+e_trsEnd trs_End( s_trsLink * io_pTrs, RESULT i_rRes ) ;
+BYTE trs_GetNbRetry( s_trsLink C* i_pTrs ) ;
+void trs_FmtStat( s_trsLink C* i_pTrs, CHAR * o_pszStat, WORD i_wSize ) ;
+void trs_FmtHist( s_trsLink C* i_pTrs, BYTE i_byQueueDepth, CHAR * o_pszHist, WORD i_wSize ) ;
+
+
 /*----------------------------------------------------------------------------*/
 /* CommWifi.c                                                                 */
 /*----------------------------------------------------------------------------*/
@@ -65,8 +169,14 @@ BOOL cwifi_IsMaintMode( void ) ;
 
 RESULT cwifi_AddExtCmd( char C* i_szStrCmd ) ;
 void cwifi_AddExtData( char C* i_szStrData ) ;
+CHAR * cwifi_ReserveData( WORD * o_pwSize ) ;
+void cwifi_CommitData( WORD i_wNbChar ) ;
 void cwifi_AskFlushData( void ) ;
+BOOL cwifi_IsFlushPending( void ) ;
+WORD cwifi_GetDataFreeSpace( void ) ;
 void cwifi_TaskCyc( void ) ;
+s_trsLink C* cwifi_GetTrs( void ) ;
+BYTE cwifi_GetQueueDepth( void ) ;
 
 
 /*----------------------------------------------------------------------------*/
@@ -101,12 +211,17 @@ typedef enum                                    /* EVSE state */
 #define COEVSE_CURRENT_CAPMAX_MAX   16			/* maximum current capacity */
 #define COEVSE_CURRENT_CAPMAX_MIN    6			/* minimum current capacity */
 
+#define COEVSE_TUNNEL_TIMEOUT_MAX   60       /* maximum tunnel inactivity timeout, sec */
+
+typedef void (*f_TunnelRxProc)( char C* i_pszData ) ;
+
 
 void coevse_Init( void ) ;
 void coevse_RegisterRetScktFunc( f_PostResProc i_fPostResProc ) ;
 
 void coevse_SetChargeEnable( BOOL i_bEnable ) ;
 void coevse_SetCurrentCap( BYTE i_byCurrent ) ;
+void coevse_SetCurrentVol( BYTE i_byCurrent ) ;
 DWORD coevse_GetCurrentCap( void ) ;
 
 e_coevseEvseState coevse_GetEvseState( void ) ;
@@ -114,12 +229,23 @@ BOOL coevse_IsPlugEvent( BOOL i_bReset ) ;
 SDWORD coevse_GetCurrent( void ) ;
 SDWORD coevse_GetVoltage( void ) ;
 DWORD coevse_GetEnergy( void ) ;
-void coevse_GetHist( CHAR * o_pszHistCmd, WORD i_wSize ) ;
+WORD coevse_ReadHist( DWORD i_dwOffset, CHAR * o_pszHistCmd, WORD i_wSize ) ;
 void coevse_FmtInfo( CHAR * o_pszInfo, WORD i_wSize ) ;
 void coevse_GetAsyncState( CHAR * o_pszAsync, WORD i_wSize ) ;
 
+void coevse_FmtLinkStat( CHAR * o_pszStat, WORD i_wSize ) ;
+void coevse_GetRxStat( DWORD * o_pdwNbLost, DWORD * o_pdwNbIrq ) ;
+s_trsLink C* coevse_GetTrs( void ) ;
+BYTE coevse_GetQueueDepth( void ) ;
+
 RESULT coevse_AddExtCmd( char C* i_szStrCmd ) ;
 
+void coevse_RegisterTunnelFunc( f_TunnelRxProc i_fTunnelRxProc ) ;
+RESULT coevse_StartTunnel( DWORD i_dwTimeout ) ;
+void coevse_StopTunnel( void ) ;
+BOOL coevse_IsTunnelActive( void ) ;
+RESULT coevse_TunnelSend( char C* i_pszData ) ;
+
 void coevse_TaskCyc( void ) ;
 
 #endif /* __COMMUNIC_H */
@@ -32,23 +32,96 @@
    It is possible to send data directly to the module with coevse_AddExtCmd()
    (bridge mode, COEVSE_CMD_EXTCMD command id)
 
-   Asked RAPI commands are stored in FIFO (l_CmdFifo). Once this FIFO is not
-   empty, and the communication is free (l_eCmd == COEVSE_CMD_NONE), the
-   command out of the FIFO is sent.
-
-   At RAPI command sending, a timeout of COEVSE_TIMEOUT ms is started. If the
+   Asked RAPI commands are stored in the queues of the transaction engine
+   (Transac.c, l_aCmdQueue). There is one queue per priority lane (given in
+   LIST_CMD) : control commands (enable, lock, current cap), user bridge
+   commands, and monitoring commands. Once a queue is not empty, and the
+   communication is free (l_eCmd == COEVSE_CMD_NONE), the command selected by
+   trs_Select() is sent : the output of the highest priority queue, or one
+   monitoring command after COEVSE_MONIT_STARV_MAX consecutive higher priority
+   commands (starvation protection). The delay between command request and
+   sending is measured for each lane.
+
+   The selected command stays selected until it succeeds or the link is
+   reset. It is formatted once : retries send again the same string, and a
+   command queued during the backoff delay is not sent in place of the
+   failed one.
+
+   The command in flight is handled by the transaction engine (Transac.c),
+   with the k_TrsPolicy policy :
+   at RAPI command sending, a timeout of COEVSE_TIMEOUT ms is started. If the
    response is wrong (bad CRC) or the timeout is over, the command is sent
-   again, with a maximum of COEVSE_MAXRETRY reties.
+   again after an exponential backoff delay (COEVSE_BACKOFF_MIN to
+   COEVSE_BACKOFF_MAX ms), with a maximum of COEVSE_MAXRETRY reties. After
+   COEVSE_RESYNC_RETRY failures, the link is resynchronized without reset : a
+   single '\r' ends any partial line on OpenEVSE side, and pending received
+   characters are dropped. Only after COEVSE_MAXRETRY failures, OpenEVSE is
+   reset ($FR).
+
+   At start and after reset, OpenEVSE readiness is probed : $GV is sent every
+   COEVSE_PROBE_PER ms (after COEVSE_PROBE_HOLDOFF ms) until a response with
+   a valid checksum is received, instead of waiting for a fixed startup
+   duration. The time to first valid response at boot, and the recovery time
+   of the last link failure are given by coevse_FmtLinkStat().
 
    The cyclic task perform verification of charging metrics by sending
    COEVSE_CMD_GETEVSESTATE,
-   COEVSE_CMD_GETCURRENTCAP,
    COEVSE_CMD_GETFAULT,
    COEVSE_CMD_GETCHARGPARAM,
    COEVSE_CMD_GETENERGYCNT,
-   every COEVSE_GETSTATE_PER seconds
+   with a period given for each command by the polling policy table
+   (k_awPollPer), depending on the EVSE state : charge metrics are sampled
+   quickly while charging, and not at all when no vehicle is connected.
+   Once asynchronous state messages ($ST) are received, $GS is only sent as a
+   slow keep-alive. COEVSE_CMD_GETCURRENTCAP is sent at start and after each
+   current capacity setting.
+   The link utilisation (part of time with a pending command) and the age of
+   each polled metric are given by coevse_FmtLinkStat().
 
    Responses from these commands is stored by coevse_Cmdresult...() callbacks
+
+   Received characters are written by a circular DMA channel into a single
+   producer/single consumer round buffer (l_RxFifo). The UART character match
+   interrupt on '\r' (one interrupt per RAPI line) publishes the DMA position
+   as input index, the cyclic task only writes the output index, so no
+   interrupt masking is needed. In tunnel mode, the UART idle line interrupt
+   also publishes data which is not ended by '\r'.
+   The task drains this buffer, and frames the received lines : a line starts
+   with '$', and ends with '\r'. Lines starting with "$OK" or "$NK" while a
+   command is pending are assembled as command response (l_Result), other
+   lines as asynchronous notification (l_Async). Characters outside of a line
+   are dropped. Once its checksum is verified, a notification is given to its
+   handler by the dispatch table (k_aAsyncDesc) : state transitions ($ST,
+   $AT) update the EVSE state and plug event immediately. Characters lost by
+   UART overrun or buffer overwrite are counted (coevse_GetRxStat()), and make
+   the pending command fail (retry).
+
+   State notifications are published on the event bus in the task call where
+   they are framed, so the charge FSM reacts in the same main loop tick. The
+   task is called every ms, and the charge enable command ($S4) is sent by the
+   next call if no command is pending. The delay from the notification line
+   reception (character match interrupt time) to coevse_SetChargeEnable() and
+   to the $S4 sending is measured (l_PlugLat, target COEVSE_PLUGLAT_TARGET),
+   and given by coevse_FmtLinkStat().
+
+   The response checksum is folded in as characters are received, and the
+   response is split in the same pass into numeric fields (decimal and
+   hexadecimal values, see s_coevseResFields) given to the result callbacks.
+
+   A transparent tunnel mode (coevse_StartTunnel()) gives a direct access to
+   the OpenEVSE serial link : once pending command is over, periodic polling,
+   and sending of bridge and monitoring commands are paused. Data given by
+   coevse_TunnelSend() are sent as is (ended by '\r'), and received characters
+   are read from the reception round buffer and forwarded by the cyclic task
+   to the registered tunnel callback.
+   Control commands (charge enable, current capacity) are not held during the
+   tunnel : once a control command is queued and the tunnel exchange is over
+   (no transmission or reception during COEVSE_TUNNEL_GAP ms), the tunnel is
+   suspended, and control commands are sent as usual. The tunnel resumes when
+   the control lane is empty. Tunnel data given meanwhile are sent at resume.
+   The tunnel is closed by coevse_StopTunnel(), on link failure, or when no
+   data is exchanged during the tunnel timeout (COEVSE_TUNNEL_TIMEOUT_MAX sec
+   at most). Normal operation then resumes (commands held in FIFO are sent).
 */
 
 
@@ -73,12 +146,28 @@
    /* power-down, a communication error may be throwed (depending on    */
    /* retries numbers) before the power save mode is effective.         */
 
-#define COEVSE_GETSTATE_PER     1000   /* OpenEVSE status read period */
-#define COEVSE_HRD_START_DUR    8000   /* OpenEVSE hardware startup duration */
+#define COEVSE_POLL_GS_ASYNC  10000   /* $GS period once asynchronous state is received, ms */
+#define COEVSE_STAT_WINDOW    10000    /* link utilisation measurement window, ms */
+#define COEVSE_PROBE_HOLDOFF    1000   /* delay before first readiness probe after reset, ms */
+#define COEVSE_PROBE_PER         500   /* readiness probe period, ms */
+#define COEVSE_PLUGLAT_TARGET    100   /* notification to charge enable delay target, ms */
 #define COEVSE_MAXRETRY           10   /* maximum number of retry before error */
+#define COEVSE_RESYNC_RETRY        3   /* number of retry before resynchronization */
+#define COEVSE_BACKOFF_MIN        20   /* first retry backoff delay, ms */
+#define COEVSE_BACKOFF_MAX       640   /* maximum retry backoff delay, ms */
 
 #define COEVSE_MAX_CMD_LEN        29   /* maximum size for RAPI command */
 
+#define COEVSE_MONIT_STARV_MAX     4   /* maximum consecutive commands before monitoring */
+
+#define COEVSE_TUNNEL_TIMEOUT_DEF 30   /* default tunnel inactivity timeout, sec */
+#define COEVSE_TUNNEL_GAP        100   /* tunnel silence before control command, ms */
+#define COEVSE_TUNNEL_TX_SIZE     64   /* tunnel transmission buffer size */
+
+#define COEVSE_RX_FIFO_SIZE      128   /* reception round buffer size */
+
+#define COEVSE_RES_FIELD_MAX       4   /* maximum numeric fields in response */
+
                                        /* disable/suspend transmit channel DMA */
 #define COEVSE_DISABLE_DMA_TX()     ( UOEVSE_DMA_TX->CCR &= ~DMA_CCR_EN )
                                        /* enable transmit channel DMA */
@@ -86,9 +175,41 @@
 
 
 static char const k_szStrReset [] = "$FR^30\r" ;
+static char const k_szStrProbe [] = "$GV^35\r" ;
+static char const k_szStrResync [] = "\r" ;
+
+static s_trsPolicy const k_TrsPolicy = /* command transaction policy */
+{
+   .dwTimeout = COEVSE_TIMEOUT,
+   .byMaxRetry = COEVSE_MAXRETRY,
+   .wBackoffMin = COEVSE_BACKOFF_MIN,
+   .wBackoffMax = COEVSE_BACKOFF_MAX,
+   .byStarvMax = COEVSE_MONIT_STARV_MAX,
+} ;
+
+
+typedef struct                         /* numeric fields of response (after "$OK") */
+{
+   BYTE byNb ;                         /* number of fields */
+   BYTE byDecValid ;                   /* bit n is set if field n is a decimal number */
+   BYTE byHexValid ;                   /* bit n is set if field n is a hexa number */
+   SDWORD asdwDec [COEVSE_RES_FIELD_MAX] ;   /* decimal values */
+   DWORD adwHex [COEVSE_RES_FIELD_MAX] ;     /* hexadecimal values */
+} s_coevseResFields ;
+
+                                       /* test if field is a decimal/hexa number */
+#define COEVSE_IS_DEC( pFields, Idx )    ISSET( (pFields)->byDecValid, 1 << (Idx) )
+#define COEVSE_IS_HEX( pFields, Idx )    ISSET( (pFields)->byHexValid, 1 << (Idx) )
 
+typedef void (*f_ResultCallback)( char C* i_pszDataRes, s_coevseResFields C* i_pFields ) ;
 
-typedef void (*f_ResultCallback)( char C* i_pszDataRes ) ;
+typedef void (*f_AsyncProc)( s_coevseResFields C* i_pFields ) ;
+
+typedef struct                         /* asynchronous notification descriptor */
+{
+   char C* szHead ;                    /* notification header ("$XX") */
+   f_AsyncProc fAsyncProc ;            /* notification handler */
+} s_AsyncDesc ;
 
 
    /* Note : LIST_CMD() defines the CRC value (<szChecksum> field of         */
@@ -104,19 +225,45 @@ typedef void (*f_ResultCallback)( char C* i_pszDataRes ) ;
    /* Macro Op = macro for command without callback                     */
    /* Macro Opg = macro for command with callback (coevse_Cmdresult...) */
 
+   /* Note : <Lane> field gives the priority lane (e_coevseLane)          */
+
+   /* Note : last field gives the FIFO coalescing policy (e_coevseCoal) : */
+   /* NONE : always queued                                                */
+   /* SKIP : not queued if the same command is already pending (getters)  */
+   /* REPLACE : parameters of the same command are replaced if it is the  */
+   /*           last one of the lane and not yet sent (setters). Older    */
+   /*           ones are not : a setter of the same OpenEVSE value (e.g.  */
+   /*           SETCURRENTCAP, SETCURRENTVOL) may be queued after them    */
+
 
 #define LIST_CMD( Op, Opg ) \
-   Op(   ENABLE,        Enable,        "$FE",    "^27\r" ) \
-   Op(   DISABLE,       Disable,       "$FD",    "^26\r" ) \
-   Op(   SETLOCK,       SetLock,       "$S4 %d", NULL    ) \
-   Op(   SETCURRENTCAP, SetCurrentCap, "$SC %d", NULL    ) \
-   Opg(  GETEVSESTATE,  GetEVSEState,  "$GS",    "^30\r" ) \
-   Opg(  GETCURRENTCAP, GetCurrentCap, "$GE",    "^26\r" ) \
-   Opg(  GETFAULT,      GetFault,      "$GF",    "^25\r" ) \
-   Opg(  GETCHARGPARAM, GetChargParam, "$GG",    "^24\r" ) \
-   Opg(  GETENERGYCNT,  GetEneryCnt,   "$GU",    "^36\r" ) \
-   Opg(  GETVERSION,    GetVersion,    "$GV",    "^35\r" ) \
-   Opg(  EXTCMD,        ExtCmd,        NULL,     NULL ) \
+   Op(   ENABLE,        Enable,        "$FE",    "^27\r", CTRL,   NONE    ) \
+   Op(   DISABLE,       Disable,       "$FD",    "^26\r", CTRL,   NONE    ) \
+   Op(   SETLOCK,       SetLock,       "$S4 %d", NULL,    CTRL,   REPLACE ) \
+   Op(   SETCURRENTCAP, SetCurrentCap, "$SC %d", NULL,    CTRL,   REPLACE ) \
+   Op(   SETCURRENTVOL, SetCurrentVol, "$SC %d V", NULL,  CTRL,   REPLACE ) \
+   Opg(  GETEVSESTATE,  GetEVSEState,  "$GS",    "^30\r", MONIT,  SKIP    ) \
+   Opg(  GETCURRENTCAP, GetCurrentCap, "$GE",    "^26\r", MONIT,  SKIP    ) \
+   Opg(  GETFAULT,      GetFault,      "$GF",    "^25\r", MONIT,  SKIP    ) \
+   Opg(  GETCHARGPARAM, GetChargParam, "$GG",    "^24\r", MONIT,  SKIP    ) \
+   Opg(  GETENERGYCNT,  GetEneryCnt,   "$GU",    "^36\r", MONIT,  SKIP    ) \
+   Opg(  GETVERSION,    GetVersion,    "$GV",    "^35\r", MONIT,  SKIP    ) \
+   Opg(  EXTCMD,        ExtCmd,        NULL,     NULL,    BRIDGE, NONE    ) \
+
+typedef enum                           /* priority lanes, highest priority first */
+{
+   COEVSE_LANE_CTRL = 0,               /* charge control commands */
+   COEVSE_LANE_BRIDGE,                 /* user bridge commands */
+   COEVSE_LANE_MONIT,                  /* monitoring commands */
+   COEVSE_LANE_NB,
+} e_coevseLane ;
+
+typedef enum                           /* FIFO coalescing policy */
+{
+   COEVSE_COAL_NONE = 0,               /* always queued */
+   COEVSE_COAL_SKIP,                   /* skipped if already pending */
+   COEVSE_COAL_REPLACE,                /* replace queued parameters */
+} e_coevseCoal ;
 
 typedef enum                           /* reduced set of used RAPI commands */
 {
@@ -133,6 +280,8 @@ typedef struct                         /* RAPI command const data */
    f_ResultCallback fResultCallback ;  /* callback, NULL if no callback */
    char C* szFmtCmd ;                  /* command string */
    char C* szChecksum ;                /* checksum value, NULL for dynamic computation*/
+   e_coevseLane eLane ;                /* priority lane */
+   e_coevseCoal eCoal ;                /* FIFO coalescing policy */
 } s_CmdDesc ;
 
 static s_CmdDesc const k_aCmdDesc [] = /* list of API commands const data */
@@ -140,20 +289,13 @@ static s_CmdDesc const k_aCmdDesc [] = /* list of API commands const data */
    LIST_CMD( COEVSE_CMD_DESC, COEVSE_CMD_DESC_G )
 } ;
 
-typedef struct                         /* one element of command FIFO */
+typedef struct                         /* one element of command queue */
 {
-   e_CmdId eCmdId ;                    /* command ID */
+   s_trsItem Hdr ;                     /* queue header (command index, request time) */
    WORD wParam [6] ;                   /* command params */
    BYTE byNbParam ;                    /* nb params */
 } s_CmdFifoData ;
 
-typedef struct                         /* command FIFO */
-{
-   BYTE byIdxIn ;                      /* input index */
-   BYTE byIdxOut ;                     /* output index */
-   s_CmdFifoData aCmdData [16] ;       /* element data */
-} s_CmdFifo ;
-
 
 typedef struct                         /* response of RAPI commmand */
 {
@@ -161,8 +303,24 @@ typedef struct                         /* response of RAPI commmand */
    BYTE byResIdx ;                     /* response data index (reponse length) */
    BOOL bError ;                       /* Uart module error */
    BOOL bWaitResponse ;                /* pending response reception indicator */
+   BYTE byXor ;                        /* checksum of received characters */
+   BOOL bCkPart ;                      /* checksum part ('^' received) */
+   BYTE byCkRead ;                     /* received checksum value */
+   BYTE byCkNbDigit ;                  /* received checksum digits (BYTE_MAX if wrong) */
+   BYTE byTokIdx ;                     /* current token index (0 for "$OK" status) */
+   BOOL bInTok ;                       /* token reception in progress */
+   BOOL bTokNeg ;                      /* current token is negative */
+   s_coevseResFields Fields ;          /* response numeric fields */
 } s_coevseResult ;
 
+typedef enum                           /* destination of received line */
+{
+   COEVSE_RX_NONE = 0,                 /* out of line, characters are dropped */
+   COEVSE_RX_HEAD,                     /* '$' received, destination is unknown */
+   COEVSE_RX_RES,                      /* command response */
+   COEVSE_RX_ASYNC,                    /* asynchronous notification */
+} e_coevseRxLine ;
+
 
 typedef struct                         /* module data */
 {
@@ -186,6 +344,96 @@ typedef struct
    WORD wIdx ;
 } s_HistCmd ;
 
+typedef enum                           /* polled commands */
+{
+   COEVSE_POLL_GS = 0,                 /* $GS : EVSE state */
+   COEVSE_POLL_GG,                     /* $GG : charge current and voltage */
+   COEVSE_POLL_GU,                     /* $GU : energy */
+   COEVSE_POLL_GF,                     /* $GF : faults counters */
+   COEVSE_POLL_GE,                     /* $GE : current capacity */
+   COEVSE_POLL_NB,
+} e_coevsePollId ;
+
+static e_CmdId const k_aePollCmd [COEVSE_POLL_NB] =
+{
+   COEVSE_CMD_GETEVSESTATE,
+   COEVSE_CMD_GETCHARGPARAM,
+   COEVSE_CMD_GETENERGYCNT,
+   COEVSE_CMD_GETFAULT,
+   COEVSE_CMD_GETCURRENTCAP,
+} ;
+                                       /* polling period (ms, 0 for no polling), */
+                                       /* given by EVSE state (e_coevseEvseState) */
+static WORD const k_awPollPer [][COEVSE_POLL_NB] =
+{                       /*  $GS    $GG    $GU    $GF    $GE */
+   /* UNKNOWN      */    { 1000,     0,     0,  5000,     0 },
+   /* NOTCONNECTED */    { 1000,     0,     0, 30000,     0 },
+   /* CONNECTED    */    { 1000,  5000,  5000, 10000,     0 },
+   /* CHARGING     */    { 1000,   250,  1000, 10000,     0 },
+} ;
+
+typedef struct                         /* polling data */
+{
+   DWORD adwTmp [COEVSE_POLL_NB] ;     /* polling period temporisations */
+   DWORD adwLastRes [COEVSE_POLL_NB] ; /* time of last valid response, ms */
+   BOOL abResValid [COEVSE_POLL_NB] ;  /* at least one valid response */
+   BOOL bAsyncState ;                  /* asynchronous state messages are received */
+   DWORD dwCmdStart ;                  /* pending command start time, ms */
+   DWORD dwBusySum ;                   /* pending command time in current window, ms */
+   DWORD dwTmpWindow ;                 /* utilisation measurement window */
+   WORD wUtil ;                        /* link utilisation of last window (per thousand) */
+} s_coevsePoll ;
+
+typedef struct                         /* link recovery */
+{
+   WORD wNbProbe ;                     /* readiness probes sent since reset */
+   DWORD dwFailTick ;                  /* first failure time (boot time at start) */
+   BOOL bBootDone ;                    /* OpenEVSE has been ready once */
+   DWORD dwBootDur ;                   /* time to first valid response at boot, ms */
+   DWORD dwRecovDur ;                  /* recovery time of last link failure, ms */
+   DWORD dwNbResync ;                  /* resynchronizations number */
+   DWORD dwNbReset ;                   /* OpenEVSE resets number */
+} s_coevseLink ;
+
+typedef struct                         /* transparent tunnel data */
+{
+   BOOL bAskStart ;                    /* tunnel start is asked (waiting for pending command end) */
+   BOOL bActive ;                      /* tunnel is active */
+   BOOL bSuspend ;                     /* tunnel is suspended for control commands */
+   BOOL bTxPending ;                   /* data to be sent at resume (szTxBuf) */
+   BYTE byTxLen ;                      /* size of data to be sent at resume */
+   DWORD dwTimeout ;                   /* inactivity timeout, sec */
+   DWORD dwTmpTimeout ;                /* inactivity temporisation */
+   DWORD dwTmpGap ;                    /* last exchange temporisation */
+   DWORD dwNbLost ;                    /* number of lost characters */
+   f_TunnelRxProc fTunnelRxProc ;      /* received data callback */
+                                       /* transmission buffer (static for DMA) */
+   char szTxBuf [COEVSE_TUNNEL_TX_SIZE] ;
+} s_coevseTunnel ;
+
+typedef struct                         /* reception round buffer (single producer/consumer) */
+{
+   volatile BYTE byIdxIn ;             /* input index (written by interrupt only) */
+   volatile BYTE byIdxOut ;            /* output index (written by task only) */
+   volatile DWORD dwNbLost ;           /* lost characters counter (written by interrupt only) */
+   volatile DWORD dwNbIrq ;            /* reception interrupts counter */
+   volatile DWORD dwTickIrq ;          /* last reception interrupt time, ms */
+   DWORD dwNbLostRead ;                /* lost characters counter already seen by task */
+   volatile BYTE abyData [COEVSE_RX_FIFO_SIZE] ;   /* written by DMA */
+} s_coevseRxFifo ;
+
+typedef struct                         /* state notification to charge enable delay */
+{
+   BOOL bNotif ;                       /* notification framed in current task call */
+   BOOL bWaitSend ;                    /* charge enable command is not sent yet */
+   DWORD dwTickNotif ;                 /* notification reception time, ms */
+   DWORD dwEnaLast ;                   /* last notification to charge enable delay, ms */
+   DWORD dwEnaMax ;                    /* maximum notification to charge enable delay, ms */
+   DWORD dwSendLast ;                  /* last notification to $S4 sending delay, ms */
+   DWORD dwSendMax ;                   /* maximum notification to $S4 sending delay, ms */
+   DWORD dwNbOver ;                    /* charge enables over COEVSE_PLUGLAT_TARGET */
+} s_coevsePlugLat ;
+
 
 /*----------------------------------------------------------------------------*/
 /* Prototypes                                                                 */
@@ -193,22 +441,56 @@ typedef struct
 
 static BOOL coevse_IsNeedSend( void ) ;
 static void coevse_AddCmdFifo( e_CmdId i_eCmdId, WORD * i_awParams, BYTE i_byNbParam ) ;
+static void coevse_FillCmdFifo( s_CmdFifoData * o_pCmdData, WORD * i_awParams,
+                                BYTE i_byNbParam ) ;
 static void coevse_SendCmdFifo( void ) ;
+static void coevse_FmtCmdFifo( s_CmdFifoData C* i_pFifoData ) ;
 static void coevse_AnalyseRes( void ) ;
+static RESULT coevse_CheckRes( s_coevseResult * io_pRes, BOOL i_bStatus ) ;
+static void coevse_ProcessProbe( void ) ;
+static void coevse_SetReady( void ) ;
+static void coevse_Poll( void ) ;
+static void coevse_PollRestart( void ) ;
+static void coevse_UpdateEvseState( DWORD i_dwState ) ;
+
+static BOOL coevse_RxFifoGet( BYTE * o_pbyData ) ;
+static BOOL coevse_RxFifoIsLost( void ) ;
+static void coevse_RxFifoFlush( void ) ;
+static void coevse_ProcessRx( void ) ;
+static void coevse_RxLineChar( BYTE i_byData ) ;
+static void coevse_AnalyseAsync( void ) ;
+static void coevse_AsyncState( s_coevseResFields C* i_pFields ) ;
+static void coevse_AsyncBoot( s_coevseResFields C* i_pFields ) ;
+static void coevse_ResAddChar( s_coevseResult * io_pRes, BYTE i_byData ) ;
+static void coevse_ResTokChar( s_coevseResult * io_pRes, char i_cChar ) ;
+static void coevse_ResTokEnd( s_coevseResult * io_pRes ) ;
 
 static void coevse_GetChecksum( char * o_sChecksum, BYTE i_byCkSize,
                                 char C* i_szData ) ;
 
 static void coevse_CmdStart( e_CmdId i_eCmdId ) ;
 static void coevse_CmdSetErr( void ) ;
+static void coevse_Resync( void ) ;
 static void coevse_SetError( void ) ;
 static void coevse_CmdEnd( void ) ;
 
 static void coevse_HistAddCmd( char C* i_pszStrCmd ) ;
 
+static void coevse_TunnelSetActive( BOOL i_bActive ) ;
+static void coevse_TunnelSuspend( BOOL i_bSuspend ) ;
+static void coevse_ProcessTunnel( void ) ;
+
 static void coevse_HrdInit( void ) ;
 static void coevse_HrdSendCmd( char C* i_pszStrCmd, BYTE i_bySize ) ;
 
+                                       /* asynchronous notifications dispatch table */
+static s_AsyncDesc const k_aAsyncDesc [] =
+{
+   { "$ST", coevse_AsyncState },       /* EVSE state transition */
+   { "$AT", coevse_AsyncState },       /* EVSE state transition (RAPI >= 5.0) */
+   { "$AB", coevse_AsyncBoot },        /* OpenEVSE boot */
+} ;
+
 
 /*----------------------------------------------------------------------------*/
 /* variables                                                                  */
@@ -219,23 +501,31 @@ static e_CmdId l_eCmd ;                /* current sending command, COEVSE_CMD_NO
 static f_PostResProc l_fPostResProc ;  /* addresse of callback function for external command result */
                                        /* external command string */
 static char l_szExtCmdStr [ COEVSE_MAX_CMD_LEN + 1 ] ;
-static s_CmdFifo l_CmdFifo ;           /* command FIFO */
+                                       /* command queue items per lane */
+static s_CmdFifoData l_aCmdItems [COEVSE_LANE_NB][8] ;
+static s_trsQueue l_aCmdQueue [COEVSE_LANE_NB] ;   /* command queue per lane */
                                        /* Buffer for sending command (must be
                                           declared in static bescause of use of DMA) */
 static char l_szStrCmdBuffer [ COEVSE_MAX_CMD_LEN + 1 ] ;
 
-static BYTE l_byNbRetry ;              /* current retry number */
-static DWORD l_dwCmdTimeout ;          /* timeout temporisation */
+static s_trsLink l_Trs ;               /* command transaction */
+                                       /* per command transaction statistics */
+static s_trsCmdStat l_aTrsStat [COEVSE_CMD_LAST - ( COEVSE_CMD_NONE + 1 )] ;
 static BOOL l_bOpenEvseRdy ;           /* hardware openEVSE ready state */
-static DWORD l_dwTmpStart ;
+static DWORD l_dwTmpStart ;            /* readiness probe temporisation */
+static s_coevseLink l_Link ;           /* link recovery */
 
 static s_coevseResult l_Result ;
 static s_coevseResult l_Async ;
+static e_coevseRxLine l_eRxLine ;      /* destination of current received line */
 
-static DWORD l_dwGetStateTmp ;
+static s_coevsePoll l_Poll ;           /* adaptive polling */
 static s_coevseData l_Status ;
 
 static s_HistCmd l_HistCmd ;           /* RAPI Sx command history */
+static s_coevseTunnel l_Tunnel ;       /* transparent tunnel */
+static s_coevseRxFifo l_RxFifo ;       /* reception round buffer */
+static s_coevsePlugLat l_PlugLat ;     /* notification to charge enable delay */
 
 
 /*----------------------------------------------------------------------------*/
@@ -244,11 +534,23 @@ static s_HistCmd l_HistCmd ;           /* RAPI Sx command history */
 
 void coevse_Init( void )
 {
+   BYTE byLane ;
+
    coevse_HrdInit() ;
 
    coevse_HrdSendCmd( k_szStrReset, sizeof(k_szStrReset) ) ;
    l_bOpenEvseRdy = FALSE ;
 
+   for ( byLane = 0 ; byLane < COEVSE_LANE_NB ; byLane++ )
+   {
+      trs_InitQueue( &l_aCmdQueue[byLane], l_aCmdItems[byLane],
+                     sizeof(s_CmdFifoData), ARRAY_SIZE(l_aCmdItems[byLane]) ) ;
+   }
+   trs_Init( &l_Trs, &k_TrsPolicy, l_aTrsStat, ARRAY_SIZE(l_aTrsStat),
+             l_aCmdQueue, COEVSE_LANE_NB ) ;
+   memset( &l_Link, 0, sizeof(l_Link) ) ;
+   l_Link.dwFailTick = HAL_GetTick() ;
+   memset( &l_PlugLat, 0, sizeof(l_PlugLat) ) ;
    tim_StartMsTmp( &l_dwTmpStart ) ;
 
    coevse_AddCmdFifo( COEVSE_CMD_ENABLE, NULL, 0 ) ;
@@ -266,12 +568,28 @@ void coevse_RegisterRetScktFunc( f_PostResProc i_fPostResProc )
 
 
 /*----------------------------------------------------------------------------*/
-/* Set current capacity                                                       */
+/* Set charge enable (OpenEVSE lock state). When called on a state            */
+/* notification framed in the current task call, the delay from notification */
+/* reception is measured                                                      */
 /*----------------------------------------------------------------------------*/
 
 void coevse_SetChargeEnable( BOOL i_bEnable )
 {
    WORD awParam [1] ;
+   DWORD dwLat ;
+
+   if ( l_PlugLat.bNotif )
+   {
+      dwLat = HAL_GetTick() - l_PlugLat.dwTickNotif ;
+      l_PlugLat.dwEnaLast = dwLat ;
+      l_PlugLat.dwEnaMax = GETMAX( l_PlugLat.dwEnaMax, dwLat ) ;
+      if ( dwLat > COEVSE_PLUGLAT_TARGET )
+      {
+         l_PlugLat.dwNbOver++ ;
+      }
+      l_PlugLat.bNotif = FALSE ;
+      l_PlugLat.bWaitSend = TRUE ;
+   }
 
    if ( i_bEnable )                    /* if charge is enabled */
    {
@@ -299,6 +617,20 @@ void coevse_SetCurrentCap( BYTE i_byCurrent )
 }
 
 
+/*----------------------------------------------------------------------------*/
+/* Set volatile current capacity (A) : not saved in OpenEVSE eeprom, used by  */
+/* load management for frequent adjustments                                   */
+/*----------------------------------------------------------------------------*/
+
+void coevse_SetCurrentVol( BYTE i_byCurrent )
+{
+   WORD awParam [1] ;
+
+   awParam[0] = i_byCurrent ;
+   coevse_AddCmdFifo( COEVSE_CMD_SETCURRENTVOL, awParam, 1 ) ;
+}
+
+
 /*----------------------------------------------------------------------------*/
 /* Get current capacity (A)                                                   */
 /*----------------------------------------------------------------------------*/
@@ -369,14 +701,29 @@ DWORD coevse_GetEnergy( void )
 
 
 /*----------------------------------------------------------------------------*/
-/* Get RAPI commands history                                                  */
+/* Read RAPI commands history from <i_dwOffset> (socket stream producer)      */
+/* Return the number of characters read. The history is cleared once fully   */
+/* read (returned size lower than <i_wSize>)                                  */
 /*----------------------------------------------------------------------------*/
 
-void coevse_GetHist( CHAR * o_pszHistCmd, WORD i_wSize )
+WORD coevse_ReadHist( DWORD i_dwOffset, CHAR * o_pszHistCmd, WORD i_wSize )
 {
-   strncpy( o_pszHistCmd, l_HistCmd.szHistStr, i_wSize ) ;
-                                       /* clear command history */
-   memset( &l_HistCmd, 0, sizeof( l_HistCmd ) ) ;
+   WORD wNbChar ;
+
+   wNbChar = 0 ;
+
+   if ( i_dwOffset < l_HistCmd.wIdx )
+   {
+      wNbChar = GETMIN( l_HistCmd.wIdx - i_dwOffset, i_wSize ) ;
+      memcpy( o_pszHistCmd, &l_HistCmd.szHistStr[i_dwOffset], wNbChar ) ;
+   }
+
+   if ( wNbChar < i_wSize )            /* clear command history */
+   {
+      memset( &l_HistCmd, 0, sizeof( l_HistCmd ) ) ;
+   }
+
+   return wNbChar ;
 }
 
 
@@ -403,6 +750,96 @@ void coevse_GetAsyncState( CHAR * o_pszAsync, WORD i_wSize )
 }
 
 
+/*----------------------------------------------------------------------------*/
+/* Format link statistics : utilisation (per thousand), age of each polled    */
+/* metric in ms ($GS, $GG, $GU, $GF, $GE, -1 if never received), lost         */
+/* characters, reception interrupts number, coalesced and dropped commands,   */
+/* last and maximum request to sending delay of control commands (ms), time  */
+/* to first valid response at boot (ms), recovery time of last link failure  */
+/* (ms), resynchronizations and resets numbers                                */
+/*----------------------------------------------------------------------------*/
+
+void coevse_FmtLinkStat( CHAR * o_pszStat, WORD i_wSize )
+{
+   SDWORD asdwAge [COEVSE_POLL_NB] ;
+   DWORD dwTick ;
+   BYTE byIdx ;
+   DWORD dwNbCoalesced ;
+   DWORD dwNbDropped ;
+
+   dwTick = HAL_GetTick() ;
+
+   for ( byIdx = 0 ; byIdx < COEVSE_POLL_NB ; byIdx++ )
+   {
+      if ( l_Poll.abResValid[byIdx] )
+      {
+         asdwAge[byIdx] = (SDWORD)( dwTick - l_Poll.adwLastRes[byIdx] ) ;
+      }
+      else
+      {
+         asdwAge[byIdx] = -1 ;
+      }
+   }
+
+   dwNbCoalesced = 0 ;
+   dwNbDropped = 0 ;
+   for ( byIdx = 0 ; byIdx < COEVSE_LANE_NB ; byIdx++ )
+   {
+      dwNbCoalesced += l_aCmdQueue[byIdx].dwNbCoalesced ;
+      dwNbDropped += l_aCmdQueue[byIdx].dwNbDropped ;
+   }
+
+   snprintf( o_pszStat, i_wSize,
+             "%u, %li, %li, %li, %li, %li, %lu, %lu, %lu, %lu, %lu, %lu, %lu, %lu, %lu, %lu, "
+             "%lu, %lu, %lu, %lu, %lu",
+             l_Poll.wUtil,
+             asdwAge[COEVSE_POLL_GS], asdwAge[COEVSE_POLL_GG],
+             asdwAge[COEVSE_POLL_GU], asdwAge[COEVSE_POLL_GF],
+             asdwAge[COEVSE_POLL_GE],
+             l_RxFifo.dwNbLost, l_RxFifo.dwNbIrq,
+             dwNbCoalesced, dwNbDropped,
+             l_aCmdQueue[COEVSE_LANE_CTRL].dwLatLast,
+             l_aCmdQueue[COEVSE_LANE_CTRL].dwLatMax,
+             l_Link.dwBootDur, l_Link.dwRecovDur,
+             l_Link.dwNbResync, l_Link.dwNbReset,
+             l_PlugLat.dwEnaLast, l_PlugLat.dwEnaMax,
+             l_PlugLat.dwSendLast, l_PlugLat.dwSendMax, l_PlugLat.dwNbOver ) ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Get reception statistics                                                   */
+/*    - <o_pdwNbLost> characters lost (UART overrun or buffer overwrite)      */
+/*    - <o_pdwNbIrq> reception interrupts number                              */
+/*----------------------------------------------------------------------------*/
+
+void coevse_GetRxStat( DWORD * o_pdwNbLost, DWORD * o_pdwNbIrq )
+{
+   *o_pdwNbLost = l_RxFifo.dwNbLost ;
+   *o_pdwNbIrq = l_RxFifo.dwNbIrq ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Get command transaction data (statistics)                                  */
+/*----------------------------------------------------------------------------*/
+
+s_trsLink C* coevse_GetTrs( void )
+{
+   return &l_Trs ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Get number of commands waiting in FIFOs (all lanes)                        */
+/*----------------------------------------------------------------------------*/
+
+BYTE coevse_GetQueueDepth( void )
+{
+   return trs_GetQueueDepth( &l_Trs ) ;
+}
+
+
 /*----------------------------------------------------------------------------*/
 /* Add external RAPI command (bridge)                                         */
 /*----------------------------------------------------------------------------*/
@@ -433,472 +870,1321 @@ RESULT coevse_AddExtCmd( char C* i_szStrCmd )
 
 
 /*----------------------------------------------------------------------------*/
-/* periodic task                                                              */
+/* Registering callback function for tunnel received data                     */
 /*----------------------------------------------------------------------------*/
 
-void coevse_TaskCyc( void )
+void coevse_RegisterTunnelFunc( f_TunnelRxProc i_fTunnelRxProc )
 {
-   if ( l_bOpenEvseRdy )
-   {
-      if ( coevse_IsNeedSend() )       /* if sending is ready */
-      {
-         coevse_SendCmdFifo() ;        /* send next command in FIFO */
-         tim_StartMsTmp( &l_dwCmdTimeout ) ;
-      }
+   l_Tunnel.fTunnelRxProc = i_fTunnelRxProc ;
+}
 
-      if ( l_eCmd != COEVSE_CMD_NONE ) /* if command is still pending */
-      {                                /* if response has arrived */
-         if ( ! l_Result.bWaitResponse )
-         {                             /* treat the response */
-            HAL_NVIC_DisableIRQ( UOEVSE_IRQn ) ;
-            coevse_AnalyseRes() ;
-            HAL_NVIC_EnableIRQ( UOEVSE_IRQn ) ;
-         }
 
-         if ( tim_IsEndMsTmp( &l_dwCmdTimeout, COEVSE_TIMEOUT ) )
-         {
-            coevse_CmdSetErr() ;       /* timeout error */
-         }
-      }
-                                       /* verification of charging metrics temporisation */
-      if ( tim_IsEndMsTmp( &l_dwGetStateTmp, COEVSE_GETSTATE_PER ) )
-      {
-         tim_StartMsTmp( &l_dwGetStateTmp ) ;
+/*----------------------------------------------------------------------------*/
+/* Ask for transparent tunnel start, with <i_dwTimeout> inactivity timeout    */
+/* (sec, 0 for default). The tunnel is effective once pending command ends    */
+/*----------------------------------------------------------------------------*/
 
-         coevse_AddCmdFifo( COEVSE_CMD_GETEVSESTATE, NULL, 0 ) ;
-         coevse_AddCmdFifo( COEVSE_CMD_GETCURRENTCAP, NULL, 0 ) ;
-         coevse_AddCmdFifo( COEVSE_CMD_GETFAULT, NULL, 0 ) ;
-         coevse_AddCmdFifo( COEVSE_CMD_GETCHARGPARAM, NULL, 0 ) ;
-         coevse_AddCmdFifo( COEVSE_CMD_GETENERGYCNT, NULL, 0 ) ;
+RESULT coevse_StartTunnel( DWORD i_dwTimeout )
+{
+   RESULT rRet ;
+
+   if ( l_bOpenEvseRdy && ( ! l_Tunnel.bActive ) )
+   {
+      if ( i_dwTimeout == 0 )
+      {
+         i_dwTimeout = COEVSE_TUNNEL_TIMEOUT_DEF ;
       }
+      DEFENS_LIM_MAX( i_dwTimeout, COEVSE_TUNNEL_TIMEOUT_MAX ) ;
+
+      l_Tunnel.dwTimeout = i_dwTimeout ;
+      l_Tunnel.bAskStart = TRUE ;
+      rRet = OK ;
    }
    else
    {
-      if ( tim_IsEndMsTmp( &l_dwTmpStart, COEVSE_HRD_START_DUR ) )
-      {
-         l_bOpenEvseRdy = TRUE ;       /* openEVSE hardware is ready */
-                                       /* get version once openEVSE is ready */
-         coevse_AddCmdFifo( COEVSE_CMD_GETVERSION, NULL, 0 ) ;
-         tim_StartMsTmp( &l_dwGetStateTmp ) ;
-      }
+      rRet = ERR ;
    }
 
-   HAL_NVIC_DisableIRQ( UOEVSE_IRQn ) ;
-   if ( l_Async.byResIdx != 0 )        /* if asynchronous message buffer is not empty */
-   {                                   /* if one asynchronous message is ready (we make assumption) */
-                                       /* that we detect '\r' of each asynchronous messages */
-      if ( l_Async.abyDataRes[( l_Async.byResIdx - 1 )] == '\r' )
-      {                                /* if asynchronous status */
-         if ( memcmp( l_Async.abyDataRes, "$ST 0", sizeof( "$ST 0") - 1 ) == 0 )
-         {                             /* reda status */
-            l_Status.byAsyncState = l_Async.abyDataRes[5] - '0' ;
-         }
-                                       /* re-initialize asynchronous data buffer */
-         memset( &l_Async.abyDataRes, 0, ( l_Async.byResIdx - 1 ) ) ;
-         l_Async.byResIdx = 0 ;
-      }
-   }
-   HAL_NVIC_EnableIRQ( UOEVSE_IRQn ) ;
+   return rRet ;
 }
 
 
-/*============================================================================*/
-
 /*----------------------------------------------------------------------------*/
-/* Test if sending is needed                                                  */
+/* Stop transparent tunnel                                                    */
 /*----------------------------------------------------------------------------*/
 
-static BOOL coevse_IsNeedSend( void )
+void coevse_StopTunnel( void )
 {
-   BOOL bNeedSend ;
+   l_Tunnel.bAskStart = FALSE ;
+
+   if ( l_Tunnel.bActive )
+   {
+      coevse_TunnelSetActive( FALSE ) ;
+   }
+}
 
-   bNeedSend = ( l_CmdFifo.byIdxIn != l_CmdFifo.byIdxOut ) &&
-               ( l_eCmd == COEVSE_CMD_NONE ) ;
 
-   return bNeedSend ;
+/*----------------------------------------------------------------------------*/
+/* Test if tunnel is active (or start is pending)                             */
+/*----------------------------------------------------------------------------*/
+
+BOOL coevse_IsTunnelActive( void )
+{
+   return ( l_Tunnel.bAskStart || l_Tunnel.bActive ) ;
 }
 
 
 /*----------------------------------------------------------------------------*/
-/* Add command in FIFO                                                        */
+/* Send data through tunnel. Final CR/LF are replaced by RAPI '\r'. While    */
+/* the tunnel is suspended, data are held until resume                        */
 /*----------------------------------------------------------------------------*/
 
-static void coevse_AddCmdFifo( e_CmdId i_eCmdId, WORD * i_awParams, BYTE i_byNbParam )
+RESULT coevse_TunnelSend( char C* i_pszData )
 {
-   BYTE byCurIdxIn ;
-   BYTE byNextIdxIn ;
-   s_CmdFifoData * pCmdData ;
-   BYTE byIdx ;
+   RESULT rRet ;
+   WORD wLen ;
 
-   byCurIdxIn = l_CmdFifo.byIdxIn ;
-                                       /* caculate next input index */
-   byNextIdxIn = NEXTIDX( byCurIdxIn, l_CmdFifo.aCmdData ) ;
-                                       /* if the FIFO overflows */
-   if ( byNextIdxIn != l_CmdFifo.byIdxOut )
+   rRet = ERR ;
+                                       /* tunnel active, and previous transfer done */
+   if ( l_Tunnel.bActive && ( ! l_Tunnel.bTxPending ) &&
+        ( l_Tunnel.bSuspend || ( UOEVSE_DMA_TX->CNDTR == 0 ) ) )
    {
-      l_CmdFifo.byIdxIn = byNextIdxIn ;
-                                       /* fill the new element */
-      pCmdData = &l_CmdFifo.aCmdData[byCurIdxIn] ;
-      pCmdData->eCmdId = i_eCmdId ;
-      pCmdData->byNbParam = i_byNbParam ;
-
-      if ( i_awParams != NULL )        /* fill parameters if needed */
+      wLen = strlen( i_pszData ) ;
+      while ( ( wLen != 0 ) &&
+              ( ( i_pszData[wLen-1] == '\r' ) || ( i_pszData[wLen-1] == '\n' ) ) )
       {
-         for ( byIdx = 0 ; byIdx < i_byNbParam ; byIdx++ )
-         {                             /* if param buffer overflows */
-            if ( byIdx >= ARRAY_SIZE( pCmdData->wParam ) )
-            {
-               break ;
-            }
-            pCmdData->wParam[byIdx] = i_awParams[byIdx] ;
+         wLen-- ;
+      }
+                                       /* space for final '\r' and NULL */
+      if ( ( wLen != 0 ) && ( wLen <= ( sizeof(l_Tunnel.szTxBuf) - 2 ) ) )
+      {
+         memcpy( l_Tunnel.szTxBuf, i_pszData, wLen ) ;
+         l_Tunnel.szTxBuf[wLen] = '\r' ;
+         l_Tunnel.szTxBuf[wLen+1] = '\0' ;
+
+         if ( l_Tunnel.bSuspend )
+         {
+            l_Tunnel.byTxLen = wLen + 1 ;
+            l_Tunnel.bTxPending = TRUE ;
+         }
+         else
+         {
+            coevse_HrdSendCmd( l_Tunnel.szTxBuf, wLen + 1 ) ;
+            tim_StartMsTmp( &l_Tunnel.dwTmpGap ) ;
          }
+         tim_StartSecTmp( &l_Tunnel.dwTmpTimeout ) ;
+         rRet = OK ;
       }
    }
-   else
+
+   if ( rRet != OK )
    {
-      err_Set( ERR_OEVSE_COM_BUF_FULL ) ;
+      l_Tunnel.dwNbLost += strlen( i_pszData ) ;
    }
+
+   return rRet ;
 }
 
 
 /*----------------------------------------------------------------------------*/
-/* Send next command in FIFO                                                  */
+/* periodic task                                                              */
 /*----------------------------------------------------------------------------*/
 
-static void coevse_SendCmdFifo( void )
+void coevse_TaskCyc( void )
 {
-   BYTE byIdxOut ;
-   s_CmdFifoData * pFifoData ;
-   e_CmdId eCmd ;
-   WORD * awPar ;
-   BYTE byCmdIdx ;
-   char C* pszFmtCmd ;
-   char * pszStrCmd ;
-   char szChecksum [3] ;
-   s_CmdDesc C* pCmdDesc ;
-   BYTE byStrRemSize ;
-   BYTE byFmtSize ;
-   WORD wExtCmdLen ;
+   coevse_ProcessRx() ;                /* process received characters */
 
-   byIdxOut = l_CmdFifo.byIdxOut ;
+   if ( l_Tunnel.bActive )             /* suspend/resume, inactivity timeout */
+   {
+      coevse_ProcessTunnel() ;
+   }
 
-   pFifoData = &l_CmdFifo.aCmdData[byIdxOut] ;
-                                       /* caculate next output index */
-   byIdxOut = NEXTIDX( byIdxOut, l_CmdFifo.aCmdData ) ;
+   if ( ( ! l_Tunnel.bActive ) || l_Tunnel.bSuspend )
+   {                                   /* link not given to an active tunnel */
+      if ( l_bOpenEvseRdy )
+      {                                /* if sending is ready, and no tunnel asked */
+         if ( coevse_IsNeedSend() && ( ( ! l_Tunnel.bAskStart ) || trs_IsSelected( &l_Trs ) ) &&
+              trs_IsReady( &l_Trs ) )
+         {
+            coevse_SendCmdFifo() ;     /* send next command in FIFO */
+            trs_Start( &l_Trs, l_eCmd - ( COEVSE_CMD_NONE + 1 ) ) ;
+         }
 
-                                       /* remaining size of command string */
-   byStrRemSize = sizeof(l_szStrCmdBuffer) ;
+         if ( l_eCmd != COEVSE_CMD_NONE ) /* if command is still pending */
+         {                             /* if response has arrived */
+            if ( ! l_Result.bWaitResponse )
+            {
+               coevse_AnalyseRes() ;   /* treat the response */
+            }
 
-   eCmd = pFifoData->eCmdId ;          /* get command descriptor */
-   byCmdIdx = eCmd - ( COEVSE_CMD_NONE + 1 ) ;
-   pCmdDesc = &k_aCmdDesc[byCmdIdx] ;
+            if ( trs_IsTimeout( &l_Trs ) )
+            {
+               coevse_CmdSetErr() ;    /* timeout error */
+            }
+         }
+                                       /* enter tunnel once pending command is over */
+         if ( l_Tunnel.bAskStart && ( l_eCmd == COEVSE_CMD_NONE ) &&
+              ( ! trs_IsSelected( &l_Trs ) ) )
+         {
+            coevse_TunnelSetActive( TRUE ) ;
+         }
+         if ( ! l_Tunnel.bActive )
+         {
+            coevse_Poll() ;            /* verification of charging metrics */
+         }
+      }
+      else
+      {
+         coevse_ProcessProbe() ;       /* wait for openEVSE readiness */
+         l_Tunnel.bAskStart = FALSE ;  /* no tunnel while openEVSE is not ready */
+      }
+   }
+}
 
-   if ( eCmd == COEVSE_CMD_EXTCMD )    /* in cas of external command */
-   {                                   /* copy from external command string */
-                                       /* NULL terminasion is garanteed since the 2 buffers */
-                                       /* share the same size and l_szExtCmdStr is NULL terminated*/
-      pszStrCmd = strncpy( l_szStrCmdBuffer, l_szExtCmdStr, sizeof(l_szStrCmdBuffer) ) ;
-      wExtCmdLen = strlen( l_szStrCmdBuffer ) ;
-                                       /* new end of string pnt */
-      pszStrCmd = &l_szStrCmdBuffer[wExtCmdLen] ;
-      byStrRemSize -= wExtCmdLen ;     /* new remaining size */
 
-      l_szExtCmdStr[0] = 0 ;           /* external cmd string is free */
+/*============================================================================*/
+
+/*----------------------------------------------------------------------------*/
+/* Readiness probing : send $GV periodically until a valid response is        */
+/* received                                                                   */
+/*----------------------------------------------------------------------------*/
+
+static void coevse_ProcessProbe( void )
+{
+   DWORD dwDelay ;
+
+   if ( l_Link.wNbProbe == 0 )         /* let OpenEVSE reset before first probe */
+   {
+      dwDelay = COEVSE_PROBE_HOLDOFF ;
    }
    else
    {
-      awPar = &pFifoData->wParam[0] ;
-
-      pszFmtCmd = pCmdDesc->szFmtCmd ;
-                                       /* format command with parameters */
-      byFmtSize = snprintf( l_szStrCmdBuffer, byStrRemSize, pszFmtCmd,
-                            awPar[0], awPar[1], awPar[2], awPar[3], awPar[4], awPar[5] ) ;
-                                       /* new end of string pnt */
-      pszStrCmd = &l_szStrCmdBuffer[byFmtSize] ;
-      byStrRemSize -= byFmtSize ;      /* new remaining size */
+      dwDelay = COEVSE_PROBE_PER ;
    }
 
-   if ( byStrRemSize >= 4 )            /* if size left for checksum */
-   {
-      if ( pCmdDesc->szChecksum == NULL )
-      {                                /* compute checksum and add it at the end of the string */
-         coevse_GetChecksum( szChecksum, sizeof(szChecksum), l_szStrCmdBuffer ) ;
-         *pszStrCmd = '^' ;
-         pszStrCmd++ ;
-         *pszStrCmd = szChecksum[0] ;
-         pszStrCmd++ ;
-         *pszStrCmd = szChecksum[1] ;
-         pszStrCmd++ ;
-         *pszStrCmd = '\r' ;
-         pszStrCmd++ ;
-         *pszStrCmd = '\0' ;
-      }
-      else
-      {                                /* add static checksum */
-         strlcpy( pszStrCmd, pCmdDesc->szChecksum, byStrRemSize ) ;
+   if ( ( l_eCmd != COEVSE_CMD_NONE ) && ( ! l_Result.bWaitResponse ) )
+   {                                   /* probe response is received */
+      if ( coevse_CheckRes( &l_Result, TRUE ) == OK )
+      {
+         coevse_CmdresultGetVersion( (char*)&l_Result.abyDataRes[3], &l_Result.Fields ) ;
+         coevse_SetReady() ;
       }
+      coevse_CmdEnd() ;
    }
+   else if ( tim_IsEndMsTmp( &l_dwTmpStart, dwDelay ) )
+   {
+      coevse_CmdEnd() ;                /* previous probe without response */
 
-   coevse_CmdStart( eCmd ) ;           /* start command transmission */
-   coevse_HrdSendCmd( l_szStrCmdBuffer, strlen( l_szStrCmdBuffer )  ) ;
-
-   coevse_HistAddCmd( l_szStrCmdBuffer ) ;
+      l_Link.wNbProbe++ ;
+      coevse_CmdStart( COEVSE_CMD_GETVERSION ) ;
+      coevse_HrdSendCmd( k_szStrProbe, strlen( k_szStrProbe ) ) ;
+      tim_StartMsTmp( &l_dwTmpStart ) ;
+   }
 }
 
 
 /*----------------------------------------------------------------------------*/
-/* Analyse response                                                           */
+/* OpenEVSE is ready : start normal operation                                 */
 /*----------------------------------------------------------------------------*/
 
-static void coevse_AnalyseRes( void )
+static void coevse_SetReady( void )
+{
+   DWORD dwDur ;
+
+   l_bOpenEvseRdy = TRUE ;             /* openEVSE hardware is ready */
+
+   dwDur = HAL_GetTick() - l_Link.dwFailTick ;
+   if ( l_Link.bBootDone )
+   {
+      l_Link.dwRecovDur = dwDur ;
+   }
+   else
+   {
+      l_Link.dwBootDur = dwDur ;
+      l_Link.bBootDone = TRUE ;
+   }
+
+   coevse_AddCmdFifo( COEVSE_CMD_GETCURRENTCAP, NULL, 0 ) ;
+   memset( l_Poll.adwTmp, 0, sizeof(l_Poll.adwTmp) ) ;
+   tim_StartMsTmp( &l_Poll.dwTmpWindow ) ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Adaptive polling : queue each status command according to its period for */
+/* current EVSE state, and update link utilisation                            */
+/*----------------------------------------------------------------------------*/
+
+static void coevse_Poll( void )
+{
+   BYTE byIdx ;
+   DWORD dwPer ;
+
+   for ( byIdx = 0 ; byIdx < COEVSE_POLL_NB ; byIdx++ )
+   {
+      dwPer = k_awPollPer[l_Status.eEvseState][byIdx] ;
+
+      if ( ( byIdx == COEVSE_POLL_GS ) && l_Poll.bAsyncState )
+      {
+         dwPer = GETMAX( dwPer, COEVSE_POLL_GS_ASYNC ) ;
+      }
+
+      if ( dwPer == 0 )                /* no polling in this state */
+      {
+         l_Poll.adwTmp[byIdx] = 0 ;
+      }                                /* first polling, or period is over */
+      else if ( ( l_Poll.adwTmp[byIdx] == 0 ) ||
+                tim_IsEndMsTmp( &l_Poll.adwTmp[byIdx], dwPer ) )
+      {
+         tim_StartMsTmp( &l_Poll.adwTmp[byIdx] ) ;
+         coevse_AddCmdFifo( k_aePollCmd[byIdx], NULL, 0 ) ;
+      }
+   }
+
+   if ( tim_IsEndMsTmp( &l_Poll.dwTmpWindow, COEVSE_STAT_WINDOW ) )
+   {
+      tim_StartMsTmp( &l_Poll.dwTmpWindow ) ;
+      l_Poll.wUtil = GETMIN( ( l_Poll.dwBusySum * 1000 ) / COEVSE_STAT_WINDOW, 1000 ) ;
+      l_Poll.dwBusySum = 0 ;
+   }
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Restart polling periods (first polling after one period)                   */
+/*----------------------------------------------------------------------------*/
+
+static void coevse_PollRestart( void )
+{
+   BYTE byIdx ;
+
+   for ( byIdx = 0 ; byIdx < COEVSE_POLL_NB ; byIdx++ )
+   {
+      tim_StartMsTmp( &l_Poll.adwTmp[byIdx] ) ;
+   }
+   tim_StartMsTmp( &l_Poll.dwTmpWindow ) ;
+   l_Poll.dwBusySum = 0 ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Test if sending is needed (only control commands during tunnel)            */
+/*----------------------------------------------------------------------------*/
+
+static BOOL coevse_IsNeedSend( void )
+{
+   BYTE byNbLane ;
+
+   byNbLane = l_Tunnel.bActive ? ( COEVSE_LANE_CTRL + 1 ) : COEVSE_LANE_NB ;
+
+   return ( l_eCmd == COEVSE_CMD_NONE ) && trs_IsQueued( &l_Trs, byNbLane ) ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Add command in queue of its lane                                           */
+/* Getters already pending are skipped, a setter last in its lane (and not  */
+/* yet sent) gets the new parameters (see LIST_CMD coalescing policy)        */
+/*----------------------------------------------------------------------------*/
+
+static void coevse_AddCmdFifo( e_CmdId i_eCmdId, WORD * i_awParams, BYTE i_byNbParam )
+{
+   s_CmdDesc C* pCmdDesc ;
+   BYTE byCmdIdx ;
+   s_CmdFifoData * pCmdData ;
+
+   byCmdIdx = i_eCmdId - ( COEVSE_CMD_NONE + 1 ) ;
+   pCmdDesc = &k_aCmdDesc[byCmdIdx] ;
+   pCmdData = NULL ;
+
+   if ( pCmdDesc->eCoal == COEVSE_COAL_SKIP )   /* getter : pending one will do */
+   {
+      pCmdData = trs_Find( &l_Trs, pCmdDesc->eLane, byCmdIdx, FALSE ) ;
+   }
+   else if ( pCmdDesc->eCoal == COEVSE_COAL_REPLACE )
+   {                                   /* setter : value not yet sent is replaced, */
+                                       /* if no later command (sending order) */
+      pCmdData = trs_GetLast( &l_Trs, pCmdDesc->eLane, TRUE ) ;
+      if ( ( pCmdData != NULL ) && ( pCmdData->Hdr.byCmdIdx == byCmdIdx ) )
+      {
+         coevse_FillCmdFifo( pCmdData, i_awParams, i_byNbParam ) ;
+      }
+      else
+      {
+         pCmdData = NULL ;
+      }
+   }
+
+   if ( pCmdData != NULL )
+   {
+      l_aCmdQueue[pCmdDesc->eLane].dwNbCoalesced++ ;
+   }
+   else
+   {                                   /* new element, NULL if the queue is full */
+      pCmdData = trs_Push( &l_Trs, pCmdDesc->eLane, byCmdIdx ) ;
+
+      if ( pCmdData != NULL )
+      {
+         coevse_FillCmdFifo( pCmdData, i_awParams, i_byNbParam ) ;
+      }
+      else
+      {
+         err_Set( ERR_OEVSE_COM_BUF_FULL ) ;
+      }
+   }
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Fill parameters of FIFO element                                            */
+/*----------------------------------------------------------------------------*/
+
+static void coevse_FillCmdFifo( s_CmdFifoData * o_pCmdData, WORD * i_awParams,
+                                BYTE i_byNbParam )
+{
+   BYTE byIdx ;
+
+   o_pCmdData->byNbParam = i_byNbParam ;
+
+   if ( i_awParams != NULL )           /* fill parameters if needed */
+   {
+      for ( byIdx = 0 ; byIdx < i_byNbParam ; byIdx++ )
+      {                                /* if param buffer overflows */
+         if ( byIdx >= ARRAY_SIZE( o_pCmdData->wParam ) )
+         {
+            break ;
+         }
+         o_pCmdData->wParam[byIdx] = i_awParams[byIdx] ;
+      }
+   }
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Send next command in queue                                                 */
+/* The command selected by the transaction engine is formatted at first       */
+/* sending, retries send again the same command string                        */
+/*----------------------------------------------------------------------------*/
+
+static void coevse_SendCmdFifo( void )
+{
+   s_CmdFifoData * pFifoData ;
+   DWORD dwLat ;
+   e_CmdId eCmd ;
+   BOOL bNewCmd ;
+   BYTE byNbLane ;
+                                       /* only control commands during tunnel */
+   byNbLane = l_Tunnel.bActive ? ( COEVSE_LANE_CTRL + 1 ) : COEVSE_LANE_NB ;
+
+   bNewCmd = ! trs_IsSelected( &l_Trs ) ;
+   pFifoData = trs_Select( &l_Trs, byNbLane ) ;
+
+   if ( pFifoData != NULL )            /* defensive programming */
+   {
+      eCmd = pFifoData->Hdr.byCmdIdx + ( COEVSE_CMD_NONE + 1 ) ;
+
+      if ( bNewCmd )                   /* new transaction */
+      {                                /* state notification to $S4 sending delay */
+         if ( ( eCmd == COEVSE_CMD_SETLOCK ) && l_PlugLat.bWaitSend )
+         {
+            dwLat = HAL_GetTick() - l_PlugLat.dwTickNotif ;
+            l_PlugLat.dwSendLast = dwLat ;
+            l_PlugLat.dwSendMax = GETMAX( l_PlugLat.dwSendMax, dwLat ) ;
+            l_PlugLat.bWaitSend = FALSE ;
+         }
+
+         coevse_FmtCmdFifo( pFifoData ) ; /* format command string */
+         coevse_HistAddCmd( l_szStrCmdBuffer ) ;
+      }
+
+      coevse_CmdStart( eCmd ) ;        /* start command transmission */
+      coevse_HrdSendCmd( l_szStrCmdBuffer, strlen( l_szStrCmdBuffer )  ) ;
+   }
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Format FIFO command <i_pFifoData> in l_szStrCmdBuffer, with checksum       */
+/*----------------------------------------------------------------------------*/
+
+static void coevse_FmtCmdFifo( s_CmdFifoData C* i_pFifoData )
+{
+   e_CmdId eCmd ;
+   WORD C* awPar ;
+   BYTE byCmdIdx ;
+   char C* pszFmtCmd ;
+   char * pszStrCmd ;
+   char szChecksum [3] ;
+   s_CmdDesc C* pCmdDesc ;
+   BYTE byStrRemSize ;
+   BYTE byFmtSize ;
+   WORD wExtCmdLen ;
+                                       /* remaining size of command string */
+   byStrRemSize = sizeof(l_szStrCmdBuffer) ;
+
+   byCmdIdx = i_pFifoData->Hdr.byCmdIdx ;  /* get command descriptor */
+   eCmd = byCmdIdx + ( COEVSE_CMD_NONE + 1 ) ;
+   pCmdDesc = &k_aCmdDesc[byCmdIdx] ;
+
+   if ( eCmd == COEVSE_CMD_EXTCMD )    /* in cas of external command */
+   {                                   /* copy from external command string */
+                                       /* NULL terminasion is garanteed since the 2 buffers */
+                                       /* share the same size and l_szExtCmdStr is NULL terminated*/
+      pszStrCmd = strncpy( l_szStrCmdBuffer, l_szExtCmdStr, sizeof(l_szStrCmdBuffer) ) ;
+      wExtCmdLen = strlen( l_szStrCmdBuffer ) ;
+                                       /* new end of string pnt */
+      pszStrCmd = &l_szStrCmdBuffer[wExtCmdLen] ;
+      byStrRemSize -= wExtCmdLen ;     /* new remaining size */
+
+      l_szExtCmdStr[0] = 0 ;           /* external cmd string is free */
+   }
+   else
+   {
+      awPar = &i_pFifoData->wParam[0] ;
+
+      pszFmtCmd = pCmdDesc->szFmtCmd ;
+                                       /* format command with parameters */
+      byFmtSize = snprintf( l_szStrCmdBuffer, byStrRemSize, pszFmtCmd,
+                            awPar[0], awPar[1], awPar[2], awPar[3], awPar[4], awPar[5] ) ;
+                                       /* new end of string pnt */
+      pszStrCmd = &l_szStrCmdBuffer[byFmtSize] ;
+      byStrRemSize -= byFmtSize ;      /* new remaining size */
+   }
+
+   if ( byStrRemSize >= 4 )            /* if size left for checksum */
+   {
+      if ( pCmdDesc->szChecksum == NULL )
+      {                                /* compute checksum and add it at the end of the string */
+         coevse_GetChecksum( szChecksum, sizeof(szChecksum), l_szStrCmdBuffer ) ;
+         *pszStrCmd = '^' ;
+         pszStrCmd++ ;
+         *pszStrCmd = szChecksum[0] ;
+         pszStrCmd++ ;
+         *pszStrCmd = szChecksum[1] ;
+         pszStrCmd++ ;
+         *pszStrCmd = '\r' ;
+         pszStrCmd++ ;
+         *pszStrCmd = '\0' ;
+      }
+      else
+      {                                /* add static checksum */
+         strlcpy( pszStrCmd, pCmdDesc->szChecksum, byStrRemSize ) ;
+      }
+   }
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Analyse response                                                           */
+/*----------------------------------------------------------------------------*/
+
+static void coevse_AnalyseRes( void )
 {
    RESULT rRes ;
    char * szResult ;
-   BYTE byResSize ;
    BYTE byCmdIdx ;
    f_ResultCallback pFunc ;
-   char szChecksum [3] ;
    char * pszDataRes ;
+   BYTE byIdx ;
+
+   szResult = (char*) l_Result.abyDataRes ;
+
+   rRes = coevse_CheckRes( &l_Result, ( l_eCmd != COEVSE_CMD_EXTCMD ) ) ;
+
+   if ( rRes == OK )                   /* call callback if defined */
+   {
+      byCmdIdx = l_eCmd - ( COEVSE_CMD_NONE + 1 ) ;
+      pFunc = k_aCmdDesc[byCmdIdx].fResultCallback ;
+
+      if ( l_eCmd == COEVSE_CMD_EXTCMD )
+      {
+         pszDataRes = &szResult[0] ;   /* in case of external we need the whole response */
+      }
+      else
+      {
+         pszDataRes = &szResult[3] ;   /* in other cases, only the data after "OK " is needed */
+      }
+
+      if ( pFunc != NULL )
+      {
+         (*pFunc)( pszDataRes, &l_Result.Fields ) ;
+      }
+      for ( byIdx = 0 ; byIdx < COEVSE_POLL_NB ; byIdx++ )
+      {                                /* metric freshness */
+         if ( k_aePollCmd[byIdx] == l_eCmd )
+         {
+            l_Poll.adwLastRes[byIdx] = HAL_GetTick() ;
+            l_Poll.abResValid[byIdx] = TRUE ;
+         }
+      }
+                                       /* read back new current capacity */
+      if ( ( l_eCmd == COEVSE_CMD_SETCURRENTCAP ) ||
+           ( l_eCmd == COEVSE_CMD_SETCURRENTVOL ) )
+      {
+         coevse_AddCmdFifo( COEVSE_CMD_GETCURRENTCAP, NULL, 0 ) ;
+      }
+      if ( trs_GetNbRetry( &l_Trs ) != 0 ) /* link is recovered */
+      {
+         l_Link.dwRecovDur = HAL_GetTick() - l_Link.dwFailTick ;
+      }
+      trs_End( &l_Trs, OK ) ;         /* command is removed from its queue */
+      coevse_CmdEnd() ;
+   }
+   else
+   {
+      coevse_CmdSetErr() ;             /* there is an error */
+   }
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Check received line : checksum, and "$OK" status if asked. In this case,   */
+/* the checksum is removed from the response string                           */
+/*    - io_pRes : received line                                               */
+/*    - i_bStatus : TRUE to verify "$OK" status                               */
+/*----------------------------------------------------------------------------*/
+
+static RESULT coevse_CheckRes( s_coevseResult * io_pRes, BOOL i_bStatus )
+{
+   RESULT rRes ;
+   char * szResult ;
+   BYTE byResSize ;
+
+   rRes = OK ;
+
+   szResult = (char*) io_pRes->abyDataRes ;
+   byResSize = io_pRes->byResIdx ;
+                                       /* verify checksum (computed at reception) */
+   if ( io_pRes->bError || ( io_pRes->byCkNbDigit != 2 ) ||
+        ( io_pRes->byCkRead != io_pRes->byXor ) || ( byResSize < 4 ) )
+   {
+      rRes = ERR ;
+   }
+
+   if ( rRes == OK )                   /* verify command OK/KO response */
+   {
+      if ( i_bStatus )
+      {
+         szResult[byResSize-4] = '\0' ;
+
+         if ( ( szResult[0] != '$' ) || ( szResult[1] != 'O' ) ||
+              ( szResult[2] != 'K' ) )
+         {
+            rRes = ERR ;
+         }
+      }
+   }
+
+   return rRes ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Compute checksum and store it in string                                    */
+/*----------------------------------------------------------------------------*/
+
+static void coevse_GetChecksum( char * o_sChecksum, BYTE i_byStrSize,
+                                char C* i_szData )
+{
+   BYTE byXor ;
+   char C* pszData ;
+                                       /* if string is null or too small */
+   if ( ( o_sChecksum == NULL ) || ( i_byStrSize < 3 ) )
+   {
+      ERR_FATAL() ;
+   }
+
+   pszData = i_szData ;
+   byXor = 0 ;
+
+   while( ( *pszData != '^' ) && ( *pszData != 0 ) )
+   {
+      byXor ^= (BYTE)*pszData ;
+      pszData++ ;
+   }
+
+   o_sChecksum[0] = cascii_GetHexChar( byXor >> 4 ) ;
+   o_sChecksum[1] = cascii_GetHexChar( byXor ) ;
+   o_sChecksum[2] = '\0' ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Start command sending                                                      */
+/*----------------------------------------------------------------------------*/
+
+static void coevse_CmdStart( e_CmdId i_eCmdId )
+{
+   memset( &l_Result, 0, sizeof(l_Result) ) ;
+   l_Result.bWaitResponse = TRUE ;
+   l_eCmd = i_eCmdId ;
+
+   l_Poll.dwCmdStart = HAL_GetTick() ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* error treatment                                                            */
+/*----------------------------------------------------------------------------*/
+
+static void coevse_CmdSetErr( void )
+{
+   if ( trs_GetNbRetry( &l_Trs ) == 0 ) /* start of link failure */
+   {
+      l_Link.dwFailTick = HAL_GetTick() ;
+   }
+                                       /* retry after backoff, or error */
+   if ( trs_End( &l_Trs, ERR ) == TRS_END_FAIL )
+   {
+      coevse_SetError() ;
+   }
+   else if ( trs_GetNbRetry( &l_Trs ) == COEVSE_RESYNC_RETRY )
+   {
+      coevse_Resync() ;
+   }
+
+   coevse_CmdEnd() ;                /* stop the sending to retry an other one */
+
+   /* note : the command is removed from its queue only if the response is   */
+   /* valid (see coevse_AnalyseRes() ) or all retries have failed. So at     */
+   /* this point the command stays selected by the transaction engine, and   */
+   /* the next retry send the same command string                            */
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Link resynchronization without reset : end partial line on OpenEVSE side,  */
+/* drop pending received characters and partial lines                        */
+/*----------------------------------------------------------------------------*/
+
+static void coevse_Resync( void )
+{
+   coevse_HrdSendCmd( k_szStrResync, strlen( k_szStrResync ) ) ;
+
+   coevse_RxFifoFlush() ;
+   memset( &l_Async, 0, sizeof(l_Async) ) ;
+   l_eRxLine = COEVSE_RX_NONE ;
+
+   l_Link.dwNbResync++ ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Hardware error processing                                                  */
+/*----------------------------------------------------------------------------*/
+
+static void coevse_SetError( void )
+{
+                                       /* send reset command */
+   coevse_HrdSendCmd( k_szStrReset, sizeof(k_szStrReset) ) ;
+
+   l_eCmd = COEVSE_CMD_NONE ;          /* initialize commands variables */
+   memset( l_szExtCmdStr, 0, sizeof(l_szExtCmdStr) ) ;
+   memset( l_szStrCmdBuffer, 0, sizeof(l_szStrCmdBuffer) ) ;
+                                       /* queues are emptied (statistics are kept) */
+   trs_Reset( &l_Trs ) ;
+   trs_Flush( &l_Trs ) ;
+   memset( l_Poll.adwTmp, 0, sizeof(l_Poll.adwTmp) ) ;
+
+   if ( l_Tunnel.bActive )             /* no tunnel while openEVSE is not ready */
+   {
+      coevse_TunnelSetActive( FALSE ) ;
+   }
+
+   l_bOpenEvseRdy = FALSE ;            /* readiness probing */
+   l_Link.wNbProbe = 0 ;
+   l_Link.dwNbReset++ ;
+   tim_StartMsTmp( &l_dwTmpStart ) ;
+
+   err_Set( ERR_OEVSE_COM ) ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* End command sending                                                        */
+/*----------------------------------------------------------------------------*/
+
+static void coevse_CmdEnd( void )
+{
+   if ( l_eCmd != COEVSE_CMD_NONE )    /* link busy time */
+   {
+      l_Poll.dwBusySum += HAL_GetTick() - l_Poll.dwCmdStart ;
+   }
+
+   memset( &l_Result, 0, sizeof(l_Result) ) ;
+   l_eCmd = COEVSE_CMD_NONE ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Add new command to historic                                                */
+/*----------------------------------------------------------------------------*/
+
+static void coevse_HistAddCmd( char C* i_pszStrCmd )
+{
+   char * pszHistbuffer ;
+   SWORD swTotalSizeLeft ;
+   BYTE byStrCmdSize ;
+
+   if ( i_pszStrCmd[1] == 'S' )           /* only Sx RAPI commands are stored */
+   {
+      byStrCmdSize = strlen( i_pszStrCmd ) - 4 ;
+
+      swTotalSizeLeft = ( sizeof( l_HistCmd.szHistStr ) ) - l_HistCmd.wIdx ;
+                                          /* if sapce left */
+      if ( ( swTotalSizeLeft > 0 ) && ( ( byStrCmdSize + 1 ) <= swTotalSizeLeft ) )
+      {                                   /* pointer to free hist character */
+         pszHistbuffer = &l_HistCmd.szHistStr[l_HistCmd.wIdx] ;
+                                          /* copy commmand string */
+         strlcpy( pszHistbuffer, i_pszStrCmd, byStrCmdSize + 1 ) ;
+
+         pszHistbuffer += byStrCmdSize ;
+         *pszHistbuffer = '\n' ;          /* add '\n' at the end */
+
+         pszHistbuffer += 1 ;
+         *pszHistbuffer = '\0' ;
+
+         l_HistCmd.wIdx += ( byStrCmdSize + 1 ) ;
+      }
+   }
+}
+
+
+
+/*----------------------------------------------------------------------------*/
+/* Read one character from reception round buffer                             */
+/* Return FALSE if the buffer is empty                                        */
+/*----------------------------------------------------------------------------*/
+
+static BOOL coevse_RxFifoGet( BYTE * o_pbyData )
+{
+   BOOL bRet ;
+   BYTE byIdxOut ;
+
+   byIdxOut = l_RxFifo.byIdxOut ;
+   bRet = ( byIdxOut != l_RxFifo.byIdxIn ) ;
+
+   if ( bRet )
+   {
+      *o_pbyData = l_RxFifo.abyData[byIdxOut] ;
+                                       /* free read character for interrupt */
+      l_RxFifo.byIdxOut = NEXTIDX( byIdxOut, l_RxFifo.abyData ) ;
+   }
+
+   return bRet ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Test if characters have been lost since last call                          */
+/*----------------------------------------------------------------------------*/
+
+static BOOL coevse_RxFifoIsLost( void )
+{
+   DWORD dwNbLost ;
+   BOOL bLost ;
+
+   dwNbLost = l_RxFifo.dwNbLost ;
+   bLost = ( dwNbLost != l_RxFifo.dwNbLostRead ) ;
+
+   if ( bLost && l_Tunnel.bActive && ( ! l_Tunnel.bSuspend ) )
+   {
+      l_Tunnel.dwNbLost += ( dwNbLost - l_RxFifo.dwNbLostRead ) ;
+   }
+   l_RxFifo.dwNbLostRead = dwNbLost ;
+
+   return bLost ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Drop all pending received characters                                       */
+/*----------------------------------------------------------------------------*/
 
-   rRes = OK ;
+static void coevse_RxFifoFlush( void )
+{
+   l_RxFifo.byIdxOut = l_RxFifo.byIdxIn ;
+   l_RxFifo.dwNbLostRead = l_RxFifo.dwNbLost ;
+}
 
-   if ( rRes == OK )                   /* verify checksum */
-   {
-      szResult = (char*) l_Result.abyDataRes ;
-      byResSize = l_Result.byResIdx ;
 
-      coevse_GetChecksum( szChecksum, sizeof(szChecksum), szResult ) ;
+/*----------------------------------------------------------------------------*/
+/* Received characters processing : forward to tunnel, or assemble command    */
+/* response and asynchronous message                                          */
+/*----------------------------------------------------------------------------*/
 
-      if ( ( szResult[ ( byResSize - 3 ) ] != szChecksum[0] ) ||
-           ( szResult[ ( byResSize - 2 ) ] != szChecksum[1] ) )
-      {
-         rRes = ERR ;
-      }
+static void coevse_ProcessRx( void )
+{
+   char szRxData [32] ;
+   BYTE byNbChar ;
+   BYTE byData ;
+   BOOL bData ;
+
+   l_PlugLat.bNotif = FALSE ;          /* notifications of previous call are handled */
+
+   if ( coevse_RxFifoIsLost() )        /* characters lost, response is wrong */
+   {
+      l_Result.bError = TRUE ;
    }
 
-   if ( rRes == OK )                   /* verify command OK/KO response */
+                                       /* tunnel : forward by pieces */
+   if ( l_Tunnel.bActive && ( ! l_Tunnel.bSuspend ) )
    {
-      if ( l_eCmd != COEVSE_CMD_EXTCMD )
+      do
       {
-         szResult[byResSize-4] = '\0' ;
+         byNbChar = 0 ;
+         bData = TRUE ;
+         while ( ( byNbChar < ( sizeof(szRxData) - 1 ) ) && bData )
+         {
+            bData = coevse_RxFifoGet( (BYTE*)&szRxData[byNbChar] ) ;
+            if ( bData )
+            {
+               byNbChar++ ;
+            }
+         }
+         szRxData[byNbChar] = '\0' ;
 
-         if ( ( szResult[0] != '$' ) || ( szResult[1] != 'O' ) ||
-              ( szResult[2] != 'K' ) )
+         if ( byNbChar != 0 )
          {
-            rRes = ERR ;
+            if ( l_Tunnel.fTunnelRxProc != NULL )
+            {
+               (*l_Tunnel.fTunnelRxProc)( szRxData ) ;
+            }
+            tim_StartSecTmp( &l_Tunnel.dwTmpTimeout ) ;
+            tim_StartMsTmp( &l_Tunnel.dwTmpGap ) ;
+         }
+      } while ( bData ) ;
+   }
+   else
+   {
+      while ( coevse_RxFifoGet( &byData ) )
+      {
+         if ( byData == '$' )          /* start of line, destination is given */
+         {                             /* by the next character */
+            l_eRxLine = COEVSE_RX_HEAD ;
+         }
+         else
+         {
+            if ( l_eRxLine == COEVSE_RX_HEAD )
+            {                          /* "$OK" or "$NK" : command response */
+               if ( l_Result.bWaitResponse && ( ( byData == 'O' ) || ( byData == 'N' ) ) )
+               {
+                  l_eRxLine = COEVSE_RX_RES ;
+               }
+               else
+               {
+                  memset( &l_Async, 0, sizeof(l_Async) ) ;
+                  l_eRxLine = COEVSE_RX_ASYNC ;
+               }
+               coevse_RxLineChar( '$' ) ;
+            }
+            coevse_RxLineChar( byData ) ;
          }
       }
    }
+}
 
-   if ( rRes == OK )                   /* call callback if defined */
+
+/*----------------------------------------------------------------------------*/
+/* Add one character to current received line                                */
+/*----------------------------------------------------------------------------*/
+
+static void coevse_RxLineChar( BYTE i_byData )
+{
+   s_coevseResult * pRes ;
+
+   if ( l_eRxLine == COEVSE_RX_RES )
    {
-      byCmdIdx = l_eCmd - ( COEVSE_CMD_NONE + 1 ) ;
-      pFunc = k_aCmdDesc[byCmdIdx].fResultCallback ;
+      pRes = &l_Result ;
+   }
+   else if ( l_eRxLine == COEVSE_RX_ASYNC )
+   {
+      pRes = &l_Async ;
+   }
+   else
+   {
+      pRes = NULL ;                    /* out of line character */
+   }
 
-      if ( l_eCmd == COEVSE_CMD_EXTCMD )
+   if ( pRes != NULL )
+   {                                   /* check overflow */
+      if ( pRes->byResIdx > sizeof(pRes->abyDataRes) - 2 )
       {
-         pszDataRes = &szResult[0] ;   /* in case of external we need the whole response */
+         pRes->bError = TRUE ;
       }
-      else
+
+      if ( ! pRes->bError )
       {
-         pszDataRes = &szResult[3] ;   /* in other cases, only the data after "OK " is needed */
+         coevse_ResAddChar( pRes, i_byData ) ;
       }
 
-      if ( pFunc != NULL )
+      if ( i_byData == '\r' )          /* end of line */
       {
-         (*pFunc)( pszDataRes ) ;
+         if ( l_eRxLine == COEVSE_RX_RES )
+         {
+            l_Result.bWaitResponse = FALSE ;
+         }
+         else
+         {
+            coevse_AnalyseAsync() ;
+         }
+         l_eRxLine = COEVSE_RX_NONE ;
       }
-                                       /* save next output FIFO index*/
-      l_CmdFifo.byIdxOut = NEXTIDX( l_CmdFifo.byIdxOut, l_CmdFifo.aCmdData ) ;
-      l_byNbRetry = 0 ;
-      coevse_CmdEnd() ;
+   }
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Add one character to received line : update checksum and fields            */
+/*----------------------------------------------------------------------------*/
+
+static void coevse_ResAddChar( s_coevseResult * io_pRes, BYTE i_byData )
+{
+   BYTE byNibble ;
+
+   io_pRes->abyDataRes[io_pRes->byResIdx] = i_byData ;
+   io_pRes->byResIdx++ ;
+
+   if ( io_pRes->bCkPart )             /* checksum digits */
+   {
+      if ( i_byData != '\r' )
+      {
+         byNibble = cascii_GetNibble( i_byData ) ;
+                                       /* too many or wrong digits */
+         if ( ( byNibble == BYTE_MAX ) || ( io_pRes->byCkNbDigit >= 2 ) )
+         {
+            io_pRes->byCkNbDigit = BYTE_MAX ;
+         }
+         else
+         {
+            io_pRes->byCkRead = ( io_pRes->byCkRead << 4 ) | byNibble ;
+            io_pRes->byCkNbDigit++ ;
+         }
+      }
+   }
+   else if ( i_byData == '^' )         /* start of checksum */
+   {
+      io_pRes->bCkPart = TRUE ;
+      coevse_ResTokEnd( io_pRes ) ;
    }
    else
    {
-      coevse_CmdSetErr() ;             /* there is an error */
+      io_pRes->byXor ^= i_byData ;
+
+      if ( ( i_byData == ' ' ) || ( i_byData == '\r' ) )
+      {
+         coevse_ResTokEnd( io_pRes ) ;
+      }
+      else
+      {
+         coevse_ResTokChar( io_pRes, i_byData ) ;
+      }
    }
 }
 
 
 /*----------------------------------------------------------------------------*/
-/* Compute checksum and store it in string                                    */
+/* Add one character to current response token                                */
 /*----------------------------------------------------------------------------*/
 
-static void coevse_GetChecksum( char * o_sChecksum, BYTE i_byStrSize,
-                                char C* i_szData )
+static void coevse_ResTokChar( s_coevseResult * io_pRes, char i_cChar )
 {
-   BYTE byXor ;
-   char C* pszData ;
-                                       /* if string is null or too small */
-   if ( ( o_sChecksum == NULL ) || ( i_byStrSize < 3 ) )
-   {
-      ERR_FATAL() ;
-   }
+   s_coevseResFields * pFields ;
+   BYTE byIdx ;
+   BYTE byMask ;
+   BYTE byNibble ;
 
-   pszData = i_szData ;
-   byXor = 0 ;
+   pFields = &io_pRes->Fields ;
+                                       /* field index (token 0 is status) */
+   byIdx = io_pRes->byTokIdx - 1 ;
+   byMask = 1 << byIdx ;
 
-   while( ( *pszData != '^' ) && ( *pszData != 0 ) )
+   if ( ( io_pRes->byTokIdx != 0 ) && ( byIdx < COEVSE_RES_FIELD_MAX ) )
    {
-      byXor ^= (BYTE)*pszData ;
-      pszData++ ;
+      if ( ! io_pRes->bInTok )         /* new field */
+      {
+         pFields->asdwDec[byIdx] = 0 ;
+         pFields->adwHex[byIdx] = 0 ;
+         pFields->byDecValid |= byMask ;
+         pFields->byHexValid |= byMask ;
+         pFields->byNb = byIdx + 1 ;
+         io_pRes->bTokNeg = FALSE ;
+      }
+
+      byNibble = cascii_GetNibble( i_cChar ) ;
+
+      if ( ( i_cChar == '-' ) && ( ! io_pRes->bInTok ) )
+      {
+         io_pRes->bTokNeg = TRUE ;
+         pFields->byHexValid &= ~byMask ;
+      }
+      else
+      {
+         if ( byNibble <= 9 )
+         {
+            pFields->asdwDec[byIdx] = ( pFields->asdwDec[byIdx] * 10 ) + byNibble ;
+         }
+         else
+         {
+            pFields->byDecValid &= ~byMask ;
+         }
+
+         if ( byNibble <= 0x0F )
+         {
+            pFields->adwHex[byIdx] = ( pFields->adwHex[byIdx] << 4 ) | byNibble ;
+         }
+         else
+         {
+            pFields->byHexValid &= ~byMask ;
+         }
+      }
    }
 
-   snprintf( o_sChecksum, i_byStrSize, "%02X", byXor ) ;
+   io_pRes->bInTok = TRUE ;
 }
 
 
 /*----------------------------------------------------------------------------*/
-/* Start command sending                                                      */
+/* End of current response token                                              */
 /*----------------------------------------------------------------------------*/
 
-static void coevse_CmdStart( e_CmdId i_eCmdId )
+static void coevse_ResTokEnd( s_coevseResult * io_pRes )
 {
-   HAL_NVIC_DisableIRQ( UOEVSE_IRQn ) ;
+   BYTE byIdx ;
 
-   memset( l_Result.abyDataRes, 0, sizeof(l_Result.abyDataRes) ) ;
-   l_Result.byResIdx = 0 ;
-   l_Result.bError = FALSE ;
-   l_Result.bWaitResponse = TRUE ;
-   l_eCmd = i_eCmdId ;
+   if ( io_pRes->bInTok )
+   {
+      byIdx = io_pRes->byTokIdx - 1 ;
 
-   HAL_NVIC_EnableIRQ( UOEVSE_IRQn ) ;
+      if ( ( io_pRes->byTokIdx != 0 ) && ( byIdx < COEVSE_RES_FIELD_MAX ) &&
+           io_pRes->bTokNeg )
+      {
+         io_pRes->Fields.asdwDec[byIdx] = - io_pRes->Fields.asdwDec[byIdx] ;
+      }
+
+      io_pRes->bInTok = FALSE ;
+      if ( io_pRes->byTokIdx < BYTE_MAX )
+      {
+         io_pRes->byTokIdx++ ;
+      }
+   }
 }
 
 
 /*----------------------------------------------------------------------------*/
-/* error treatment                                                            */
+/* Analyse asynchronous message                                               */
 /*----------------------------------------------------------------------------*/
 
-static void coevse_CmdSetErr( void )
+static void coevse_AnalyseAsync( void )
 {
-   if ( l_byNbRetry >= COEVSE_MAXRETRY )
-   {
-      coevse_SetError() ;
-   }
-   else
-   {
-      l_byNbRetry++ ;
-   }
+   BYTE byIdx ;
+   char C* pszHead ;
+   char cSep ;
 
-   coevse_CmdEnd() ;                /* stop the sending to retry an other one */
+   if ( coevse_CheckRes( &l_Async, FALSE ) == OK )
+   {                                   /* header is followed by ' ' or '^' */
+      cSep = l_Async.abyDataRes[3] ;
 
-   /* note : the output index of command FIFO is incremented only if the     */
-   /* response valid (see coevse_AnalyseRes() ). So at this point the output */
-   /* index remain the same, and the next retry send the same command        */
+      for ( byIdx = 0 ; byIdx < ARRAY_SIZE(k_aAsyncDesc) ; byIdx++ )
+      {
+         pszHead = k_aAsyncDesc[byIdx].szHead ;
+
+         if ( ( memcmp( l_Async.abyDataRes, pszHead, 3 ) == 0 ) &&
+              ( ( cSep == ' ' ) || ( cSep == '^' ) ) )
+         {
+            (*k_aAsyncDesc[byIdx].fAsyncProc)( &l_Async.Fields ) ;
+         }
+      }
+   }
+                                       /* re-initialize asynchronous data buffer */
+   memset( &l_Async, 0, sizeof(l_Async) ) ;
 }
 
 
 /*----------------------------------------------------------------------------*/
-/* Hardware error processing                                                  */
+/* EVSE state notification ($ST <state>, $AT <state> <pilot> <current>        */
+/* <vflags>) : immediate state and plug event update                          */
 /*----------------------------------------------------------------------------*/
 
-static void coevse_SetError( void )
+static void coevse_AsyncState( s_coevseResFields C* i_pFields )
 {
-                                       /* send reset command */
-   coevse_HrdSendCmd( k_szStrReset, sizeof(k_szStrReset) ) ;
+   if ( COEVSE_IS_HEX( i_pFields, 0 ) )
+   {
+      l_Status.byAsyncState = (BYTE)i_pFields->adwHex[0] ;
+      l_PlugLat.bNotif = TRUE ;        /* line end reception time */
+      l_PlugLat.dwTickNotif = l_RxFifo.dwTickIrq ;
+      coevse_UpdateEvseState( i_pFields->adwHex[0] ) ;
+      l_Poll.bAsyncState = TRUE ;      /* $GS is now only a keep-alive */
+   }
+}
 
-   l_eCmd = COEVSE_CMD_NONE ;          /* initialize commands variables */
-   memset( l_szExtCmdStr, 0, sizeof(l_szExtCmdStr) ) ;
-   memset( l_szStrCmdBuffer, 0, sizeof(l_szStrCmdBuffer) ) ;
-   memset( &l_CmdFifo, 0, sizeof(l_CmdFifo) ) ;
 
-   l_byNbRetry = 0 ;
-   l_dwCmdTimeout = 0 ;
-   l_dwGetStateTmp = 0 ;
+/*----------------------------------------------------------------------------*/
+/* OpenEVSE boot notification ($AB) : current capacity is read again, and     */
+/* all metrics are polled                                                     */
+/*----------------------------------------------------------------------------*/
 
-   l_bOpenEvseRdy = FALSE ;
-   tim_StartMsTmp( &l_dwTmpStart ) ;
+static void coevse_AsyncBoot( s_coevseResFields C* i_pFields )
+{
+   USEPARAM( i_pFields ) ;
 
-   err_Set( ERR_OEVSE_COM ) ;
+   coevse_AddCmdFifo( COEVSE_CMD_GETCURRENTCAP, NULL, 0 ) ;
+   coevse_PollRestart() ;
 }
 
 
 /*----------------------------------------------------------------------------*/
-/* End command sending                                                        */
+/* Tunnel activation/deactivation                                             */
 /*----------------------------------------------------------------------------*/
 
-static void coevse_CmdEnd( void )
+static void coevse_TunnelSetActive( BOOL i_bActive )
 {
-   HAL_NVIC_DisableIRQ( UOEVSE_IRQn ) ;
-
-   memset( l_Result.abyDataRes, 0, sizeof(l_Result.abyDataRes) ) ;
-   l_Result.byResIdx = 0 ;
-   l_Result.bError = FALSE ;
-   l_Result.bWaitResponse = FALSE ;
-   l_eCmd = COEVSE_CMD_NONE ;
+   coevse_RxFifoFlush() ;              /* pending characters are dropped */
+
+   l_Tunnel.bAskStart = FALSE ;
+   l_Tunnel.bActive = i_bActive ;
+   l_Tunnel.bSuspend = FALSE ;
+   l_Tunnel.bTxPending = FALSE ;
+                                       /* asynchronous message may be partial */
+   memset( &l_Async, 0, sizeof(l_Async) ) ;
+   l_eRxLine = COEVSE_RX_NONE ;
+                                       /* tunnel data may not end with '\r' : */
+   if ( i_bActive )                    /* idle line also publishes reception */
+   {
+      UOEVSE->CR1 |= USART_CR1_IDLEIE ;
+   }
+   else
+   {
+      UOEVSE->CR1 &= ~USART_CR1_IDLEIE ;
+   }
 
-   HAL_NVIC_EnableIRQ( UOEVSE_IRQn ) ;
+   if ( i_bActive )
+   {
+      l_Tunnel.dwNbLost = 0 ;
+      tim_StartSecTmp( &l_Tunnel.dwTmpTimeout ) ;
+      tim_StartMsTmp( &l_Tunnel.dwTmpGap ) ;
+   }
+   else
+   {                                   /* periodic polling restarts */
+      coevse_PollRestart() ;
+      l_Tunnel.dwTmpTimeout = 0 ;
+   }
 }
 
 
 /*----------------------------------------------------------------------------*/
-/* Add new command to historic                                                */
+/* Tunnel suspension (control commands are sent) and resume                   */
 /*----------------------------------------------------------------------------*/
 
-static void coevse_HistAddCmd( char C* i_pszStrCmd )
+static void coevse_TunnelSuspend( BOOL i_bSuspend )
 {
-   char * pszHistbuffer ;
-   SWORD swTotalSizeLeft ;
-   BYTE byStrCmdSize ;
+   l_Tunnel.bSuspend = i_bSuspend ;
+                                       /* lines are framed from the next '$' */
+   memset( &l_Async, 0, sizeof(l_Async) ) ;
+   l_eRxLine = COEVSE_RX_NONE ;
 
-   if ( i_pszStrCmd[1] == 'S' )           /* only Sx RAPI commands are stored */
+   if ( ! i_bSuspend )
    {
-      byStrCmdSize = strlen( i_pszStrCmd ) - 4 ;
+      coevse_RxFifoFlush() ;           /* characters after the command end */
+                                       /* tunnel data held during suspension */
+      if ( l_Tunnel.bTxPending )
+      {
+         coevse_HrdSendCmd( l_Tunnel.szTxBuf, l_Tunnel.byTxLen ) ;
+         l_Tunnel.bTxPending = FALSE ;
+      }
+      tim_StartSecTmp( &l_Tunnel.dwTmpTimeout ) ;
+      tim_StartMsTmp( &l_Tunnel.dwTmpGap ) ;
+   }
+}
 
-      swTotalSizeLeft = ( sizeof( l_HistCmd.szHistStr ) ) - l_HistCmd.wIdx ;
-                                          /* if sapce left */
-      if ( ( swTotalSizeLeft > 0 ) && ( ( byStrCmdSize + 1 ) <= swTotalSizeLeft ) )
-      {                                   /* pointer to free hist character */
-         pszHistbuffer = &l_HistCmd.szHistStr[l_HistCmd.wIdx] ;
-                                          /* copy commmand string */
-         strlcpy( pszHistbuffer, i_pszStrCmd, byStrCmdSize + 1 ) ;
 
-         pszHistbuffer += byStrCmdSize ;
-         *pszHistbuffer = '\n' ;          /* add '\n' at the end */
+/*----------------------------------------------------------------------------*/
+/* Tunnel processing : suspension for control commands, inactivity timeout  */
+/*----------------------------------------------------------------------------*/
 
-         pszHistbuffer += 1 ;
-         *pszHistbuffer = '\0' ;
+static void coevse_ProcessTunnel( void )
+{
+   BOOL bCtrlPending ;
 
-         l_HistCmd.wIdx += ( byStrCmdSize + 1 ) ;
+   bCtrlPending = trs_IsQueued( &l_Trs, COEVSE_LANE_CTRL + 1 ) ;
+
+   if ( l_Tunnel.bSuspend )
+   {                                   /* control commands are done */
+      if ( ( ! bCtrlPending ) && ( l_eCmd == COEVSE_CMD_NONE ) )
+      {
+         coevse_TunnelSuspend( FALSE ) ;
       }
+   }                                   /* tunnel exchange is over */
+   else if ( bCtrlPending && ( UOEVSE_DMA_TX->CNDTR == 0 ) &&
+             ( tim_GetRemainMsTmp( &l_Tunnel.dwTmpGap, COEVSE_TUNNEL_GAP ) == 0 ) )
+   {
+      coevse_TunnelSuspend( TRUE ) ;
+   }
+   else if ( tim_IsEndSecTmp( &l_Tunnel.dwTmpTimeout, l_Tunnel.dwTimeout ) )
+   {
+      coevse_TunnelSetActive( FALSE ) ;
    }
 }
 
 
-
 /*============================================================================*/
 
 /*----------------------------------------------------------------------------*/
-/* COEVSE_CMD_GETEVSESTATE command callback (update EVSE state)               */
+/* COEVSE_CMD_GETEVSESTATE command callback (update EVSE state). The state is */
+/* given in hexadecimal, as in $ST messages                                   */
+/*----------------------------------------------------------------------------*/
+
+static void coevse_CmdresultGetEVSEState( char C* i_pszDataRes,
+                                          s_coevseResFields C* i_pFields )
+{
+   USEPARAM( i_pszDataRes ) ;
+
+   if ( COEVSE_IS_HEX( i_pFields, 0 ) )
+   {
+      coevse_UpdateEvseState( i_pFields->adwHex[0] ) ;
+   }
+   else
+   {
+      coevse_UpdateEvseState( 0 ) ;
+   }
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Update EVSE state from OpenEVSE state value ($GS response or $ST message) */
 /*----------------------------------------------------------------------------*/
 
-static void coevse_CmdresultGetEVSEState( char C* i_pszDataRes )
+static void coevse_UpdateEvseState( DWORD i_dwState )
 {
-   if ( i_pszDataRes[1] == '1' )
+   e_coevseEvseState eEvseState ;
+
+   if ( i_dwState == 1 )
    {
-      l_Status.eEvseState = COEVSE_STATE_NOTCONNECTED ;
+      eEvseState = COEVSE_STATE_NOTCONNECTED ;
    }
-   else if ( i_pszDataRes[1] == '2' )
+   else if ( i_dwState == 2 )
    {
       if ( l_Status.eEvseState == COEVSE_STATE_NOTCONNECTED )
       {
          l_Status.bPlugEvent = TRUE ;
+         evt_Publish( EVT_PLUG, 0 ) ;
       }
 
-      l_Status.eEvseState = COEVSE_STATE_CONNECTED ;
+      eEvseState = COEVSE_STATE_CONNECTED ;
    }
-   else if ( i_pszDataRes[1] == '3' )
+   else if ( ( i_dwState == 3 ) || ( i_dwState == 4 ) )
    {
-      l_Status.eEvseState = COEVSE_STATE_CHARGING ;
+      eEvseState = COEVSE_STATE_CHARGING ;
    }
-   else if ( i_pszDataRes[1] == '4' )
+   else
    {
-      l_Status.eEvseState = COEVSE_STATE_CHARGING ;
+      eEvseState = COEVSE_STATE_UNKNOWN;
    }
-   else
+
+   if ( eEvseState != l_Status.eEvseState )
    {
-      l_Status.eEvseState = COEVSE_STATE_UNKNOWN;
+      l_Status.eEvseState = eEvseState ;
+      evt_Publish( EVT_EVSE_STATE, eEvseState ) ;
    }
 }
 
@@ -907,20 +2193,14 @@ static void coevse_CmdresultGetEVSEState( char C* i_pszDataRes )
 /* COEVSE_CMD_GETCURRENTCAP command callback (read current cap)               */
 /*----------------------------------------------------------------------------*/
 
-static void coevse_CmdresultGetCurrentCap( char C* i_pszDataRes )
+static void coevse_CmdresultGetCurrentCap( char C* i_pszDataRes,
+                                           s_coevseResFields C* i_pFields )
 {
-   SDWORD sdwValue ;
-   CHAR C* pszStr ;
-   CHAR C* pszNext ;
-
-   pszStr = i_pszDataRes ;
-                                       /* convert next digit to integer */
-   pszNext = cascii_GetNextDec( pszStr, &sdwValue, FALSE, DWORD_MAX ) ;
+   USEPARAM( i_pszDataRes ) ;
 
-   if ( pszStr != pszNext )            /* if conversion succeded */
-   {
-      pszStr = pszNext ;               /* store current cap */
-      l_Status.dwCurrentCap = sdwValue ;
+   if ( COEVSE_IS_DEC( i_pFields, 0 ) )
+   {                                   /* store current cap */
+      l_Status.dwCurrentCap = i_pFields->asdwDec[0] ;
    }
 }
 
@@ -929,33 +2209,22 @@ static void coevse_CmdresultGetCurrentCap( char C* i_pszDataRes )
 /* COEVSE_CMD_GETFAULT command callback (read faults counter)                 */
 /*----------------------------------------------------------------------------*/
 
-static void coevse_CmdresultGetFault( char C* i_pszDataRes )
+static void coevse_CmdresultGetFault( char C* i_pszDataRes,
+                                      s_coevseResFields C* i_pFields )
 {
-   DWORD dwValue ;
-   CHAR C* pszStr ;
-   CHAR C* pszNext ;
+   USEPARAM( i_pszDataRes ) ;
 
-   pszStr = i_pszDataRes ;
-                                          /* convert next hexa to integer */
-   pszNext = cascii_GetNextHex( pszStr, &dwValue ) ;
-   if ( pszStr != pszNext )
+   if ( COEVSE_IS_HEX( i_pFields, 0 ) )
    {
-      pszStr = pszNext ;
-      l_Status.dwErrGfiTripCnt = dwValue ;
+      l_Status.dwErrGfiTripCnt = i_pFields->adwHex[0] ;
    }
-                                       /* convert next hexa to integer */
-   pszNext = cascii_GetNextHex( pszStr, &dwValue ) ;
-   if ( pszStr != pszNext )
+   if ( COEVSE_IS_HEX( i_pFields, 1 ) )
    {
-      pszStr = pszNext ;
-      l_Status.dwNoGndTripCnt = dwValue ;
+      l_Status.dwNoGndTripCnt = i_pFields->adwHex[1] ;
    }
-                                       /* convert next hexa to integer */
-   pszNext = cascii_GetNextHex( pszStr, &dwValue ) ;
-   if ( pszStr != pszNext )
+   if ( COEVSE_IS_HEX( i_pFields, 2 ) )
    {
-      pszStr = pszNext ;
-      l_Status.dwStuckRelayTripCnt = dwValue ;
+      l_Status.dwStuckRelayTripCnt = i_pFields->adwHex[2] ;
    }
 }
 
@@ -964,26 +2233,18 @@ static void coevse_CmdresultGetFault( char C* i_pszDataRes )
 /* COEVSE_CMD_GETCHARGPARAM command callback (read charge param)              */
 /*----------------------------------------------------------------------------*/
 
-static void coevse_CmdresultGetChargParam( char C* i_pszDataRes )
+static void coevse_CmdresultGetChargParam( char C* i_pszDataRes,
+                                           s_coevseResFields C* i_pFields )
 {
-   SDWORD sdwValue ;
-   CHAR C* pszStr ;
-   CHAR C* pszNext ;
+   USEPARAM( i_pszDataRes ) ;
 
-   pszStr = i_pszDataRes ;
-                                       /* convert next digit to integer */
-   pszNext = cascii_GetNextDec( pszStr, &sdwValue, TRUE, SDWORD_MAX ) ;
-   if ( pszStr != pszNext )
+   if ( COEVSE_IS_DEC( i_pFields, 0 ) )
    {
-      pszStr = pszNext ;
-      l_Status.sdwChargeCurrent = sdwValue ;
+      l_Status.sdwChargeCurrent = i_pFields->asdwDec[0] ;
    }
-                                       /* convert next digit to integer */
-   pszNext = cascii_GetNextDec( pszStr, &sdwValue, TRUE, SDWORD_MAX ) ;
-   if ( pszStr != pszNext )
+   if ( COEVSE_IS_DEC( i_pFields, 1 ) )
    {
-      pszStr = pszNext ;
-      l_Status.sdwChargeVoltage = sdwValue ;
+      l_Status.sdwChargeVoltage = i_pFields->asdwDec[1] ;
    }
 }
 
@@ -992,26 +2253,18 @@ static void coevse_CmdresultGetChargParam( char C* i_pszDataRes )
 /* COEVSE_CMD_GETENERGYCNT command callback                                   */
 /*----------------------------------------------------------------------------*/
 
-static void coevse_CmdresultGetEneryCnt( char C* i_pszDataRes )
+static void coevse_CmdresultGetEneryCnt( char C* i_pszDataRes,
+                                         s_coevseResFields C* i_pFields )
 {
-   SDWORD sdwValue ;
-   CHAR C* pszStr ;
-   CHAR C* pszNext ;
+   USEPARAM( i_pszDataRes ) ;
 
-   pszStr = i_pszDataRes ;
-                                       /* convert next digit to integer */
-   pszNext = cascii_GetNextDec( pszStr, &sdwValue, FALSE, DWORD_MAX ) ;
-   if ( pszStr != pszNext )
+   if ( COEVSE_IS_DEC( i_pFields, 0 ) )
    {
-      pszStr = pszNext ;
-      l_Status.dwCurWh = ( sdwValue / ( 60 * 60 ) ) ;
+      l_Status.dwCurWh = ( (DWORD)i_pFields->asdwDec[0] / ( 60 * 60 ) ) ;
    }
-                                       /* convert next digit to integer */
-   pszNext = cascii_GetNextDec( pszStr, &sdwValue, FALSE, DWORD_MAX ) ;
-   if ( pszStr != pszNext )
+   if ( COEVSE_IS_DEC( i_pFields, 1 ) )
    {
-      pszStr = pszNext ;
-      l_Status.dwAccWh = sdwValue ;
+      l_Status.dwAccWh = i_pFields->asdwDec[1] ;
    }
 }
 
@@ -1020,9 +2273,11 @@ static void coevse_CmdresultGetEneryCnt( char C* i_pszDataRes )
 /* COEVSE_CMD_GETVERSION command callback                                     */
 /*----------------------------------------------------------------------------*/
 
-static void coevse_CmdresultGetVersion( char C* i_pszDataRes )
+static void coevse_CmdresultGetVersion( char C* i_pszDataRes,
+                                        s_coevseResFields C* i_pFields )
 {
    USEPARAM( i_pszDataRes ) //TODO: save version
+   USEPARAM( i_pFields ) ;
 }
 
 
@@ -1030,8 +2285,11 @@ static void coevse_CmdresultGetVersion( char C* i_pszDataRes )
 /* COEVSE_CMD_EXTCMD command callback                                         */
 /*----------------------------------------------------------------------------*/
 
-static void coevse_CmdresultExtCmd( char C* i_pszDataRes )
+static void coevse_CmdresultExtCmd( char C* i_pszDataRes,
+                                    s_coevseResFields C* i_pFields )
 {
+   USEPARAM( i_pFields ) ;
+
    if ( l_fPostResProc != NULL )
    {                                   /* post to ScktFrame module */
       (*l_fPostResProc)( i_pszDataRes, TRUE ) ;
@@ -1075,21 +2333,32 @@ static void coevse_HrdInit( void )
                                          /* set baudrate */
    UOEVSE->BRR = UART_DIV_LPUART( APB1_CLK, COEVSE_BAUDRATE ) ;
 
-   UOEVSE->CR3 = USART_CR3_DMAT ;
+                                       /* character match on RAPI end of line */
+   UOEVSE->CR2 = ( (DWORD)'\r' << USART_CR2_ADD_Pos ) ;
+                                       /* DMA reception and emission, */
+                                       /* overrun interrupt */
+   UOEVSE->CR3 = USART_CR3_DMAT | USART_CR3_DMAR | USART_CR3_EIE ;
 
    UOEVSE->RDR ;                       /* read input register to avoid unwanted data */
 
    UOEVSE->ICR |= 0xFFFFFFFF ;         /* reset interrupt */
-                                       /* activate emission */
-   UOEVSE->CR1 = USART_CR1_UE | USART_CR1_RXNEIE | USART_CR1_RE | USART_CR1_TE  ;
-
-                                       /* set USART interrupt priority level */
-   HAL_NVIC_SetPriority( UOEVSE_IRQn, UOEVSE_IRQPri, 0 ) ;
-   HAL_NVIC_EnableIRQ( UOEVSE_IRQn ) ;  /* enable USART interrupt */
 
    /* -------- DMA -------- */
 
    UOEVSE_DMA_CLK_ENABLE() ;           /* enable DMA clock */
+                                       /* reception : set direction perif-to-mem, */
+                                       /* memory increment, circular mode */
+   UOEVSE_DMA_RX->CCR = DMA_CCR_MINC | DMA_CCR_CIRC ;
+                                       /* set periferal address (USART RDR register) */
+   UOEVSE_DMA_RX->CPAR = (DWORD)&(UOEVSE->RDR) ;
+                                       /* set memory address (reception round buffer) */
+   UOEVSE_DMA_RX->CMAR = (DWORD)l_RxFifo.abyData ;
+   UOEVSE_DMA_RX->CNDTR = sizeof(l_RxFifo.abyData) ;
+                                       /* set RX request source */
+   UOEVSE_DMA_CSELR->CSELR &= ~UOEVSE_DMA_RX_CSELR( DMA_CSELR_C1S_Msk ) ;
+   UOEVSE_DMA_CSELR->CSELR |= UOEVSE_DMA_RX_CSELR( UOEVSE_DMA_RX_REQ ) ;
+   UOEVSE_DMA_RX->CCR |= DMA_CCR_EN ;  /* reception is always running */
+
                                        /* set direction mem-to-perif, memory increment, */
                                        /* enable transfer complete and error interrupt */
    UOEVSE_DMA_TX->CCR = DMA_CCR_DIR | DMA_CCR_MINC ;
@@ -1098,6 +2367,14 @@ static void coevse_HrdInit( void )
                                        /* set TX request source */
    UOEVSE_DMA_CSELR->CSELR &= ~UOEVSE_DMA_TX_CSELR( DMA_CSELR_C1S_Msk ) ;
    UOEVSE_DMA_CSELR->CSELR |= UOEVSE_DMA_TX_CSELR( UOEVSE_DMA_TX_REQ ) ;
+
+                                       /* activate emission/reception, */
+                                       /* character match interrupt */
+   UOEVSE->CR1 = USART_CR1_UE | USART_CR1_CMIE | USART_CR1_RE | USART_CR1_TE  ;
+
+                                       /* set USART interrupt priority level */
+   HAL_NVIC_SetPriority( UOEVSE_IRQn, UOEVSE_IRQPri, 0 ) ;
+   HAL_NVIC_EnableIRQ( UOEVSE_IRQn ) ;  /* enable USART interrupt */
 }
 
 
@@ -1118,43 +2395,38 @@ static void coevse_HrdSendCmd( char C* i_pszStrCmd, BYTE i_bySize )
 
 
 /*----------------------------------------------------------------------------*/
-/* Open EVSE USART interrupt                                                  */
+/* Open EVSE USART interrupt (character match, idle line, overrun)            */
+/* Publish characters written by DMA since last interrupt                     */
 /*----------------------------------------------------------------------------*/
 
 void UOEVSE_IRQHandler( void )
 {
-   BYTE byData ;
-   BYTE byResIdx ;
+   BYTE byIdxIn ;
+   BYTE byNbNew ;
+   BYTE byNbUsed ;
 
-   byData = UOEVSE->RDR ;
+   l_RxFifo.dwNbIrq++ ;
+   l_RxFifo.dwTickIrq = HAL_GetTick() ;
 
-   byResIdx = l_Result.byResIdx ;
-                                       /* check error presence */
-   if ( ( ISSET( UOEVSE->ISR, USART_ISR_ORE ) ) ||
-        ( byResIdx > sizeof(l_Result.abyDataRes) - 1 ) )
+   if ( ISSET( UOEVSE->ISR, USART_ISR_ORE ) )
    {
-	   UOEVSE->ICR |= USART_ICR_ORECF ;
-      l_Result.bError = TRUE ;
+      UOEVSE->ICR |= USART_ICR_ORECF ;
+      l_RxFifo.dwNbLost++ ;
    }
-
-   if ( ! l_Result.bError )
+                                       /* clear character match and idle flags */
+   UOEVSE->ICR |= ( USART_ICR_CMCF | USART_ICR_IDLECF ) ;
+
+                                       /* current DMA writing position */
+   byIdxIn = ( COEVSE_RX_FIFO_SIZE - UOEVSE_DMA_RX->CNDTR ) % COEVSE_RX_FIFO_SIZE ;
+                                       /* new and not yet read characters */
+   byNbNew = ( byIdxIn + COEVSE_RX_FIFO_SIZE - l_RxFifo.byIdxIn ) % COEVSE_RX_FIFO_SIZE ;
+   byNbUsed = ( l_RxFifo.byIdxIn + COEVSE_RX_FIFO_SIZE - l_RxFifo.byIdxOut ) %
+              COEVSE_RX_FIFO_SIZE ;
+                                       /* DMA has overwritten unread characters */
+   if ( ( byNbUsed + byNbNew ) > ( COEVSE_RX_FIFO_SIZE - 1 ) )
    {
-      if ( l_Result.bWaitResponse )
-      {
-         l_Result.abyDataRes[byResIdx] = byData ;
-         l_Result.byResIdx = byResIdx + 1 ;
-
-         if ( byData == '\r' )         /* check the end of response */
-         {
-            l_Result.bWaitResponse = FALSE ;
-         }
-      }
-      else
-      {
-         //data outside commmand transfer is not used for now
-
-         l_Async.abyDataRes[l_Async.byResIdx] = byData ;
-         l_Async.byResIdx = ( l_Async.byResIdx + 1 ) % ARRAY_SIZE(l_Async.abyDataRes) ;
-      }
+      l_RxFifo.dwNbLost += ( byNbUsed + byNbNew ) - ( COEVSE_RX_FIFO_SIZE - 1 ) ;
    }
+
+   l_RxFifo.byIdxIn = byIdxIn ;        /* publish characters to task */
 }
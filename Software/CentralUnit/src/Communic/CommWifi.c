@@ -39,12 +39,14 @@
    callbacks Opf() macro) which can handle command's response. Some command
    may not request responses from the wifi module (see last argument of LIST_CMD()
    structure).
-   Commands are sent by calling cwifi_AddCmdFifo(). They are stored in FIFO
-   (l_CmdFifo). If FIFO contain at least 1 element and the command sending is
-   ready (Wifi module ready and no pending command) the last FIFO command is
-   sent.
+   Commands are sent by calling cwifi_AddCmdFifo(). They are stored in the
+   queue of the transaction engine (Transac.c, l_CmdQueue). If the queue
+   contains at least 1 element and the command sending is ready (Wifi module
+   ready and no pending command) the first queued command is sent. It is
+   removed from the queue at the end of its transaction.
    When a response is required, a timeout duration of CWIFI_CMD_TIMEOUT ms
-   is checked.
+   is checked by the transaction engine (k_TrsPolicy policy, no retry), which
+   also counts errors and response latency (cwifi_GetTrs()).
 
    - Wind message : these frame are sent asynchonously by the module,
    to describe an event. Only Wind event described by LIST_WIND() macro are
@@ -278,21 +280,23 @@ typedef struct                               /* command/response datas */
    e_CmdId eCmdId ;                          /* current command ID (CWIFI_CMD_NONE if no command is processing) */
    e_CmdStatus eStatus ;                     /* command status */
    WORD wStrContentIdx ;                     /* string index to store response content (eg. l_szRespGCfg) */
-   DWORD dwTmpCmdTimeout ;                   /* command/response timeout */
 } s_CmdCurData ;
 
-typedef struct                               /* command FIFO's item */
+typedef struct                               /* command queue's item */
 {
-   e_CmdId eCmdId ;                          /* command ID */
+   s_trsItem Hdr ;                           /* queue header (command index) */
    char szStrCmd [128] ;                     /* command string (already formatted) to send */
 } s_CmdItem ;
 
-typedef struct                               /* command FIFO */
+
+static s_trsPolicy const k_TrsPolicy =      /* command transaction policy */
 {
-   BYTE byIdxIn ;                            /* input index */
-   BYTE byIdxOut ;                           /* output index */
-   s_CmdItem aCmdItems [10] ;                /* FIFO elements */
-} s_CmdFifo ;
+   .dwTimeout = CWIFI_CMD_TIMEOUT,
+   .byMaxRetry = 0,
+   .wBackoffMin = 0,
+   .wBackoffMax = 0,
+   .byStarvMax = 0,
+} ;
 
 
 #define CWIFI_DATABUF_SIZE  1024             /* socket data buffer size, in bytes */
@@ -320,6 +324,7 @@ static RESULT cwifi_AddCmdFifo( e_CmdId i_eCmdId, char C* i_szStrCmd ) ;
 static void cwifi_ExecSendCmd( void ) ;
 
 static void cwifi_AddDataBuffer( char C* i_szStrData ) ;
+static WORD cwifi_GetDataBufferFree( void ) ;
 static void cwifi_ExecSendData( void ) ;
 
 static void cwifi_ProcessRec( void ) ;
@@ -340,6 +345,9 @@ static void cwifi_HrdSetResetModule( BOOL i_bReset );
 
 static e_WifiState l_eWifiState ;      /* Wifi module state */
 static s_CmdCurData l_CmdCurStatus ;   /* command/response datas */
+static s_trsLink l_Trs ;               /* command transaction */
+                                       /* per command transaction statistics */
+static s_trsCmdStat l_aTrsStat [CWIFI_CMD_LAST - 1] ;
 
 static DWORD l_dwTmpDataMode ;         /* data mode (socket) timeout */
 static DWORD l_dwTmpMaintMode ;        /* maintenance mode timeout */
@@ -357,7 +365,8 @@ static f_PostResProc l_fPostResProc ;  /* external command's response callback *
 static f_htmlSsi l_fHtmlSsi ;          /* SSI callback */
 static f_htmlCgi l_fHtmlCgi ;          /* CGI callback */
 
-static s_CmdFifo l_CmdFifo ;           /* command FIFO */
+static s_CmdItem l_aCmdItems [10] ;    /* command queue items */
+static s_trsQueue l_CmdQueue ;         /* command queue */
 static s_DataBuf l_DataBuf ;           /* data (socket) buffer */
 
 
@@ -370,6 +379,8 @@ void cwifi_Init( void )
    cwifi_HrdInit() ;
    cwifi_HrdSetResetModule( TRUE ) ;
    cwifi_HrdSetResetModule( FALSE ) ;
+   trs_InitQueue( &l_CmdQueue, l_aCmdItems, sizeof(s_CmdItem), ARRAY_SIZE(l_aCmdItems) ) ;
+   trs_Init( &l_Trs, &k_TrsPolicy, l_aTrsStat, ARRAY_SIZE(l_aTrsStat), &l_CmdQueue, 1 ) ;
    cwifi_ResetVar() ;
    l_bMaintMode = FALSE ;
    l_bConfigDone = FALSE ;
@@ -442,6 +453,26 @@ BOOL cwifi_IsMaintMode( void )
 }
 
 
+/*----------------------------------------------------------------------------*/
+/* Get command transaction data (statistics)                                  */
+/*----------------------------------------------------------------------------*/
+
+s_trsLink C* cwifi_GetTrs( void )
+{
+   return &l_Trs ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Get number of commands waiting in FIFO                                     */
+/*----------------------------------------------------------------------------*/
+
+BYTE cwifi_GetQueueDepth( void )
+{
+   return trs_GetQueueDepth( &l_Trs ) ;
+}
+
+
 /*----------------------------------------------------------------------------*/
 /* add external command to command's FIFO                                     */
 /*----------------------------------------------------------------------------*/
@@ -472,6 +503,69 @@ void cwifi_AskFlushData( void )
 }
 
 
+/*----------------------------------------------------------------------------*/
+/* test if a data (socket) buffer flush is still pending                      */
+/*----------------------------------------------------------------------------*/
+
+BOOL cwifi_IsFlushPending( void )
+{
+   return l_DataBuf.bAskFlush ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* get free space in data (socket) buffer                                     */
+/*----------------------------------------------------------------------------*/
+
+WORD cwifi_GetDataFreeSpace( void )
+{
+   return cwifi_GetDataBufferFree() ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* reserve data (socket) buffer free space, for in place formatting.          */
+/* Return the first free character address (NULL if buffer is full), and the */
+/* free size in <o_pwSize>. Data written are added with cwifi_CommitData().   */
+/*----------------------------------------------------------------------------*/
+
+CHAR * cwifi_ReserveData( WORD * o_pwSize )
+{
+   CHAR * psDataBuf ;
+   WORD wFreeSpace ;
+
+   wFreeSpace = cwifi_GetDataBufferFree() ;
+                                       /* if space remaining + defensive prog */
+   if ( ( wFreeSpace != 0 ) && ( l_DataBuf.wNbChar < sizeof(l_DataBuf.sDataBuf) ) )
+   {
+      psDataBuf = &l_DataBuf.sDataBuf[l_DataBuf.wNbChar] ;
+   }
+   else
+   {
+      psDataBuf = NULL ;
+      wFreeSpace = 0 ;
+   }
+
+   *o_pwSize = wFreeSpace ;
+
+   return psDataBuf ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* add <i_wNbChar> characters written in reserved space to data buffer        */
+/*----------------------------------------------------------------------------*/
+
+void cwifi_CommitData( WORD i_wNbChar )
+{
+   WORD wNbChar ;
+                                       /* defensive prog : limit to free space */
+   wNbChar = GETMIN( i_wNbChar, cwifi_GetDataBufferFree() ) ;
+
+   l_DataBuf.wNbChar += wNbChar ;
+}
+
+
 /*----------------------------------------------------------------------------*/
 /* Cyclic task ( period = 10 msec )                                           */
 /*----------------------------------------------------------------------------*/
@@ -482,11 +576,13 @@ void cwifi_TaskCyc( void )
 
    if ( l_CmdCurStatus.eStatus == CWIFI_CMDST_END_ERR )
    {
+      trs_End( &l_Trs, ERR ) ;
       l_CmdCurStatus.eCmdId = CWIFI_CMD_NONE ;
       l_CmdCurStatus.eStatus = CWIFI_CMDST_NONE ;
    }
    else if ( l_CmdCurStatus.eStatus == CWIFI_CMDST_END_OK )
    {
+      trs_End( &l_Trs, OK ) ;
       l_CmdCurStatus.eCmdId = CWIFI_CMD_NONE ;
       l_CmdCurStatus.eStatus = CWIFI_CMDST_NONE ;
    }
@@ -524,7 +620,7 @@ void cwifi_TaskCyc( void )
          if ( l_bSocketConnected )
          {
             if ( ( l_DataBuf.bAskFlush ) && ( ! l_bCmdToDataInFifo ) &&
-                 ( l_CmdFifo.byIdxIn == l_CmdFifo.byIdxOut ) )
+                 ( ! trs_IsQueued( &l_Trs, 1 ) ) )
             {
                cwifi_FmtAddCmdFifo( CWIFI_CMD_CMDTODATA, "", "" ) ;
                l_bCmdToDataInFifo = TRUE ;
@@ -657,11 +753,14 @@ static void cwifi_ConnectFSM( void )
 
 static void wifi_DoSetMaintMode( BOOL i_bMaintmode )
 {
+   if ( l_bMaintMode != i_bMaintmode )
+   {
+      evt_Publish( EVT_MAINT_MODE, i_bMaintmode ) ;
+   }
    l_bMaintMode = i_bMaintmode ;
 
    l_bConfigDone = FALSE ;
-   l_CmdFifo.byIdxIn = 0 ;
-   l_CmdFifo.byIdxOut = 0 ;
+   trs_Flush( &l_Trs ) ;               /* command in progress is kept */
 
    if ( i_bMaintmode )
    {
@@ -693,32 +792,25 @@ static RESULT cwifi_FmtAddCmdFifo( e_CmdId i_eCmdId, char C* i_szArg1, char C* i
 
 
 /*----------------------------------------------------------------------------*/
-/* Add command to FIFO                                                        */
+/* Add command to queue                                                       */
 /*----------------------------------------------------------------------------*/
 
 static RESULT cwifi_AddCmdFifo( e_CmdId i_eCmdId, char C* i_szStrCmd )
 {
-   BYTE byCurIdxIn ;
-   BYTE byNextIdxIn ;
    s_CmdItem * pCmdItem ;
    RESULT rRet ;
 
    rRet = OK ;
+                                       /* new item, NULL if the queue is full */
+   pCmdItem = trs_Push( &l_Trs, 0, (BYTE)(i_eCmdId) - 1 ) ;
 
-   byCurIdxIn = l_CmdFifo.byIdxIn ;
-
-   byNextIdxIn = NEXTIDX( byCurIdxIn, l_CmdFifo.aCmdItems ) ;
-
-   if ( byNextIdxIn == l_CmdFifo.byIdxOut )
+   if ( pCmdItem == NULL )
    {
       rRet = ERR ;
    }
    else
    {
-      pCmdItem = &l_CmdFifo.aCmdItems[byCurIdxIn] ;
-      pCmdItem->eCmdId = i_eCmdId ;
       strncpy( pCmdItem->szStrCmd, i_szStrCmd, sizeof(pCmdItem->szStrCmd) ) ;
-      l_CmdFifo.byIdxIn = byNextIdxIn ;
    }
 
    return rRet ;
@@ -726,26 +818,24 @@ static RESULT cwifi_AddCmdFifo( e_CmdId i_eCmdId, char C* i_szStrCmd )
 
 
 /*----------------------------------------------------------------------------*/
-/* Sent incoming item from command FIFO                                       */
+/* Sent incoming item from command queue                                      */
+/* The command stays in queue until the end of its transaction (trs_End())    */
 /*----------------------------------------------------------------------------*/
 
 static void cwifi_ExecSendCmd( void )
 {
-   BYTE byIdxOut ;
    s_CmdItem * pCmdItem ;
    BOOL bUartAccept ;
    e_CmdId eCmdId ;
    BOOL bIsResult ;
 
-   byIdxOut = l_CmdFifo.byIdxOut ;
-
    if ( ( l_eWifiState != CWIFI_STATE_OFF ) &&
         ( l_CmdCurStatus.eStatus == CWIFI_CMDST_NONE ) &&
-        ( byIdxOut != l_CmdFifo.byIdxIn ) &&
+        trs_IsQueued( &l_Trs, 1 ) &&
         uwifi_IsSendDone() )
    {
-      pCmdItem = &l_CmdFifo.aCmdItems[byIdxOut] ;
-      eCmdId = pCmdItem->eCmdId ;
+      pCmdItem = trs_Select( &l_Trs, 1 ) ;
+      eCmdId = pCmdItem->Hdr.byCmdIdx + 1 ;
 
       bUartAccept = uwifi_Send( pCmdItem->szStrCmd, strlen(pCmdItem->szStrCmd) ) ;
 
@@ -756,7 +846,7 @@ static void cwifi_ExecSendCmd( void )
          if ( bIsResult )
          {
             l_CmdCurStatus.eStatus = CWIFI_CMDST_PROCESSING ;
-            tim_StartMsTmp( &l_CmdCurStatus.dwTmpCmdTimeout ) ;
+            trs_Start( &l_Trs, (BYTE)(eCmdId) - 1 ) ;
          }
          else
          {
@@ -764,9 +854,6 @@ static void cwifi_ExecSendCmd( void )
          }
          l_CmdCurStatus.eCmdId = eCmdId ;
          l_CmdCurStatus.wStrContentIdx = 0 ;
-
-         byIdxOut = NEXTIDX( byIdxOut, l_CmdFifo.aCmdItems )  ;
-         l_CmdFifo.byIdxOut = byIdxOut ;
       }
    }
 }
@@ -785,20 +872,7 @@ static void cwifi_AddDataBuffer( char C* i_szStrData )
    CHAR C* psDataBufEnd  ;
 
    wNbChar = l_DataBuf.wNbChar ;
-
-   if ( l_DataBuf.wNbCharInTx == 0 )     /* if no DMA transfer is ongoing */
-   {
-      wFreeSpace = sizeof(l_DataBuf.sDataBuf) - wNbChar ;
-   }
-   else
-   {                                      /* take the space left from DMA transfer */
-      wFreeSpace = ( l_DataBuf.wNbCharInTx - uwifi_GetRemainingSend() ) - wNbChar ;
-                                          /* defensive prog : limit to buffer size */
-      if ( wFreeSpace > sizeof(l_DataBuf.sDataBuf) )
-      {
-         wFreeSpace = sizeof(l_DataBuf.sDataBuf) ;
-      }
-   }
+   wFreeSpace = cwifi_GetDataBufferFree() ;
                                        /* if space remaining + defensive prog */
    if ( ( wFreeSpace != 0 ) && ( wNbChar < sizeof(l_DataBuf.sDataBuf) ) )
    {                                   /* pointer to first free character */
@@ -820,6 +894,35 @@ static void cwifi_AddDataBuffer( char C* i_szStrData )
 }
 
 
+/*----------------------------------------------------------------------------*/
+/* Compute free space in data (socket) buffer                                 */
+/*----------------------------------------------------------------------------*/
+
+static WORD cwifi_GetDataBufferFree( void )
+{
+   WORD wNbChar ;
+   WORD wFreeSpace ;
+
+   wNbChar = l_DataBuf.wNbChar ;
+
+   if ( l_DataBuf.wNbCharInTx == 0 )     /* if no DMA transfer is ongoing */
+   {
+      wFreeSpace = sizeof(l_DataBuf.sDataBuf) - wNbChar ;
+   }
+   else
+   {                                      /* take the space left from DMA transfer */
+      wFreeSpace = ( l_DataBuf.wNbCharInTx - uwifi_GetRemainingSend() ) - wNbChar ;
+                                          /* defensive prog : limit to buffer size */
+      if ( wFreeSpace > sizeof(l_DataBuf.sDataBuf) )
+      {
+         wFreeSpace = sizeof(l_DataBuf.sDataBuf) ;
+      }
+   }
+
+   return wFreeSpace ;
+}
+
+
 /*----------------------------------------------------------------------------*/
 /* Sent data (socket) buffer to Wifi module                                   */
 /*----------------------------------------------------------------------------*/
@@ -922,7 +1025,7 @@ static void cwifi_ProcessRec( void )
    }
 
    if ( ( l_CmdCurStatus.eStatus == CWIFI_CMDST_PROCESSING ) &&
-        ( tim_IsEndMsTmp( &l_CmdCurStatus.dwTmpCmdTimeout, CWIFI_CMD_TIMEOUT ) ) )
+        ( trs_IsTimeout( &l_Trs ) ) )
    {
       l_CmdCurStatus.eStatus = CWIFI_CMDST_END_ERR ;
 
@@ -1227,8 +1330,11 @@ static void cwifi_ProcessRecResp( char * io_pszProcessData )
          eStatus = CWIFI_CMDST_END_ERR ;
       }
       else if ( strncmp( io_pszProcessData, CWIFI_RESP_OK, strlen(CWIFI_RESP_OK) ) == 0 )
-      {
-         pCmdDesc->pszStrContent[l_CmdCurStatus.wStrContentIdx] = '\0' ;
+      {                                /* only commands storing their response */
+         if ( pCmdDesc->pszStrContent != NULL )
+         {
+            pCmdDesc->pszStrContent[l_CmdCurStatus.wStrContentIdx] = '\0' ;
+         }
 
          eStatus = CWIFI_CMDST_END_OK ;
       }
@@ -1350,6 +1456,7 @@ static void cwifi_ResetVar( void )
    l_eWifiState = CWIFI_STATE_OFF ;
    l_CmdCurStatus.eCmdId = CWIFI_CMD_NONE ;
    l_CmdCurStatus.eStatus = CWIFI_CMDST_NONE ;
+   trs_Reset( &l_Trs ) ;
 
    l_bPowerOn = FALSE ;
    l_bConsoleRdy = FALSE ;
@@ -58,6 +58,8 @@
 
 #define HTML_COL_END     "</FONT>"
 
+#define HTML_SESS_NB     4             /* charge sessions given by SSI */
+
 
 /*----------------------------------------------------------------------------*/
 /* CCI/SSI defines section.                                                   */
@@ -76,6 +78,7 @@
 #define HTML_CHARGE_SSI_ENERGY_MES       6  /* SSI in charge HTML page : energy consumption in Wh */
 #define HTML_CHARGE_SSI_CURRENT_CAP      7  /* SSI in charge HTML page : maximum current capacity */
 #define HTML_CHARGE_SSI_CURRENT_MIN      8  /* SSI in charge HTML page : minimum current to stop the charge is allowed */
+#define HTML_CHARGE_SSI_SESSIONS         9  /* SSI in charge HTML page : last charge sessions (table rows) */
 
 #define HTML_CALENDAR_SSI_DATETIME       0  /* SSI in calendar HTML page : current date time in "weekday DD/MM/YYYY HH/MM/SS" format */
 #define HTML_CALDNDAR_SSI_AUTOADJUST     1  /* SSI in calendar HTML page : auto-adjuste time */
@@ -108,6 +111,7 @@
 static void html_ProcessSsi( DWORD i_dwParam1, DWORD i_dwParam2, char * o_pszOutput, WORD i_wStrSize ) ;
 static void html_ProcessSsiCharge( DWORD i_dwParam2,
                                    char * o_pszOutput, WORD i_wStrSize ) ;
+static void html_FmtSessions( char * o_pszOutput, WORD i_wStrSize ) ;
 static void html_ProcessSsiCalendar( DWORD i_dwParam2, char * o_pszOut, WORD i_wStrSize ) ;
 static void html_ProcessSsiWifi( DWORD i_dwParam2, char * o_pszOutput, WORD i_wStrSize ) ;
 
@@ -291,6 +295,10 @@ static void html_ProcessSsiCharge( DWORD i_dwParam2,
          snprintf( o_pszOutput, i_wStrSize, "%lu", cstate_GetCurrentMinStop() ) ;
          break ;
 
+      case HTML_CHARGE_SSI_SESSIONS :
+         html_FmtSessions( o_pszOutput, i_wStrSize ) ;
+         break ;
+
       default :
           html_AddToStr( o_pszOutput, &wStrSize, "---" ) ;
           break ;
@@ -298,6 +306,60 @@ static void html_ProcessSsiCharge( DWORD i_dwParam2,
 }
 
 
+/*----------------------------------------------------------------------------*/
+/* Last charge sessions (HTML_SESS_NB, newest first), one table row per       */
+/* session : start, end, energy, maximum current and stop reason              */
+/*----------------------------------------------------------------------------*/
+
+static void html_FmtSessions( char * o_pszOutput, WORD i_wStrSize )
+{
+   s_ChargeSessRec C* pRec ;
+   s_DateTime sStart ;
+   s_DateTime sEnd ;
+   char C* pszReason ;
+   BYTE byAge ;
+   BYTE byIdx ;
+   WORD wLen ;
+
+   *o_pszOutput = 0 ;
+   wLen = 0 ;
+
+   for ( byAge = 0 ; byAge < HTML_SESS_NB ; byAge++ )
+   {
+      byIdx = cstate_GetSessIdx( byAge ) ;
+
+      if ( byIdx != BYTE_MAX )
+      {
+         pRec = &g_sDataEeprom->sChargeSessData.aRec[byIdx] ;
+         cstate_UnpackTime( pRec->dwStart, &sStart ) ;
+         cstate_UnpackTime( pRec->dwEnd, &sEnd ) ;
+
+         switch ( pRec->dwReason )
+         {
+            case CSTATE_REASON_EV_STOP :     pszReason = "VE" ;          break ;
+            case CSTATE_REASON_CAL_OFF :     pszReason = "Calendrier" ;  break ;
+            case CSTATE_REASON_EOC_LOWCUR :  pszReason = "Courant min" ; break ;
+            default :                        pszReason = "---" ;         break ;
+         }
+
+         snprintf( &o_pszOutput[wLen], i_wStrSize - wLen,
+                   "<TR><TD>%02u/%02u %02u:%02u</TD><TD>%02u/%02u %02u:%02u</TD>"
+                   "<TD>%lu Wh</TD><TD>%lu.%lu A</TD><TD>%s</TD></TR>",
+                   sStart.byDays, sStart.byMonth, sStart.byHours, sStart.byMinutes,
+                   sEnd.byDays, sEnd.byMonth, sEnd.byHours, sEnd.byMinutes,
+                   pRec->dwEnergy, pRec->dwMaxCur / 1000,
+                   ( pRec->dwMaxCur % 1000 ) / 100, pszReason ) ;
+         wLen = strlen( o_pszOutput ) ;
+      }
+   }
+
+   if ( wLen == 0 )
+   {
+      snprintf( o_pszOutput, i_wStrSize, "<TR><TD>Aucune</TD></TR>" ) ;
+   }
+}
+
+
 /*----------------------------------------------------------------------------*/
 /* Calendar page SSIs treatment                                               */
 /*----------------------------------------------------------------------------*/
@@ -539,7 +601,7 @@ static void html_ProcessCgiCharge( DWORD i_dwParam2, char C* i_pszValue )
               ( wCurrentCapMax >= COEVSE_CURRENT_CAPMAX_MIN ) &&
               ( wCurrentCapMax <= COEVSE_CURRENT_CAPMAX_MAX ) )
          {
-            coevse_SetCurrentCap( wCurrentCapMax ) ;
+            lmgt_SetUserCap( (BYTE)wCurrentCapMax ) ;
          }
          break ;
 
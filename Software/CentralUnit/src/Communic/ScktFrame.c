@@ -61,8 +61,82 @@
                sent with the response
    $12:      : Get charge history (response code 0x92) : The 10 last charge states
                are sent with the response (see ChargeState.c)
-   $13:      : RAPI (openEvse) Sx commands history
+   $13:      : RAPI (openEvse) Sx commands history (streamed response, see below)
    $14:      : Get OpenEVSE asynchronous state
+   $15:<mask>,<period> : Telemetry subscription (response code 0x95) : <mask> (hex)
+               selects the fields to be pushed (see SFRM_TELEM_xxx), <period> (decimal)
+               is the sampling period in ms. A null mask stops the subscription.
+               Each sample is then pushed with the same response code :
+               "$95:<seq>, <tick>, <mask>, <field>, ..." where <seq> is incremented at
+               each sampling period (a gap means a dropped sample) and <tick> is the
+               system time (ms). Fields are in the mask bits order.
+   $16:<timeout> : RAPI transparent tunnel (response code 0x96) : the socket is
+               directly connected to OpenEVSE serial link. Each received socket line
+               is sent to OpenEVSE, and all OpenEVSE characters are sent back to the
+               socket without any response code. Charge control commands are still
+               sent to OpenEVSE between tunnel exchanges. The tunnel ends after
+               <timeout> sec (decimal, 0 for default, 60 max) without exchange, on
+               OpenEVSE link failure, or by the "ScktFrame" reset command.
+               "$96:END\r\n" is then sent.
+   $17:      : OpenEVSE link statistics (response code 0x97) : link utilisation
+               (per thousand), age (ms, -1 if never received) of $GS, $GG, $GU, $GF
+               and $GE metrics, lost characters, reception interrupts number,
+               coalesced and dropped commands, last and maximum control command
+               request to sending delay in ms, time to first valid response at
+               boot and recovery time of last link failure in ms, resync and
+               reset numbers, then last and maximum delay (ms) from EVSE state
+               notification to charge enable, last and maximum delay to $S4
+               sending, and number of charge enables over 100 ms
+               (see coevse_FmtLinkStat())
+   $18:      : Charge state records (streamed response, code 0x98) : one line per
+               record, oldest first : "<time> <state> <reason> <current>\r\n"
+               with time in seconds since start-up, e_cstateChargeSt state,
+               e_cstateReason reason and charge current in mA
+               (see cstate_ReadHistRec())
+   $19:      : Time in state statistics (response code 0x99) : current state and
+               time in it (sec), then for each state from CSTATE_OFF :
+               "<entries>/<total sec>/<longest sec>" (see cstate_FmtStateStat())
+   $1A:<power> : Household power (response code 0x9A) : <power> (W, decimal,
+               EV included) is given to load management. Without argument, the
+               status is only read. Load management status is sent with the
+               response (see lmgt_FmtStat()), last field is the charge planner
+               current capacity (0 if none)
+   $1B:<energy>,<delay> : Charge plan (response code 0x9B) : starts a plan for
+               <energy> (Wh, decimal) before <delay> (minutes, decimal). A null
+               energy stops the running plan, without argument the status is only
+               read. Plan status is sent with the response (see cplan_FmtPlan())
+   $1C:<idx>,<days>,<start>,<end>,<price> : Charge planner tariff (response code
+               0x9C) : sets period <idx> (decimal, 0 to 7) with <days> week days
+               mask (hex, bit 0 : Monday, 00 clears the period), <start> and <end>
+               slots of the day (decimal, 15 minutes slots, end excluded) and
+               <price> (decimal). <idx> 8 sets the default price only
+               ("$1C:8,<price>"). Tariff table is sent with the response, without
+               argument it is only read (see cplan_FmtTariff())
+   $1D:      : Charge session records (streamed response, code 0x9D) : one line
+               per record, oldest first : "<seq> <start> <end> <energy> <max
+               current> <reason>\r\n" with date/time as YYYY/MM/DD-HH:MM:SS,
+               energy in Wh, maximum current in mA and e_cstateReason
+               termination reason (see cstate_ReadSessRec())
+   $1E:<dwell>,<energy>,<filter> : End of charge detection (response code
+               0x9E) : sets the dwell time below low current limit (sec), the
+               maximum energy delivered during dwell time (Wh) and the current
+               average factor (1/2^n), all decimal, 0 for default values.
+               Without argument, the status is only read. Parameters and
+               detection status are sent with the response (see cstate_FmtEoc())
+   $21:      : Communication transactions statistics (response code 0xA1) : for
+               Wifi module, then OpenEVSE links (separated by ';') : transactions,
+               valid responses, errors, timeouts, failures after all retries, last
+               and maximum response latency in ms (see trs_FmtStat())
+   $22:      : Watchdog monitoring status (response code 0xA2) : last reset by
+               watchdog (0/1), offending task of last watchdog reset (e_mainTask,
+               0 if none), watchdog resets number, task budget overruns number,
+               last overrun task, rounds without watchdog refresh, then maximum
+               call duration (ms) of each task (see main_FmtWdgStat())
+   $23:<link> : Per command latency histograms (response code 0xA3) : <link> is
+               0 for Wifi module, 1 for OpenEVSE. Current queue depth, then for
+               each used command : "<cmd index>:<h0>/.../<h7>/<timeouts>/<retries>"
+               where <hn> counts the responses with latency lower than 4^(n+1) ms
+               (h7 : higher latencies). See trs_FmtHist() and WallyLat.py.
    $7F:      : "ScktFrame" reset (response code 0xFF) : reset the "ScktFrame" state
                <l_eFrmId>, in case of pending delayed response.
 
@@ -73,6 +147,16 @@
    <i_bLastCall> argument is set.
    It is not possible to send an other command while a delayed repsonse is pending
    (l_eFrmId != SFRM_ID_NULL) execpt for the "ScktFrame" reset command ("$7F:").
+
+   Responses which may exceed SFRM_DATA_PAYLOAD_SIZE are streamed : a producer
+   function (f_StreamProd) is given to sfrm_StartStream(), and is called by the
+   periodic task to fill a SFRM_STREAM_CHUNK_SIZE chunk each time the socket buffer
+   has been flushed. Each chunk is sent with the response code, where the final ':'
+   is replaced by '+' (continuation marker) while more chunks follow. The last
+   chunk (producer returns less than asked) is sent with the regular ':' code.
+   The host has to concatenate chunks payload until ':' code is received.
+   The stream is a delayed response (l_eFrmId is kept until last chunk), and can
+   be aborted by the "ScktFrame" reset command.
 */
 
 
@@ -81,6 +165,7 @@
 #include "Communic.h"
 #include "System.h"
 #include "Main.h"
+#include "Lib.h"
 
 
 
@@ -89,9 +174,21 @@
 /*----------------------------------------------------------------------------*/
 
 #define SFRM_DATA_PAYLOAD_SIZE         512   /* Frame payload size */
-                                             /* Frame response size (plus response code size) */
-#define SFRM_DATA_ITEM_SIZE \
-            ( SFRM_DATA_PAYLOAD_SIZE + 5 )
+
+#define SFRM_STREAM_CHUNK_SIZE    128        /* streamed response chunk size */
+#define SFRM_STREAM_MARK_MORE     '+'        /* continuation marker (more chunks follow) */
+
+#define SFRM_TELEM_CURRENT       0x01u       /* telemetry field : charge current (mA) */
+#define SFRM_TELEM_VOLTAGE       0x02u       /* telemetry field : charge voltage (mV) */
+#define SFRM_TELEM_ENERGY        0x04u       /* telemetry field : session energy (Wh) */
+#define SFRM_TELEM_EVSESTATE     0x08u       /* telemetry field : OpenEVSE state */
+#define SFRM_TELEM_CHARGESTATE   0x10u       /* telemetry field : charge FSM state */
+#define SFRM_TELEM_ALL           0x1Fu
+
+#define SFRM_TELEM_PER_MIN        100        /* minimum telemetry period (ms) */
+#define SFRM_TELEM_PER_MAX     600000        /* maximum telemetry period (ms) */
+#define SFRM_TELEM_SAMPLE_SIZE     96        /* maximum sample string size */
+#define SFRM_TELEM_THROTTLE_MAX     3        /* maximum period shift when socket is backlogged */
 
 typedef enum                                 /* Frames command Ids */
 {
@@ -108,8 +205,21 @@ typedef enum                                 /* Frames command Ids */
    SFRM_ID_CHARGE_HISTSTATE,                 /* $12: Get charge history */
    SFRM_ID_COEVSE_HIST,                      /* $13: Get RAPI Sx History */
    SFRM_ID_COEVSE_ASYNCH,                    /* $14: Get OpenEVSE asynchronous state */
+   SFRM_ID_TELEM_SUBSCRIBE,                  /* $15: Telemetry subscription */
+   SFRM_ID_RAPI_TUNNEL,                      /* $16: RAPI transparent tunnel */
+   SFRM_ID_COEVSE_LINKSTAT,                  /* $17: OpenEVSE link statistics */
+   SFRM_ID_CHARGE_HISTREC,                   /* $18: Charge state records */
+   SFRM_ID_CHARGE_STATESTAT,                 /* $19: Time in state statistics */
+   SFRM_ID_HOUSE_POWER,                      /* $1A: Household power */
+   SFRM_ID_CHARGE_PLAN,                      /* $1B: Charge plan */
+   SFRM_ID_PLAN_TARIFF,                      /* $1C: Charge planner tariff */
+   SFRM_ID_CHARGE_SESSREC,                   /* $1D: Charge session records */
+   SFRM_ID_CHARGE_EOC,                       /* $1E: End of charge detection */
 
    SFRM_ID_ERRORS_LIST,                      /* $20: Get error list */
+   SFRM_ID_TRS_STAT,                         /* $21: Transactions statistics */
+   SFRM_ID_WDG_STAT,                         /* $22: Watchdog monitoring status */
+   SFRM_ID_TRS_HIST,                         /* $23: Latency histograms */
 
    SFRM_ID_RESET,                            /* $7F: "ScktFrame" reset */
 
@@ -125,6 +235,25 @@ typedef struct                               /* Frame descriptor */
    BOOL bDelayRes ;                          /* Delayed response */
 } s_FrameDesc ;
 
+                                             /* response formatting function, writes */
+                                             /* directly into socket buffer */
+typedef void (*f_sfrmFmt)( CHAR * o_pszStr, WORD i_wSize ) ;
+
+typedef struct                               /* streamed response */
+{
+   f_StreamProd fProducer ;                  /* data producer, NULL if no stream */
+   DWORD dwOffset ;                          /* current data offset */
+} s_sfrmStream ;
+
+typedef struct                               /* telemetry subscription */
+{
+   DWORD dwMask ;                            /* subscribed fields (0 if no subscription) */
+   DWORD dwPeriod ;                          /* sampling period (ms) */
+   DWORD dwSeqNum ;                          /* sample sequence number */
+   BYTE byThrottle ;                         /* period shift, while socket is backlogged */
+   DWORD dwTmpSample ;                       /* sampling temporisation */
+} s_sfrmTelem ;
+
                                              /* descriptor define macro */
 #define _D( Name, StrCmd, StrRes, Wifimodule, DelayRes ) \
    { .eFrmId = SFRM_ID_##Name, .szCmd = StrCmd, .szRes = StrRes, \
@@ -141,9 +270,22 @@ static s_FrameDesc const k_aFrameDesc [] =
    _D( RAPI_BRIGE,       "$10:", "$90:", FALSE, TRUE  ),
    _D( RAPI_CHARGEINFO,  "$11:", "$91:", FALSE, FALSE ),
    _D( CHARGE_HISTSTATE, "$12:", "$92:", FALSE, FALSE ),
-   _D( COEVSE_HIST,      "$13:", "$93:", FALSE, FALSE ),
+   _D( COEVSE_HIST,      "$13:", "$93:", FALSE, TRUE  ),
    _D( COEVSE_ASYNCH,    "$14:", "$94:", FALSE, FALSE ),
+   _D( TELEM_SUBSCRIBE,  "$15:", "$95:", FALSE, FALSE ),
+   _D( RAPI_TUNNEL,      "$16:", "$96:", FALSE, TRUE  ),
+   _D( COEVSE_LINKSTAT,  "$17:", "$97:", FALSE, FALSE ),
+   _D( CHARGE_HISTREC,   "$18:", "$98:", FALSE, TRUE  ),
+   _D( CHARGE_STATESTAT, "$19:", "$99:", FALSE, FALSE ),
+   _D( HOUSE_POWER,      "$1A:", "$9A:", FALSE, FALSE ),
+   _D( CHARGE_PLAN,      "$1B:", "$9B:", FALSE, FALSE ),
+   _D( PLAN_TARIFF,      "$1C:", "$9C:", FALSE, FALSE ),
+   _D( CHARGE_SESSREC,   "$1D:", "$9D:", FALSE, TRUE  ),
+   _D( CHARGE_EOC,       "$1E:", "$9E:", FALSE, FALSE ),
    _D( ERRORS_LIST,      "$20:", "$A0:", FALSE, FALSE ),
+   _D( TRS_STAT,         "$21:", "$A1:", FALSE, FALSE ),
+   _D( WDG_STAT,         "$22:", "$A2:", FALSE, FALSE ),
+   _D( TRS_HIST,         "$23:", "$A3:", FALSE, FALSE ),
    _D( RESET,            "$7F:", "$FF:", FALSE, FALSE ),
 } ;
 
@@ -156,6 +298,23 @@ static void sfrm_ProcessFrame( char * i_szStrFrm ) ;
 static void sfrm_ExecCmd( char C* i_pszArg ) ;
 static void sfrm_ProcessResExt( char C* i_szStrFrm, BOOL i_bLastCall ) ;
 static void sfrm_SendRes( char C* i_szRes ) ;
+static void sfrm_SendResFmt( f_sfrmFmt i_fFmt ) ;
+static void sfrm_WriteRes( f_sfrmFmt i_fFmt, char C* i_szParam ) ;
+static void sfrm_FmtErrorList( CHAR * o_pszStr, WORD i_wSize ) ;
+static void sfrm_FmtTrsStat( CHAR * o_pszStr, WORD i_wSize ) ;
+static void sfrm_FmtTrsHistWifi( CHAR * o_pszStr, WORD i_wSize ) ;
+static void sfrm_FmtTrsHistOEvse( CHAR * o_pszStr, WORD i_wSize ) ;
+static void sfrm_StartStream( f_StreamProd i_fProducer ) ;
+static void sfrm_ProcessStream( void ) ;
+static void sfrm_StartTunnel( char C* i_pszArg ) ;
+static void sfrm_ProcessTunnel( void ) ;
+static void sfrm_TunnelData( char C* i_pszData ) ;
+static void sfrm_SetTelem( char C* i_pszArg ) ;
+static void sfrm_SetPlan( char C* i_pszArg ) ;
+static void sfrm_SetTariff( char C* i_pszArg ) ;
+static void sfrm_SetEoc( char C* i_pszArg ) ;
+static void sfrm_ProcessTelem( void ) ;
+static void sfrm_SendTelem( void ) ;
 
 
 /*----------------------------------------------------------------------------*/
@@ -163,6 +322,8 @@ static void sfrm_SendRes( char C* i_szRes ) ;
 /*----------------------------------------------------------------------------*/
 
 static e_sfrmFrameId l_eFrmId ;
+static s_sfrmStream l_Stream ;         /* streamed response */
+static s_sfrmTelem l_Telem ;           /* telemetry subscription */
 
 
 
@@ -174,8 +335,23 @@ void sfrm_Init( void )
 {
    cwifi_RegisterScktFunc( &sfrm_ProcessFrame, &sfrm_ProcessResExt ) ;
    coevse_RegisterRetScktFunc( &sfrm_ProcessResExt ) ;
+   coevse_RegisterTunnelFunc( &sfrm_TunnelData ) ;
 
    l_eFrmId = SFRM_ID_NULL ;
+   memset( &l_Stream, 0, sizeof(l_Stream) ) ;
+   memset( &l_Telem, 0, sizeof(l_Telem) ) ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* periodic task                                                              */
+/*----------------------------------------------------------------------------*/
+
+void sfrm_TaskCyc( void )
+{
+   sfrm_ProcessStream() ;
+   sfrm_ProcessTunnel() ;
+   sfrm_ProcessTelem() ;
 }
 
 
@@ -222,7 +398,18 @@ static void sfrm_ProcessFrame( char * i_szStrFrm )
 
    if ( eFrmId == SFRM_ID_RESET )
    {
+      if ( l_eFrmId == SFRM_ID_RAPI_TUNNEL )
+      {                                /* close tunnel, and leave data mode */
+         coevse_StopTunnel() ;
+         cwifi_AddExtData( "at+s." ) ;
+         cwifi_AskFlushData() ;
+      }
       l_eFrmId = SFRM_ID_NULL ;
+      l_Stream.fProducer = NULL ;      /* abort pending stream */
+   }
+   else if ( l_eFrmId == SFRM_ID_RAPI_TUNNEL )
+   {                                   /* tunnel : frame is sent as is to OpenEVSE */
+      coevse_TunnelSend( i_szStrFrm ) ;
    }
    else
    {
@@ -251,7 +438,6 @@ static void sfrm_ProcessFrame( char * i_szStrFrm )
 /*----------------------------------------------------------------------------*/
 static void sfrm_ExecCmd( char C* i_pszArg )
 {
-   char szStrInfo [SFRM_DATA_PAYLOAD_SIZE] ;
    char C* pszName ;
    RESULT rRet ;
 
@@ -307,28 +493,103 @@ static void sfrm_ExecCmd( char C* i_pszArg )
          break ;
 
       case SFRM_ID_RAPI_CHARGEINFO :
-         coevse_FmtInfo( szStrInfo, sizeof(szStrInfo) ) ;
-         sfrm_SendRes( szStrInfo ) ;
+         sfrm_SendResFmt( &coevse_FmtInfo ) ;
          break ;
 
       case SFRM_ID_CHARGE_HISTSTATE :
-         cstate_GetHistState( szStrInfo, sizeof(szStrInfo) ) ;
-         sfrm_SendRes( szStrInfo ) ;
+         sfrm_SendResFmt( &cstate_GetHistState ) ;
          break ;
 
       case SFRM_ID_COEVSE_HIST :
-         coevse_GetHist( szStrInfo, sizeof(szStrInfo) ) ;
-         sfrm_SendRes( szStrInfo ) ;
+         sfrm_StartStream( &coevse_ReadHist ) ;
          break ;
 
       case SFRM_ID_COEVSE_ASYNCH :
-         coevse_GetAsyncState( szStrInfo, sizeof(szStrInfo) ) ;
-         sfrm_SendRes( szStrInfo ) ;
+         sfrm_SendResFmt( &coevse_GetAsyncState ) ;
+         break ;
+
+      case SFRM_ID_TELEM_SUBSCRIBE :
+         sfrm_SetTelem( i_pszArg ) ;
+         sfrm_SendRes( "OK\r\n" ) ;
+         break ;
+
+      case SFRM_ID_RAPI_TUNNEL :
+         sfrm_StartTunnel( i_pszArg ) ;
+         break ;
+
+      case SFRM_ID_COEVSE_LINKSTAT :
+         sfrm_SendResFmt( &coevse_FmtLinkStat ) ;
+         break ;
+
+      case SFRM_ID_CHARGE_HISTREC :
+         sfrm_StartStream( &cstate_ReadHistRec ) ;
+         break ;
+
+      case SFRM_ID_CHARGE_STATESTAT :
+         sfrm_SendResFmt( &cstate_FmtStateStat ) ;
+         break ;
+
+      case SFRM_ID_HOUSE_POWER :
+         if ( ( i_pszArg[0] != '\0' ) &&
+              ( lmgt_SetHousePowerStr( i_pszArg ) != OK ) )
+         {
+            sfrm_SendRes( "ERROR : Invalid power\r\n" ) ;
+         }
+         else
+         {
+            sfrm_SendResFmt( &lmgt_FmtStat ) ;
+         }
+         break ;
+
+      case SFRM_ID_CHARGE_PLAN :
+         if ( i_pszArg[0] != '\0' )
+         {
+            sfrm_SetPlan( i_pszArg ) ;
+         }
+         sfrm_SendResFmt( &cplan_FmtPlan ) ;
+         break ;
+
+      case SFRM_ID_PLAN_TARIFF :
+         if ( i_pszArg[0] != '\0' )
+         {
+            sfrm_SetTariff( i_pszArg ) ;
+         }
+         sfrm_SendResFmt( &cplan_FmtTariff ) ;
+         break ;
+
+      case SFRM_ID_CHARGE_SESSREC :
+         sfrm_StartStream( &cstate_ReadSessRec ) ;
+         break ;
+
+      case SFRM_ID_CHARGE_EOC :
+         if ( i_pszArg[0] != '\0' )
+         {
+            sfrm_SetEoc( i_pszArg ) ;
+         }
+         sfrm_SendResFmt( &cstate_FmtEoc ) ;
          break ;
 
       case SFRM_ID_ERRORS_LIST :
-         err_GetErrorList( NULL, FALSE, szStrInfo, sizeof(szStrInfo) );
-         sfrm_SendRes( szStrInfo ) ;
+         sfrm_SendResFmt( &sfrm_FmtErrorList ) ;
+         break ;
+
+      case SFRM_ID_TRS_STAT :
+         sfrm_SendResFmt( &sfrm_FmtTrsStat ) ;
+         break ;
+
+      case SFRM_ID_WDG_STAT :
+         sfrm_SendResFmt( &main_FmtWdgStat ) ;
+         break ;
+
+      case SFRM_ID_TRS_HIST :
+         if ( i_pszArg[0] == '1' )
+         {
+            sfrm_SendResFmt( &sfrm_FmtTrsHistOEvse ) ;
+         }
+         else
+         {
+            sfrm_SendResFmt( &sfrm_FmtTrsHistWifi ) ;
+         }
          break ;
 
       default :
@@ -355,30 +616,437 @@ static void sfrm_ProcessResExt( char C* i_szStrFrm, BOOL i_bLastCall )
 
 
 /*----------------------------------------------------------------------------*/
+/* Send response with <i_szParam> string as payload                           */
+/*----------------------------------------------------------------------------*/
+
 static void sfrm_SendRes( char C* i_szParam )
+{
+   sfrm_WriteRes( NULL, i_szParam ) ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Send response formatted in place by <i_fFmt>                               */
+/*----------------------------------------------------------------------------*/
+
+static void sfrm_SendResFmt( f_sfrmFmt i_fFmt )
+{
+   sfrm_WriteRes( i_fFmt, NULL ) ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Write response (code and payload) directly into socket buffer. The payload */
+/* is either formatted by <i_fFmt> or copied from <i_szParam>                 */
+/*----------------------------------------------------------------------------*/
+
+static void sfrm_WriteRes( f_sfrmFmt i_fFmt, char C* i_szParam )
 {
    s_FrameDesc C* pFrmDesc ;
-   char szRes [SFRM_DATA_ITEM_SIZE] ;
-   char * pszRes ;
+   CHAR * pszRes ;
    WORD wResSize ;
+   WORD wPrefixLen ;
 
    if ( l_eFrmId != SFRM_ID_NULL )
    {
       pFrmDesc = &k_aFrameDesc[ ( l_eFrmId - SFRM_ID_FIRST ) ] ;
+      wPrefixLen = strlen( pFrmDesc->szRes ) ;
+
+      pszRes = cwifi_ReserveData( &wResSize ) ;
+                                       /* space for response code and final NULL */
+      if ( ( pszRes != NULL ) && ( wResSize > ( wPrefixLen + 1 ) ) )
+      {
+         memcpy( pszRes, pFrmDesc->szRes, wPrefixLen ) ;
+         pszRes += wPrefixLen ;
+         wResSize = GETMIN( wResSize - wPrefixLen, SFRM_DATA_PAYLOAD_SIZE ) ;
+
+         if ( i_fFmt != NULL )
+         {
+            (*i_fFmt)( pszRes, wResSize ) ;
+         }
+         else
+         {
+            strlcpy( pszRes, i_szParam, wResSize ) ;
+         }
+
+         cwifi_CommitData( wPrefixLen + strlen( pszRes ) ) ;
+      }
+   }
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Error list formatting                                                      */
+/*----------------------------------------------------------------------------*/
+
+static void sfrm_FmtErrorList( CHAR * o_pszStr, WORD i_wSize )
+{
+   err_GetErrorList( NULL, FALSE, o_pszStr, i_wSize ) ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Transactions statistics formatting : Wifi module, then OpenEVSE links      */
+/*----------------------------------------------------------------------------*/
+
+static void sfrm_FmtTrsStat( CHAR * o_pszStr, WORD i_wSize )
+{
+   WORD wLen ;
+
+   trs_FmtStat( cwifi_GetTrs(), o_pszStr, i_wSize ) ;
+   wLen = strlen( o_pszStr ) ;
+
+   if ( wLen + 2 < i_wSize )
+   {
+      strcpy( &o_pszStr[wLen], "; " ) ;
+      wLen += 2 ;
+      trs_FmtStat( coevse_GetTrs(), &o_pszStr[wLen], i_wSize - wLen ) ;
+   }
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Latency histograms formatting : Wifi module link                           */
+/*----------------------------------------------------------------------------*/
+
+static void sfrm_FmtTrsHistWifi( CHAR * o_pszStr, WORD i_wSize )
+{
+   trs_FmtHist( cwifi_GetTrs(), cwifi_GetQueueDepth(), o_pszStr, i_wSize ) ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Latency histograms formatting : OpenEVSE link                              */
+/*----------------------------------------------------------------------------*/
 
-      pszRes = szRes ;
-      wResSize = sizeof(szRes) ;
+static void sfrm_FmtTrsHistOEvse( CHAR * o_pszStr, WORD i_wSize )
+{
+   trs_FmtHist( coevse_GetTrs(), coevse_GetQueueDepth(), o_pszStr, i_wSize ) ;
+}
 
-      strncpy( pszRes, pFrmDesc->szRes, wResSize ) ;
-      pszRes += strlen( pFrmDesc->szRes ) ;
-      wResSize -= strlen( pFrmDesc->szRes ) ;
 
-      strncpy( pszRes, i_szParam, wResSize ) ;
+/*----------------------------------------------------------------------------*/
+/* Start a streamed response                                                  */
+/*----------------------------------------------------------------------------*/
+
+static void sfrm_StartStream( f_StreamProd i_fProducer )
+{
+   l_Stream.fProducer = i_fProducer ;
+   l_Stream.dwOffset = 0 ;
+}
 
-         /* Note : force the end of string */
 
-      szRes[ sizeof(szRes)-1 ] = '\0' ;
+/*----------------------------------------------------------------------------*/
+/* Streamed response processing : send next chunk when socket buffer is free  */
+/*----------------------------------------------------------------------------*/
+
+static void sfrm_ProcessStream( void )
+{
+   s_FrameDesc C* pFrmDesc ;
+   CHAR * pszChunk ;
+   WORD wSize ;
+   WORD wPrefixLen ;
+   WORD wNbChar ;
+
+   if ( ( l_Stream.fProducer != NULL ) && ( l_eFrmId != SFRM_ID_NULL ) )
+   {                                   /* stream ends with socket connection */
+      if ( ! cwifi_IsSocketConnected() )
+      {
+         l_Stream.fProducer = NULL ;
+         l_eFrmId = SFRM_ID_NULL ;
+      }                                /* flow control : wait for previous chunk */
+                                       /* to be flushed */
+      else if ( ! cwifi_IsFlushPending() )
+      {
+         pFrmDesc = &k_aFrameDesc[ ( l_eFrmId - SFRM_ID_FIRST ) ] ;
+         wPrefixLen = strlen( pFrmDesc->szRes ) ;
+
+         pszChunk = cwifi_ReserveData( &wSize ) ;
+                                       /* space for a full chunk, and data mode exit */
+         if ( ( pszChunk != NULL ) &&
+              ( wSize >= ( wPrefixLen + SFRM_STREAM_CHUNK_SIZE + sizeof("at+s.") ) ) )
+         {                             /* chunk is produced in place */
+            memcpy( pszChunk, pFrmDesc->szRes, wPrefixLen ) ;
+
+            wNbChar = (*l_Stream.fProducer)( l_Stream.dwOffset, &pszChunk[wPrefixLen],
+                                             SFRM_STREAM_CHUNK_SIZE ) ;
+            DEFENS_LIM_MAX( wNbChar, SFRM_STREAM_CHUNK_SIZE ) ;
+
+            l_Stream.dwOffset += wNbChar ;
+
+            if ( wNbChar == SFRM_STREAM_CHUNK_SIZE )
+            {                          /* more chunks follow */
+               pszChunk[wPrefixLen - 1] = SFRM_STREAM_MARK_MORE ;
+               cwifi_CommitData( wPrefixLen + wNbChar ) ;
+            }
+            else                       /* last chunk */
+            {
+               cwifi_CommitData( wPrefixLen + wNbChar ) ;
+               cwifi_AddExtData( "at+s." ) ;
+               l_Stream.fProducer = NULL ;
+               l_eFrmId = SFRM_ID_NULL ;
+            }
+            cwifi_AskFlushData() ;
+         }
+      }
+   }
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* RAPI tunnel start ( "<timeout>" )                                          */
+/*----------------------------------------------------------------------------*/
+
+static void sfrm_StartTunnel( char C* i_pszArg )
+{
+   SDWORD sdwTimeout ;
+
+   cascii_GetNextDec( i_pszArg, &sdwTimeout, FALSE, COEVSE_TUNNEL_TIMEOUT_MAX ) ;
+
+   if ( coevse_StartTunnel( (DWORD)sdwTimeout ) == OK )
+   {
+      sfrm_SendRes( "OK\r\n" ) ;     /* data mode is kept during tunnel */
+   }
+   else
+   {
+      sfrm_SendRes( "ERROR\r\n" ) ;
+      cwifi_AddExtData( "at+s." ) ;
+      l_eFrmId = SFRM_ID_NULL ;
+   }
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* RAPI tunnel end processing                                                 */
+/*----------------------------------------------------------------------------*/
+
+static void sfrm_ProcessTunnel( void )
+{
+   if ( l_eFrmId == SFRM_ID_RAPI_TUNNEL )
+   {
+      if ( ! cwifi_IsSocketConnected() )
+      {
+         coevse_StopTunnel() ;
+         l_eFrmId = SFRM_ID_NULL ;
+      }
+      else if ( ! coevse_IsTunnelActive() )
+      {                                /* tunnel timeout */
+         sfrm_SendRes( "END\r\n" ) ;
+         cwifi_AddExtData( "at+s." ) ;
+         cwifi_AskFlushData() ;
+         l_eFrmId = SFRM_ID_NULL ;
+      }
+   }
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* RAPI tunnel received data : sent to socket as is                           */
+/*----------------------------------------------------------------------------*/
+
+static void sfrm_TunnelData( char C* i_pszData )
+{
+   cwifi_AddExtData( i_pszData ) ;
+   cwifi_AskFlushData() ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Telemetry subscription setting ( "<mask>,<period>" )                       */
+/*----------------------------------------------------------------------------*/
+
+static void sfrm_SetTelem( char C* i_pszArg )
+{
+   char C* pszArg ;
+   DWORD dwMask ;
+   SDWORD sdwPeriod ;
+
+   pszArg = cascii_GetNextHex( i_pszArg, &dwMask ) ;
+   cascii_GetNextDec( pszArg, &sdwPeriod, FALSE, SFRM_TELEM_PER_MAX ) ;
+
+   l_Telem.dwMask = ( dwMask & SFRM_TELEM_ALL ) ;
+   l_Telem.dwPeriod = GETMAX( (DWORD)sdwPeriod, SFRM_TELEM_PER_MIN ) ;
+   l_Telem.dwSeqNum = 0 ;
+   l_Telem.byThrottle = 0 ;
+
+   if ( l_Telem.dwMask != 0 )
+   {
+      tim_StartMsTmp( &l_Telem.dwTmpSample ) ;
+   }
+   else
+   {
+      l_Telem.dwTmpSample = 0 ;
+   }
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Charge plan setting ( "<energy>,<delay>" )                                 */
+/*----------------------------------------------------------------------------*/
+
+static void sfrm_SetPlan( char C* i_pszArg )
+{
+   char C* pszArg ;
+   SDWORD sdwEnergy ;
+   SDWORD sdwDelay ;
+
+   pszArg = cascii_GetNextDec( i_pszArg, &sdwEnergy, FALSE, CPLAN_ENERGY_MAX ) ;
+   cascii_GetNextDec( pszArg, &sdwDelay, FALSE, CPLAN_DUR_MAX ) ;
+
+   if ( sdwEnergy == 0 )
+   {
+      cplan_Stop() ;
+   }
+   else
+   {                                   /* invalid plan is reported by status */
+      cplan_Start( (DWORD)sdwEnergy, (DWORD)sdwDelay ) ;
+   }
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Charge planner tariff setting ( "<idx>,<days>,<start>,<end>,<price>" )     */
+/*----------------------------------------------------------------------------*/
+
+static void sfrm_SetTariff( char C* i_pszArg )
+{
+   char C* pszArg ;
+   SDWORD sdwIdx ;
+   DWORD dwDays ;
+   SDWORD sdwStart ;
+   SDWORD sdwEnd ;
+   SDWORD sdwPrice ;
+
+   pszArg = cascii_GetNextDec( i_pszArg, &sdwIdx, FALSE, CPLAN_TARIFF_NB ) ;
+
+   if ( sdwIdx == CPLAN_TARIFF_NB )
+   {
+      cascii_GetNextDec( pszArg, &sdwPrice, FALSE, CPLAN_PRICE_MAX ) ;
+      cplan_SetPriceDef( (WORD)sdwPrice ) ;
+   }
+   else
+   {
+      pszArg = cascii_GetNextHex( pszArg, &dwDays ) ;
+      pszArg = cascii_GetNextDec( pszArg, &sdwStart, FALSE, BYTE_MAX ) ;
+      pszArg = cascii_GetNextDec( pszArg, &sdwEnd, FALSE, BYTE_MAX ) ;
+      cascii_GetNextDec( pszArg, &sdwPrice, FALSE, CPLAN_PRICE_MAX ) ;
+
+      cplan_SetTariff( (BYTE)sdwIdx, (BYTE)GETMIN( dwDays, BYTE_MAX ),
+                       (BYTE)sdwStart, (BYTE)sdwEnd, (WORD)sdwPrice ) ;
+   }
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* End of charge detection setting ( "<dwell>,<energy>,<filter>" )            */
+/*----------------------------------------------------------------------------*/
+
+static void sfrm_SetEoc( char C* i_pszArg )
+{
+   char C* pszArg ;
+   SDWORD sdwDwell ;
+   SDWORD sdwEnergy ;
+   SDWORD sdwFilter ;
+
+   pszArg = cascii_GetNextDec( i_pszArg, &sdwDwell, FALSE, CSTATE_EOC_DWELL_MAX ) ;
+   pszArg = cascii_GetNextDec( pszArg, &sdwEnergy, FALSE, CSTATE_EOC_ENERGY_MAX ) ;
+   cascii_GetNextDec( pszArg, &sdwFilter, FALSE, CSTATE_EOC_FILTER_MAX ) ;
+
+   cstate_SetEocParam( (DWORD)sdwDwell, (DWORD)sdwEnergy, (DWORD)sdwFilter ) ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Telemetry sampling                                                         */
+/*----------------------------------------------------------------------------*/
+
+static void sfrm_ProcessTelem( void )
+{
+   if ( l_Telem.dwMask != 0 )
+   {                                   /* subscription ends with socket connection */
+      if ( ! cwifi_IsSocketConnected() )
+      {
+         memset( &l_Telem, 0, sizeof(l_Telem) ) ;
+      }
+      else if ( tim_IsEndMsTmp( &l_Telem.dwTmpSample,
+                                l_Telem.dwPeriod << l_Telem.byThrottle ) )
+      {
+         tim_StartMsTmp( &l_Telem.dwTmpSample ) ;
+         l_Telem.dwSeqNum++ ;
+                                       /* no pending response, and socket buffer */
+                                       /* not backlogged */
+         if ( ( l_eFrmId == SFRM_ID_NULL ) && ( ! cwifi_IsFlushPending() ) &&
+              ( cwifi_GetDataFreeSpace() >= SFRM_TELEM_SAMPLE_SIZE ) )
+         {
+            sfrm_SendTelem() ;
+            if ( l_Telem.byThrottle != 0 )
+            {
+               l_Telem.byThrottle-- ;
+            }
+         }
+         else                          /* sample is dropped, slow down sampling */
+         {
+            if ( l_Telem.byThrottle < SFRM_TELEM_THROTTLE_MAX )
+            {
+               l_Telem.byThrottle++ ;
+            }
+         }
+      }
+   }
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Format and send a telemetry sample                                         */
+/*----------------------------------------------------------------------------*/
+
+static void sfrm_SendTelem( void )
+{
+   CHAR * pszSample ;
+   WORD wSize ;
+   WORD wLen ;
+   DWORD dwMask ;
+
+   pszSample = cwifi_ReserveData( &wSize ) ;
+
+   if ( ( pszSample != NULL ) && ( wSize >= SFRM_TELEM_SAMPLE_SIZE ) )
+   {                                   /* sample is formatted in place */
+      wSize = SFRM_TELEM_SAMPLE_SIZE ;
+      dwMask = l_Telem.dwMask ;
+
+      wLen = snprintf( pszSample, wSize, "%s%lu, %lu, %lX",
+                       k_aFrameDesc[ SFRM_ID_TELEM_SUBSCRIBE - SFRM_ID_FIRST ].szRes,
+                       l_Telem.dwSeqNum, (DWORD)HAL_GetTick(), dwMask ) ;
+
+      if ( ISSET( dwMask, SFRM_TELEM_CURRENT ) )
+      {
+         wLen += snprintf( &pszSample[wLen], wSize - wLen, ", %li",
+                           coevse_GetCurrent() ) ;
+      }
+      if ( ISSET( dwMask, SFRM_TELEM_VOLTAGE ) )
+      {
+         wLen += snprintf( &pszSample[wLen], wSize - wLen, ", %li",
+                           coevse_GetVoltage() ) ;
+      }
+      if ( ISSET( dwMask, SFRM_TELEM_ENERGY ) )
+      {
+         wLen += snprintf( &pszSample[wLen], wSize - wLen, ", %lu",
+                           coevse_GetEnergy() ) ;
+      }
+      if ( ISSET( dwMask, SFRM_TELEM_EVSESTATE ) )
+      {
+         wLen += snprintf( &pszSample[wLen], wSize - wLen, ", %u",
+                           coevse_GetEvseState() ) ;
+      }
+      if ( ISSET( dwMask, SFRM_TELEM_CHARGESTATE ) )
+      {
+         wLen += snprintf( &pszSample[wLen], wSize - wLen, ", %u",
+                           cstate_GetChargeState() ) ;
+      }
+      wLen += snprintf( &pszSample[wLen], wSize - wLen, "\r\n" ) ;
 
-      cwifi_AddExtData( szRes ) ;
+      cwifi_CommitData( wLen ) ;
+      cwifi_AddExtData( "at+s." ) ;
+      cwifi_AskFlushData() ;
    }
 }
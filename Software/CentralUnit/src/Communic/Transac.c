@@ -0,0 +1,702 @@
+/******************************************************************************/
+/*                                  Transac.c                                 */
+/******************************************************************************/
+/*
+   Request/response transaction engine
+
+   Copyright (C) 2018  Sylvain BASSET
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+   ------------
+   @version 1.0
+   @history 1.0, 19 oct. 2019, creation
+   @brief
+
+   This module handles the commands of a serial link (CommWifi, CommOEvse),
+   from queuing to the end of transaction, each link having one s_trsLink
+   variable, configured by a const policy (s_trsPolicy).
+
+   Commands are queued in ring FIFOs (s_trsQueue), given by the link at
+   trs_Init() by decreasing priority. A queue stores items of the link type
+   (e.g. formatted string or parameters), whose size is given at
+   trs_InitQueue(), and which start with a s_trsItem header (command index
+   and queuing time). trs_Push() gives a new item to be filled by the link,
+   trs_Find() or trs_GetLast() an already queued one (coalescing).
+
+   trs_Select() gives the command to be sent : the output item of the first
+   not empty queue. If the policy gives byStarvMax, one command of the last
+   queue is sent after byStarvMax consecutive higher priority commands. The
+   queuing to sending delay is measured for each queue. The command stays
+   selected (trs_IsSelected()) until the end of its transaction : retries
+   send the same command, and it is removed from its queue once it succeeds
+   or all retries have failed.
+
+   The command in flight :
+
+   - trs_Start() is called when a command is sent. The response timeout
+     (dwTimeout) is started.
+   - trs_IsTimeout() is polled while the response is awaited.
+   - trs_End() is called when the transaction is over (valid response, wrong
+     response or timeout). In case of error, the command may be retried up to
+     byMaxRetry times : trs_End() then gives TRS_END_RETRY, and starts an
+     exponential backoff delay (wBackoffMin, doubled at each retry, up to
+     wBackoffMax). Once all retries have failed, TRS_END_FAIL is given.
+   - trs_IsReady() tells if a new command may be sent (no transaction in
+     progress, backoff delay over).
+
+   Formatting of commands, and processing of responses (LIST_CMD tables,
+   protocol specific) stay in link modules.
+   Transactions, errors, timeouts and response latency are counted for each
+   link, and formatted by trs_FmtStat().
+
+   For each command (index given to trs_Start()), the response latency is
+   also counted in a base 4 logarithmic histogram : bucket n counts latencies
+   lower than 4^(n+1) ms (bucket 0 : < 4 ms, bucket 1 : < 16 ms, ... bucket 6 :
+   < 16384 ms), the last bucket counts higher latencies. Timeouts and retries
+   are counted for each command. Counters saturate at WORD_MAX. They are
+   formatted by trs_FmtHist().
+*/
+
+
+#include "Define.h"
+#include "Communic.h"
+#include "System.h"
+
+
+/*----------------------------------------------------------------------------*/
+/* Defines                                                                    */
+/*----------------------------------------------------------------------------*/
+
+#define TRS_BACKOFF_SHIFT_MAX    8     /* maximum backoff doubling number */
+
+#define TRS_HIST_SHIFT           2     /* histogram scale (log 2 of base) */
+
+
+/*----------------------------------------------------------------------------*/
+/* Prototypes                                                                 */
+/*----------------------------------------------------------------------------*/
+
+static s_trsCmdStat * trs_GetCmdStat( s_trsLink * io_pTrs ) ;
+static void trs_IncCnt( WORD * io_pwCnt ) ;
+
+static s_trsItem * trs_GetItem( s_trsQueue C* i_pQueue, BYTE i_byIdx ) ;
+static BYTE trs_NextIdx( s_trsQueue C* i_pQueue, BYTE i_byIdx ) ;
+static void trs_DropCur( s_trsLink * io_pTrs ) ;
+
+
+/*----------------------------------------------------------------------------*/
+/* Command queue initialization                                               */
+/*    - o_pQueue : queue data                                                 */
+/*    - i_pItems : items table (link type, starting with s_trsItem)           */
+/*    - i_wItemSize : item size, bytes                                        */
+/*    - i_byNbItem : items number of table (queue capacity + 1)               */
+/*----------------------------------------------------------------------------*/
+
+void trs_InitQueue( s_trsQueue * o_pQueue, void * i_pItems, WORD i_wItemSize,
+                    BYTE i_byNbItem )
+{
+   memset( o_pQueue, 0, sizeof(s_trsQueue) ) ;
+
+   o_pQueue->pbyItems = (BYTE*)i_pItems ;
+   o_pQueue->wItemSize = i_wItemSize ;
+   o_pQueue->byNbItem = i_byNbItem ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Link transaction initialization                                            */
+/*    - o_pTrs : link transaction data                                        */
+/*    - i_pPolicy : link transaction policy                                   */
+/*    - i_aCmdStat : per command statistics table                             */
+/*    - i_byNbCmd : commands number (size of i_aCmdStat)                      */
+/*    - i_aQueue : command queues (initialized), by decreasing priority       */
+/*    - i_byNbQueue : queues number (size of i_aQueue)                        */
+/*----------------------------------------------------------------------------*/
+
+void trs_Init( s_trsLink * o_pTrs, s_trsPolicy C* i_pPolicy,
+               s_trsCmdStat * i_aCmdStat, BYTE i_byNbCmd,
+               s_trsQueue * i_aQueue, BYTE i_byNbQueue )
+{
+   BYTE byQueue ;
+
+   memset( o_pTrs, 0, sizeof(s_trsLink) ) ;
+   memset( i_aCmdStat, 0, i_byNbCmd * sizeof(s_trsCmdStat) ) ;
+
+   o_pTrs->pPolicy = i_pPolicy ;
+   o_pTrs->aCmdStat = i_aCmdStat ;
+   o_pTrs->byNbCmd = i_byNbCmd ;
+   o_pTrs->aQueue = i_aQueue ;
+   o_pTrs->byNbQueue = i_byNbQueue ;
+
+   for ( byQueue = 0 ; byQueue < i_byNbQueue ; byQueue++ )
+   {                                   /* empty queues, clear counters */
+      trs_InitQueue( &i_aQueue[byQueue], i_aQueue[byQueue].pbyItems,
+                     i_aQueue[byQueue].wItemSize, i_aQueue[byQueue].byNbItem ) ;
+   }
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Abort current transaction and retries (link reset), the selected command   */
+/* is dropped, other queued commands and counters are kept                    */
+/*----------------------------------------------------------------------------*/
+
+void trs_Reset( s_trsLink * io_pTrs )
+{
+   io_pTrs->bPending = FALSE ;
+   io_pTrs->byNbRetry = 0 ;
+   io_pTrs->dwTmpTimeout = 0 ;
+   io_pTrs->dwTmpBackoff = 0 ;
+
+   trs_DropCur( io_pTrs ) ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Empty command queues, the selected command is kept until its transaction   */
+/* end                                                                        */
+/*----------------------------------------------------------------------------*/
+
+void trs_Flush( s_trsLink * io_pTrs )
+{
+   s_trsQueue * pQueue ;
+   BYTE byQueue ;
+
+   for ( byQueue = 0 ; byQueue < io_pTrs->byNbQueue ; byQueue++ )
+   {
+      pQueue = &io_pTrs->aQueue[byQueue] ;
+
+      if ( io_pTrs->bSelect && ( byQueue == io_pTrs->byQueueCur ) )
+      {
+         pQueue->byIdxIn = trs_NextIdx( pQueue, pQueue->byIdxOut ) ;
+      }
+      else
+      {
+         pQueue->byIdxIn = pQueue->byIdxOut ;
+      }
+   }
+
+   io_pTrs->byNbPrioSent = 0 ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Add a command in queue <i_byQueue>                                         */
+/*    - i_byCmdIdx : command index                                            */
+/* Return the new item (header filled, to be completed by the link), NULL if  */
+/* the queue is full (command dropped)                                        */
+/*----------------------------------------------------------------------------*/
+
+void * trs_Push( s_trsLink * io_pTrs, BYTE i_byQueue, BYTE i_byCmdIdx )
+{
+   s_trsQueue * pQueue ;
+   s_trsItem * pItem ;
+   BYTE byNextIdxIn ;
+
+   pItem = NULL ;
+   pQueue = &io_pTrs->aQueue[ GETMIN( i_byQueue, io_pTrs->byNbQueue - 1 ) ] ;
+
+   byNextIdxIn = trs_NextIdx( pQueue, pQueue->byIdxIn ) ;
+
+   if ( byNextIdxIn != pQueue->byIdxOut )
+   {
+      pItem = trs_GetItem( pQueue, pQueue->byIdxIn ) ;
+      memset( pItem, 0, pQueue->wItemSize ) ;
+      pItem->byCmdIdx = i_byCmdIdx ;
+      pItem->dwTick = HAL_GetTick() ;
+
+      pQueue->byIdxIn = byNextIdxIn ;
+   }
+   else
+   {
+      pQueue->dwNbDropped++ ;
+   }
+
+   return pItem ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Find first command <i_byCmdIdx> in queue <i_byQueue>                       */
+/*    - i_bSkipCur : ignore the selected command (being sent)                 */
+/* Return the item, NULL if not found                                         */
+/*----------------------------------------------------------------------------*/
+
+void * trs_Find( s_trsLink * io_pTrs, BYTE i_byQueue, BYTE i_byCmdIdx, BOOL i_bSkipCur )
+{
+   s_trsQueue * pQueue ;
+   s_trsItem * pItem ;
+   s_trsItem * pFound ;
+   BYTE byIdx ;
+
+   pFound = NULL ;
+   i_byQueue = GETMIN( i_byQueue, io_pTrs->byNbQueue - 1 ) ;
+   pQueue = &io_pTrs->aQueue[i_byQueue] ;
+   byIdx = pQueue->byIdxOut ;
+                                       /* output item is being sent */
+   if ( i_bSkipCur && io_pTrs->bSelect && ( io_pTrs->byQueueCur == i_byQueue ) &&
+        ( byIdx != pQueue->byIdxIn ) )
+   {
+      byIdx = trs_NextIdx( pQueue, byIdx ) ;
+   }
+
+   while ( ( byIdx != pQueue->byIdxIn ) && ( pFound == NULL ) )
+   {
+      pItem = trs_GetItem( pQueue, byIdx ) ;
+      if ( pItem->byCmdIdx == i_byCmdIdx )
+      {
+         pFound = pItem ;
+      }
+      byIdx = trs_NextIdx( pQueue, byIdx ) ;
+   }
+
+   return pFound ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Last command of queue <i_byQueue>                                          */
+/*    - i_bSkipCur : ignore the selected command (being sent)                 */
+/* Return the item, NULL if the queue is empty                                */
+/*----------------------------------------------------------------------------*/
+
+void * trs_GetLast( s_trsLink * io_pTrs, BYTE i_byQueue, BOOL i_bSkipCur )
+{
+   s_trsQueue * pQueue ;
+   s_trsItem * pItem ;
+   BYTE byIdx ;
+
+   pItem = NULL ;
+   i_byQueue = GETMIN( i_byQueue, io_pTrs->byNbQueue - 1 ) ;
+   pQueue = &io_pTrs->aQueue[i_byQueue] ;
+
+   if ( pQueue->byIdxIn != pQueue->byIdxOut )
+   {
+      byIdx = ( pQueue->byIdxIn + pQueue->byNbItem - 1 ) % pQueue->byNbItem ;
+                                       /* output item is being sent */
+      if ( ! ( i_bSkipCur && io_pTrs->bSelect && ( io_pTrs->byQueueCur == i_byQueue ) &&
+               ( byIdx == pQueue->byIdxOut ) ) )
+      {
+         pItem = trs_GetItem( pQueue, byIdx ) ;
+      }
+   }
+
+   return pItem ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Test if a command is queued in one of the <i_byNbQueue> first queues       */
+/* (selected command included)                                                */
+/*----------------------------------------------------------------------------*/
+
+BOOL trs_IsQueued( s_trsLink C* i_pTrs, BYTE i_byNbQueue )
+{
+   BOOL bQueued ;
+   BYTE byQueue ;
+
+   bQueued = FALSE ;
+   i_byNbQueue = GETMIN( i_byNbQueue, i_pTrs->byNbQueue ) ;
+
+   for ( byQueue = 0 ; byQueue < i_byNbQueue ; byQueue++ )
+   {
+      if ( i_pTrs->aQueue[byQueue].byIdxIn != i_pTrs->aQueue[byQueue].byIdxOut )
+      {
+         bQueued = TRUE ;
+      }
+   }
+
+   return bQueued ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Get number of queued commands, all queues (selected command included)      */
+/*----------------------------------------------------------------------------*/
+
+BYTE trs_GetQueueDepth( s_trsLink C* i_pTrs )
+{
+   s_trsQueue C* pQueue ;
+   BYTE byDepth ;
+   BYTE byQueue ;
+
+   byDepth = 0 ;
+
+   for ( byQueue = 0 ; byQueue < i_pTrs->byNbQueue ; byQueue++ )
+   {
+      pQueue = &i_pTrs->aQueue[byQueue] ;
+      byDepth += ( pQueue->byIdxIn + pQueue->byNbItem - pQueue->byIdxOut ) %
+                 pQueue->byNbItem ;
+   }
+
+   return byDepth ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Select the command to be sent, in the <i_byNbQueue> first queues           */
+/* The selected command is kept until the end of its transaction, so retries  */
+/* give the same command. The starvation protection of the last queue only    */
+/* applies when all queues are allowed.                                       */
+/* Return the item of the command, NULL if no command is queued               */
+/*----------------------------------------------------------------------------*/
+
+void * trs_Select( s_trsLink * io_pTrs, BYTE i_byNbQueue )
+{
+   s_trsQueue * pQueue ;
+   s_trsItem * pItem ;
+   BYTE byQueue ;
+   BYTE byLast ;
+   BOOL bLastQueued ;
+   DWORD dwLat ;
+
+   pItem = NULL ;
+
+   if ( io_pTrs->bSelect )             /* transaction not yet over */
+   {
+      pQueue = &io_pTrs->aQueue[io_pTrs->byQueueCur] ;
+      pItem = trs_GetItem( pQueue, pQueue->byIdxOut ) ;
+   }
+   else
+   {
+      i_byNbQueue = GETMIN( i_byNbQueue, io_pTrs->byNbQueue ) ;
+
+      byQueue = 0 ;                    /* first not empty queue */
+      while ( ( byQueue < i_byNbQueue ) &&
+              ( io_pTrs->aQueue[byQueue].byIdxIn == io_pTrs->aQueue[byQueue].byIdxOut ) )
+      {
+         byQueue++ ;
+      }
+                                       /* last queue starvation protection */
+      if ( ( byQueue < i_byNbQueue ) && ( i_byNbQueue == io_pTrs->byNbQueue ) &&
+           ( io_pTrs->pPolicy->byStarvMax != 0 ) )
+      {
+         byLast = io_pTrs->byNbQueue - 1 ;
+         bLastQueued = ( io_pTrs->aQueue[byLast].byIdxIn !=
+                         io_pTrs->aQueue[byLast].byIdxOut ) ;
+
+         if ( bLastQueued && ( io_pTrs->byNbPrioSent >= io_pTrs->pPolicy->byStarvMax ) )
+         {
+            byQueue = byLast ;
+         }
+
+         if ( ( byQueue == byLast ) || ( ! bLastQueued ) )
+         {
+            io_pTrs->byNbPrioSent = 0 ;
+         }
+         else
+         {
+            io_pTrs->byNbPrioSent++ ;
+         }
+      }
+
+      if ( byQueue < i_byNbQueue )
+      {
+         pQueue = &io_pTrs->aQueue[byQueue] ;
+         pItem = trs_GetItem( pQueue, pQueue->byIdxOut ) ;
+                                       /* queuing to sending delay */
+         dwLat = HAL_GetTick() - pItem->dwTick ;
+         pQueue->dwLatLast = dwLat ;
+         pQueue->dwLatMax = GETMAX( pQueue->dwLatMax, dwLat ) ;
+
+         io_pTrs->byQueueCur = byQueue ;
+         io_pTrs->bSelect = TRUE ;
+      }
+   }
+
+   return pItem ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Test if a command is selected (sent, transaction not yet over)             */
+/*----------------------------------------------------------------------------*/
+
+BOOL trs_IsSelected( s_trsLink C* i_pTrs )
+{
+   return i_pTrs->bSelect ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Test if a new command may be sent                                          */
+/*----------------------------------------------------------------------------*/
+
+BOOL trs_IsReady( s_trsLink * io_pTrs )
+{
+   BOOL bReady ;
+
+   bReady = FALSE ;
+
+   if ( ! io_pTrs->bPending )
+   {
+      bReady = ( io_pTrs->dwTmpBackoff == 0 ) ||
+               tim_IsEndMsTmp( &io_pTrs->dwTmpBackoff, io_pTrs->wBackoff ) ;
+   }
+
+   return bReady ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Start a transaction (command is sent)                                      */
+/*    - i_byCmdIdx : command index in statistics table                        */
+/*----------------------------------------------------------------------------*/
+
+void trs_Start( s_trsLink * io_pTrs, BYTE i_byCmdIdx )
+{
+   io_pTrs->bPending = TRUE ;
+   io_pTrs->byCmdIdx = i_byCmdIdx ;
+   io_pTrs->dwStartTick = HAL_GetTick() ;
+   io_pTrs->dwNbStart++ ;
+
+   tim_StartMsTmp( &io_pTrs->dwTmpTimeout ) ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Test the end of response timeout                                           */
+/*----------------------------------------------------------------------------*/
+
+BOOL trs_IsTimeout( s_trsLink * io_pTrs )
+{
+   BOOL bTimeout ;
+
+   bTimeout = io_pTrs->bPending &&
+              tim_IsEndMsTmp( &io_pTrs->dwTmpTimeout, io_pTrs->pPolicy->dwTimeout ) ;
+
+   if ( bTimeout )
+   {
+      io_pTrs->dwNbTimeout++ ;
+      trs_IncCnt( &trs_GetCmdStat( io_pTrs )->wNbTimeout ) ;
+   }
+
+   return bTimeout ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* End of transaction                                                         */
+/*    - i_rRes : OK for valid response, ERR for wrong response or timeout     */
+/* Return TRS_END_OK, TRS_END_RETRY if the command has to be sent again, or   */
+/* TRS_END_FAIL if all retries have failed                                    */
+/* Unless it is retried, the selected command is removed from its queue (also */
+/* for a command without response, which has no transaction)                  */
+/*----------------------------------------------------------------------------*/
+
+e_trsEnd trs_End( s_trsLink * io_pTrs, RESULT i_rRes )
+{
+   e_trsEnd eEnd ;
+   s_trsPolicy C* pPolicy ;
+   s_trsCmdStat * pCmdStat ;
+   DWORD dwLat ;
+   BYTE byBucket ;
+
+   eEnd = TRS_END_OK ;
+   pPolicy = io_pTrs->pPolicy ;
+   pCmdStat = trs_GetCmdStat( io_pTrs ) ;
+
+   if ( io_pTrs->bPending )            /* no transaction for command without */
+   {                                   /* response */
+      io_pTrs->bPending = FALSE ;
+      io_pTrs->dwTmpTimeout = 0 ;
+
+      if ( i_rRes == OK )
+      {
+         dwLat = HAL_GetTick() - io_pTrs->dwStartTick ;
+         io_pTrs->dwLatLast = dwLat ;
+         io_pTrs->dwLatMax = GETMAX( io_pTrs->dwLatMax, dwLat ) ;
+         io_pTrs->dwNbOk++ ;
+         io_pTrs->byNbRetry = 0 ;
+                                       /* log scale histogram bucket */
+         byBucket = 0 ;
+         while ( ( byBucket < ( TRS_HIST_NB - 1 ) ) &&
+                 ( ( dwLat >> ( TRS_HIST_SHIFT * ( byBucket + 1 ) ) ) != 0 ) )
+         {
+            byBucket++ ;
+         }
+         trs_IncCnt( &pCmdStat->awHist[byBucket] ) ;
+      }
+      else
+      {
+         io_pTrs->dwNbErr++ ;
+
+         if ( io_pTrs->byNbRetry >= pPolicy->byMaxRetry )
+         {
+            io_pTrs->dwNbFail++ ;
+            io_pTrs->byNbRetry = 0 ;
+            eEnd = TRS_END_FAIL ;
+         }
+         else
+         {
+            io_pTrs->byNbRetry++ ;
+            trs_IncCnt( &pCmdStat->wNbRetry ) ;
+                                       /* exponential backoff before retry */
+            io_pTrs->wBackoff = GETMIN( (DWORD)pPolicy->wBackoffMin <<
+                                        GETMIN( io_pTrs->byNbRetry - 1, TRS_BACKOFF_SHIFT_MAX ),
+                                        pPolicy->wBackoffMax ) ;
+            tim_StartMsTmp( &io_pTrs->dwTmpBackoff ) ;
+            eEnd = TRS_END_RETRY ;
+         }
+      }
+   }
+
+   if ( eEnd != TRS_END_RETRY )        /* command is over */
+   {
+      trs_DropCur( io_pTrs ) ;
+   }
+
+   return eEnd ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Get current retry number (0 if the last transaction is OK)                 */
+/*----------------------------------------------------------------------------*/
+
+BYTE trs_GetNbRetry( s_trsLink C* i_pTrs )
+{
+   return i_pTrs->byNbRetry ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Format link statistics : transactions, valid responses, errors (including  */
+/* timeouts), timeouts, failures after all retries, last and maximum response */
+/* latency (ms)                                                               */
+/*----------------------------------------------------------------------------*/
+
+void trs_FmtStat( s_trsLink C* i_pTrs, CHAR * o_pszStat, WORD i_wSize )
+{
+   snprintf( o_pszStat, i_wSize, "%lu, %lu, %lu, %lu, %lu, %lu, %lu",
+             i_pTrs->dwNbStart, i_pTrs->dwNbOk, i_pTrs->dwNbErr,
+             i_pTrs->dwNbTimeout, i_pTrs->dwNbFail,
+             i_pTrs->dwLatLast, i_pTrs->dwLatMax ) ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Format per command statistics : current queue depth, then for each used    */
+/* command : " <index>:<bucket 0>/.../<bucket 7>/<timeouts>/<retries>"        */
+/*    - i_byQueueDepth : current number of queued commands (given by link)    */
+/*----------------------------------------------------------------------------*/
+
+void trs_FmtHist( s_trsLink C* i_pTrs, BYTE i_byQueueDepth, CHAR * o_pszHist, WORD i_wSize )
+{
+   s_trsCmdStat C* pCmdStat ;
+   BYTE byCmdIdx ;
+   BYTE byIdx ;
+   DWORD dwUsed ;
+   WORD wLen ;
+   SWORD swRet ;
+
+   wLen = snprintf( o_pszHist, i_wSize, "%u", i_byQueueDepth ) ;
+
+   for ( byCmdIdx = 0 ; byCmdIdx < i_pTrs->byNbCmd ; byCmdIdx++ )
+   {
+      pCmdStat = &i_pTrs->aCmdStat[byCmdIdx] ;
+
+      dwUsed = pCmdStat->wNbTimeout + pCmdStat->wNbRetry ;
+      for ( byIdx = 0 ; byIdx < TRS_HIST_NB ; byIdx++ )
+      {
+         dwUsed += pCmdStat->awHist[byIdx] ;
+      }
+                                       /* only used commands, if space left */
+      if ( ( dwUsed != 0 ) && ( wLen < i_wSize ) )
+      {
+         swRet = snprintf( &o_pszHist[wLen], i_wSize - wLen,
+                           " %u:%u/%u/%u/%u/%u/%u/%u/%u/%u/%u", byCmdIdx,
+                           pCmdStat->awHist[0], pCmdStat->awHist[1],
+                           pCmdStat->awHist[2], pCmdStat->awHist[3],
+                           pCmdStat->awHist[4], pCmdStat->awHist[5],
+                           pCmdStat->awHist[6], pCmdStat->awHist[7],
+                           pCmdStat->wNbTimeout, pCmdStat->wNbRetry ) ;
+         if ( swRet > 0 )
+         {
+            wLen += swRet ;
+         }
+      }
+   }
+}
+
+
+/*============================================================================*/
+
+/*----------------------------------------------------------------------------*/
+/* Get statistics of current command                                          */
+/*----------------------------------------------------------------------------*/
+
+static s_trsCmdStat * trs_GetCmdStat( s_trsLink * io_pTrs )
+{
+   BYTE byCmdIdx ;
+                                       /* defensive programming */
+   byCmdIdx = GETMIN( io_pTrs->byCmdIdx, io_pTrs->byNbCmd - 1 ) ;
+
+   return &io_pTrs->aCmdStat[byCmdIdx] ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Increment saturated counter                                                */
+/*----------------------------------------------------------------------------*/
+
+static void trs_IncCnt( WORD * io_pwCnt )
+{
+   if ( *io_pwCnt < WORD_MAX )
+   {
+      (*io_pwCnt)++ ;
+   }
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Get item <i_byIdx> of queue                                                */
+/*----------------------------------------------------------------------------*/
+
+static s_trsItem * trs_GetItem( s_trsQueue C* i_pQueue, BYTE i_byIdx )
+{
+   return (s_trsItem*)&i_pQueue->pbyItems[ (DWORD)i_byIdx * i_pQueue->wItemSize ] ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Get next index of queue                                                    */
+/*----------------------------------------------------------------------------*/
+
+static BYTE trs_NextIdx( s_trsQueue C* i_pQueue, BYTE i_byIdx )
+{
+   return ( i_byIdx + 1 ) % i_pQueue->byNbItem ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Remove the selected command from its queue                                 */
+/*----------------------------------------------------------------------------*/
+
+static void trs_DropCur( s_trsLink * io_pTrs )
+{
+   s_trsQueue * pQueue ;
+
+   if ( io_pTrs->bSelect )
+   {
+      pQueue = &io_pTrs->aQueue[io_pTrs->byQueueCur] ;
+
+      if ( pQueue->byIdxOut != pQueue->byIdxIn )   /* defensive programming */
+      {
+         pQueue->byIdxOut = trs_NextIdx( pQueue, pQueue->byIdxOut ) ;
+      }
+      io_pTrs->bSelect = FALSE ;
+   }
+}
@@ -89,17 +89,20 @@
 /* CommOEvse.c                                                                 */
 /*----------------------------------------------------------------------------*/
 
-#define COEVSE_CMD_NULL( NameUp, NameLo, StrCmd, StrCk )
+#define COEVSE_CMD_NULL( NameUp, NameLo, StrCmd, StrCk, Lane, Coal )
 
-#define COEVSE_CMD_ENUM( NameUp, NameLo, StrCmd, StrCk ) COEVSE_CMD_##NameUp,
+#define COEVSE_CMD_ENUM( NameUp, NameLo, StrCmd, StrCk, Lane, Coal ) COEVSE_CMD_##NameUp,
 
-#define COEVSE_CMD_CALLBACK( NameUp, NameLo, StrCmd, StrCk ) \
-   static void coevse_Cmdresult##NameLo( char C* i_pszDataRes ) ;
+#define COEVSE_CMD_CALLBACK( NameUp, NameLo, StrCmd, StrCk, Lane, Coal ) \
+   static void coevse_Cmdresult##NameLo( char C* i_pszDataRes,  \
+                                         s_coevseResFields C* i_pFields ) ;
 
-#define COEVSE_CMD_DESC( NameUp, NameLo, StrCmd, StrCk ) \
+#define COEVSE_CMD_DESC( NameUp, NameLo, StrCmd, StrCk, Lane, Coal ) \
    { .eCmdId = COEVSE_CMD_##NameUp, .szFmtCmd = (StrCmd), \
-     .szChecksum = (StrCk), .fResultCallback = NULL },
+     .szChecksum = (StrCk), .fResultCallback = NULL, \
+     .eLane = COEVSE_LANE_##Lane, .eCoal = COEVSE_COAL_##Coal },
 
-#define COEVSE_CMD_DESC_G( NameUp, NameLo, StrCmd, StrCk ) \
+#define COEVSE_CMD_DESC_G( NameUp, NameLo, StrCmd, StrCk, Lane, Coal ) \
    { .eCmdId = COEVSE_CMD_##NameUp, .szFmtCmd = (StrCmd), \
-     .szChecksum = (StrCk), .fResultCallback = coevse_Cmdresult##NameLo },
+     .szChecksum = (StrCk), .fResultCallback = coevse_Cmdresult##NameLo, \
+     .eLane = COEVSE_LANE_##Lane, .eCoal = COEVSE_COAL_##Coal },
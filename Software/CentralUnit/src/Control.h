@@ -34,8 +34,45 @@
 /* SysLed.c                                                                   */
 /*----------------------------------------------------------------------------*/
 
+typedef enum                           /* status Leds */
+{
+   SYSLED_LED_WIFI = 0,                /* wifi RGB Led */
+   SYSLED_LED_CHARGE,                  /* charge RGB Led */
+   SYSLED_LED_SYS,                     /* system Led (nucleo board) */
+   SYSLED_LED_LAST
+} e_sysledLed ;
+
+typedef enum                           /* Leds patterns */
+{
+   SYSLED_PAT_OFF = 0,                 /* steady off */
+   SYSLED_PAT_ON,                      /* steady on */
+   SYSLED_PAT_BLINK,                   /* 1 Hz blinking */
+   SYSLED_PAT_BLINK_FAST,              /* 5 Hz blinking */
+   SYSLED_PAT_HEARTBEAT,               /* two flashes, then pause */
+   SYSLED_PAT_ERR_1,                   /* error codes : 1 to 5 flashes, */
+   SYSLED_PAT_ERR_2,                   /* then pause                    */
+   SYSLED_PAT_ERR_3,
+   SYSLED_PAT_ERR_4,
+   SYSLED_PAT_ERR_5,
+   SYSLED_PAT_LAST
+} e_sysledPat ;
+
 void sysled_Init( void ) ;
-void sysled_TaskCyc( void ) ;
+void sysled_SetPattern( e_sysledLed i_eLed, e_sysledPat i_ePat ) ;
+
+
+/*----------------------------------------------------------------------------*/
+/* Button.c                                                                   */
+/*----------------------------------------------------------------------------*/
+
+typedef enum                           /* button gestures (EVT_BUTTON) */
+{
+   BTN_PRESS = 1,                      /* short press */
+   BTN_LONG_PRESS,                     /* long press (5 sec) */
+   BTN_DOUBLE_PRESS,                   /* two short presses */
+} e_btnGesture ;
+
+void btn_Init( void ) ;
 
 
 /*----------------------------------------------------------------------------*/
@@ -62,8 +99,24 @@ typedef enum                     /* FSM charge state */
    CSTATE_ON_WAIT,               /* calendar enabled and waiting for EV, charge enabled */
    CSTATE_CHARGING,              /* charging in progress, charge enabled */
    CSTATE_EOC_LOWCUR,            /* end of charge for low current, charge disabled */
+   CSTATE_LAST
 } e_cstateChargeSt ;
 
+typedef enum                     /* charge state change reason */
+{
+   CSTATE_REASON_NONE,
+   CSTATE_REASON_INIT,           /* start-up */
+   CSTATE_REASON_FORCE,          /* force mode set */
+   CSTATE_REASON_UNFORCE,        /* force mode cleared */
+   CSTATE_REASON_CAL_ON,         /* calendar period start */
+   CSTATE_REASON_CAL_OFF,        /* calendar period end */
+   CSTATE_REASON_EV_CHARGE,      /* EV starts charging */
+   CSTATE_REASON_EV_STOP,        /* EV stops charging */
+   CSTATE_REASON_EOC_LOWCUR,     /* charge current below minimum */
+   CSTATE_REASON_PLUG,           /* EV plugged, state unchanged */
+   CSTATE_REASON_LAST
+} e_cstateReason ;
+
 typedef enum                     /* forced charge status */
 {
    CSTATE_FORCE_NONE,            /* no force */
@@ -76,16 +129,64 @@ typedef enum                     /* forced charge status */
 
 void cstate_Init( void ) ;
 
+#define CSTATE_EOC_DWELL_MAX       3600   /* maximum end of charge dwell time (sec) */
+#define CSTATE_EOC_ENERGY_MAX     10000   /* maximum end of charge energy delta (Wh) */
+#define CSTATE_EOC_FILTER_MAX         6   /* maximum current average factor (1/2^n) */
+
 void cstate_SetCurrentMinStop( DWORD i_dwCurrentMinStop ) ;
 DWORD cstate_GetCurrentMinStop( void ) ;
+void cstate_SetEocParam( DWORD i_dwDwellSec, DWORD i_dwEnergyWh, DWORD i_dwFilter ) ;
+void cstate_FmtEoc( CHAR * o_pszStr, WORD i_wSize ) ;
 
 void cstate_ToggleForce( void ) ;
 e_cstateForceSt cstate_GetForceState( void ) ;
 e_cstateChargeSt cstate_GetChargeState( void ) ;
 
 void cstate_GetHistState( CHAR * o_pszHistState, WORD i_wSize ) ;
+WORD cstate_ReadHistRec( DWORD i_dwOffset, CHAR * o_pszHistRec, WORD i_wSize ) ;
+void cstate_FmtStateStat( CHAR * o_pszStat, WORD i_wSize ) ;
+
+BYTE cstate_GetSessIdx( BYTE i_byAge ) ;
+WORD cstate_ReadSessRec( DWORD i_dwOffset, CHAR * o_pszSessRec, WORD i_wSize ) ;
+void cstate_UnpackTime( DWORD i_dwTime, s_DateTime * o_psDateTime ) ;
 
 void cstate_TaskCyc( void ) ;
 
 
+/*----------------------------------------------------------------------------*/
+/* LoadMgmt.c                                                                 */
+/*----------------------------------------------------------------------------*/
+
+#define LMGT_POWER_MAX        99999    /* maximum household power (W) */
+
+void lmgt_Init( void ) ;
+void lmgt_SetHousePower( DWORD i_dwPower ) ;
+RESULT lmgt_SetHousePowerStr( char C* i_pszArg ) ;
+void lmgt_SetPlanCap( BYTE i_byCurrent ) ;
+void lmgt_SetUserCap( BYTE i_byCurrent ) ;
+BYTE lmgt_GetUserCap( void ) ;
+void lmgt_FmtStat( CHAR * o_pszStr, WORD i_wSize ) ;
+void lmgt_TaskCyc( void ) ;
+
+
+/*----------------------------------------------------------------------------*/
+/* ChargePlan.c                                                               */
+/*----------------------------------------------------------------------------*/
+
+#define CPLAN_ENERGY_MAX      100000   /* maximum target energy (Wh) */
+#define CPLAN_DUR_MAX         ( 7 * 24 * 60 )  /* maximum plan duration (min) */
+#define CPLAN_PRICE_MAX       WORD_MAX /* maximum tariff price */
+
+void cplan_Init( void ) ;
+RESULT cplan_Start( DWORD i_dwEnergyWh, DWORD i_dwDurMin ) ;
+void cplan_Stop( void ) ;
+BOOL cplan_IsActive( void ) ;
+BOOL cplan_IsChargeSlot( void ) ;
+RESULT cplan_SetTariff( BYTE i_byIdx, BYTE i_byDays, BYTE i_byStart,
+                        BYTE i_byEnd, WORD i_wPrice ) ;
+void cplan_SetPriceDef( WORD i_wPrice ) ;
+void cplan_FmtPlan( CHAR * o_pszStr, WORD i_wSize ) ;
+void cplan_FmtTariff( CHAR * o_pszStr, WORD i_wSize ) ;
+
+
 #endif /* __CONTROL_H */
\ No newline at end of file
@@ -0,0 +1,260 @@
+/******************************************************************************/
+/*                                  Button.c                                  */
+/******************************************************************************/
+/*
+   User push button management
+
+   Copyright (C) 2018  Sylvain BASSET
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+   ------------
+   @version 1.0
+   @history 1.0, 19 oct. 2019, creation
+   @brief
+   The button is fully handled under interrupt, the main loop does not poll
+   it :
+      - each button pin edge (EXTI interrupt) masks the EXTI line and starts
+        the TIMBTN one-shot timer for BTN_FLT_DUR (debounce),
+      - at the end of the debounce time, the pin level is read and the EXTI
+        line is enabled again. A level change is a press or a release,
+      - the timer is then started again for the next gesture timeout (long
+        press duration while pressed, double press window after a release).
+
+   Gestures are published on the event bus (EVT_BUTTON, e_btnGesture) :
+      - BTN_PRESS : short press, not followed by another press within
+        BTN_DOUBLE_DUR,
+      - BTN_LONG_PRESS : pressed during BTN_LONGPRESS_DUR, published without
+        waiting for the release,
+      - BTN_DOUBLE_PRESS : second short press within BTN_DOUBLE_DUR.
+*/
+
+
+#include <stm32l0xx_hal.h>
+#include "Define.h"
+#include "Control.h"
+#include "System.h"
+#include "System/Hard.h"
+
+
+/*----------------------------------------------------------------------------*/
+/* Defines                                                                    */
+/*----------------------------------------------------------------------------*/
+
+#define BTN_FLT_DUR             50     /* debounce duration (ms) */
+#define BTN_LONGPRESS_DUR     5000     /* long press duration (ms) */
+#define BTN_DOUBLE_DUR         400     /* double press window after release (ms) */
+
+#define TIMBTN_FREQ        1000llu     /* timer counter frequency (Hz) */
+
+
+/*----------------------------------------------------------------------------*/
+/* Types                                                                      */
+/*----------------------------------------------------------------------------*/
+
+typedef struct
+{
+   BOOL bFlt ;                         /* debounce in progress */
+   BOOL bPressed ;                     /* debounced button state */
+   BOOL bLong ;                        /* long press published for this press */
+   BYTE byNbPress ;                    /* short presses waiting for gesture end */
+   DWORD dwTickPress ;                 /* last press time (ms) */
+   DWORD dwTickRelease ;               /* last release time (ms) */
+} s_btnState ;
+
+
+/*----------------------------------------------------------------------------*/
+/* Variables                                                                  */
+/*----------------------------------------------------------------------------*/
+
+static s_btnState l_Btn ;
+
+
+/*----------------------------------------------------------------------------*/
+/* Prototypes                                                                 */
+/*----------------------------------------------------------------------------*/
+
+static void btn_StartTimer( DWORD i_dwDur ) ;
+static void btn_HrdInit( void ) ;
+
+
+/*----------------------------------------------------------------------------*/
+/* Module initialization                                                      */
+/*----------------------------------------------------------------------------*/
+
+void btn_Init( void )
+{
+   memset( &l_Btn, 0, sizeof(l_Btn) ) ;
+
+   btn_HrdInit() ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* IRQ button pin edge : start debounce                                       */
+/*----------------------------------------------------------------------------*/
+
+void BTN_EXTI_IRQHandler( void )
+{
+   EXTI->IMR &= ~CSTATE_BUTTON_P2_PIN ; /* no more edge during debounce */
+   EXTI->PR = CSTATE_BUTTON_P2_PIN ;   /* clear pending edge */
+
+   l_Btn.bFlt = TRUE ;
+   btn_StartTimer( BTN_FLT_DUR ) ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* IRQ button timer : end of debounce, or gesture timeout                     */
+/*----------------------------------------------------------------------------*/
+
+void TIMBTN_IRQHandler( void )
+{
+   BOOL bLevel ;
+   DWORD dwTick ;
+   DWORD dwElapsed ;
+   DWORD dwNextDur ;
+
+   TIMBTN->SR = ~TIM_SR_UIF ;          /* clear update interrupt flag */
+
+   dwTick = HAL_GetTick() ;
+   dwNextDur = 0 ;
+
+   if ( l_Btn.bFlt )
+   {                                   /* end of debounce : edges allowed again */
+      l_Btn.bFlt = FALSE ;
+      EXTI->PR = CSTATE_BUTTON_P2_PIN ;
+      EXTI->IMR |= CSTATE_BUTTON_P2_PIN ;
+
+      bLevel = ISSET( CSTATE_BUTTON_P2_GPIO->IDR, CSTATE_BUTTON_P2_PIN ) ;
+
+      if ( bLevel && ! l_Btn.bPressed )
+      {                                /* press */
+         l_Btn.bPressed = TRUE ;
+         l_Btn.bLong = FALSE ;
+         l_Btn.dwTickPress = dwTick ;
+      }
+      else if ( ( ! bLevel ) && l_Btn.bPressed )
+      {                                /* release */
+         l_Btn.bPressed = FALSE ;
+         l_Btn.dwTickRelease = dwTick ;
+
+         if ( ! l_Btn.bLong )
+         {
+            l_Btn.byNbPress++ ;
+         }
+         if ( l_Btn.byNbPress >= 2 )
+         {
+            evt_Publish( EVT_BUTTON, BTN_DOUBLE_PRESS ) ;
+            l_Btn.byNbPress = 0 ;
+         }
+      }
+   }
+                                       /* gesture timeouts */
+   if ( l_Btn.bPressed && ( ! l_Btn.bLong ) )
+   {
+      dwElapsed = dwTick - l_Btn.dwTickPress ;
+
+      if ( dwElapsed >= BTN_LONGPRESS_DUR )
+      {
+         evt_Publish( EVT_BUTTON, BTN_LONG_PRESS ) ;
+         l_Btn.bLong = TRUE ;
+         l_Btn.byNbPress = 0 ;
+      }
+      else
+      {
+         dwNextDur = BTN_LONGPRESS_DUR - dwElapsed ;
+      }
+   }
+   else if ( ( ! l_Btn.bPressed ) && ( l_Btn.byNbPress != 0 ) )
+   {
+      dwElapsed = dwTick - l_Btn.dwTickRelease ;
+
+      if ( dwElapsed >= BTN_DOUBLE_DUR )
+      {
+         evt_Publish( EVT_BUTTON, BTN_PRESS ) ;
+         l_Btn.byNbPress = 0 ;
+      }
+      else
+      {
+         dwNextDur = BTN_DOUBLE_DUR - dwElapsed ;
+      }
+   }
+
+   if ( dwNextDur != 0 )
+   {
+      btn_StartTimer( dwNextDur ) ;
+   }
+}
+
+
+/*============================================================================*/
+
+/*----------------------------------------------------------------------------*/
+/* Start button one-shot timer for <i_dwDur> ms                               */
+/*----------------------------------------------------------------------------*/
+
+static void btn_StartTimer( DWORD i_dwDur )
+{
+   TIMBTN->CR1 = TIM_CR1_URS ;         /* stop timer, update event by overflow only */
+   TIMBTN->ARR = (WORD)( GETMIN( i_dwDur, WORD_MAX ) - 1 ) ;
+   TIMBTN->CNT = 0 ;
+   TIMBTN->SR = 0 ;
+   TIMBTN->CR1 = TIM_CR1_URS | TIM_CR1_OPM | TIM_CR1_CEN ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Hardware initialization for button pins, EXTI line and timer               */
+/*----------------------------------------------------------------------------*/
+
+static void btn_HrdInit( void )
+{
+   GPIO_InitTypeDef sGpioInit ;
+
+      /* configure button 1 pin as output, no push/pull, high freq */
+   sGpioInit.Pin = CSTATE_BUTTON_P1_PIN ;
+   sGpioInit.Mode = GPIO_MODE_OUTPUT_PP ;
+   sGpioInit.Pull = GPIO_NOPULL ;
+   sGpioInit.Speed = GPIO_SPEED_FREQ_HIGH ;
+   sGpioInit.Alternate = CSTATE_BUTTON_P1_AF ;
+   HAL_GPIO_Init( CSTATE_BUTTON_P1_GPIO, &sGpioInit ) ;
+
+   HAL_GPIO_WritePin( CSTATE_BUTTON_P1_GPIO, CSTATE_BUTTON_P1_PIN, GPIO_PIN_SET ) ;
+
+      /* configure button 2 pin as input, pull-down, interrupt on both edges */
+   sGpioInit.Pin = CSTATE_BUTTON_P2_PIN ;
+   sGpioInit.Mode = GPIO_MODE_IT_RISING_FALLING ;
+   sGpioInit.Pull = GPIO_PULLDOWN ;
+   sGpioInit.Speed = GPIO_SPEED_FREQ_HIGH ;
+   sGpioInit.Alternate = CSTATE_BUTTON_P2_AF ;
+   HAL_GPIO_Init( CSTATE_BUTTON_P2_GPIO, &sGpioInit ) ;
+
+   TIMBTN_CLK_ENABLE() ;               /* enable button timer clock */
+
+   TIMBTN->CR1 = TIM_CR1_URS ;         /* timer stopped */
+   TIMBTN->PSC = ( APB1_CLK / TIMBTN_FREQ ) - 1 ;
+   TIMBTN->EGR = TIM_EGR_UG ;          /* load prescaler */
+   TIMBTN->SR = 0 ;
+   TIMBTN->DIER = TIM_DIER_UIE ;       /* enable update interruption */
+
+                                       /* same priority : no nesting between */
+                                       /* edge and timer interrupts          */
+   HAL_NVIC_SetPriority( TIMBTN_IRQn, BTN_IRQPri, 0 ) ;
+   HAL_NVIC_EnableIRQ( TIMBTN_IRQn ) ;
+
+   EXTI->PR = CSTATE_BUTTON_P2_PIN ;
+   HAL_NVIC_SetPriority( BTN_EXTI_IRQn, BTN_IRQPri, 0 ) ;
+   HAL_NVIC_EnableIRQ( BTN_EXTI_IRQn ) ;
+}
@@ -29,7 +29,10 @@
    eeprom for power-off retention. They are recovered at initialisation.
    cal_GetDayVals() is used to get start and end time of charing for one day.
    And cal_IsChargeEnable() allows to determine if charge is enable at this
-   instant.
+   instant. While a charge plan is running (see ChargePlan.c), its slot
+   decision replaces the calendar periods.
+   Charge enable changes are also published on the event bus (EVT_CHARGE_ENABLE),
+   the state is re-evaluated on each clock second tick and on calendar change.
 */
 
 
@@ -61,6 +64,8 @@ static DWORD l_adwTimeSecStart [ NB_DAYS_WEEK ] ;
                                        /* table of ending times in second */
 static DWORD l_adwTimeSecEnd [ NB_DAYS_WEEK ] ;
 
+static BOOL l_bChargeEnable ;          /* last published charge enable state */
+
 
 /*----------------------------------------------------------------------------*/
 /* Prototypes                                                                 */
@@ -68,6 +73,8 @@ static DWORD l_adwTimeSecEnd [ NB_DAYS_WEEK ] ;
 
 static DWORD cal_CalcCntFromStruct( s_Time C* i_psTime ) ;
 static void cal_CalcStructFromCnt( DWORD i_dwTimeSec, s_Time * o_pTime ) ;
+static void cal_EvtClockSec( e_evtId i_eEvtId, DWORD i_dwValue ) ;
+static void cal_UpdateChargeEnable( void ) ;
 
 
 /*----------------------------------------------------------------------------*/
@@ -104,6 +111,9 @@ void cal_Init( void )
                                        /* set ending time */
       l_adwTimeSecEnd[byWeekDay] = dwTimeSecEnd ;
    }
+
+   l_bChargeEnable = FALSE ;
+   evt_Subscribe( EVT_CLOCK_SEC, &cal_EvtClockSec ) ;
 }
 
 
@@ -159,6 +169,8 @@ void cal_SetDayVals( BYTE i_byWeekday, s_Time C* i_pStartTime, s_Time C* i_pEndT
    eep_write( (DWORD)&g_sDataEeprom->sCalData.adwTimeSecStart[i_byWeekday], dwStartValue ) ;
                                        /* write ending time in eeprom */
    eep_write( (DWORD)&g_sDataEeprom->sCalData.adwTimeSecEnd[i_byWeekday], dwEndValue ) ;
+
+   cal_UpdateChargeEnable() ;
 }
 
 
@@ -257,12 +269,48 @@ BOOL cal_IsChargeEnable( void )
       }
    }
 
+   if ( cplan_IsActive() )             /* charge plan overrides calendar */
+   {
+      bRet = cplan_IsChargeSlot() ;
+   }
+
    return bRet ;
 }
 
 
 /*============================================================================*/
 
+/*----------------------------------------------------------------------------*/
+/* Clock second tick event callback                                           */
+/*----------------------------------------------------------------------------*/
+
+static void cal_EvtClockSec( e_evtId i_eEvtId, DWORD i_dwValue )
+{
+   USEPARAM( i_eEvtId ) ;
+   USEPARAM( i_dwValue ) ;
+
+   cal_UpdateChargeEnable() ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Publish charge enable state if it has changed                              */
+/*----------------------------------------------------------------------------*/
+
+static void cal_UpdateChargeEnable( void )
+{
+   BOOL bChargeEnable ;
+
+   bChargeEnable = cal_IsChargeEnable() ;
+
+   if ( bChargeEnable != l_bChargeEnable )
+   {
+      l_bChargeEnable = bChargeEnable ;
+      evt_Publish( EVT_CHARGE_ENABLE, bChargeEnable ) ;
+   }
+}
+
+
 /*----------------------------------------------------------------------------*/
 /* Calculate second count representation of a particular time.                */
 /*    - <i_psTime> time structure to convert                                  */
@@ -0,0 +1,583 @@
+/******************************************************************************/
+/*                                ChargePlan.c                                */
+/******************************************************************************/
+/*
+   Tariff-aware charge planner
+
+   Copyright (C) 2018  Sylvain BASSET
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+   ------------
+   @version 1.0
+   @history 1.0, 19 oct. 2019, creation
+   @brief
+   A charge plan is started by cplan_Start() with a target energy (Wh) and
+   a departure delay (minutes, up to one week). The week is divided in
+   CPLAN_SLOT_DUR slots (15 minutes), each slot has a price given by the
+   tariff table.
+
+   The tariff table (CPLAN_TARIFF_NB periods) is stored in eeprom, and read
+   in place. Each period gives a week days mask (bit 0 : Monday), a start and
+   an end slot of the day (end excluded, end lower than start for a period
+   over midnight) and a price (any unit). The first matching period gives
+   the slot price, the default price is used for the other slots.
+
+   At each slot start, the plan is computed again for the remaining energy
+   (target minus energy delivered since plan start) up to the departure :
+   slots are counted by price level, and levels are taken from the cheapest
+   one until the remaining energy is reached at maximum current (user
+   capacity). All slots cheaper than this threshold level are charged at
+   maximum current, threshold level slots are all charged at one current
+   spreading the remaining energy evenly over them (rounded up, not lower
+   than COEVSE_CURRENT_CAPMAX_MIN : the target may be reached before the
+   last ones, which ends the plan). If the energy can't be reached before
+   departure, all slots are charged at maximum current.
+
+   Only the current slot decision is kept : the computation needs a few
+   bytes of stack per price level and one pass over the horizon slots
+   (CPLAN_HORIZON_MAX at most), run once per slot.
+
+   While a plan is active, its decision replaces the calendar one in
+   cal_IsChargeEnable(), and the slot current is given to load management
+   (lmgt_SetPlanCap()). The plan ends at departure, when target energy is
+   reached, or if date/time is lost.
+*/
+
+
+#include <stm32l0xx_hal.h>
+#include "Define.h"
+#include "Control.h"
+#include "Communic.h"
+#include "System.h"
+
+
+/*----------------------------------------------------------------------------*/
+/* Defines                                                                    */
+/*----------------------------------------------------------------------------*/
+
+#define CPLAN_SLOT_DUR           ( 15 * 60 )  /* slot duration (sec) */
+#define CPLAN_SLOT_PER_DAY       ( ( 24 * 60 * 60 ) / CPLAN_SLOT_DUR )
+#define CPLAN_HORIZON_MAX        ( NB_DAYS_WEEK * CPLAN_SLOT_PER_DAY )
+#define CPLAN_SLOT_NONE          WORD_MAX     /* no slot computed yet */
+
+#define CPLAN_VOLTAGE            230          /* mains nominal voltage (V) */
+#define CPLAN_SLOT_PER_HOUR      ( ( 60 * 60 ) / CPLAN_SLOT_DUR )
+
+#define CPLAN_LEVEL_NB           ( CPLAN_TARIFF_NB + 1 )  /* periods and default price */
+
+                                       /* tariff period eeprom coding */
+#define CPLAN_PERIOD( Days, Start, End ) \
+   ( ( (DWORD)(Days) << 16 ) | ( (DWORD)(Start) << 8 ) | (DWORD)(End) )
+#define CPLAN_PERIOD_DAYS( Period )    ( (BYTE)( (Period) >> 16 ) & 0x7F )
+#define CPLAN_PERIOD_START( Period )   ( (BYTE)( (Period) >> 8 ) )
+#define CPLAN_PERIOD_END( Period )     ( (BYTE)(Period) )
+
+
+/*----------------------------------------------------------------------------*/
+/* Types                                                                      */
+/*----------------------------------------------------------------------------*/
+
+typedef struct
+{
+   BOOL bActive ;                      /* a plan is running */
+   DWORD dwTargetWh ;                  /* target energy (Wh) */
+   DWORD dwEnergyStart ;               /* OpenEVSE energy at plan start (Wh) */
+   DWORD dwRemainWh ;                  /* remaining energy (Wh) */
+   DWORD dwEndSec ;                    /* departure time (seconds since start-up) */
+   WORD wSlotCur ;                     /* current week slot, CPLAN_SLOT_NONE if none */
+   WORD wNbSlot ;                      /* number of slots up to departure */
+   WORD wPriceThr ;                    /* highest price level used by the plan */
+   BOOL bShort ;                       /* target can't be reached before departure */
+   BOOL bChargeSlot ;                  /* current slot is charged */
+   BYTE byCap ;                        /* current slot current capacity (A) */
+   DWORD dwComputeMs ;                 /* last computation duration (ms) */
+} s_cplanState ;
+
+
+/*----------------------------------------------------------------------------*/
+/* Variables                                                                  */
+/*----------------------------------------------------------------------------*/
+
+static s_cplanState l_Plan ;
+
+
+/*----------------------------------------------------------------------------*/
+/* Prototypes                                                                 */
+/*----------------------------------------------------------------------------*/
+
+static void cplan_EvtClockSec( e_evtId i_eEvtId, DWORD i_dwValue ) ;
+static void cplan_End( void ) ;
+static void cplan_Compute( BYTE i_byWeekday, BYTE i_bySlotDay ) ;
+static WORD cplan_GetPrice( BYTE i_byWeekday, BYTE i_bySlotDay ) ;
+static BYTE cplan_GetLevels( WORD * o_pawLevel ) ;
+static BYTE cplan_GetLevelIdx( WORD C* i_pawLevel, BYTE i_byNbLevel, WORD i_wPrice ) ;
+
+
+/*----------------------------------------------------------------------------*/
+/* Module initialization                                                      */
+/*----------------------------------------------------------------------------*/
+
+void cplan_Init( void )
+{
+   memset( &l_Plan, 0, sizeof(l_Plan) ) ;
+   l_Plan.wSlotCur = CPLAN_SLOT_NONE ;
+
+   evt_Subscribe( EVT_CLOCK_SEC, &cplan_EvtClockSec ) ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Start a charge plan                                                        */
+/*    - <i_dwEnergyWh> target energy (Wh)                                     */
+/*    - <i_dwDurMin> delay before departure (minutes)                         */
+/* Return:                                                                    */
+/*    - OK if plan is started                                                 */
+/*----------------------------------------------------------------------------*/
+
+RESULT cplan_Start( DWORD i_dwEnergyWh, DWORD i_dwDurMin )
+{
+   RESULT rRet ;
+
+   if ( ( i_dwEnergyWh == 0 ) || ( i_dwEnergyWh > CPLAN_ENERGY_MAX ) ||
+        ( i_dwDurMin == 0 ) || ( i_dwDurMin > CPLAN_DUR_MAX ) ||
+        clk_IsDateTimeLost() )
+   {
+      rRet = ERR ;
+   }
+   else
+   {
+      l_Plan.bActive = TRUE ;
+      l_Plan.dwTargetWh = i_dwEnergyWh ;
+      l_Plan.dwRemainWh = i_dwEnergyWh ;
+      l_Plan.dwEnergyStart = coevse_GetEnergy() ;
+      l_Plan.dwEndSec = tim_GetSecCnt() + ( i_dwDurMin * 60 ) ;
+      l_Plan.wSlotCur = CPLAN_SLOT_NONE ;    /* computed at next second tick */
+      l_Plan.bChargeSlot = FALSE ;
+      rRet = OK ;
+   }
+
+   return rRet ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Stop the running charge plan                                               */
+/*----------------------------------------------------------------------------*/
+
+void cplan_Stop( void )
+{
+   if ( l_Plan.bActive )
+   {
+      cplan_End() ;
+   }
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Is a charge plan running                                                   */
+/*----------------------------------------------------------------------------*/
+
+BOOL cplan_IsActive( void )
+{
+   return l_Plan.bActive ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Is the current slot charged by the plan                                    */
+/*----------------------------------------------------------------------------*/
+
+BOOL cplan_IsChargeSlot( void )
+{
+   return ( l_Plan.bActive && l_Plan.bChargeSlot ) ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Set a tariff period                                                        */
+/*    - <i_byIdx> period index (0 to CPLAN_TARIFF_NB - 1)                     */
+/*    - <i_byDays> week days mask (bit 0 : Monday), 0 to clear the period     */
+/*    - <i_byStart> first slot of the day                                     */
+/*    - <i_byEnd> slot of the day following the period                        */
+/*    - <i_wPrice> slot price                                                 */
+/* Return:                                                                    */
+/*    - OK if period is valid                                                 */
+/*----------------------------------------------------------------------------*/
+
+RESULT cplan_SetTariff( BYTE i_byIdx, BYTE i_byDays, BYTE i_byStart,
+                        BYTE i_byEnd, WORD i_wPrice )
+{
+   RESULT rRet ;
+
+   if ( ( i_byIdx >= CPLAN_TARIFF_NB ) || ( i_byDays > 0x7F ) ||
+        ( i_byStart > CPLAN_SLOT_PER_DAY ) || ( i_byEnd > CPLAN_SLOT_PER_DAY ) )
+   {
+      rRet = ERR ;
+   }
+   else
+   {
+      eep_write( (DWORD)&g_sDataEeprom->sChargePlanData.adwPeriod[i_byIdx],
+                 CPLAN_PERIOD( i_byDays, i_byStart, i_byEnd ) ) ;
+      eep_write( (DWORD)&g_sDataEeprom->sChargePlanData.adwPrice[i_byIdx], i_wPrice ) ;
+
+      l_Plan.wSlotCur = CPLAN_SLOT_NONE ;    /* compute plan again */
+      rRet = OK ;
+   }
+
+   return rRet ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Set default price (slots outside tariff periods)                           */
+/*----------------------------------------------------------------------------*/
+
+void cplan_SetPriceDef( WORD i_wPrice )
+{
+   eep_write( (DWORD)&g_sDataEeprom->sChargePlanData.dwPriceDef, i_wPrice ) ;
+
+   l_Plan.wSlotCur = CPLAN_SLOT_NONE ;       /* compute plan again */
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Plan status formatting : active, target and remaining energy (Wh),         */
+/* remaining time (min), current slot charged and current (A), threshold      */
+/* price, target not reachable, horizon slots and computation time (ms)       */
+/*----------------------------------------------------------------------------*/
+
+void cplan_FmtPlan( CHAR * o_pszStr, WORD i_wSize )
+{
+   DWORD dwRemainMin ;
+
+   if ( l_Plan.bActive )
+   {
+      dwRemainMin = ( l_Plan.dwEndSec - tim_GetSecCnt() ) / 60 ;
+   }
+   else
+   {
+      dwRemainMin = 0 ;
+   }
+
+   snprintf( o_pszStr, i_wSize, "%u, %lu, %lu, %lu, %u, %u, %u, %u, %u, %lu\r\n",
+             l_Plan.bActive, l_Plan.dwTargetWh, l_Plan.dwRemainWh, dwRemainMin,
+             l_Plan.bChargeSlot, l_Plan.byCap, l_Plan.wPriceThr, l_Plan.bShort,
+             l_Plan.wNbSlot, l_Plan.dwComputeMs ) ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Tariff table formatting : default price, then for each period              */
+/* "<days mask (hex)>/<start slot>/<end slot>/<price>"                        */
+/*----------------------------------------------------------------------------*/
+
+void cplan_FmtTariff( CHAR * o_pszStr, WORD i_wSize )
+{
+   DWORD dwPeriod ;
+   BYTE byIdx ;
+   WORD wLen ;
+
+   snprintf( o_pszStr, i_wSize, "%lu;", g_sDataEeprom->sChargePlanData.dwPriceDef ) ;
+
+   for ( byIdx = 0 ; byIdx < CPLAN_TARIFF_NB ; byIdx++ )
+   {
+      dwPeriod = g_sDataEeprom->sChargePlanData.adwPeriod[byIdx] ;
+      wLen = strlen( o_pszStr ) ;
+
+      snprintf( &o_pszStr[wLen], i_wSize - wLen, " %02X/%u/%u/%lu",
+                CPLAN_PERIOD_DAYS( dwPeriod ), CPLAN_PERIOD_START( dwPeriod ),
+                CPLAN_PERIOD_END( dwPeriod ),
+                g_sDataEeprom->sChargePlanData.adwPrice[byIdx] ) ;
+   }
+}
+
+
+/*============================================================================*/
+
+/*----------------------------------------------------------------------------*/
+/* Clock second tick event callback : plan end and slot change                */
+/*----------------------------------------------------------------------------*/
+
+static void cplan_EvtClockSec( e_evtId i_eEvtId, DWORD i_dwValue )
+{
+   s_DateTime sDateTime ;
+   BYTE byWeekday ;
+   BYTE bySlotDay ;
+   WORD wSlot ;
+   DWORD dwEnergy ;
+   DWORD dwDelivered ;
+   SDWORD sdwRemainSec ;
+
+   USEPARAM( i_eEvtId ) ;
+   USEPARAM( i_dwValue ) ;
+
+   if ( l_Plan.bActive )
+   {
+      dwEnergy = coevse_GetEnergy() ;
+                                       /* OpenEVSE session energy restarted */
+      if ( dwEnergy < l_Plan.dwEnergyStart )
+      {
+         l_Plan.dwEnergyStart = 0 ;
+      }
+      dwDelivered = dwEnergy - l_Plan.dwEnergyStart ;
+
+      if ( dwDelivered < l_Plan.dwTargetWh )
+      {
+         l_Plan.dwRemainWh = l_Plan.dwTargetWh - dwDelivered ;
+      }
+      else
+      {
+         l_Plan.dwRemainWh = 0 ;
+      }
+
+      sdwRemainSec = (SDWORD)( l_Plan.dwEndSec - tim_GetSecCnt() ) ;
+
+      if ( ( l_Plan.dwRemainWh == 0 ) || ( sdwRemainSec <= 0 ) ||
+           clk_IsDateTimeLost() )
+      {
+         cplan_End() ;
+      }
+      else
+      {
+         clk_GetDateTime( &sDateTime, &byWeekday ) ;
+         DEFENS_LIM_MAX( byWeekday, NB_DAYS_WEEK - 1 ) ;
+
+         bySlotDay = ( ( sDateTime.sTime.byHours * 60 ) + sDateTime.sTime.byMinutes ) /
+                     ( CPLAN_SLOT_DUR / 60 ) ;
+         DEFENS_LIM_MAX( bySlotDay, CPLAN_SLOT_PER_DAY - 1 ) ;
+         wSlot = ( byWeekday * CPLAN_SLOT_PER_DAY ) + bySlotDay ;
+
+         if ( wSlot != l_Plan.wSlotCur )
+         {                             /* new slot : compute plan again */
+            l_Plan.wSlotCur = wSlot ;
+            l_Plan.wNbSlot = ( sdwRemainSec + CPLAN_SLOT_DUR - 1 ) / CPLAN_SLOT_DUR ;
+            DEFENS_LIM_MAX( l_Plan.wNbSlot, CPLAN_HORIZON_MAX ) ;
+
+            cplan_Compute( byWeekday, bySlotDay ) ;
+
+            if ( l_Plan.bChargeSlot )
+            {
+               lmgt_SetPlanCap( l_Plan.byCap ) ;
+            }
+            else
+            {
+               lmgt_SetPlanCap( 0 ) ;
+            }
+         }
+      }
+   }
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Plan end : calendar and user capacity are used again                       */
+/*----------------------------------------------------------------------------*/
+
+static void cplan_End( void )
+{
+   l_Plan.bActive = FALSE ;
+   l_Plan.bChargeSlot = FALSE ;
+   l_Plan.wSlotCur = CPLAN_SLOT_NONE ;
+
+   lmgt_SetPlanCap( 0 ) ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Compute the current slot decision (l_Plan.bChargeSlot and l_Plan.byCap)    */
+/*    - <i_byWeekday> current week day (0=Monday)                             */
+/*    - <i_bySlotDay> current slot of the day                                 */
+/*----------------------------------------------------------------------------*/
+
+static void cplan_Compute( BYTE i_byWeekday, BYTE i_bySlotDay )
+{
+   WORD awLevel [CPLAN_LEVEL_NB] ;
+   WORD awNbSlot [CPLAN_LEVEL_NB] ;
+   BYTE byNbLevel ;
+   BYTE byLvl ;
+   WORD wSlot ;
+   WORD wSlotDay ;
+   WORD wPrice ;
+   WORD wPriceCur ;
+   DWORD dwCapMax ;
+   DWORD dwCap ;
+   DWORD dwRemain ;                    /* remaining energy, Wh x CPLAN_SLOT_PER_HOUR */
+   DWORD dwLvlEnergy ;                 /* price level energy, same unit */
+   DWORD dwTick ;
+
+   dwTick = HAL_GetTick() ;
+
+   byNbLevel = cplan_GetLevels( awLevel ) ;
+   memset( awNbSlot, 0, sizeof(awNbSlot) ) ;
+                                       /* count horizon slots by price level */
+   for ( wSlot = 0 ; wSlot < l_Plan.wNbSlot ; wSlot++ )
+   {
+      wSlotDay = i_bySlotDay + wSlot ;
+      wPrice = cplan_GetPrice( ( i_byWeekday + ( wSlotDay / CPLAN_SLOT_PER_DAY ) ) % NB_DAYS_WEEK,
+                               wSlotDay % CPLAN_SLOT_PER_DAY ) ;
+      awNbSlot[cplan_GetLevelIdx( awLevel, byNbLevel, wPrice )]++ ;
+   }
+
+   wPriceCur = cplan_GetPrice( i_byWeekday, i_bySlotDay ) ;
+   dwCapMax = lmgt_GetUserCap() ;
+   dwRemain = l_Plan.dwRemainWh * CPLAN_SLOT_PER_HOUR ;
+
+   l_Plan.bShort = TRUE ;              /* charge every slot at maximum current */
+   l_Plan.bChargeSlot = TRUE ;         /* if target can't be reached          */
+   l_Plan.byCap = (BYTE)dwCapMax ;
+   l_Plan.wPriceThr = awLevel[byNbLevel - 1] ;
+                                       /* cheapest levels first */
+   for ( byLvl = 0 ; ( byLvl < byNbLevel ) && l_Plan.bShort ; byLvl++ )
+   {
+      dwLvlEnergy = awNbSlot[byLvl] * dwCapMax * CPLAN_VOLTAGE ;
+
+      if ( ( awNbSlot[byLvl] != 0 ) && ( dwRemain <= dwLvlEnergy ) )
+      {                                /* threshold level found */
+         l_Plan.bShort = FALSE ;
+         l_Plan.wPriceThr = awLevel[byLvl] ;
+
+         if ( wPriceCur < l_Plan.wPriceThr )
+         {
+            l_Plan.bChargeSlot = TRUE ;
+            l_Plan.byCap = (BYTE)dwCapMax ;
+         }
+         else if ( wPriceCur == l_Plan.wPriceThr )
+         {                             /* spread remaining energy over level slots */
+            dwCap = ( dwRemain + ( awNbSlot[byLvl] * CPLAN_VOLTAGE ) - 1 ) /
+                    ( awNbSlot[byLvl] * CPLAN_VOLTAGE ) ;
+            dwCap = GETMAX( dwCap, COEVSE_CURRENT_CAPMAX_MIN ) ;
+            l_Plan.bChargeSlot = TRUE ;
+            l_Plan.byCap = (BYTE)GETMIN( dwCap, dwCapMax ) ;
+         }
+         else
+         {
+            l_Plan.bChargeSlot = FALSE ;
+         }
+      }
+      else
+      {
+         dwRemain -= dwLvlEnergy ;
+      }
+   }
+
+   l_Plan.dwComputeMs = HAL_GetTick() - dwTick ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Get slot price                                                             */
+/*    - <i_byWeekday> week day (0=Monday)                                     */
+/*    - <i_bySlotDay> slot of the day                                         */
+/*----------------------------------------------------------------------------*/
+
+static WORD cplan_GetPrice( BYTE i_byWeekday, BYTE i_bySlotDay )
+{
+   DWORD dwPeriod ;
+   BYTE byStart ;
+   BYTE byEnd ;
+   BYTE byIdx ;
+   WORD wPrice ;
+   BOOL bFound ;
+
+   wPrice = (WORD)g_sDataEeprom->sChargePlanData.dwPriceDef ;
+   bFound = FALSE ;
+
+   for ( byIdx = 0 ; ( byIdx < CPLAN_TARIFF_NB ) && ( ! bFound ) ; byIdx++ )
+   {
+      dwPeriod = g_sDataEeprom->sChargePlanData.adwPeriod[byIdx] ;
+
+      if ( ISSET( CPLAN_PERIOD_DAYS( dwPeriod ), 1u << i_byWeekday ) )
+      {
+         byStart = CPLAN_PERIOD_START( dwPeriod ) ;
+         byEnd = CPLAN_PERIOD_END( dwPeriod ) ;
+
+         if ( byStart <= byEnd )
+         {
+            bFound = ( ( i_bySlotDay >= byStart ) && ( i_bySlotDay < byEnd ) ) ;
+         }
+         else                          /* period over midnight */
+         {
+            bFound = ( ( i_bySlotDay >= byStart ) || ( i_bySlotDay < byEnd ) ) ;
+         }
+
+         if ( bFound )
+         {
+            wPrice = (WORD)g_sDataEeprom->sChargePlanData.adwPrice[byIdx] ;
+         }
+      }
+   }
+
+   return wPrice ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Get the distinct price levels, in ascending order                          */
+/* Return:                                                                    */
+/*    - number of levels (at least the default price)                         */
+/*----------------------------------------------------------------------------*/
+
+static BYTE cplan_GetLevels( WORD * o_pawLevel )
+{
+   WORD wPrice ;
+   BYTE byNbLevel ;
+   BYTE byIdx ;
+   BYTE byPos ;
+
+   o_pawLevel[0] = (WORD)g_sDataEeprom->sChargePlanData.dwPriceDef ;
+   byNbLevel = 1 ;
+
+   for ( byIdx = 0 ; byIdx < CPLAN_TARIFF_NB ; byIdx++ )
+   {
+      if ( CPLAN_PERIOD_DAYS( g_sDataEeprom->sChargePlanData.adwPeriod[byIdx] ) != 0 )
+      {
+         wPrice = (WORD)g_sDataEeprom->sChargePlanData.adwPrice[byIdx] ;
+                                       /* insertion position */
+         byPos = 0 ;
+         while ( ( byPos < byNbLevel ) && ( o_pawLevel[byPos] < wPrice ) )
+         {
+            byPos++ ;
+         }
+
+         if ( ( byPos == byNbLevel ) || ( o_pawLevel[byPos] != wPrice ) )
+         {                             /* new level */
+            memmove( &o_pawLevel[byPos + 1], &o_pawLevel[byPos],
+                     ( byNbLevel - byPos ) * sizeof(WORD) ) ;
+            o_pawLevel[byPos] = wPrice ;
+            byNbLevel++ ;
+         }
+      }
+   }
+
+   return byNbLevel ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Get price level index                                                      */
+/*----------------------------------------------------------------------------*/
+
+static BYTE cplan_GetLevelIdx( WORD C* i_pawLevel, BYTE i_byNbLevel, WORD i_wPrice )
+{
+   BYTE byIdx ;
+
+   byIdx = 0 ;
+   while ( ( byIdx < ( i_byNbLevel - 1 ) ) && ( i_pawLevel[byIdx] != i_wPrice ) )
+   {
+      byIdx++ ;
+   }
+
+   return byIdx ;
+}
@@ -25,14 +25,26 @@
    @brief
    This module manage the enable/disable state of OpenEVSE.
 
-   The enable/disable state is computed the FSM located in
-   cstate_ProcessState(), given the following entries :
+   The enable/disable state is computed by the FSM (cstate_ProcessEvt()),
+   given the following entries :
     - Calendard state : Given by cal_IsChargeEnable() to check if a regular
       enable is currently allowed by the calendar.
     - Charge force : 3 types of force are managed by the module :
     - Actual charging status, with consumed current, provided by commEVSE.c
       module
 
+   These entries are received from the event bus (see Event.c) and turned
+   into FSM events (CSTATE_EVT_xxx) : the FSM is evaluated as soon as one of
+   them changes, and on each clock second tick for the temporisations.
+
+   The FSM is described by two tables :
+      - k_aStateDesc : for each state, the openEVSE charge enable, and the
+        entry and exit actions,
+      - k_aTrans : transitions (source state, triggering events, guard,
+        destination state and history reason). For one state, transitions
+        are checked in table order, the first one whose guard is TRUE is
+        taken. At state entry, all transitions of the new state are checked.
+
    Three forcing levels are available :
       . CSTATE_FORCE_NONE : no force. Charge is allowed only if it set in
         calendar, and the consumed current is above the theshold limit
@@ -41,6 +53,10 @@
         if it set in  calendar, the actual consumed current is not checked
       . CSTATE_FORCE_ALL : Charge is allowed in any circumstances.
    These 3 levels can be switched by a short press on the CSTATE_BUTTON.
+   A double press starts a boost : CSTATE_FORCE_ALL during CSTATE_BOOST_DUR,
+   not stored in eeprom, the stored force level is then restored. A long
+   press toggles the wifi maintenance mode. Button gestures come from
+   Button.c by the event bus (EVT_BUTTON).
    The 'color' of the charge state led can indicable the current forcing
    level,(cf led state)
 
@@ -64,6 +80,45 @@
         this state is activated, until calandar or fored charge is not
         allowed. Charge is disabled.
 
+   End of charge detection (see cstate_CheckEoc()) : the charge current is
+   filtered by an exponential moving average (factor 1/2^n, sampled every
+   second). After CSTATE_ENDOFCHARGE_DELAY from charge start, the end of
+   charge is detected when the average current stays below the low limit
+   during the dwell time, and the energy delivered during this dwell time
+   is not above the energy delta (otherwise the dwell time restarts).
+   Dwell time, energy delta and filter factor are stored in eeprom (0 for
+   default values), see cstate_SetEocParam() and cstate_FmtEoc().
+
+   Each state change is recorded with its time (seconds since start-up),
+   reason (e_cstateReason) and charge current in a CSTATE_HIST_NB records
+   ring (l_Hist), plugging events are also recorded. Time spent in each
+   state is accumulated (number of entries, total and longest duration).
+   Records and statistics are read with cstate_ReadHistRec() and
+   cstate_FmtStateStat() (see ScktFrame.c).
+
+   Charge sessions (see cstate_SessStart()) : a session starts at
+   CSTATE_CHARGING entry, and each exit closes a charging period (end time,
+   energy from openEVSE $GU counter, stop reason). The maximum current is
+   taken from the end of charge current samples. A charge resumed within
+   CSTATE_SESS_MERGE_DUR continues the same session, so the session is only
+   recorded after this delay (even if the EV is unplugged, so records are at
+   least CSTATE_SESS_MERGE_DUR apart). Sessions below CSTATE_SESS_ENERGY_MIN
+   are not recorded, a session in progress is lost at reset.
+   Records are written in a ring of CSTATE_SESS_NB records in eeprom
+   (g_sDataEeprom->sChargeSessData). There is no head pointer : the newest
+   record is found at start-up by its sequence number, so writes are spread
+   over the whole ring. The sequence number is cleared before the record is
+   written, and written last, so a record interrupted by a reset is ignored
+   (eep_write() returns when the word is programmed, so each write is
+   completed before the next one, see test/TestChargeState.c).
+   Endurance budget : eeprom is specified for 100000 cycles per word. A
+   record costs 7 word writes, each word of the ring is written once per
+   CSTATE_SESS_NB sessions (sequence number twice). With at most 144
+   records per day, sequence words take 9 cycles per day : more than 30
+   years in the worst case.
+   Records are read with cstate_ReadSessRec() (see ScktFrame.c) and
+   cstate_GetSessIdx() (see HtmlInfo.c).
+
    Note : In case of plgging event (the plug state comes from disonnected
    to connected), the openEVSE charge is allowed for 30 sec.
    This is a workaround for the Zoe sleep state.
@@ -83,6 +138,7 @@
                          always forced force mode
          . blinking green : calendar enabled and waiting for EV state
          . steady green : charging in progress state
+   Led colors are set here, blinking is generated by SysLed.c.
 */
 
 
@@ -97,17 +153,51 @@
 /* Defines                                                                    */
 /*----------------------------------------------------------------------------*/
 
-#define CSTATE_BUTTON_FLT_DUR          100
-#define CSTATE_BUTTON_LONGPRESS_DUR   5000
-
-#define CSTATE_LED_BLINK               500
+#define CSTATE_BOOST_DUR              3600   /* boost charge duration (double press), sec */
 
 #define CSTATE_ENDOFCHARGE_DELAY        30   /* delai before taking End of charge in account, sec */
 
+#define CSTATE_EOC_DWELL_DEF            60   /* default end of charge dwell time, sec */
+#define CSTATE_EOC_ENERGY_DEF           20   /* default end of charge energy delta, Wh */
+#define CSTATE_EOC_FILTER_DEF            3   /* default current average factor (1/2^n) */
+
 #define CSTATE_ADC_EV_CONNECT_TH      1184
 
 #define CSTATE_PLUGING_DELAY            30   /* delai for OPENEVSE enable at pluging, sec */
 
+#define CSTATE_EVT_FORCE             0x01u   /* FSM event : force mode change */
+#define CSTATE_EVT_CAL               0x02u   /* FSM event : calendar charge enable change */
+#define CSTATE_EVT_EVSE              0x04u   /* FSM event : openEVSE state change */
+#define CSTATE_EVT_TICK              0x08u   /* FSM event : clock second tick */
+#define CSTATE_EVT_PLUG              0x10u   /* FSM event : EV plugging */
+#define CSTATE_EVT_MAINT             0x20u   /* FSM event : wifi maintenance mode change */
+#define CSTATE_EVT_ALL               0xFFu   /* state entry : all transitions are checked */
+
+#define CSTATE_CHAIN_MAX                 4   /* maximum successive transitions for one event */
+
+   /* Records ring size, from test/RamBudget.sh (host estimate of the 8192 B  */
+   /* of RAM) : static RAM 6777 B and worst stack 2024 B, 609 B over (769 B   */
+   /* with 32 records, baseline tree : 1268 B free). No RAM is left for a     */
+   /* longer history : the ring keeps the CSTATE_HIST_LAST_NB states given by */
+   /* cstate_GetHistState() and 2 plugging records.                           */
+#define CSTATE_HIST_LAST_NB             10   /* number of states given by cstate_GetHistState() */
+#define CSTATE_HIST_NB    ( CSTATE_HIST_LAST_NB + 2 )   /* records number (8 bytes each) */
+#define CSTATE_HIST_LINE_LEN            22   /* formatted record length, see cstate_FmtHistRec() */
+                                             /* one digit state and reason in records */
+_Static_assert( ( CSTATE_LAST <= 10 ) && ( CSTATE_REASON_LAST <= 10 ),
+                "state and reason must be one digit, see CSTATE_HIST_LINE_LEN" ) ;
+
+#define CSTATE_SESS_MERGE_DUR          600   /* delay to resume a session after charge stop, sec */
+#define CSTATE_SESS_ENERGY_MIN          10   /* minimum energy for a session record, Wh */
+#define CSTATE_SESS_LINE_LEN            62   /* formatted session length, see cstate_FmtSessRec() */
+#define CSTATE_TIME_LEN                 19   /* formatted date/time length, see cstate_FmtTime() */
+
+                                             /* date/time packed in one DWORD */
+#define CSTATE_PACK_TIME( Dt )                                                   \
+   ( ( (DWORD)(Dt).byYear << 26 ) | ( (DWORD)(Dt).byMonth << 22 ) |             \
+     ( (DWORD)(Dt).byDays << 17 ) | ( (DWORD)(Dt).byHours << 12 ) |             \
+     ( (DWORD)(Dt).byMinutes << 6 ) | (DWORD)(Dt).bySeconds )
+
 typedef enum
 {
    CSTATE_LED_OFF = 0,
@@ -128,26 +218,173 @@ typedef struct
    e_cstateForceSt eForceState ;       /* force status */
    e_cstateChargeSt eChargeState ;     /* FSM charge state */
    DWORD dwTmpPlugging ;               /* delay to enable openEVSE because of plugging */
+   BOOL bCalEnable ;                   /* calendar charge enable from ChargeCalendar.c */
+   e_coevseEvseState eEvseState ;      /* openEVSE state from CommOEvse.c */
+   BOOL bBoost ;                       /* boost charge in progress */
+   DWORD dwTmpBoost ;                  /* boost charge duration */
+   e_cstateReason eReason ;            /* reason of state change in progress */
 } s_cstateData ;
 
+typedef enum                           /* openEVSE charge enable in a state */
+{
+   CSTATE_EN_OFF = 0,                  /* charge disabled */
+   CSTATE_EN_ON,                       /* charge enabled */
+   CSTATE_EN_PLUG,                     /* charge enabled during plugging delay only */
+} e_cstateEnable ;
+
+typedef BOOL (*f_cstateGuard)( void ) ;
+typedef void (*f_cstateAction)( void ) ;
+
+typedef struct                         /* FSM state description */
+{
+   e_cstateEnable eEnable ;            /* openEVSE charge enable */
+   f_cstateAction fEntry ;             /* entry action, NULL if none */
+   f_cstateAction fExit ;              /* exit action, NULL if none */
+} s_cstateStateDesc ;
+
+typedef struct                         /* FSM transition description */
+{
+   e_cstateChargeSt eState ;           /* source state */
+   BYTE byEvtMask ;                    /* events triggering the transition check */
+   f_cstateGuard fGuard ;              /* transition condition */
+   e_cstateChargeSt eNextState ;       /* destination state */
+   e_cstateReason eReason ;            /* change reason (history) */
+} s_cstateTrans ;
+
+typedef struct                         /* end of charge detection */
+{
+   DWORD dwDwellSec ;                  /* dwell time below low limit (sec) */
+   DWORD dwEnergyWh ;                  /* maximum energy during dwell time (Wh) */
+   BYTE byFilter ;                     /* current average factor (1/2^n) */
+   BOOL bAvgInit ;                     /* average current initialized */
+   SDWORD sdwAvgCur ;                  /* average charge current (mA) */
+   DWORD dwSampleSec ;                 /* last current sample time (sec) */
+   DWORD dwStartSec ;                  /* charge start time (sec) */
+   BOOL bLow ;                         /* average current below low limit */
+   DWORD dwLowSec ;                    /* dwell time start (sec) */
+   DWORD dwLowEnergy ;                 /* energy at dwell time start (Wh) */
+   DWORD dwNbRestart ;                 /* dwell restarts for energy delta */
+   DWORD dwNbEoc ;                     /* end of charge detections */
+} s_cstateEoc ;
+
+typedef struct                         /* charge state change record */
+{
+   DWORD dwTimeSec ;                   /* record time (seconds since start-up) */
+   BYTE byState ;                      /* charge state (e_cstateChargeSt) */
+   BYTE byReason ;                     /* change reason (e_cstateReason) */
+   WORD wCurrent ;                     /* charge current (mA) */
+} s_cstateHistRec ;
+
+typedef struct                         /* time in state statistics */
+{
+   DWORD dwNbEnter ;                   /* number of state entries */
+   DWORD dwTotalSec ;                  /* total time in state (sec) */
+   DWORD dwMaxSec ;                    /* longest time in state (sec) */
+} s_cstateStat ;
+
+typedef struct
+{
+   s_cstateHistRec aRec [CSTATE_HIST_NB] ;   /* records ring */
+   BYTE byIdxIn ;                      /* next record index */
+   BYTE byNbRec ;                      /* number of valid records */
+   DWORD dwEnterSec ;                  /* current state entry time (sec) */
+   s_cstateStat aStat [CSTATE_LAST] ;  /* time in state statistics */
+} s_cstateHist ;
+
+typedef struct                         /* charge session accounting */
+{
+   BOOL bActive ;                      /* charging period in progress */
+   BOOL bPaused ;                      /* charge stopped, waiting for resume or record */
+   DWORD dwStart ;                     /* session start date/time (packed) */
+   DWORD dwEnd ;                       /* last charge stop date/time (packed) */
+   DWORD dwStartWh ;                   /* openEVSE energy at charging period start (Wh) */
+   DWORD dwEnergy ;                    /* energy of ended charging periods (Wh) */
+   DWORD dwMaxCur ;                    /* maximum charge current (mA) */
+   e_cstateReason eReason ;            /* last charge stop reason */
+   DWORD dwTmpMerge ;                  /* resume delay after charge stop */
+   BYTE byIdxIn ;                      /* next eeprom record index */
+   BYTE byNbRec ;                      /* number of valid eeprom records */
+   DWORD dwSeq ;                       /* newest record sequence number */
+} s_cstateSess ;
+
 
 /*----------------------------------------------------------------------------*/
 /* Prototypes                                                                 */
 /*----------------------------------------------------------------------------*/
 
-static void cstate_ProcessState( BOOL i_bToogleForce ) ;
+static void cstate_EvtProc( e_evtId i_eEvtId, DWORD i_dwValue ) ;
+static void cstate_ProcessEvt( BYTE i_byEvt ) ;
+static s_cstateTrans C* cstate_FindTrans( BYTE i_byEvt ) ;
+static void cstate_SetState( e_cstateChargeSt i_eNextState, e_cstateReason i_eReason ) ;
+static void cstate_EntryCharging( void ) ;
+static void cstate_ExitCharging( void ) ;
+static BOOL cstate_IsForce( void ) ;
+static BOOL cstate_IsNotForce( void ) ;
+static BOOL cstate_IsCal( void ) ;
+static BOOL cstate_IsNotCal( void ) ;
+static BOOL cstate_IsCharge( void ) ;
+static BOOL cstate_IsNotCharge( void ) ;
+static BOOL cstate_IsCalEnd( void ) ;
+static BOOL cstate_IsEoc( void ) ;
 static BOOL cstate_CheckEoc( void ) ;
+static void cstate_LoadEocParam( void ) ;
 static e_cstateForceSt cstate_GetNextForcedState( e_cstateForceSt i_eForceState ) ;
 static void cstate_UpdateForceState( e_cstateForceSt i_eForceState ) ;
 
+static void cstate_UpdateStat( e_cstateChargeSt i_eNextState ) ;
+static void cstate_AddHistRec( e_cstateChargeSt i_eState, e_cstateReason i_eReason ) ;
+static s_cstateHistRec C* cstate_GetHistRec( BYTE i_byPos ) ;
+static void cstate_FmtHistRec( s_cstateHistRec C* i_pRec, CHAR * o_pszLine ) ;
+
+static void cstate_SessLoad( void ) ;
+static void cstate_SessStart( void ) ;
+static void cstate_SessStop( e_cstateReason i_eReason ) ;
+static void cstate_SessWrite( void ) ;
+static DWORD cstate_GetTime( void ) ;
+static void cstate_FmtSessRec( s_ChargeSessRec C* i_pRec, CHAR * o_pszLine ) ;
+static void cstate_FmtTime( DWORD i_dwTime, CHAR * o_pszTime ) ;
+
 static void cstate_ProcessLed( void ) ;
-static BOOL cstate_ProcessButton( BOOL * o_bLongPress ) ;
+static e_sysledPat cstate_GetLedPattern( e_cstateLedColor i_eLedColor ) ;
+static BYTE cstate_ProcessButton( e_btnGesture i_eGesture ) ;
 
-static void cstate_HrdInitButton( void ) ;
 static void cstate_HrdInitLed( void ) ;
 static void cstate_HrdSetColorLedWifi( e_cstateLedColor i_eLedColor ) ;
 static void cstate_HrdSetColorLedCharge( e_cstateLedColor i_eLedColor ) ;
 
+                                       /* FSM states description */
+static s_cstateStateDesc const k_aStateDesc [CSTATE_LAST] =
+{
+   [CSTATE_NULL]       = { CSTATE_EN_OFF,  NULL,                  NULL                },
+   [CSTATE_OFF]        = { CSTATE_EN_PLUG, NULL,                  NULL                },
+   [CSTATE_FORCE_WAIT] = { CSTATE_EN_ON,   NULL,                  NULL                },
+   [CSTATE_ON_WAIT]    = { CSTATE_EN_ON,   NULL,                  NULL                },
+   [CSTATE_CHARGING]   = { CSTATE_EN_ON,   cstate_EntryCharging,  cstate_ExitCharging },
+   [CSTATE_EOC_LOWCUR] = { CSTATE_EN_OFF,  NULL,                  NULL                },
+} ;
+
+#define _T( State, EvtMask, Guard, NextState, Reason ) \
+   { .eState = CSTATE_##State, .byEvtMask = (EvtMask), .fGuard = cstate_##Guard, \
+     .eNextState = CSTATE_##NextState, .eReason = CSTATE_REASON_##Reason }
+
+                                       /* FSM transitions, by priority order for each state */
+static s_cstateTrans const k_aTrans [] =
+{
+   _T( OFF,        CSTATE_EVT_FORCE, IsForce,     FORCE_WAIT, FORCE      ),
+   _T( OFF,        CSTATE_EVT_CAL,   IsCal,       ON_WAIT,    CAL_ON     ),
+   _T( FORCE_WAIT, CSTATE_EVT_FORCE, IsNotForce,  OFF,        UNFORCE    ),
+   _T( FORCE_WAIT, CSTATE_EVT_EVSE,  IsCharge,    CHARGING,   EV_CHARGE  ),
+   _T( ON_WAIT,    CSTATE_EVT_FORCE, IsForce,     FORCE_WAIT, FORCE      ),
+   _T( ON_WAIT,    CSTATE_EVT_CAL,   IsNotCal,    OFF,        CAL_OFF    ),
+   _T( ON_WAIT,    CSTATE_EVT_EVSE,  IsCharge,    CHARGING,   EV_CHARGE  ),
+   _T( CHARGING,   CSTATE_EVT_EVSE,  IsNotCharge, ON_WAIT,    EV_STOP    ),
+   _T( CHARGING,   CSTATE_EVT_FORCE | CSTATE_EVT_CAL,
+                                     IsCalEnd,    OFF,        CAL_OFF    ),
+   _T( CHARGING,   CSTATE_EVT_TICK,  IsEoc,       EOC_LOWCUR, EOC_LOWCUR ),
+   _T( EOC_LOWCUR, CSTATE_EVT_FORCE, IsForce,     FORCE_WAIT, FORCE      ),
+   _T( EOC_LOWCUR, CSTATE_EVT_CAL,   IsNotCal,    OFF,        CAL_OFF    ),
+} ;
+
 
 /*----------------------------------------------------------------------------*/
 /* Variables                                                                  */
@@ -155,21 +392,15 @@ static void cstate_HrdSetColorLedCharge( e_cstateLedColor i_eLedColor ) ;
 
 static s_cstateData l_Data ;
 
-static e_cstateChargeSt l_aeHistState [10] ;
-static BYTE l_byHistStateIdx ;
-
-static DWORD l_dwTmpEndOfCharge ;
-static SDWORD l_sdwPrevCurrent ;
+static s_cstateHist l_Hist ;           /* charge state records and statistics */
+static BYTE l_byEvtPending ;           /* FSM events to process at next task call */
 
-static DWORD l_dwTmpButtonFilt ;
-static DWORD l_dwTmpButtonLongPress ;
-static BOOL l_bButtonState ;
+static s_cstateEoc l_Eoc ;             /* end of charge detection */
+static s_cstateSess l_Sess ;           /* charge session accounting */
 
 static e_cstateLedColor l_eWifiLedColor ;
 static e_cstateLedColor l_eChargeLedColor ;
 
-static DWORD l_dwTmpBlinkLedWifi ;
-static DWORD l_dwTmpBlinkLedCharge ;
 
 
 /*----------------------------------------------------------------------------*/
@@ -181,16 +412,28 @@ void cstate_Init( void )
    l_Data.eForceState = (e_cstateForceSt)g_sDataEeprom->sChargeStateData.dwForceState ;
    l_Data.dwCurrentMinStop = g_sDataEeprom->sChargeStateData.dwCurrentMinStop ;
 
-   l_sdwPrevCurrent = SDWORD_MAX ;
+   cstate_LoadEocParam() ;
+   cstate_SessLoad() ;
    l_Data.bEnabled = BYTE_MAX ;              /* force first update */
 
    l_Data.eChargeState = CSTATE_OFF ;
+   l_Data.bCalEnable = FALSE ;
+   l_Data.eEvseState = COEVSE_STATE_UNKNOWN ;
                                              /* init charge state history */
-   l_aeHistState[l_byHistStateIdx] = CSTATE_OFF ;
-   l_byHistStateIdx = NEXTIDX( l_byHistStateIdx, l_aeHistState ) ;
+   l_Hist.dwEnterSec = tim_GetSecCnt() ;
+   l_Hist.aStat[CSTATE_OFF].dwNbEnter = 1 ;
+   cstate_AddHistRec( CSTATE_OFF, CSTATE_REASON_INIT ) ;
+                                             /* check all CSTATE_OFF transitions */
+   l_byEvtPending = CSTATE_EVT_ALL ;         /* once all modules are initialized */
 
-   cstate_HrdInitButton() ;
    cstate_HrdInitLed() ;
+
+   evt_Subscribe( EVT_EVSE_STATE, &cstate_EvtProc ) ;
+   evt_Subscribe( EVT_PLUG, &cstate_EvtProc ) ;
+   evt_Subscribe( EVT_CHARGE_ENABLE, &cstate_EvtProc ) ;
+   evt_Subscribe( EVT_CLOCK_SEC, &cstate_EvtProc ) ;
+   evt_Subscribe( EVT_MAINT_MODE, &cstate_EvtProc ) ;
+   evt_Subscribe( EVT_BUTTON, &cstate_EvtProc ) ;
 }
 
 
@@ -221,6 +464,61 @@ DWORD cstate_GetCurrentMinStop( void )
 }
 
 
+/*----------------------------------------------------------------------------*/
+/* Set end of charge detection parameters (0 for default value)               */
+/*    - <i_dwDwellSec> dwell time below low limit (sec)                       */
+/*    - <i_dwEnergyWh> maximum energy delivered during dwell time (Wh)        */
+/*    - <i_dwFilter> current average factor (1/2^n)                           */
+/*----------------------------------------------------------------------------*/
+
+void cstate_SetEocParam( DWORD i_dwDwellSec, DWORD i_dwEnergyWh, DWORD i_dwFilter )
+{
+   if ( i_dwDwellSec != g_sDataEeprom->sChargeStateData.dwEocDwell )
+   {
+      eep_write( (DWORD)&g_sDataEeprom->sChargeStateData.dwEocDwell, i_dwDwellSec ) ;
+   }
+   if ( i_dwEnergyWh != g_sDataEeprom->sChargeStateData.dwEocEnergy )
+   {
+      eep_write( (DWORD)&g_sDataEeprom->sChargeStateData.dwEocEnergy, i_dwEnergyWh ) ;
+   }
+   if ( i_dwFilter != g_sDataEeprom->sChargeStateData.dwEocFilter )
+   {
+      eep_write( (DWORD)&g_sDataEeprom->sChargeStateData.dwEocFilter, i_dwFilter ) ;
+   }
+
+   cstate_LoadEocParam() ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* End of charge detection formatting : low limit (A), dwell time (sec),      */
+/* energy delta (Wh), filter factor, average current (mA), time below low     */
+/* limit (sec), energy since dwell start (Wh), dwell restarts and detections  */
+/*----------------------------------------------------------------------------*/
+
+void cstate_FmtEoc( CHAR * o_pszStr, WORD i_wSize )
+{
+   DWORD dwLowSec ;
+   DWORD dwLowEnergy ;
+
+   if ( ( l_Data.eChargeState == CSTATE_CHARGING ) && l_Eoc.bLow )
+   {
+      dwLowSec = tim_GetSecCnt() - l_Eoc.dwLowSec ;
+      dwLowEnergy = coevse_GetEnergy() - l_Eoc.dwLowEnergy ;
+   }
+   else
+   {
+      dwLowSec = 0 ;
+      dwLowEnergy = 0 ;
+   }
+
+   snprintf( o_pszStr, i_wSize, "%lu, %lu, %lu, %u, %li, %lu, %lu, %lu, %lu\r\n",
+             l_Data.dwCurrentMinStop, l_Eoc.dwDwellSec, l_Eoc.dwEnergyWh,
+             l_Eoc.byFilter, l_Eoc.sdwAvgCur, dwLowSec, dwLowEnergy,
+             l_Eoc.dwNbRestart, l_Eoc.dwNbEoc ) ;
+}
+
+
 /*----------------------------------------------------------------------------*/
 /* Toggle force state mode                                                    */
 /*----------------------------------------------------------------------------*/
@@ -231,6 +529,8 @@ void cstate_ToggleForce( void )
 
    eForceState = cstate_GetNextForcedState( l_Data.eForceState ) ;
    cstate_UpdateForceState( eForceState ) ;
+
+   cstate_ProcessEvt( CSTATE_EVT_FORCE ) ;   /* update FSM state */
 }
 
 
@@ -255,210 +555,462 @@ e_cstateChargeSt cstate_GetChargeState( void )
 
 
 /*----------------------------------------------------------------------------*/
-/* Read charge state history                                                  */
+/* Read charge state history : CSTATE_HIST_LAST_NB last states                */
 /*----------------------------------------------------------------------------*/
 
 void cstate_GetHistState( CHAR * o_pszHistState, WORD i_wSize )
 {
-   BYTE byIdxOut ;
+   s_cstateHistRec C* pRec ;
+   BYTE byPos ;
+   BYTE byNbState ;
+   BYTE byNbSkip ;
    CHAR * pszOut ;
    WORD wSize ;
 
-   byIdxOut = l_byHistStateIdx ;
    pszOut = o_pszHistState ;
    wSize = i_wSize ;
-
-   do
+                                       /* count state changes (no plugging) */
+   byNbState = 0 ;
+   for ( byPos = 0 ; byPos < l_Hist.byNbRec ; byPos++ )
    {
-      if ( wSize >= 2 )
+      if ( cstate_GetHistRec( byPos )->byReason != CSTATE_REASON_PLUG )
       {
-         *pszOut++ = '0' + (BYTE) l_aeHistState[byIdxOut] ;
-         wSize-- ;
-         *pszOut++= ' ' ;
-         wSize-- ;
+         byNbState++ ;
       }
+   }
+   byNbSkip = byNbState - GETMIN( byNbState, CSTATE_HIST_LAST_NB ) ;
 
-      byIdxOut = NEXTIDX( byIdxOut, l_aeHistState ) ;
-   } while ( byIdxOut != l_byHistStateIdx ) ;
+   for ( byPos = 0 ; byPos < l_Hist.byNbRec ; byPos++ )
+   {
+      pRec = cstate_GetHistRec( byPos ) ;
+
+      if ( pRec->byReason != CSTATE_REASON_PLUG )
+      {
+         if ( byNbSkip != 0 )
+         {
+            byNbSkip-- ;
+         }
+         else if ( wSize >= 3 )        /* 2 characters and final NULL */
+         {
+            *pszOut++ = '0' + pRec->byState ;
+            wSize-- ;
+            *pszOut++= ' ' ;
+            wSize-- ;
+         }
+      }
+   }
 
    *pszOut = 0 ;
 }
 
 
 /*----------------------------------------------------------------------------*/
-/* periodic task                                                              */
+/* Read charge state records from <i_dwOffset> (socket stream producer), one  */
+/* CSTATE_HIST_LINE_LEN line per record, oldest first.                        */
+/* Return the number of characters read.                                      */
 /*----------------------------------------------------------------------------*/
 
-void cstate_TaskCyc( void )
+WORD cstate_ReadHistRec( DWORD i_dwOffset, CHAR * o_pszHistRec, WORD i_wSize )
 {
-   BOOL bPress ;
-   BOOL bLongPress ;
-   BOOL bToogleWifi ;
-   BOOL bToogleForce ;
-
-   l_Data.bWifiMaint = cwifi_IsMaintMode() ;          /* check if wifi is in maintenance mode */
+   CHAR szLine [CSTATE_HIST_LINE_LEN + 1] ;
+   DWORD dwPos ;
+   WORD wOffsetLine ;
+   WORD wNbChar ;
+   WORD wLen ;
 
+   wNbChar = 0 ;
+   dwPos = i_dwOffset / CSTATE_HIST_LINE_LEN ;
+   wOffsetLine = i_dwOffset % CSTATE_HIST_LINE_LEN ;
 
-   if ( coevse_IsPlugEvent( TRUE ) )                  /* if plugging action is detected */
+   while ( ( wNbChar < i_wSize ) && ( dwPos < l_Hist.byNbRec ) )
    {
-      tim_StartSecTmp( &l_Data.dwTmpPlugging ) ;      /* start tempo to enable charge shortly */
-                                                      /* (even if charge is not allowed) */
+      cstate_FmtHistRec( cstate_GetHistRec( (BYTE)dwPos ), szLine ) ;
+
+      wLen = GETMIN( CSTATE_HIST_LINE_LEN - wOffsetLine, i_wSize - wNbChar ) ;
+      memcpy( &o_pszHistRec[wNbChar], &szLine[wOffsetLine], wLen ) ;
+      wNbChar += wLen ;
+
+      wOffsetLine = 0 ;
+      dwPos++ ;
    }
 
-   bPress = cstate_ProcessButton( &bLongPress ) ;     /* check main button */
+   return wNbChar ;
+}
+
 
-   bToogleWifi = bPress && bLongPress ;
-   bToogleForce = bPress && ( ! bLongPress ) ;
+/*----------------------------------------------------------------------------*/
+/* Format time in state statistics : current state and time in it (sec), then */
+/* for each state from CSTATE_OFF : "<entries>/<total sec>/<longest sec>"     */
+/*----------------------------------------------------------------------------*/
 
-   if ( bToogleWifi )                                 /* if there is long press */
-   {
-      cwifi_SetMaintMode( ! l_Data.bWifiMaint ) ;     /* toggle wifi maintenance mode */
-   }
+void cstate_FmtStateStat( CHAR * o_pszStat, WORD i_wSize )
+{
+   s_cstateStat C* pStat ;
+   BYTE byState ;
+   WORD wLen ;
 
-   cstate_ProcessState( bToogleForce ) ;              /* update FSM state */
+   snprintf( o_pszStat, i_wSize, "%u, %lu;", l_Data.eChargeState,
+             tim_GetSecCnt() - l_Hist.dwEnterSec ) ;
 
-   cstate_ProcessLed() ;                              /* update LEDs */
-}
+   for ( byState = CSTATE_OFF ; byState < CSTATE_LAST ; byState++ )
+   {
+      pStat = &l_Hist.aStat[byState] ;
+      wLen = strlen( o_pszStat ) ;
 
+      snprintf( &o_pszStat[wLen], i_wSize - wLen, " %lu/%lu/%lu",
+                pStat->dwNbEnter, pStat->dwTotalSec, pStat->dwMaxSec ) ;
+   }
+}
 
-/*=========================================================================*/
 
 /*----------------------------------------------------------------------------*/
-/* Update FSM state                                                           */
+/* Get eeprom index of a charge session record                                */
+/*    - <i_byAge> record age (0 : newest record)                              */
+/* Return the index in g_sDataEeprom->sChargeSessData.aRec, BYTE_MAX if none  */
 /*----------------------------------------------------------------------------*/
 
-static void cstate_ProcessState( BOOL i_bToogleForce )
+BYTE cstate_GetSessIdx( BYTE i_byAge )
 {
-   e_cstateChargeSt eNextChargeState ;
-   e_cstateForceSt eForceState ;
-   BOOL bForce ;
-   BOOL bCal ;
-   BOOL bCharge ;
-   BOOL bEnabled ;
+   BYTE byIdx ;
 
-   if ( i_bToogleForce )
+   if ( i_byAge < l_Sess.byNbRec )
    {
-      eForceState = cstate_GetNextForcedState( l_Data.eForceState ) ;
+      byIdx = ( l_Sess.byIdxIn + CSTATE_SESS_NB - 1 - i_byAge ) % CSTATE_SESS_NB ;
    }
    else
    {
-      eForceState = l_Data.eForceState ;
+      byIdx = BYTE_MAX ;
    }
 
-   bForce = ( eForceState != CSTATE_FORCE_NONE ) ;
-   bCal = ( ! clk_IsDateTimeLost() ) && cal_IsChargeEnable() ;
-   bCharge = ( coevse_GetEvseState() == COEVSE_STATE_CHARGING ) ;
+   return byIdx ;
+}
 
-   if ( l_Data.eChargeState != CSTATE_CHARGING )
+
+/*----------------------------------------------------------------------------*/
+/* Read charge session records from <i_dwOffset> (socket stream producer),    */
+/* one CSTATE_SESS_LINE_LEN line per record, oldest first.                    */
+/* Return the number of characters read.                                      */
+/*----------------------------------------------------------------------------*/
+
+WORD cstate_ReadSessRec( DWORD i_dwOffset, CHAR * o_pszSessRec, WORD i_wSize )
+{
+   CHAR szLine [CSTATE_SESS_LINE_LEN + 1] ;
+   s_ChargeSessRec C* pRec ;
+   DWORD dwPos ;
+   WORD wOffsetLine ;
+   WORD wNbChar ;
+   WORD wLen ;
+
+   wNbChar = 0 ;
+   dwPos = i_dwOffset / CSTATE_SESS_LINE_LEN ;
+   wOffsetLine = i_dwOffset % CSTATE_SESS_LINE_LEN ;
+
+   while ( ( wNbChar < i_wSize ) && ( dwPos < l_Sess.byNbRec ) )
    {
-      l_sdwPrevCurrent = SDWORD_MAX ;
+      pRec = &g_sDataEeprom->sChargeSessData.aRec[
+                cstate_GetSessIdx( l_Sess.byNbRec - 1 - (BYTE)dwPos )] ;
+      cstate_FmtSessRec( pRec, szLine ) ;
+
+      wLen = GETMIN( CSTATE_SESS_LINE_LEN - wOffsetLine, i_wSize - wNbChar ) ;
+      memcpy( &o_pszSessRec[wNbChar], &szLine[wOffsetLine], wLen ) ;
+      wNbChar += wLen ;
+
+      wOffsetLine = 0 ;
+      dwPos++ ;
    }
 
-   eNextChargeState = CSTATE_NULL ;
+   return wNbChar ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Unpack a session record date/time (see CSTATE_PACK_TIME())                 */
+/*----------------------------------------------------------------------------*/
+
+void cstate_UnpackTime( DWORD i_dwTime, s_DateTime * o_psDateTime )
+{
+   o_psDateTime->byYear = (BYTE)( ( i_dwTime >> 26 ) & 0x3F ) ;
+   o_psDateTime->byMonth = (BYTE)( ( i_dwTime >> 22 ) & 0x0F ) ;
+   o_psDateTime->byDays = (BYTE)( ( i_dwTime >> 17 ) & 0x1F ) ;
+   o_psDateTime->byHours = (BYTE)( ( i_dwTime >> 12 ) & 0x1F ) ;
+   o_psDateTime->byMinutes = (BYTE)( ( i_dwTime >> 6 ) & 0x3F ) ;
+   o_psDateTime->bySeconds = (BYTE)( i_dwTime & 0x3F ) ;
+}
 
-   switch ( l_Data.eChargeState )
+
+/*----------------------------------------------------------------------------*/
+/* periodic task                                                              */
+/*----------------------------------------------------------------------------*/
+
+void cstate_TaskCyc( void )
+{
+   if ( l_byEvtPending != 0 )                         /* first FSM evaluation */
    {
-      case CSTATE_OFF :
-         if ( bForce )
-         {
-            eNextChargeState = CSTATE_FORCE_WAIT ;
-         }
-         else if ( bCal )
-         {
-            eNextChargeState = CSTATE_ON_WAIT ;
-         }
+      cstate_ProcessEvt( l_byEvtPending ) ;
+      l_byEvtPending = 0 ;
+   }
 
-         if ( tim_GetRemainSecTmp( &l_Data.dwTmpPlugging, CSTATE_PLUGING_DELAY ) != 0 )
-         {
-            bEnabled = TRUE ;
-         }
-         else
-         {
-            bEnabled = FALSE ;
-         }
+   cstate_ProcessLed() ;                              /* update LEDs */
+}
+
+
+/*=========================================================================*/
+
+/*----------------------------------------------------------------------------*/
+/* Event bus callback                                                         */
+/*----------------------------------------------------------------------------*/
+
+static void cstate_EvtProc( e_evtId i_eEvtId, DWORD i_dwValue )
+{
+   BYTE byEvt ;
+
+   switch ( i_eEvtId )
+   {
+      case EVT_EVSE_STATE :
+         l_Data.eEvseState = (e_coevseEvseState)i_dwValue ;
+         byEvt = CSTATE_EVT_EVSE ;
          break ;
 
-      case CSTATE_FORCE_WAIT :
-         if ( ! bForce )
-         {
-            eNextChargeState = CSTATE_OFF ;
-         }
-         else if ( bCharge )
-         {
-            tim_StartSecTmp( &l_dwTmpEndOfCharge ) ;
-            eNextChargeState = CSTATE_CHARGING ;
-         }
-         bEnabled = TRUE ;
+      case EVT_PLUG :                        /* plugging action is detected */
+         tim_StartSecTmp( &l_Data.dwTmpPlugging ) ;   /* start tempo to enable charge shortly */
+         cstate_AddHistRec( l_Data.eChargeState, CSTATE_REASON_PLUG ) ;
+         byEvt = CSTATE_EVT_PLUG ;                    /* (even if charge is not allowed) */
          break ;
 
-      case CSTATE_ON_WAIT :
-         if ( bForce )
-         {
-            eNextChargeState = CSTATE_FORCE_WAIT ;
-         }
-         else if ( ! bCal )
-         {
-            eNextChargeState = CSTATE_OFF ;
-         }
-         else if ( bCharge )
-         {
-            tim_StartSecTmp( &l_dwTmpEndOfCharge ) ;
-            eNextChargeState = CSTATE_CHARGING ;
-         }
-         bEnabled = TRUE ;
+      case EVT_CHARGE_ENABLE :
+         l_Data.bCalEnable = (BOOL)i_dwValue ;
+         byEvt = CSTATE_EVT_CAL ;
          break ;
 
-      case CSTATE_CHARGING :
-         if ( ! bCharge )
-         {
-            eNextChargeState = CSTATE_ON_WAIT ;
-            eForceState = CSTATE_FORCE_NONE ;
-         }
-         else if ( ( l_Data.eForceState == CSTATE_FORCE_NONE ) && ( ! bCal ) )
+      case EVT_CLOCK_SEC :                   /* temporisations */
+         byEvt = CSTATE_EVT_TICK ;
+                                             /* end of boost charge */
+         if ( l_Data.bBoost && tim_IsEndSecTmp( &l_Data.dwTmpBoost, CSTATE_BOOST_DUR ) )
          {
-            eNextChargeState = CSTATE_OFF ;
-            eForceState = CSTATE_FORCE_NONE ;
+            l_Data.bBoost = FALSE ;
+            l_Data.eForceState =
+               (e_cstateForceSt)g_sDataEeprom->sChargeStateData.dwForceState ;
+            byEvt |= CSTATE_EVT_FORCE ;
          }
-         else if ( ( l_Data.eForceState != CSTATE_FORCE_ALL ) && cstate_CheckEoc() )
+                                             /* charge not resumed : session is over */
+         if ( l_Sess.bPaused && tim_IsEndSecTmp( &l_Sess.dwTmpMerge, CSTATE_SESS_MERGE_DUR ) )
          {
-            eNextChargeState = CSTATE_EOC_LOWCUR ;
-            eForceState = CSTATE_FORCE_NONE ;
+            cstate_SessWrite() ;
          }
+         break ;
+
+      case EVT_MAINT_MODE :                  /* wifi maintenance mode change */
+         l_Data.bWifiMaint = (BOOL)i_dwValue ;
+         byEvt = CSTATE_EVT_MAINT ;
+         break ;
+
+      case EVT_BUTTON :                      /* button gesture */
+         byEvt = cstate_ProcessButton( (e_btnGesture)i_dwValue ) ;
+         break ;
+
+      default :
+         byEvt = 0 ;
+         break ;
+   }
+
+   if ( byEvt != 0 )
+   {
+      cstate_ProcessEvt( byEvt ) ;           /* update FSM state */
+   }
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Process FSM event : the first transition of the current state matching     */
+/* the event and whose guard is TRUE is taken. On state entry, all the new    */
+/* state transitions are checked (CSTATE_EVT_ALL), up to CSTATE_CHAIN_MAX     */
+/* successive transitions.                                                    */
+/*----------------------------------------------------------------------------*/
+
+static void cstate_ProcessEvt( BYTE i_byEvt )
+{
+   s_cstateTrans C* pTrans ;
+   BYTE byEvt ;
+   BYTE byNbChain ;
+   BOOL bEnabled ;
+
+   byEvt = i_byEvt ;
+   byNbChain = 0 ;
+
+   while ( ( byEvt != 0 ) && ( byNbChain < CSTATE_CHAIN_MAX ) )
+   {
+      pTrans = cstate_FindTrans( byEvt ) ;
+
+      if ( pTrans != NULL )
+      {
+         cstate_SetState( pTrans->eNextState, pTrans->eReason ) ;
+         byEvt = CSTATE_EVT_ALL ;
+         byNbChain++ ;
+      }
+      else
+      {
+         byEvt = 0 ;
+      }
+   }
+                                       /* openEVSE charge enable */
+   switch ( k_aStateDesc[l_Data.eChargeState].eEnable )
+   {
+      case CSTATE_EN_ON :
          bEnabled = TRUE ;
          break ;
 
-      case CSTATE_EOC_LOWCUR :
-         if ( bForce )
-         {
-            eNextChargeState = CSTATE_FORCE_WAIT ;
-         }
-         else if ( ! bCal )
-         {
-            eNextChargeState = CSTATE_OFF ;
-         }
-         bEnabled = FALSE ;
+      case CSTATE_EN_PLUG :
+         bEnabled = ( tim_GetRemainSecTmp( &l_Data.dwTmpPlugging,
+                                           CSTATE_PLUGING_DELAY ) != 0 ) ;
          break ;
 
       default :
-         eNextChargeState = CSTATE_OFF ;
          bEnabled = FALSE ;
          break ;
    }
 
-   cstate_UpdateForceState( eForceState ) ;
-
    if ( l_Data.bEnabled != bEnabled )
    {
       l_Data.bEnabled = bEnabled ;
       coevse_SetChargeEnable( bEnabled ) ;
    }
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Find the transition to take on <i_byEvt> event, NULL if none               */
+/*----------------------------------------------------------------------------*/
+
+static s_cstateTrans C* cstate_FindTrans( BYTE i_byEvt )
+{
+   s_cstateTrans C* pTrans ;
+   BYTE byIdx ;
+
+   pTrans = NULL ;
+
+   for ( byIdx = 0 ; byIdx < ARRAY_SIZE(k_aTrans) ; byIdx++ )
+   {
+      if ( ( k_aTrans[byIdx].eState == l_Data.eChargeState ) &&
+           ( ( k_aTrans[byIdx].byEvtMask & i_byEvt ) != 0 ) &&
+           ( (*k_aTrans[byIdx].fGuard)() ) )
+      {
+         pTrans = &k_aTrans[byIdx] ;
+         break ;
+      }
+   }
+
+   return pTrans ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Change FSM state : exit action, entry action and history record            */
+/*----------------------------------------------------------------------------*/
+
+static void cstate_SetState( e_cstateChargeSt i_eNextState, e_cstateReason i_eReason )
+{
+   l_Data.eReason = i_eReason ;        /* given to exit and entry actions */
+
+   if ( k_aStateDesc[l_Data.eChargeState].fExit != NULL )
+   {
+      (*k_aStateDesc[l_Data.eChargeState].fExit)() ;
+   }
+
+   cstate_UpdateStat( i_eNextState ) ;
+   l_Data.eChargeState = i_eNextState ;
+
+   if ( k_aStateDesc[i_eNextState].fEntry != NULL )
+   {
+      (*k_aStateDesc[i_eNextState].fEntry)() ;
+   }
+
+   cstate_AddHistRec( i_eNextState, i_eReason ) ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* CSTATE_CHARGING entry action : start end of charge check and session       */
+/*----------------------------------------------------------------------------*/
+
+static void cstate_EntryCharging( void )
+{
+   l_Eoc.bAvgInit = FALSE ;
+   l_Eoc.bLow = FALSE ;
+   l_Eoc.dwStartSec = tim_GetSecCnt() ;
+   l_Eoc.dwSampleSec = l_Eoc.dwStartSec - 1 ;
+
+   cstate_SessStart() ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* CSTATE_CHARGING exit action : force mode is cleared at the end of charge,  */
+/* charging period is added to session                                        */
+/*----------------------------------------------------------------------------*/
+
+static void cstate_ExitCharging( void )
+{
+   cstate_UpdateForceState( CSTATE_FORCE_NONE ) ;
+
+   cstate_SessStop( l_Data.eReason ) ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Transitions guards                                                         */
+/*----------------------------------------------------------------------------*/
+
+static BOOL cstate_IsForce( void )
+{
+   return ( l_Data.eForceState != CSTATE_FORCE_NONE ) ;
+}
+
+static BOOL cstate_IsNotForce( void )
+{
+   return ( l_Data.eForceState == CSTATE_FORCE_NONE ) ;
+}
+
+static BOOL cstate_IsCal( void )
+{
+   return l_Data.bCalEnable ;
+}
+
+static BOOL cstate_IsNotCal( void )
+{
+   return ( ! l_Data.bCalEnable ) ;
+}
+
+static BOOL cstate_IsCharge( void )
+{
+   return ( l_Data.eEvseState == COEVSE_STATE_CHARGING ) ;
+}
+
+static BOOL cstate_IsNotCharge( void )
+{
+   return ( l_Data.eEvseState != COEVSE_STATE_CHARGING ) ;
+}
 
-   if ( eNextChargeState != CSTATE_NULL )
+static BOOL cstate_IsCalEnd( void )
+{
+   return ( ( l_Data.eForceState == CSTATE_FORCE_NONE ) && ( ! l_Data.bCalEnable ) ) ;
+}
+
+static BOOL cstate_IsEoc( void )
+{
+   BOOL bEoc ;
+                                       /* average current is kept up to date */
+   bEoc = cstate_CheckEoc() ;          /* in all force modes                  */
+
+   if ( bEoc && ( l_Data.eForceState != CSTATE_FORCE_ALL ) )
    {
-      l_Data.eChargeState = eNextChargeState ;
-      l_aeHistState[l_byHistStateIdx] = eNextChargeState ;
-      l_byHistStateIdx = NEXTIDX( l_byHistStateIdx, l_aeHistState ) ;
+      l_Eoc.dwNbEoc++ ;
    }
+   else
+   {
+      bEoc = FALSE ;
+   }
+
+   return bEoc ;
 }
 
 
@@ -468,29 +1020,93 @@ static void cstate_ProcessState( BOOL i_bToogleForce )
 
 static BOOL cstate_CheckEoc( void )
 {
-	BOOL bEocLowCur ;
+   BOOL bEocLowCur ;
    SDWORD sdwCurrent ;
+   DWORD dwSec ;
+   DWORD dwEnergy ;
 
    bEocLowCur = FALSE ;
-
-   if ( tim_IsEndSecTmp( &l_dwTmpEndOfCharge, CSTATE_ENDOFCHARGE_DELAY ) )
+   dwSec = tim_GetSecCnt() ;
+                                       /* one current sample per second */
+   if ( dwSec != l_Eoc.dwSampleSec )
    {
-      tim_StartSecTmp( &l_dwTmpEndOfCharge ) ;
-
+      l_Eoc.dwSampleSec = dwSec ;
       sdwCurrent = coevse_GetCurrent() ;
 
-      if ( ( sdwCurrent < ( l_Data.dwCurrentMinStop * 1000 )  ) &&
-           ( l_sdwPrevCurrent < ( l_Data.dwCurrentMinStop * 1000 ) ) )
+      if ( sdwCurrent > (SDWORD)l_Sess.dwMaxCur )
+      {                                /* session maximum current */
+         l_Sess.dwMaxCur = (DWORD)sdwCurrent ;
+      }
+
+      if ( ! l_Eoc.bAvgInit )
       {
-         bEocLowCur = TRUE ;
+         l_Eoc.sdwAvgCur = sdwCurrent ;
+         l_Eoc.bAvgInit = TRUE ;
+      }
+      else
+      {
+         l_Eoc.sdwAvgCur += ( sdwCurrent - l_Eoc.sdwAvgCur ) / ( 1 << l_Eoc.byFilter ) ;
+      }
+
+      if ( ( dwSec - l_Eoc.dwStartSec ) >= CSTATE_ENDOFCHARGE_DELAY )
+      {
+         dwEnergy = coevse_GetEnergy() ;
+
+         if ( l_Eoc.sdwAvgCur >= (SDWORD)( l_Data.dwCurrentMinStop * 1000 ) )
+         {
+            l_Eoc.bLow = FALSE ;
+         }
+         else if ( ( ! l_Eoc.bLow ) || ( dwEnergy < l_Eoc.dwLowEnergy ) )
+         {                             /* dwell time start */
+            l_Eoc.bLow = TRUE ;
+            l_Eoc.dwLowSec = dwSec ;
+            l_Eoc.dwLowEnergy = dwEnergy ;
+         }
+         else if ( ( dwSec - l_Eoc.dwLowSec ) >= l_Eoc.dwDwellSec )
+         {
+            if ( ( dwEnergy - l_Eoc.dwLowEnergy ) <= l_Eoc.dwEnergyWh )
+            {
+               bEocLowCur = TRUE ;
+            }
+            else
+            {                          /* energy still delivered : restart */
+               l_Eoc.dwLowSec = dwSec ;
+               l_Eoc.dwLowEnergy = dwEnergy ;
+               l_Eoc.dwNbRestart++ ;
+            }
+         }
       }
-      l_sdwPrevCurrent = sdwCurrent ;
    }
 
    return bEocLowCur ;
 }
 
 
+/*----------------------------------------------------------------------------*/
+/* Load end of charge detection parameters from eeprom                        */
+/*----------------------------------------------------------------------------*/
+
+static void cstate_LoadEocParam( void )
+{
+   l_Eoc.dwDwellSec = g_sDataEeprom->sChargeStateData.dwEocDwell ;
+   l_Eoc.dwEnergyWh = g_sDataEeprom->sChargeStateData.dwEocEnergy ;
+   l_Eoc.byFilter = (BYTE)g_sDataEeprom->sChargeStateData.dwEocFilter ;
+
+   if ( ( l_Eoc.dwDwellSec == 0 ) || ( l_Eoc.dwDwellSec > CSTATE_EOC_DWELL_MAX ) )
+   {
+      l_Eoc.dwDwellSec = CSTATE_EOC_DWELL_DEF ;
+   }
+   if ( ( l_Eoc.dwEnergyWh == 0 ) || ( l_Eoc.dwEnergyWh > CSTATE_EOC_ENERGY_MAX ) )
+   {
+      l_Eoc.dwEnergyWh = CSTATE_EOC_ENERGY_DEF ;
+   }
+   if ( ( l_Eoc.byFilter == 0 ) || ( l_Eoc.byFilter > CSTATE_EOC_FILTER_MAX ) )
+   {
+      l_Eoc.byFilter = CSTATE_EOC_FILTER_DEF ;
+   }
+}
+
+
 /*----------------------------------------------------------------------------*/
 /* Get the next forced mode status                                            */
 /*----------------------------------------------------------------------------*/
@@ -522,6 +1138,9 @@ static e_cstateForceSt cstate_GetNextForcedState( e_cstateForceSt i_eForceState
 
 static void cstate_UpdateForceState( e_cstateForceSt i_eForceState )
 {
+   l_Data.bBoost = FALSE ;             /* stored force level replaces boost */
+   l_Data.dwTmpBoost = 0 ;
+
    if ( l_Data.eForceState != i_eForceState )
    {
       l_Data.eForceState = i_eForceState ;
@@ -531,6 +1150,247 @@ static void cstate_UpdateForceState( e_cstateForceSt i_eForceState )
 }
 
 
+/*----------------------------------------------------------------------------*/
+/* Update time in state statistics at state change                            */
+/*----------------------------------------------------------------------------*/
+
+static void cstate_UpdateStat( e_cstateChargeSt i_eNextState )
+{
+   s_cstateStat * pStat ;
+   DWORD dwTimeSec ;
+   DWORD dwDur ;
+
+   dwTimeSec = tim_GetSecCnt() ;
+   dwDur = dwTimeSec - l_Hist.dwEnterSec ;
+                                       /* leaving current state */
+   pStat = &l_Hist.aStat[l_Data.eChargeState] ;
+   pStat->dwTotalSec += dwDur ;
+   pStat->dwMaxSec = GETMAX( pStat->dwMaxSec, dwDur ) ;
+                                       /* entering next state */
+   l_Hist.aStat[i_eNextState].dwNbEnter++ ;
+   l_Hist.dwEnterSec = dwTimeSec ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Add a record to charge state history ring                                  */
+/*----------------------------------------------------------------------------*/
+
+static void cstate_AddHistRec( e_cstateChargeSt i_eState, e_cstateReason i_eReason )
+{
+   s_cstateHistRec * pRec ;
+   SDWORD sdwCurrent ;
+
+   sdwCurrent = coevse_GetCurrent() ;
+   sdwCurrent = GETMAX( sdwCurrent, 0 ) ;
+
+   pRec = &l_Hist.aRec[l_Hist.byIdxIn] ;
+   pRec->dwTimeSec = tim_GetSecCnt() ;
+   pRec->byState = (BYTE)i_eState ;
+   pRec->byReason = (BYTE)i_eReason ;
+   pRec->wCurrent = (WORD)GETMIN( sdwCurrent, WORD_MAX ) ;
+
+   l_Hist.byIdxIn = NEXTIDX( l_Hist.byIdxIn, l_Hist.aRec ) ;
+   if ( l_Hist.byNbRec < CSTATE_HIST_NB )
+   {
+      l_Hist.byNbRec++ ;
+   }
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Get history record from its position (0 : oldest record)                   */
+/*----------------------------------------------------------------------------*/
+
+static s_cstateHistRec C* cstate_GetHistRec( BYTE i_byPos )
+{
+   BYTE byIdx ;
+
+   byIdx = ( l_Hist.byIdxIn + CSTATE_HIST_NB - l_Hist.byNbRec + i_byPos ) %
+           CSTATE_HIST_NB ;
+
+   return &l_Hist.aRec[byIdx] ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Format one history record, CSTATE_HIST_LINE_LEN characters :               */
+/* "<time sec> <state> <reason> <current mA>\r\n"                             */
+/*----------------------------------------------------------------------------*/
+
+static void cstate_FmtHistRec( s_cstateHistRec C* i_pRec, CHAR * o_pszLine )
+{
+   snprintf( o_pszLine, CSTATE_HIST_LINE_LEN + 1, "%10lu %1u %1u %5u\r\n",
+             i_pRec->dwTimeSec, i_pRec->byState % 10u, i_pRec->byReason % 10u,
+             i_pRec->wCurrent ) ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Load charge sessions ring state : the newest record has the highest        */
+/* sequence number, records with null sequence number are not valid          */
+/*----------------------------------------------------------------------------*/
+
+static void cstate_SessLoad( void )
+{
+   s_ChargeSessRec C* pRec ;
+   BYTE byIdx ;
+
+   memset( &l_Sess, 0, sizeof(l_Sess) ) ;
+
+   for ( byIdx = 0 ; byIdx < CSTATE_SESS_NB ; byIdx++ )
+   {
+      pRec = &g_sDataEeprom->sChargeSessData.aRec[byIdx] ;
+
+      if ( pRec->dwSeq != 0 )
+      {
+         l_Sess.byNbRec++ ;
+      }
+      if ( pRec->dwSeq > l_Sess.dwSeq )
+      {
+         l_Sess.dwSeq = pRec->dwSeq ;
+         l_Sess.byIdxIn = NEXTIDX( byIdx, g_sDataEeprom->sChargeSessData.aRec ) ;
+      }
+   }
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Charging period start : new session, or resume of the paused session       */
+/*----------------------------------------------------------------------------*/
+
+static void cstate_SessStart( void )
+{
+   if ( ! l_Sess.bPaused )
+   {
+      l_Sess.dwStart = cstate_GetTime() ;
+      l_Sess.dwEnergy = 0 ;
+      l_Sess.dwMaxCur = 0 ;
+   }
+
+   l_Sess.bActive = TRUE ;
+   l_Sess.bPaused = FALSE ;
+   l_Sess.dwTmpMerge = 0 ;
+   l_Sess.dwStartWh = coevse_GetEnergy() ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Charging period end : energy is added, session waits for resume            */
+/*    - <i_eReason> charge stop reason                                        */
+/*----------------------------------------------------------------------------*/
+
+static void cstate_SessStop( e_cstateReason i_eReason )
+{
+   DWORD dwEnergy ;
+
+   if ( l_Sess.bActive )
+   {
+      dwEnergy = coevse_GetEnergy() ;
+      if ( dwEnergy >= l_Sess.dwStartWh )
+      {
+         dwEnergy -= l_Sess.dwStartWh ;
+      }                                /* else openEVSE counter has restarted */
+
+      l_Sess.dwEnergy += dwEnergy ;
+      l_Sess.dwEnd = cstate_GetTime() ;
+      l_Sess.eReason = i_eReason ;
+
+      l_Sess.bActive = FALSE ;
+      l_Sess.bPaused = TRUE ;
+      tim_StartSecTmp( &l_Sess.dwTmpMerge ) ;
+   }
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* End of session : record is written in eeprom ring (sequence number is      */
+/* cleared first and written last)                                            */
+/*----------------------------------------------------------------------------*/
+
+static void cstate_SessWrite( void )
+{
+   s_ChargeSessRec * pRec ;
+
+   l_Sess.bPaused = FALSE ;
+   l_Sess.dwTmpMerge = 0 ;
+
+   if ( l_Sess.dwEnergy >= CSTATE_SESS_ENERGY_MIN )
+   {
+      pRec = &g_sDataEeprom->sChargeSessData.aRec[l_Sess.byIdxIn] ;
+      l_Sess.dwSeq++ ;
+
+      if ( pRec->dwSeq != 0 )
+      {
+         eep_write( (DWORD)&pRec->dwSeq, 0 ) ;
+      }
+      eep_write( (DWORD)&pRec->dwStart, l_Sess.dwStart ) ;
+      eep_write( (DWORD)&pRec->dwEnd, l_Sess.dwEnd ) ;
+      eep_write( (DWORD)&pRec->dwEnergy, l_Sess.dwEnergy ) ;
+      eep_write( (DWORD)&pRec->dwMaxCur, l_Sess.dwMaxCur ) ;
+      eep_write( (DWORD)&pRec->dwReason, l_Sess.eReason ) ;
+      eep_write( (DWORD)&pRec->dwSeq, l_Sess.dwSeq ) ;
+
+      l_Sess.byIdxIn = NEXTIDX( l_Sess.byIdxIn, g_sDataEeprom->sChargeSessData.aRec ) ;
+      l_Sess.byNbRec = GETMIN( l_Sess.byNbRec + 1, CSTATE_SESS_NB ) ;
+   }
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Current date/time, packed for session records                              */
+/*----------------------------------------------------------------------------*/
+
+static DWORD cstate_GetTime( void )
+{
+   s_DateTime sDateTime ;
+   BYTE byWeekday ;
+
+   clk_GetDateTime( &sDateTime, &byWeekday ) ;
+
+   return CSTATE_PACK_TIME( sDateTime ) ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Format one session record (CSTATE_SESS_LINE_LEN characters) :              */
+/* "<seq> <start> <end> <energy> <max current> <reason>\r\n" with date/time   */
+/* as "YYYY/MM/DD-HH:MM:SS", energy in Wh and current in mA                   */
+/*----------------------------------------------------------------------------*/
+
+static void cstate_FmtSessRec( s_ChargeSessRec C* i_pRec, CHAR * o_pszLine )
+{
+   CHAR szStart [CSTATE_TIME_LEN + 1] ;
+   CHAR szEnd [CSTATE_TIME_LEN + 1] ;
+
+   cstate_FmtTime( i_pRec->dwStart, szStart ) ;
+   cstate_FmtTime( i_pRec->dwEnd, szEnd ) ;
+
+   snprintf( o_pszLine, CSTATE_SESS_LINE_LEN + 1, "%5lu %s %s %6lu %5lu %1lu\r\n",
+             i_pRec->dwSeq % 100000, szStart, szEnd,
+             GETMIN( i_pRec->dwEnergy, 999999 ), GETMIN( i_pRec->dwMaxCur, 99999 ),
+             i_pRec->dwReason % 10 ) ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Format a packed date/time (see CSTATE_PACK_TIME()), CSTATE_TIME_LEN        */
+/* characters : "YYYY/MM/DD-HH:MM:SS"                                         */
+/*----------------------------------------------------------------------------*/
+
+static void cstate_FmtTime( DWORD i_dwTime, CHAR * o_pszTime )
+{
+   s_DateTime sDateTime ;
+                                       /* unpacked fields are two digits */
+   cstate_UnpackTime( i_dwTime, &sDateTime ) ;
+
+   snprintf( o_pszTime, CSTATE_TIME_LEN + 1, "%04u/%02u/%02u-%02u:%02u:%02u",
+             sDateTime.byYear % 100u + 2000, sDateTime.byMonth % 100u,
+             sDateTime.byDays % 100u, sDateTime.byHours % 100u,
+             sDateTime.byMinutes % 100u, sDateTime.bySeconds % 100u ) ;
+}
+
+
 /*----------------------------------------------------------------------------*/
 /* Update Led color/blink                                                     */
 /*----------------------------------------------------------------------------*/
@@ -558,22 +1418,7 @@ static void cstate_ProcessLed( void )
       l_eWifiLedColor = eWifiLedColor ;
 
       cstate_HrdSetColorLedWifi( eWifiLedColor ) ;
-
-      if ( ( eWifiLedColor == CSTATE_LED_RED_BLINK ) ||
-           ( eWifiLedColor == CSTATE_LED_BLUE_BLINK ) ||
-           ( eWifiLedColor == CSTATE_LED_GREEN_BLINK )  )
-      {
-         tim_StartMsTmp( &l_dwTmpBlinkLedWifi ) ;
-      }
-      else
-      {
-         l_dwTmpBlinkLedWifi = 0 ;
-      }
-   }
-   if ( tim_IsEndMsTmp( &l_dwTmpBlinkLedWifi, CSTATE_LED_BLINK ) )
-   {
-      HAL_GPIO_TogglePin( CSTATE_LEDWIFI_COMMON_GPIO,CSTATE_LEDWIFI_COMMON_PIN ) ;
-      tim_StartMsTmp( &l_dwTmpBlinkLedWifi ) ;
+      sysled_SetPattern( SYSLED_LED_WIFI, cstate_GetLedPattern( eWifiLedColor ) ) ;
    }
 
    switch( l_Data.eChargeState )
@@ -619,97 +1464,78 @@ static void cstate_ProcessLed( void )
       l_eChargeLedColor = eChargeLedColor ;
 
       cstate_HrdSetColorLedCharge( eChargeLedColor ) ;
-
-      if ( ( eChargeLedColor == CSTATE_LED_RED_BLINK ) ||
-           ( eChargeLedColor == CSTATE_LED_BLUE_BLINK ) ||
-           ( eChargeLedColor == CSTATE_LED_GREEN_BLINK )  )
-      {
-         tim_StartMsTmp( &l_dwTmpBlinkLedCharge ) ;
-      }
-      else
-      {
-         l_dwTmpBlinkLedCharge = 0 ;
-      }
-   }
-   if ( tim_IsEndMsTmp( &l_dwTmpBlinkLedCharge, CSTATE_LED_BLINK ) )
-   {
-      HAL_GPIO_TogglePin( CSTATE_LEDCH_COMMON_GPIO, CSTATE_LEDCH_COMMON_PIN ) ;
-      tim_StartMsTmp( &l_dwTmpBlinkLedCharge ) ;
+      sysled_SetPattern( SYSLED_LED_CHARGE, cstate_GetLedPattern( eChargeLedColor ) ) ;
    }
 }
 
 
 /*----------------------------------------------------------------------------*/
-/* Button read proces                                                         */
+/* Led pattern for a Led color (blinking is generated by SysLed.c)            */
 /*----------------------------------------------------------------------------*/
 
-static BOOL cstate_ProcessButton( BOOL * o_bLongPress )
+static e_sysledPat cstate_GetLedPattern( e_cstateLedColor i_eLedColor )
 {
-   BOOL bPressEvt ;
-   BOOL bButtonRaw ;
+   e_sysledPat ePat ;
 
-   bPressEvt = FALSE ;
-   *o_bLongPress = FALSE ;
-
-   bButtonRaw = ISSET( CSTATE_BUTTON_P2_GPIO->IDR, CSTATE_BUTTON_P2_PIN ) ;
-
-   if ( tim_IsEndMsTmp( &l_dwTmpButtonFilt, CSTATE_BUTTON_FLT_DUR ) )
+   switch ( i_eLedColor )
    {
-      if ( l_bButtonState != bButtonRaw )
-      {
-         l_bButtonState = bButtonRaw ;
+      case CSTATE_LED_RED_BLINK :
+      case CSTATE_LED_BLUE_BLINK :
+      case CSTATE_LED_GREEN_BLINK :
+         ePat = SYSLED_PAT_BLINK ;
+         break ;
 
-         if ( bButtonRaw )
-         {
-            tim_StartMsTmp( &l_dwTmpButtonLongPress ) ;
-         }
-         else
-         {
-            bPressEvt = TRUE ;
-            if ( tim_IsEndMsTmp( &l_dwTmpButtonLongPress, CSTATE_BUTTON_LONGPRESS_DUR ) )
-            {
-               *o_bLongPress = TRUE ;
-            }
-            l_dwTmpButtonLongPress = 0 ;
-         }
-      }
-   }
+      case CSTATE_LED_RED :
+      case CSTATE_LED_BLUE :
+      case CSTATE_LED_GREEN :
+         ePat = SYSLED_PAT_ON ;
+         break ;
 
-   if ( ( l_bButtonState != bButtonRaw ) &&
-        ( tim_GetRemainMsTmp( &l_dwTmpButtonFilt, CSTATE_BUTTON_FLT_DUR ) == 0 ) )
-   {
-      tim_StartMsTmp( &l_dwTmpButtonFilt ) ;
+      case CSTATE_LED_OFF :
+      default :
+         ePat = SYSLED_PAT_OFF ;
+         break ;
    }
 
-   return bPressEvt ;
+   return ePat ;
 }
 
 
 /*----------------------------------------------------------------------------*/
-/* Hardware initialization for button                                         */
+/* Button gesture process                                                     */
+/* Return:                                                                    */
+/*    - FSM events to process                                                 */
 /*----------------------------------------------------------------------------*/
 
-static void cstate_HrdInitButton( void )
+static BYTE cstate_ProcessButton( e_btnGesture i_eGesture )
 {
-   GPIO_InitTypeDef sGpioInit ;
+   BYTE byEvt ;
 
-      /* configure button 1 pin as output, no push/pull, high freq */
-   sGpioInit.Pin = CSTATE_BUTTON_P1_PIN ;
-   sGpioInit.Mode = GPIO_MODE_OUTPUT_PP ;
-   sGpioInit.Pull = GPIO_NOPULL ;
-   sGpioInit.Speed = GPIO_SPEED_FREQ_HIGH ;
-   sGpioInit.Alternate = CSTATE_BUTTON_P1_AF ;
-   HAL_GPIO_Init( CSTATE_BUTTON_P1_GPIO, &sGpioInit ) ;
+   byEvt = 0 ;
 
-   HAL_GPIO_WritePin( CSTATE_BUTTON_P1_GPIO, CSTATE_BUTTON_P1_PIN, GPIO_PIN_SET ) ;
+   switch ( i_eGesture )
+   {
+      case BTN_PRESS :                       /* next force level */
+         cstate_UpdateForceState( cstate_GetNextForcedState( l_Data.eForceState ) ) ;
+         byEvt = CSTATE_EVT_FORCE ;
+         break ;
 
-      /* configure button 2 pin as input, pull-down, high freq */
-   sGpioInit.Pin = CSTATE_BUTTON_P2_PIN ;
-   sGpioInit.Mode = GPIO_MODE_INPUT ;
-   sGpioInit.Pull = GPIO_PULLDOWN ;
-   sGpioInit.Speed = GPIO_SPEED_FREQ_HIGH ;
-   sGpioInit.Alternate = CSTATE_BUTTON_P2_AF ;
-   HAL_GPIO_Init( CSTATE_BUTTON_P2_GPIO, &sGpioInit ) ;
+      case BTN_LONG_PRESS :                  /* toggle wifi maintenance mode */
+         cwifi_SetMaintMode( ! l_Data.bWifiMaint ) ;
+         break ;
+
+      case BTN_DOUBLE_PRESS :                /* boost charge */
+         l_Data.eForceState = CSTATE_FORCE_ALL ;
+         l_Data.bBoost = TRUE ;
+         tim_StartSecTmp( &l_Data.dwTmpBoost ) ;
+         byEvt = CSTATE_EVT_FORCE ;
+         break ;
+
+      default :
+         break ;
+   }
+
+   return byEvt ;
 }
 
 
@@ -798,7 +1624,6 @@ static void cstate_HrdSetColorLedWifi( e_cstateLedColor i_eLedColor )
    {
       case CSTATE_LED_RED_BLINK :
       case CSTATE_LED_RED :
-         HAL_GPIO_WritePin( CSTATE_LEDWIFI_COMMON_GPIO, CSTATE_LEDWIFI_COMMON_PIN, GPIO_PIN_RESET ) ;
          HAL_GPIO_WritePin( CSTATE_LEDWIFI_RED_GPIO, CSTATE_LEDWIFI_RED_PIN, GPIO_PIN_SET ) ;
          HAL_GPIO_WritePin( CSTATE_LEDWIFI_BLUE_GPIO, CSTATE_LEDWIFI_BLUE_PIN, GPIO_PIN_RESET ) ;
          HAL_GPIO_WritePin( CSTATE_LEDWIFI_GREEN_GPIO, CSTATE_LEDWIFI_GREEN_PIN, GPIO_PIN_RESET ) ;
@@ -806,7 +1631,6 @@ static void cstate_HrdSetColorLedWifi( e_cstateLedColor i_eLedColor )
 
       case CSTATE_LED_BLUE_BLINK :
       case CSTATE_LED_BLUE :
-         HAL_GPIO_WritePin( CSTATE_LEDWIFI_COMMON_GPIO, CSTATE_LEDWIFI_COMMON_PIN, GPIO_PIN_RESET ) ;
          HAL_GPIO_WritePin( CSTATE_LEDWIFI_RED_GPIO, CSTATE_LEDWIFI_RED_PIN, GPIO_PIN_RESET ) ;
          HAL_GPIO_WritePin( CSTATE_LEDWIFI_BLUE_GPIO, CSTATE_LEDWIFI_BLUE_PIN, GPIO_PIN_SET ) ;
          HAL_GPIO_WritePin( CSTATE_LEDWIFI_GREEN_GPIO, CSTATE_LEDWIFI_GREEN_PIN, GPIO_PIN_RESET ) ;
@@ -814,7 +1638,6 @@ static void cstate_HrdSetColorLedWifi( e_cstateLedColor i_eLedColor )
 
       case CSTATE_LED_GREEN_BLINK :
       case CSTATE_LED_GREEN :
-         HAL_GPIO_WritePin( CSTATE_LEDWIFI_COMMON_GPIO, CSTATE_LEDWIFI_COMMON_PIN, GPIO_PIN_RESET ) ;
          HAL_GPIO_WritePin( CSTATE_LEDWIFI_RED_GPIO, CSTATE_LEDWIFI_RED_PIN, GPIO_PIN_RESET ) ;
          HAL_GPIO_WritePin( CSTATE_LEDWIFI_BLUE_GPIO, CSTATE_LEDWIFI_BLUE_PIN, GPIO_PIN_RESET ) ;
          HAL_GPIO_WritePin( CSTATE_LEDWIFI_GREEN_GPIO, CSTATE_LEDWIFI_GREEN_PIN, GPIO_PIN_SET ) ;
@@ -822,7 +1645,6 @@ static void cstate_HrdSetColorLedWifi( e_cstateLedColor i_eLedColor )
 
       case CSTATE_LED_OFF :
       default :
-         HAL_GPIO_WritePin( CSTATE_LEDWIFI_COMMON_GPIO, CSTATE_LEDWIFI_COMMON_PIN, GPIO_PIN_RESET ) ;
          HAL_GPIO_WritePin( CSTATE_LEDWIFI_RED_GPIO, CSTATE_LEDWIFI_RED_PIN, GPIO_PIN_RESET ) ;
          HAL_GPIO_WritePin( CSTATE_LEDWIFI_BLUE_GPIO, CSTATE_LEDWIFI_BLUE_PIN, GPIO_PIN_RESET ) ;
          HAL_GPIO_WritePin( CSTATE_LEDWIFI_GREEN_GPIO, CSTATE_LEDWIFI_GREEN_PIN, GPIO_PIN_RESET ) ;
@@ -841,7 +1663,6 @@ static void cstate_HrdSetColorLedCharge( e_cstateLedColor i_eLedColor )
    {
       case CSTATE_LED_RED_BLINK :
       case CSTATE_LED_RED :
-         HAL_GPIO_WritePin( CSTATE_LEDCH_COMMON_GPIO, CSTATE_LEDCH_COMMON_PIN, GPIO_PIN_RESET ) ;
          HAL_GPIO_WritePin( CSTATE_LEDCH_RED_GPIO, CSTATE_LEDCH_RED_PIN, GPIO_PIN_SET ) ;
          HAL_GPIO_WritePin( CSTATE_LEDCH_BLUE_GPIO, CSTATE_LEDCH_BLUE_PIN, GPIO_PIN_RESET ) ;
          HAL_GPIO_WritePin( CSTATE_LEDCH_GREEN_GPIO, CSTATE_LEDCH_GREEN_PIN, GPIO_PIN_RESET ) ;
@@ -849,7 +1670,6 @@ static void cstate_HrdSetColorLedCharge( e_cstateLedColor i_eLedColor )
 
       case CSTATE_LED_BLUE_BLINK :
       case CSTATE_LED_BLUE :
-         HAL_GPIO_WritePin( CSTATE_LEDCH_COMMON_GPIO, CSTATE_LEDCH_COMMON_PIN, GPIO_PIN_RESET ) ;
          HAL_GPIO_WritePin( CSTATE_LEDCH_RED_GPIO, CSTATE_LEDCH_RED_PIN, GPIO_PIN_RESET ) ;
          HAL_GPIO_WritePin( CSTATE_LEDCH_BLUE_GPIO, CSTATE_LEDCH_BLUE_PIN, GPIO_PIN_SET ) ;
          HAL_GPIO_WritePin( CSTATE_LEDCH_GREEN_GPIO, CSTATE_LEDCH_GREEN_PIN, GPIO_PIN_RESET ) ;
@@ -857,7 +1677,6 @@ static void cstate_HrdSetColorLedCharge( e_cstateLedColor i_eLedColor )
 
       case CSTATE_LED_GREEN_BLINK :
       case CSTATE_LED_GREEN :
-         HAL_GPIO_WritePin( CSTATE_LEDCH_COMMON_GPIO, CSTATE_LEDCH_COMMON_PIN, GPIO_PIN_RESET ) ;
          HAL_GPIO_WritePin( CSTATE_LEDCH_RED_GPIO, CSTATE_LEDCH_RED_PIN, GPIO_PIN_RESET ) ;
          HAL_GPIO_WritePin( CSTATE_LEDCH_BLUE_GPIO, CSTATE_LEDCH_BLUE_PIN, GPIO_PIN_RESET ) ;
          HAL_GPIO_WritePin( CSTATE_LEDCH_GREEN_GPIO, CSTATE_LEDCH_GREEN_PIN, GPIO_PIN_SET ) ;
@@ -865,7 +1684,6 @@ static void cstate_HrdSetColorLedCharge( e_cstateLedColor i_eLedColor )
 
       case CSTATE_LED_OFF :
       default :
-         HAL_GPIO_WritePin( CSTATE_LEDCH_COMMON_GPIO, CSTATE_LEDCH_COMMON_PIN, GPIO_PIN_RESET ) ;
          HAL_GPIO_WritePin( CSTATE_LEDCH_RED_GPIO, CSTATE_LEDCH_RED_PIN, GPIO_PIN_RESET ) ;
          HAL_GPIO_WritePin( CSTATE_LEDCH_BLUE_GPIO, CSTATE_LEDCH_BLUE_PIN, GPIO_PIN_RESET ) ;
          HAL_GPIO_WritePin( CSTATE_LEDCH_GREEN_GPIO, CSTATE_LEDCH_GREEN_PIN, GPIO_PIN_RESET ) ;
@@ -0,0 +1,401 @@
+/******************************************************************************/
+/*                                LoadMgmt.c                                  */
+/******************************************************************************/
+/*
+   Dynamic load management of the charge current capacity
+
+   Copyright (C) 2018  Sylvain BASSET
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+   ------------
+   @version 1.0
+   @history 1.0, 19 oct. 2019, creation
+   @brief
+   The household power (W, measured at the house main meter, EV included) is
+   pushed by an external source with lmgt_SetHousePower() (socket frame, see
+   ScktFrame.c and lmgt_SetHousePowerStr(), an argument without digits is
+   rejected, and not taken as a 0 W measurement). From this measurement and the EV charge current, the current
+   left under the main breaker rating (LMGT_MAIN_CURRENT, minus LMGT_MARGIN_MA)
+   is computed, and given to OpenEVSE as a volatile current capacity (not
+   saved in OpenEVSE eeprom).
+
+   The capacity is bounded by the user capacity (lmgt_SetUserCap(), set from
+   the HTML charge page and saved in OpenEVSE eeprom) and by
+   COEVSE_CURRENT_CAPMAX_MIN, the lowest value allowed by the pilot signal.
+
+   - decreases are applied immediately,
+   - increases need a LMGT_HYST_UP margin, are limited to LMGT_STEP_UP per
+     step, and to one step every LMGT_UP_PERIOD.
+   - without new measurement for LMGT_MES_TIMEOUT, the capacity falls back to
+     COEVSE_CURRENT_CAPMAX_MIN until measurements come back.
+
+   The charge planner (ChargePlan.c) may also bound the capacity with
+   lmgt_SetPlanCap() (current modulation of the planned slots).
+
+   Load management is inactive (user capacity only) until the first
+   measurement or planner capacity is received.
+
+   The capacity computation (lmgt_ComputeCap()) and its hysteresis and rate
+   limit (lmgt_StepCap()) access neither OpenEVSE nor the time base :
+   measurements and current time are given as parameters, so they are
+   replayed on the host (test/TestLoadMgmt.c).
+*/
+
+
+#include <stm32l0xx_hal.h>
+#include "Define.h"
+#include "Control.h"
+#include "Communic.h"
+#include "System.h"
+#include "Lib.h"
+
+
+/*----------------------------------------------------------------------------*/
+/* Defines                                                                    */
+/*----------------------------------------------------------------------------*/
+
+#define LMGT_MAIN_CURRENT        30    /* house main breaker rating (A) */
+#define LMGT_MARGIN_MA         1000    /* margin kept under breaker rating (mA) */
+#define LMGT_MAINS_VOLTAGE      230    /* mains nominal voltage (V) */
+
+#define LMGT_HYST_UP              1    /* capacity increase hysteresis (A) */
+#define LMGT_STEP_UP              2    /* maximum capacity increase per step (A) */
+#define LMGT_UP_PERIOD        30000    /* minimum delay before capacity increase (ms) */
+
+#define LMGT_MES_TIMEOUT      60000    /* house power measurement validity (ms) */
+#define LMGT_CHECK_PER        10000    /* OpenEVSE capacity read back check period (ms) */
+
+
+/*----------------------------------------------------------------------------*/
+/* Types                                                                      */
+/*----------------------------------------------------------------------------*/
+
+typedef struct
+{
+   BOOL bActive ;                      /* load management engaged */
+   BOOL bMeter ;                       /* at least one measurement received */
+   BOOL bStale ;                       /* measurement lost, minimum capacity */
+   DWORD dwPower ;                     /* last household power (W) */
+   DWORD dwTickMes ;                   /* last measurement time (ms) */
+   BYTE byUserCap ;                    /* user capacity (A), 0 if unknown */
+   BYTE byCap ;                        /* capacity given to OpenEVSE (A), 0 if none */
+   BYTE byPlanCap ;                    /* charge planner capacity (A), 0 if none */
+   DWORD dwTickUp ;                    /* last capacity setting time (ms) */
+   DWORD dwTmpCheck ;                  /* capacity read back check tempo */
+   DWORD dwNbDecrease ;                /* number of capacity decreases */
+   DWORD dwNbIncrease ;                /* number of capacity increases */
+   DWORD dwNbStale ;                   /* number of measurement losses */
+} s_lmgtState ;
+
+
+/*----------------------------------------------------------------------------*/
+/* Variables                                                                  */
+/*----------------------------------------------------------------------------*/
+
+static s_lmgtState l_Lmgt ;
+
+
+/*----------------------------------------------------------------------------*/
+/* Prototypes                                                                 */
+/*----------------------------------------------------------------------------*/
+
+static void lmgt_Engage( void ) ;
+static BYTE lmgt_ComputeCap( DWORD i_dwPower, SDWORD i_sdwEvCurrent,
+                             BYTE i_byUserCap ) ;
+static BOOL lmgt_StepCap( s_lmgtState * io_pLmgt, BYTE i_byTarget,
+                          DWORD i_dwTick ) ;
+
+
+/*----------------------------------------------------------------------------*/
+/* Module initialization                                                      */
+/*----------------------------------------------------------------------------*/
+
+void lmgt_Init( void )
+{
+   memset( &l_Lmgt, 0, sizeof(l_Lmgt) ) ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* New household power measurement (W)                                        */
+/*----------------------------------------------------------------------------*/
+
+void lmgt_SetHousePower( DWORD i_dwPower )
+{
+   l_Lmgt.dwPower = i_dwPower ;
+   l_Lmgt.dwTickMes = HAL_GetTick() ;
+   l_Lmgt.bMeter = TRUE ;
+
+   lmgt_Engage() ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* New household power measurement from socket frame argument                 */
+/*    - <i_pszArg> decimal power (W)                                          */
+/* Return ERR if no power is given (measurement ignored)                      */
+/*----------------------------------------------------------------------------*/
+
+RESULT lmgt_SetHousePowerStr( char C* i_pszArg )
+{
+   char C* pszEnd ;
+   SDWORD sdwPower ;
+   RESULT rRet ;
+
+   pszEnd = cascii_GetNextDec( i_pszArg, &sdwPower, FALSE, LMGT_POWER_MAX ) ;
+
+   if ( pszEnd == i_pszArg )           /* no digit parsed */
+   {
+      rRet = ERR ;
+   }
+   else
+   {
+      lmgt_SetHousePower( (DWORD)sdwPower ) ;
+      rRet = OK ;
+   }
+
+   return rRet ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Set charge planner current capacity (A), 0 if none                         */
+/*----------------------------------------------------------------------------*/
+
+void lmgt_SetPlanCap( BYTE i_byCurrent )
+{
+   l_Lmgt.byPlanCap = i_byCurrent ;
+
+   if ( i_byCurrent != 0 )
+   {
+      lmgt_Engage() ;
+   }
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Set user current capacity (A), saved in OpenEVSE eeprom                    */
+/*----------------------------------------------------------------------------*/
+
+void lmgt_SetUserCap( BYTE i_byCurrent )
+{
+   l_Lmgt.byUserCap = i_byCurrent ;
+   coevse_SetCurrentCap( i_byCurrent ) ;
+
+   if ( l_Lmgt.bActive )
+   {                                   /* persistent capacity overrides the */
+      l_Lmgt.byCap = 0 ;               /* volatile one : send it again      */
+   }
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Get user current capacity (A), OpenEVSE one if not set since boot          */
+/*----------------------------------------------------------------------------*/
+
+BYTE lmgt_GetUserCap( void )
+{
+   BYTE byCap ;
+
+   if ( l_Lmgt.byUserCap != 0 )
+   {
+      byCap = l_Lmgt.byUserCap ;
+   }
+   else
+   {
+      byCap = (BYTE)GETMIN( coevse_GetCurrentCap(), COEVSE_CURRENT_CAPMAX_MAX ) ;
+      byCap = GETMAX( byCap, COEVSE_CURRENT_CAPMAX_MIN ) ;
+   }
+
+   return byCap ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Load management status formatting : allowed capacity (A), user capacity    */
+/* (A), household power (W), measurement age (ms, -1 if never received),      */
+/* decreases, increases and measurement losses numbers, planner capacity (A)  */
+/*----------------------------------------------------------------------------*/
+
+void lmgt_FmtStat( CHAR * o_pszStr, WORD i_wSize )
+{
+   SDWORD sdwAge ;
+
+   if ( l_Lmgt.bMeter )
+   {
+      sdwAge = (SDWORD)( HAL_GetTick() - l_Lmgt.dwTickMes ) ;
+   }
+   else
+   {
+      sdwAge = -1 ;
+   }
+
+   snprintf( o_pszStr, i_wSize, "%u, %u, %lu, %li, %lu, %lu, %lu, %u\r\n",
+             l_Lmgt.byCap, l_Lmgt.byUserCap, l_Lmgt.dwPower, sdwAge,
+             l_Lmgt.dwNbDecrease, l_Lmgt.dwNbIncrease, l_Lmgt.dwNbStale,
+             l_Lmgt.byPlanCap ) ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* periodic task                                                              */
+/*----------------------------------------------------------------------------*/
+
+void lmgt_TaskCyc( void )
+{
+   DWORD dwCap ;
+   BYTE byTarget ;
+
+   if ( l_Lmgt.bActive && ( l_Lmgt.byUserCap == 0 ) )
+   {                                   /* user capacity not set since boot : */
+      dwCap = coevse_GetCurrentCap() ; /* take the OpenEVSE saved one        */
+
+      if ( ( dwCap >= COEVSE_CURRENT_CAPMAX_MIN ) &&
+           ( dwCap <= COEVSE_CURRENT_CAPMAX_MAX ) )
+      {
+         l_Lmgt.byUserCap = (BYTE)dwCap ;
+      }
+   }
+
+   if ( l_Lmgt.bActive && ( l_Lmgt.byUserCap != 0 ) )
+   {
+      if ( ! l_Lmgt.bMeter )
+      {                                /* planner only */
+         byTarget = l_Lmgt.byUserCap ;
+      }
+      else if ( ( HAL_GetTick() - l_Lmgt.dwTickMes ) > LMGT_MES_TIMEOUT )
+      {                                /* measurement lost : safe minimum */
+         if ( ! l_Lmgt.bStale )
+         {
+            l_Lmgt.bStale = TRUE ;
+            l_Lmgt.dwNbStale++ ;
+         }
+         byTarget = COEVSE_CURRENT_CAPMAX_MIN ;
+      }
+      else
+      {
+         l_Lmgt.bStale = FALSE ;
+         byTarget = lmgt_ComputeCap( l_Lmgt.dwPower, coevse_GetCurrent(),
+                                     l_Lmgt.byUserCap ) ;
+      }
+
+      if ( l_Lmgt.byPlanCap != 0 )
+      {
+         byTarget = GETMIN( byTarget, l_Lmgt.byPlanCap ) ;
+      }
+                                       /* OpenEVSE restarted or persistent */
+                                       /* capacity changed : send again    */
+      if ( tim_IsEndMsTmp( &l_Lmgt.dwTmpCheck, LMGT_CHECK_PER ) )
+      {
+         tim_StartMsTmp( &l_Lmgt.dwTmpCheck ) ;
+
+         if ( coevse_GetCurrentCap() != l_Lmgt.byCap )
+         {
+            l_Lmgt.byCap = 0 ;
+         }
+      }
+
+      if ( lmgt_StepCap( &l_Lmgt, byTarget, HAL_GetTick() ) )
+      {
+         coevse_SetCurrentVol( l_Lmgt.byCap ) ;
+      }
+   }
+}
+
+
+/*============================================================================*/
+
+/*----------------------------------------------------------------------------*/
+/* Engage load management (first measurement or planner capacity)             */
+/*----------------------------------------------------------------------------*/
+
+static void lmgt_Engage( void )
+{
+   if ( ! l_Lmgt.bActive )
+   {
+      l_Lmgt.bActive = TRUE ;
+      tim_StartMsTmp( &l_Lmgt.dwTmpCheck ) ;
+   }
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Allowed current capacity (A) given household power <i_dwPower> (W), EV     */
+/* current <i_sdwEvCurrent> (mA) and user capacity <i_byUserCap> (A)          */
+/*----------------------------------------------------------------------------*/
+
+static BYTE lmgt_ComputeCap( DWORD i_dwPower, SDWORD i_sdwEvCurrent,
+                             BYTE i_byUserCap )
+{
+   SDWORD sdwEvCurrent ;
+   SDWORD sdwHouseCurrent ;
+   SDWORD sdwAvail ;
+   BYTE byCap ;
+                                       /* EV charge current (mA) */
+   sdwEvCurrent = GETMAX( i_sdwEvCurrent, 0 ) ;
+                                       /* household current, EV excluded (mA) */
+   sdwHouseCurrent = (SDWORD)( ( i_dwPower * 1000 ) / LMGT_MAINS_VOLTAGE ) -
+                     sdwEvCurrent ;
+   sdwHouseCurrent = GETMAX( sdwHouseCurrent, 0 ) ;
+                                       /* current left for EV (mA) */
+   sdwAvail = ( LMGT_MAIN_CURRENT * 1000 ) - LMGT_MARGIN_MA - sdwHouseCurrent ;
+
+   if ( sdwAvail < ( COEVSE_CURRENT_CAPMAX_MIN * 1000 ) )
+   {
+      byCap = COEVSE_CURRENT_CAPMAX_MIN ;
+   }
+   else
+   {
+      byCap = (BYTE)GETMIN( sdwAvail / 1000, i_byUserCap ) ;
+   }
+
+   return byCap ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Step capacity toward target, at time <i_dwTick> (ms) : decrease is         */
+/* immediate, increase needs hysteresis and is rate limited. Returns TRUE if  */
+/* capacity has changed and has to be sent to OpenEVSE                        */
+/*----------------------------------------------------------------------------*/
+
+static BOOL lmgt_StepCap( s_lmgtState * io_pLmgt, BYTE i_byTarget,
+                          DWORD i_dwTick )
+{
+   BOOL bChanged ;
+
+   bChanged = FALSE ;
+
+   if ( ( io_pLmgt->byCap == 0 ) || ( i_byTarget < io_pLmgt->byCap ) )
+   {                                   /* first setting or overload : now */
+      if ( io_pLmgt->byCap != 0 )
+      {
+         io_pLmgt->dwNbDecrease++ ;
+      }
+      io_pLmgt->byCap = i_byTarget ;
+      io_pLmgt->dwTickUp = i_dwTick ;
+      bChanged = TRUE ;
+   }
+   else if ( ( i_byTarget >= ( io_pLmgt->byCap + LMGT_HYST_UP ) ) &&
+             ( ( i_dwTick - io_pLmgt->dwTickUp ) >= LMGT_UP_PERIOD ) )
+   {
+      io_pLmgt->byCap = GETMIN( i_byTarget, io_pLmgt->byCap + LMGT_STEP_UP ) ;
+      io_pLmgt->dwNbIncrease++ ;
+      io_pLmgt->dwTickUp = i_dwTick ;
+      bChanged = TRUE ;
+   }
+
+   return bChanged ;
+}
@@ -2,7 +2,7 @@
 /*                                 SysLed.c                                   */
 /******************************************************************************/
 /*
-   System Led (on nucleo board) management
+   Status Leds patterns management
 
    Copyright (C) 2018  Sylvain BASSET
 
@@ -22,6 +22,20 @@
    ------------
    @version 1.0
    @history 1.0, 14 mar. 2019, creation
+            1.1, 19 oct. 2019, patterns generated by timer interrupt
+   @brief
+   Led blinking is generated by the TIMLED timer update interrupt, every
+   SYSLED_STEP_DUR ms : each Led follows an on/off pattern from k_aPattern
+   table (one bit per step, SYSLED_STEP_MAX steps maximum). Modules only
+   select the Led pattern with sysled_SetPattern(), so blinking does not
+   depend on the main loop timing. The timer is stopped when no Led blinks.
+
+   For the wifi and charge RGB Leds, the pattern drives the common pin, the
+   color is selected by ChargeState.c with the color pins. Led pins are not
+   timer channels, so Leds are only switched on/off (no brightness control).
+
+   The system Led (on nucleo board) blinks while there is no error, and
+   gives the lowest error Id (see e_ErrorId) by a number of flashes.
 */
 
 
@@ -32,21 +46,100 @@
 
 
 /*----------------------------------------------------------------------------*/
-/* Defines                                                                  */
+/* Defines                                                                    */
+/*----------------------------------------------------------------------------*/
+
+#define SYSLED_STEP_DUR    100         /* pattern step duration (ms) */
+#define SYSLED_STEP_MAX    32          /* maximum steps per pattern */
+
+#define TIMLED_FREQ        1000llu     /* timer counter frequency (Hz) */
+
+#define SYSLED_ERRCODE_MAX    5        /* highest error Id given by flashes */
+
+                                       /* error code pattern : <n> 100 ms */
+                                       /* flashes, then pause              */
+#define SYSLED_ERRCODE( Nb )  ( 0x55555555 & ( ( 1lu << ( 2 * (Nb) ) ) - 1 ) )
+
+
+/*----------------------------------------------------------------------------*/
+/* Types                                                                      */
 /*----------------------------------------------------------------------------*/
 
-#define  SYSLED_DUR_TMP    500         /* ms */
+typedef struct                         /* Led pattern */
+{
+   DWORD dwSeq ;                       /* on/off steps, bit 0 first */
+   BYTE byNbStep ;                     /* number of steps */
+} s_sysledPattern ;
+
+typedef struct                         /* Led hardware */
+{
+   GPIO_TypeDef * pGpio ;              /* switched pin port */
+   WORD wPin ;                         /* switched pin */
+   GPIO_PinState eOnState ;            /* pin state for Led on */
+} s_sysledHrd ;
+
+typedef struct                         /* Led state */
+{
+   volatile BYTE byPat ;               /* current pattern (e_sysledPat) */
+   volatile BYTE byStep ;              /* current step */
+} s_sysledState ;
+
+
+/*----------------------------------------------------------------------------*/
+/* Constants                                                                  */
+/*----------------------------------------------------------------------------*/
+
+                                       /* pattern define macro */
+#define _P( Name, Seq, NbStep ) \
+   [SYSLED_PAT_##Name] = { .dwSeq = Seq, .byNbStep = NbStep }
+
+static s_sysledPattern const k_aPattern [SYSLED_PAT_LAST] =
+{
+   _P( OFF,        0x00000000,  1 ),
+   _P( ON,         0x00000001,  1 ),
+   _P( BLINK,      0x0000001F, 10 ),   /* 500 ms on, 500 ms off */
+   _P( BLINK_FAST, 0x00000001,  2 ),   /* 100 ms on, 100 ms off */
+   _P( HEARTBEAT,  0x00000005, 15 ),   /* two flashes, then pause */
+   _P( ERR_1,      SYSLED_ERRCODE( 1 ), 20 ),
+   _P( ERR_2,      SYSLED_ERRCODE( 2 ), 20 ),
+   _P( ERR_3,      SYSLED_ERRCODE( 3 ), 20 ),
+   _P( ERR_4,      SYSLED_ERRCODE( 4 ), 20 ),
+   _P( ERR_5,      SYSLED_ERRCODE( 5 ), 20 ),
+} ;
+
+static s_sysledHrd const k_aLedHrd [SYSLED_LED_LAST] =
+{
+   [SYSLED_LED_WIFI] = { .pGpio = CSTATE_LEDWIFI_COMMON_GPIO,
+                         .wPin = CSTATE_LEDWIFI_COMMON_PIN,
+                         .eOnState = GPIO_PIN_RESET },
+   [SYSLED_LED_CHARGE] = { .pGpio = CSTATE_LEDCH_COMMON_GPIO,
+                           .wPin = CSTATE_LEDCH_COMMON_PIN,
+                           .eOnState = GPIO_PIN_RESET },
+   [SYSLED_LED_SYS] = { .pGpio = SYSLED_GPIO,
+                        .wPin = SYSLED_PIN,
+                        .eOnState = GPIO_PIN_SET },
+} ;
 
 
 /*----------------------------------------------------------------------------*/
 /* Variables                                                                  */
 /*----------------------------------------------------------------------------*/
 
-static DWORD l_dwLedTmp ;
+static s_sysledState l_aLed [SYSLED_LED_LAST] ;
+
+
+/*----------------------------------------------------------------------------*/
+/* Prototypes                                                                 */
+/*----------------------------------------------------------------------------*/
+
+static void sysled_EvtError( e_evtId i_eEvtId, DWORD i_dwValue ) ;
+static void sysled_WriteStep( e_sysledLed i_eLed ) ;
+static void sysled_HrdInitTimer( void ) ;
 
 
 /*----------------------------------------------------------------------------*/
 /* Module initialization                                                      */
+/* Note : wifi and charge Leds pins are initialized by ChargeState.c          */
 /*----------------------------------------------------------------------------*/
 
 void sysled_Init( void )
@@ -60,21 +153,158 @@ void sysled_Init( void )
    sGpioInit.Alternate = SYSLED_AF ;
    HAL_GPIO_Init( SYSLED_GPIO, &sGpioInit ) ;
 
-   tim_StartMsTmp( &l_dwLedTmp ) ;
+   memset( l_aLed, 0, sizeof(l_aLed) ) ;
+
+   sysled_HrdInitTimer() ;
+
+   sysled_SetPattern( SYSLED_LED_SYS, SYSLED_PAT_BLINK ) ;
+
+   evt_Subscribe( EVT_ERROR, &sysled_EvtError ) ;
 }
 
 
 /*----------------------------------------------------------------------------*/
-/* periodic task                                                              */
+/* Set Led pattern                                                            */
+/*    - <i_eLed> Led                                                          */
+/*    - <i_ePat> new pattern, restarted from first step if changed            */
 /*----------------------------------------------------------------------------*/
 
-void sysled_TaskCyc( void )
+void sysled_SetPattern( e_sysledLed i_eLed, e_sysledPat i_ePat )
 {
-                                       /* if tempo ended */
-   if ( tim_IsEndMsTmp( &l_dwLedTmp, SYSLED_DUR_TMP ) )
+   BOOL bBlink ;
+   BYTE byLed ;
+
+   if ( ( i_eLed < SYSLED_LED_LAST ) && ( i_ePat < SYSLED_PAT_LAST ) &&
+        ( l_aLed[i_eLed].byPat != i_ePat ) )
    {
-      tim_StartMsTmp( &l_dwLedTmp ) ;
-                                       /* toggle system LED pin */
-      HAL_GPIO_TogglePin( SYSLED_GPIO, SYSLED_PIN ) ;
+      HAL_NVIC_DisableIRQ( TIMLED_IRQn ) ;
+
+      l_aLed[i_eLed].byPat = i_ePat ;
+      l_aLed[i_eLed].byStep = 0 ;
+      sysled_WriteStep( i_eLed ) ;
+                                       /* timer is only needed for blinking */
+      bBlink = FALSE ;
+      for ( byLed = 0 ; byLed < SYSLED_LED_LAST ; byLed++ )
+      {
+         if ( k_aPattern[l_aLed[byLed].byPat].byNbStep > 1 )
+         {
+            bBlink = TRUE ;
+         }
+      }
+
+      if ( bBlink && ! ISSET( TIMLED->CR1, TIM_CR1_CEN ) )
+      {
+         TIMLED->CNT = 0 ;
+         TIMLED->CR1 |= TIM_CR1_CEN ;
+      }
+      else if ( ! bBlink )
+      {
+         TIMLED->CR1 &= ~TIM_CR1_CEN ;
+      }
+
+      HAL_NVIC_EnableIRQ( TIMLED_IRQn ) ;
    }
 }
+
+
+/*----------------------------------------------------------------------------*/
+/* IRQ Leds timer : next pattern step                                         */
+/*----------------------------------------------------------------------------*/
+
+void TIMLED_IRQHandler( void )
+{
+   BYTE byLed ;
+
+   TIMLED->SR = ~TIM_SR_UIF ;          /* clear update interrupt flag */
+
+   for ( byLed = 0 ; byLed < SYSLED_LED_LAST ; byLed++ )
+   {
+      l_aLed[byLed].byStep = ( l_aLed[byLed].byStep + 1 ) %
+                             k_aPattern[l_aLed[byLed].byPat].byNbStep ;
+      sysled_WriteStep( byLed ) ;
+   }
+}
+
+
+/*============================================================================*/
+
+/*----------------------------------------------------------------------------*/
+/* Error list change event callback : error code given by system Led          */
+/*----------------------------------------------------------------------------*/
+
+static void sysled_EvtError( e_evtId i_eEvtId, DWORD i_dwValue )
+{
+   BYTE byErrId ;
+
+   USEPARAM( i_eEvtId ) ;
+                                       /* lowest error Id (bit 0 : Id 1) */
+   byErrId = 1 ;
+   while ( ( byErrId <= SYSLED_ERRCODE_MAX ) &&
+           ! ISSET( i_dwValue, 1lu << ( byErrId - 1 ) ) )
+   {
+      byErrId++ ;
+   }
+
+   if ( byErrId <= SYSLED_ERRCODE_MAX )
+   {
+      sysled_SetPattern( SYSLED_LED_SYS, SYSLED_PAT_ERR_1 + byErrId - 1 ) ;
+   }
+   else if ( i_dwValue != 0 )
+   {
+      sysled_SetPattern( SYSLED_LED_SYS, SYSLED_PAT_BLINK_FAST ) ;
+   }
+   else
+   {
+      sysled_SetPattern( SYSLED_LED_SYS, SYSLED_PAT_BLINK ) ;
+   }
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Write Led pin for current pattern step                                     */
+/*----------------------------------------------------------------------------*/
+
+static void sysled_WriteStep( e_sysledLed i_eLed )
+{
+   s_sysledHrd C* pHrd ;
+   GPIO_PinState eState ;
+
+   pHrd = &k_aLedHrd[i_eLed] ;
+
+   if ( ISSET( k_aPattern[l_aLed[i_eLed].byPat].dwSeq, 1lu << l_aLed[i_eLed].byStep ) )
+   {
+      eState = pHrd->eOnState ;
+   }
+   else if ( pHrd->eOnState == GPIO_PIN_SET )
+   {
+      eState = GPIO_PIN_RESET ;
+   }
+   else
+   {
+      eState = GPIO_PIN_SET ;
+   }
+
+   HAL_GPIO_WritePin( pHrd->pGpio, pHrd->wPin, eState ) ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Hardware initialization for Leds timer : update interrupt every step       */
+/*----------------------------------------------------------------------------*/
+
+static void sysled_HrdInitTimer( void )
+{
+   TIMLED_CLK_ENABLE() ;               /* enable Leds timer clock */
+
+   TIMLED->CR1 = 0 ;                   /* timer stopped, up counter */
+   TIMLED->PSC = ( APB2_CLK / TIMLED_FREQ ) - 1 ;
+   TIMLED->ARR = ( ( TIMLED_FREQ * SYSLED_STEP_DUR ) / 1000 ) - 1 ;
+   TIMLED->EGR = TIM_EGR_UG ;          /* load prescaler */
+   TIMLED->SR = 0 ;
+
+   TIMLED->DIER = TIM_DIER_UIE ;       /* enable update interruption */
+
+                                       /* set the Leds timer priority */
+   HAL_NVIC_SetPriority( TIMLED_IRQn, TIMLED_IRQPri, 0 ) ;
+   HAL_NVIC_EnableIRQ( TIMLED_IRQn ) ;
+}
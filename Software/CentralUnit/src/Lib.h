@@ -36,5 +36,8 @@ char C* cascii_GetNextDec( char C* i_pszStr, SDWORD *o_psdwValue,
                            BOOL i_bIsSigned, DWORD i_dwMax ) ;
 char C* cascii_GetNextHex( char C* i_pszStr, DWORD *o_pdwValue ) ;
 
+BYTE cascii_GetNibble( char i_cChar ) ;
+char cascii_GetHexChar( BYTE i_byNibble ) ;
+
 
 #endif /* __LIB_H */
\ No newline at end of file
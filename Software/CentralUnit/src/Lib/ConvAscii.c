@@ -24,7 +24,8 @@
    @history 1.0, 11 avr. 2020, creation
    @brief
    Implement read of next decimal or hexadecimal number, ignoring non digit
-   caracter at the begining of the string
+   caracter at the begining of the string, and single hexadecimal digit
+   conversions
 */
 
 
@@ -163,3 +164,45 @@ char C* cascii_GetNextHex( char C* i_pszStr, DWORD *o_pdwValue )
 
    return pszEnd ;
 }
+
+
+/*----------------------------------------------------------------------------*/
+/* convert one hexa character to its value                                    */
+/* Return BYTE_MAX if the character is not an hexa digit                     */
+/*----------------------------------------------------------------------------*/
+
+BYTE cascii_GetNibble( char i_cChar )
+{
+   BYTE byNibble ;
+
+   if ( ( i_cChar >= '0' ) && ( i_cChar <= '9' ) )
+   {
+      byNibble = i_cChar - '0' ;
+   }
+   else if ( ( i_cChar >= 'A' ) && ( i_cChar <= 'F' ) )
+   {
+      byNibble = ( i_cChar - 'A' ) + 10 ;
+   }
+   else if ( ( i_cChar >= 'a' ) && ( i_cChar <= 'f' ) )
+   {
+      byNibble = ( i_cChar - 'a' ) + 10 ;
+   }
+   else
+   {
+      byNibble = BYTE_MAX ;
+   }
+
+   return byNibble ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* convert 4 lowest bits to upper case hexa character                         */
+/*----------------------------------------------------------------------------*/
+
+char cascii_GetHexChar( BYTE i_byNibble )
+{
+   static char const k_szHexChar [] = "0123456789ABCDEF" ;
+
+   return k_szHexChar[ i_byNibble & 0x0F ] ;
+}
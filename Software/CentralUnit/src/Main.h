@@ -35,6 +35,22 @@
 
 #define TASKCALL_PER_MS  10            /* tasks call period, ms */
 
+typedef enum                           /* monitored tasks Id (watchdog) */
+{
+   MAIN_TASK_NONE = 0,                 /* no running task */
+   MAIN_TASK_INIT,                     /* modules initialization */
+   MAIN_TASK_CLK,                      /* Clock.c */
+   MAIN_TASK_CSTATE,                   /* ChargeState.c */
+   MAIN_TASK_CWIFI,                    /* CommWifi.c */
+   MAIN_TASK_SFRM,                     /* ScktFrame.c */
+   MAIN_TASK_COEVSE,                   /* CommOEvse.c */
+   MAIN_TASK_LMGT,                     /* LoadMgmt.c */
+   MAIN_TASK_EVT,                      /* Event.c dispatch (last) */
+   MAIN_TASK_LAST
+} e_mainTask ;
+
+void main_FmtWdgStat( CHAR * o_pszStat, WORD i_wSize ) ;
+
 
 /*----------------------------------------------------------------------------*/
 /* Identity.c                                                                 */
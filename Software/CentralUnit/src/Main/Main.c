@@ -22,6 +22,26 @@
    ------------
    @version 1.0
    @history 1.0, 4 mars 2018, creation
+            1.1, 19 oct. 2019, watchdog and task deadline monitoring
+   @brief
+   The main loop calls each module cyclic task every <XXX_TASK_PER> ms. The
+   independent watchdog (IWDG) guards against a hang of the main loop
+   (busy waiting loops, fatal error) :
+      - each task call is timed, and the task checks in when it returns
+        within its budget (<XXX_TASK_BUDGET> ms). The event dispatch is
+        monitored the same way,
+      - at the end of each round (all tasks called, main loop counter back to
+        0), the watchdog is refreshed only if every task has checked in and
+        no task has overrun its budget,
+      - the running task Id is written in RTC backup register MAIN_BKP_TASK,
+        and the last overrun task Id in MAIN_BKP_OVERRUN, so the offending
+        task of a watchdog reset is known after reboot : the running task if
+        the reset occurred inside a task, otherwise the last overrun one.
+
+   Backup registers are read before clk_Init(), which may reset the backup
+   domain, and are written only after it (main_WdgBkpInit()), so the reset
+   count survives a backup domain reset. Monitoring status is given by
+   main_FmtWdgStat().
 */
 
 
@@ -38,9 +58,6 @@
 /* Defines                                                                    */
 /*----------------------------------------------------------------------------*/
 
-#define TIMSYSLED_FREQ_DIV    1000llu     /* set counter incr frequency to 1 ms */
-#define TIMSYSLED_PERIOD      500llu      /* set period to 500 ms*/
-
 #define TASK_PER_LOOP    1000             /* calling loop period (must be multiple for all periods) */
 
 #define CLK_TASK_PER     1000             /* Clock.c module call period */
@@ -52,18 +69,86 @@
 #define CWIFI_TASK_PER      1             /* CommWifi.c module call period */
 #define CWIFI_TASK_ORDER    0
 
-#define COEVSE_TASK_PER    10             /* CommOEvse.c module call period */
+#define SFRM_TASK_PER      10             /* ScktFrame.c module call period */
+#define SFRM_TASK_ORDER     0
+
+#define COEVSE_TASK_PER     1             /* CommOEvse.c module call period */
 #define COEVSE_TASK_ORDER   0
 
-#define SYSLED_TASK_PER       10          /* SysLed.c module call period */
-#define SYSLED_TASK_ORDER      0
+#define LMGT_TASK_PER        100          /* LoadMgmt.c module call period */
+#define LMGT_TASK_ORDER        5
+
+#define CLK_TASK_BUDGET       10          /* maximum task call durations (ms) */
+#define CSTATE_TASK_BUDGET    50
+#define CWIFI_TASK_BUDGET     50
+#define SFRM_TASK_BUDGET     100
+#define COEVSE_TASK_BUDGET    20
+#define LMGT_TASK_BUDGET      20
+#define EVT_TASK_BUDGET       50
 
 #define TASK_CALL( prefixlow, prefixup )                                         \
-   if ( ( byTaskPerCnt % prefixup##_TASK_PER ) == prefixup##_TASK_ORDER )    \
+   if ( ( wTaskPerCnt % prefixup##_TASK_PER ) == prefixup##_TASK_ORDER )     \
    {                                                                             \
+      main_TaskStart( MAIN_TASK_##prefixup ) ;                                   \
       prefixlow##_TaskCyc() ;                                                  \
+      main_TaskEnd( prefixup##_TASK_BUDGET ) ;                                   \
    }
 
+#define MAIN_WDG_TIMEOUT   10000llu       /* watchdog timeout (ms), higher than LSE */
+                                          /* startup timeout with LSI tolerance    */
+#define MAIN_WDG_PRESC       256llu       /* watchdog prescaler */
+                                          /* watchdog reload value */
+#define MAIN_WDG_RELOAD    ( ( LSI_VALUE * MAIN_WDG_TIMEOUT ) / ( MAIN_WDG_PRESC * 1000 ) )
+
+#define MAIN_IWDG_KEY_START    0xCCCC     /* IWDG key register values */
+#define MAIN_IWDG_KEY_ACCESS   0x5555
+#define MAIN_IWDG_KEY_REFRESH  0xAAAA
+
+#define MAIN_BKP_TASK      ( RTC->BKP1R ) /* running task Id */
+#define MAIN_BKP_OVERRUN   ( RTC->BKP2R ) /* last overrun task Id */
+#define MAIN_BKP_NBRESET   ( RTC->BKP3R ) /* watchdog resets number */
+
+                                          /* check-in mask of a healthy round */
+#define MAIN_TASK_MASK     ( ( 1lu << MAIN_TASK_LAST ) - ( 1lu << MAIN_TASK_CLK ) )
+
+
+/*----------------------------------------------------------------------------*/
+/* Types                                                                      */
+/*----------------------------------------------------------------------------*/
+
+typedef struct                         /* task deadline monitoring */
+{
+   e_mainTask eTask ;                  /* running task */
+   DWORD dwTickStart ;                 /* running task start time, ms */
+   DWORD dwCheckIn ;                   /* tasks checked in during current round */
+   BOOL bOverrun ;                     /* a task has overrun its budget in current round */
+   BOOL bWdgReset ;                    /* last reset was a watchdog reset */
+   BYTE byResetTask ;                  /* offending task of last watchdog reset */
+   DWORD dwNbReset ;                   /* watchdog resets number */
+   DWORD dwNbOverrun ;                 /* task budget overruns number */
+   DWORD dwNbUnhealthy ;               /* rounds without watchdog refresh */
+   BYTE byOverTask ;                   /* last overrun task */
+   WORD awMaxDur [MAIN_TASK_LAST] ;    /* maximum call duration per task, ms */
+} s_mainWdg ;
+
+
+/*----------------------------------------------------------------------------*/
+/* Variables                                                                  */
+/*----------------------------------------------------------------------------*/
+
+static s_mainWdg l_Wdg ;
+
+
+/*----------------------------------------------------------------------------*/
+/* Prototypes                                                                 */
+/*----------------------------------------------------------------------------*/
+
+static void main_WdgInit( void ) ;
+static void main_WdgBkpInit( void ) ;
+static void main_TaskStart( e_mainTask i_eTask ) ;
+static void main_TaskEnd( DWORD i_dwBudget ) ;
+static void main_WdgRound( void ) ;
+
 
 
 
@@ -74,7 +159,7 @@
 int main( void )
 {
    DWORD dwTaskTmp ;
-   BYTE byTaskPerCnt ;
+   WORD wTaskPerCnt ;                  /* wide enough for TASK_PER_LOOP */
 
       /* Note: The call to HAL_Init() perform these oprations:               */
       /* - Configure the Flash prefetch, Flash preread and Buffer caches     */
@@ -89,32 +174,192 @@ int main( void )
    HAL_Init() ;                        /* STM32L0xx HAL library initialization */
    GPIO_CLK_ENABLE() ;
 
+   main_WdgInit() ;                    /* watchdog is running from here */
+
+   evt_Init() ;
+
    clk_Init() ;
+   main_WdgBkpInit() ;                 /* backup domain is ready from here */
    cal_Init() ;
 
    cstate_Init() ;
+   btn_Init() ;
    cwifi_Init() ;
    sfrm_Init() ;
    html_Init() ;
 
    coevse_Init() ;
    sysled_Init() ;
+   lmgt_Init() ;
+   cplan_Init() ;
 
-   byTaskPerCnt = 0 ;
+   wTaskPerCnt = 0 ;
    tim_StartMsTmp( &dwTaskTmp ) ;
 
+   IWDG->KR = MAIN_IWDG_KEY_REFRESH ;  /* end of initialization */
+
    while ( TRUE )                      /* Infinite loop */
    {
 
       TASK_CALL( clk, CLK ) ;
       TASK_CALL( cstate, CSTATE ) ;
       TASK_CALL( cwifi, CWIFI ) ;
+      TASK_CALL( sfrm, SFRM ) ;
       TASK_CALL( coevse, COEVSE ) ;
-      TASK_CALL( sysled, SYSLED ) ;
+      TASK_CALL( lmgt, LMGT ) ;
+
+      main_TaskStart( MAIN_TASK_EVT ) ;
+      evt_TaskCyc() ;                  /* dispatch events published in this tick */
+      main_TaskEnd( EVT_TASK_BUDGET ) ;
 
       while ( ! tim_IsEndMsTmp( &dwTaskTmp, 1 ) ) ;
       tim_StartMsTmp( &dwTaskTmp ) ;
 
-      byTaskPerCnt = ( byTaskPerCnt + 1 ) % TASK_PER_LOOP ;
+      wTaskPerCnt = ( wTaskPerCnt + 1 ) % TASK_PER_LOOP ;
+
+      if ( wTaskPerCnt == 0 )          /* end of round */
+      {
+         main_WdgRound() ;
+      }
+   }
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Format watchdog monitoring status : last reset by watchdog (0/1),          */
+/* offending task Id of last watchdog reset (e_mainTask, 0 if none), watchdog */
+/* resets number, budget overruns number, last overrun task Id, rounds        */
+/* without watchdog refresh, then maximum call duration (ms) of each task     */
+/* from MAIN_TASK_CLK, separated by '/'                                       */
+/*----------------------------------------------------------------------------*/
+
+void main_FmtWdgStat( CHAR * o_pszStat, WORD i_wSize )
+{
+   WORD wLen ;
+   BYTE byTask ;
+
+   snprintf( o_pszStat, i_wSize, "%u, %u, %lu, %lu, %u, %lu, ",
+             l_Wdg.bWdgReset, l_Wdg.byResetTask, l_Wdg.dwNbReset,
+             l_Wdg.dwNbOverrun, l_Wdg.byOverTask, l_Wdg.dwNbUnhealthy ) ;
+
+   for ( byTask = MAIN_TASK_CLK ; byTask < MAIN_TASK_LAST ; byTask++ )
+   {
+      wLen = strlen( o_pszStat ) ;
+      snprintf( &o_pszStat[wLen], i_wSize - wLen, "%s%u",
+                ( byTask == MAIN_TASK_CLK ) ? "" : "/", l_Wdg.awMaxDur[byTask] ) ;
    }
+}
+
+
+/*============================================================================*/
+
+/*----------------------------------------------------------------------------*/
+/* Watchdog initialization : get last reset cause and offending task from     */
+/* backup registers (read only, backup domain may be reset by clk_Init()),    */
+/* then start IWDG                                                            */
+/*----------------------------------------------------------------------------*/
+
+static void main_WdgInit( void )
+{
+   memset( &l_Wdg, 0, sizeof(l_Wdg) ) ;
+
+   HAL_PWR_EnableBkUpAccess() ;        /* enable backup and RTC domain access */
+
+   if ( ISSET( RCC->CSR, RCC_CSR_IWDGRSTF ) )
+   {
+      l_Wdg.bWdgReset = TRUE ;
+      if ( MAIN_BKP_TASK != MAIN_TASK_NONE )
+      {                                /* reset occurred inside a task */
+         l_Wdg.byResetTask = (BYTE)MAIN_BKP_TASK ;
+      }
+      else
+      {                                /* no refresh because of overruns */
+         l_Wdg.byResetTask = (BYTE)MAIN_BKP_OVERRUN ;
+      }
+   }
+   l_Wdg.dwNbReset = MAIN_BKP_NBRESET + ( l_Wdg.bWdgReset ? 1 : 0 ) ;
+
+   RCC->CSR |= RCC_CSR_RMVF ;          /* clear reset flags */
+
+   IWDG->KR = MAIN_IWDG_KEY_START ;    /* start watchdog (LSI is enabled by hardware) */
+   IWDG->KR = MAIN_IWDG_KEY_ACCESS ;   /* enable prescaler and reload access */
+   IWDG->PR = IWDG_PR_PR_2 | IWDG_PR_PR_1 ; /* prescaler 256 */
+   IWDG->RLR = MAIN_WDG_RELOAD ;
+                                       /* wait for registers update (if it never */
+   while ( IWDG->SR != 0 ) ;           /* ends, the watchdog resets anyway)      */
+
+   IWDG->KR = MAIN_IWDG_KEY_REFRESH ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Backup registers initialization, after clk_Init() : reset count is written */
+/* back (restored if backup domain has been reset), initialization is running */
+/*----------------------------------------------------------------------------*/
+
+static void main_WdgBkpInit( void )
+{
+   MAIN_BKP_NBRESET = l_Wdg.dwNbReset ;
+   MAIN_BKP_TASK = MAIN_TASK_INIT ;
+   MAIN_BKP_OVERRUN = MAIN_TASK_NONE ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Task call start : task Id is written in backup register                    */
+/*----------------------------------------------------------------------------*/
+
+static void main_TaskStart( e_mainTask i_eTask )
+{
+   l_Wdg.eTask = i_eTask ;
+   l_Wdg.dwTickStart = HAL_GetTick() ;
+   MAIN_BKP_TASK = i_eTask ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Task call end : the task checks in if it has returned within its budget    */
+/*    - <i_dwBudget> maximum call duration, ms                                */
+/*----------------------------------------------------------------------------*/
+
+static void main_TaskEnd( DWORD i_dwBudget )
+{
+   DWORD dwDur ;
+
+   dwDur = HAL_GetTick() - l_Wdg.dwTickStart ;
+   l_Wdg.awMaxDur[l_Wdg.eTask] = GETMAX( l_Wdg.awMaxDur[l_Wdg.eTask],
+                                         GETMIN( dwDur, WORD_MAX ) ) ;
+   if ( dwDur <= i_dwBudget )
+   {
+      l_Wdg.dwCheckIn |= ( 1lu << l_Wdg.eTask ) ;
+   }
+   else
+   {
+      l_Wdg.bOverrun = TRUE ;
+      l_Wdg.dwNbOverrun++ ;
+      l_Wdg.byOverTask = l_Wdg.eTask ;
+      MAIN_BKP_OVERRUN = l_Wdg.eTask ;
+   }
+
+   MAIN_BKP_TASK = MAIN_TASK_NONE ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* End of round : watchdog is refreshed only if the round is fully healthy    */
+/*----------------------------------------------------------------------------*/
+
+static void main_WdgRound( void )
+{
+   if ( ( l_Wdg.dwCheckIn == MAIN_TASK_MASK ) && ( ! l_Wdg.bOverrun ) )
+   {
+      IWDG->KR = MAIN_IWDG_KEY_REFRESH ;
+   }
+   else
+   {
+      l_Wdg.dwNbUnhealthy++ ;
+   }
+
+   l_Wdg.dwCheckIn = 0 ;
+   l_Wdg.bOverrun = FALSE ;
 }
\ No newline at end of file
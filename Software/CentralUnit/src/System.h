@@ -66,6 +66,32 @@ DWORD err_GetErrorList( BOOL * o_pbChange, BOOL i_bResetChange, CHAR * o_pszStr,
 void err_FatalError( void ) ;
 
 
+/*----------------------------------------------------------------------------*/
+/* Event.c                                                                    */
+/*----------------------------------------------------------------------------*/
+
+typedef enum                           /* event topics */
+{
+   EVT_EVSE_STATE = 0,                 /* openEvse state change (e_coevseEvseState) */
+   EVT_PLUG,                           /* vehicle plugging event */
+   EVT_CHARGE_ENABLE,                  /* calendar charge enable change (BOOL) */
+   EVT_CLOCK_SEC,                      /* clock second tick */
+   EVT_MAINT_MODE,                     /* wifi maintenance mode change (BOOL) */
+   EVT_ERROR,                          /* error list change (error bit mask) */
+   EVT_BUTTON,                         /* button gesture (e_btnGesture), each gesture */
+   EVT_NB,
+} e_evtId ;
+                                       /* event callback */
+typedef void (*f_evtProc)( e_evtId i_eEvtId, DWORD i_dwValue ) ;
+
+void evt_Init( void ) ;
+void evt_Subscribe( e_evtId i_eEvtId, f_evtProc i_fEvtProc ) ;
+void evt_Publish( e_evtId i_eEvtId, DWORD i_dwValue ) ;
+DWORD evt_GetNbLost( void ) ;
+
+void evt_TaskCyc( void ) ;
+
+
 /*----------------------------------------------------------------------------*/
 /* Timer.c                                                                    */
 /*----------------------------------------------------------------------------*/
@@ -79,6 +105,8 @@ BOOL tim_IsEndSecTmp( DWORD* io_pdwTempo, DWORD i_dwDelay ) ;
 DWORD tim_GetRemainMsTmp( DWORD* io_pdwTempo, DWORD i_dwDelay ) ;
 DWORD tim_GetRemainSecTmp( DWORD* io_pdwTempo, DWORD i_dwDelay ) ;
 
+DWORD tim_GetSecCnt( void ) ;
+
 
 /*----------------------------------------------------------------------------*/
 /* Clock.c                                                                    */
@@ -124,13 +152,44 @@ typedef struct
 {
    DWORD dwForceState ;
    DWORD dwCurrentMinStop ;
+   DWORD dwEocDwell ;                  /* end of charge dwell time (sec), 0 : default */
+   DWORD dwEocEnergy ;                 /* end of charge energy delta (Wh), 0 : default */
+   DWORD dwEocFilter ;                 /* end of charge current filter, 0 : default */
 } s_ChargeStateData ;
 
+#define CPLAN_TARIFF_NB     8          /* charge planner tariff periods number */
+
+typedef struct                         /* eeprom structure for charge planner tariff */
+{
+   DWORD adwPeriod [ CPLAN_TARIFF_NB ] ;  /* days mask, start and end slots */
+   DWORD adwPrice [ CPLAN_TARIFF_NB ] ;   /* period slot price */
+   DWORD dwPriceDef ;                  /* price outside periods */
+} s_ChargePlanData ;
+
+#define CSTATE_SESS_NB     32          /* charge session records number (ring) */
+
+typedef struct                         /* eeprom charge session record */
+{
+   DWORD dwSeq ;                       /* record sequence number, 0 : no record */
+   DWORD dwStart ;                     /* start date/time (packed, see cstate_UnpackTime()) */
+   DWORD dwEnd ;                       /* end date/time (packed) */
+   DWORD dwEnergy ;                    /* delivered energy (Wh) */
+   DWORD dwMaxCur ;                    /* maximum charge current (mA) */
+   DWORD dwReason ;                    /* termination reason (e_cstateReason) */
+} s_ChargeSessRec ;
+
+typedef struct                         /* eeprom structure for charge sessions */
+{
+   s_ChargeSessRec aRec [ CSTATE_SESS_NB ] ;  /* wear-leveled records ring */
+} s_ChargeSessData ;
+
 typedef struct                         /* eeprom data structure definition */
 {
    s_CalData sCalData ;                /* calendar module eeprom data */
    s_WifiConInfo sWifiConInfo ;        /* wifi SSID and password */
    s_ChargeStateData sChargeStateData ;
+   s_ChargePlanData sChargePlanData ;  /* charge planner tariff */
+   s_ChargeSessData sChargeSessData ;  /* charge session records */
 } s_DataEeprom ;
 
                                        /* global for eeprom data access */
@@ -429,6 +429,8 @@ void clk_TaskCyc( void )
       }
       RTC->WPR = 0xFFU ;                  /* enable RTC register write protection */
    }
+
+   evt_Publish( EVT_CLOCK_SEC, 0 ) ;
 }
 
 
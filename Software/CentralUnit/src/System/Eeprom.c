@@ -98,7 +98,8 @@ RESULT eep_WriteWifiId( BOOL i_bIsSsid, char C* i_szParam )
 
 
 /*----------------------------------------------------------------------------*/
-/* Eeprom writing operation                                                   */
+/* Eeprom writing operation, returns when the word is programmed, so that     */
+/* successive writes are completed in the call order                          */
 /*    - <i_dwAddress> address in eeprom                                       */
 /*    - <i_dwValue> value to write                                            */
 /*----------------------------------------------------------------------------*/
@@ -127,6 +128,15 @@ void eep_write( DWORD i_dwAddress, DWORD i_dwValue )
       }
                                        /* write the value */
       *(volatile DWORD *)i_dwAddress = i_dwValue ;
+
+      tim_StartMsTmp( &dwTmpTimeout ) ; /* wait erase/program has finished */
+      while ( ISSET( FLASH->SR, FLASH_FLAG_BSY ) )
+      {
+         if ( tim_IsEndMsTmp( &dwTmpTimeout, EEP_BUSY_TIMEOUT ) )
+         {
+            break ;
+         }
+      }
                                        /* Set the PELOCK Bit to lock eeprom access */
       SET_BIT( FLASH->PECR, FLASH_PECR_PELOCK ) ;
    }
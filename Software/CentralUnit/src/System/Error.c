@@ -62,6 +62,7 @@ void err_Set( e_ErrorId i_eErrorId )
    {
       l_dwRecordedError = dwRecordedError ;
       l_bErrChange = TRUE ;
+      evt_Publish( EVT_ERROR, dwRecordedError ) ;
    }
 }
 
@@ -98,6 +99,9 @@ void err_FatalError( void )
 {
    GPIO_InitTypeDef sGpioInit ;
 
+   TIMLED->CR1 = 0 ;                   /* stop Leds patterns timer */
+   HAL_NVIC_DisableIRQ( TIMLED_IRQn ) ;
+
                                        /* Configure SYSLED_PIN pin as output push-pull */
    sGpioInit.Pin = SYSLED_PIN ;
    sGpioInit.Mode = GPIO_MODE_OUTPUT_PP ;
@@ -0,0 +1,192 @@
+/******************************************************************************/
+/*                                   Event.c                                  */
+/******************************************************************************/
+/*
+   Event bus
+
+   Copyright (C) 2018  Sylvain BASSET
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+   ------------
+   @version 1.0
+   @history 1.0, 19 oct. 2019, creation
+   @brief
+
+   This module allows modules to exchange state changes without polling :
+
+   - Topics are defined at compile time by e_evtId (see System.h).
+   - A consumer registers a callback for one topic with evt_Subscribe(), at
+     initialisation time. Callbacks table is static, no dynamic allocation.
+   - A producer calls evt_Publish() only when the published value changes.
+     The event is stored in a fixed-size queue, it may be called from
+     interrupt context.
+   - evt_TaskCyc() is called at the end of each main loop tick, it dispatches
+     all the queued events to their subscribers. Events published by a
+     subscriber are dispatched in the same call, so a state change is
+     propagated in the tick where it has been published.
+*/
+
+
+#include <stm32l0xx_hal.h>
+#include "Define.h"
+#include "System.h"
+
+
+/*----------------------------------------------------------------------------*/
+/* Defines                                                                    */
+/*----------------------------------------------------------------------------*/
+
+#define EVT_QUEUE_SIZE      16         /* events queue size */
+#define EVT_SUBSCR_MAX       3         /* maximum subscribers number per topic */
+
+                                       /* maximum number of dispatched events */
+                                       /* in one call (prevents endless loop) */
+#define EVT_DISPATCH_MAX    ( 2 * EVT_QUEUE_SIZE )
+
+typedef struct                         /* queued event */
+{
+   BYTE byEvtId ;                      /* event topic */
+   DWORD dwValue ;                     /* event value */
+} s_evtItem ;
+
+typedef struct                         /* events queue */
+{
+   s_evtItem aItem [EVT_QUEUE_SIZE] ;
+   volatile BYTE byIdxIn ;
+   volatile BYTE byIdxOut ;
+   DWORD dwNbLost ;                    /* number of events lost (queue full) */
+} s_evtQueue ;
+
+
+/*----------------------------------------------------------------------------*/
+/* Variables                                                                  */
+/*----------------------------------------------------------------------------*/
+
+static s_evtQueue l_Queue ;
+                                       /* subscribers table */
+static f_evtProc l_afSubscr [EVT_NB][EVT_SUBSCR_MAX] ;
+
+
+/*----------------------------------------------------------------------------*/
+/* Module initialization                                                      */
+/*----------------------------------------------------------------------------*/
+
+void evt_Init( void )
+{
+   memset( &l_Queue, 0, sizeof(l_Queue) ) ;
+   memset( l_afSubscr, 0, sizeof(l_afSubscr) ) ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Register a callback for one topic                                          */
+/*    - i_eEvtId : event topic                                                */
+/*    - i_fEvtProc : callback function                                        */
+/*----------------------------------------------------------------------------*/
+
+void evt_Subscribe( e_evtId i_eEvtId, f_evtProc i_fEvtProc )
+{
+   BYTE byIdx ;
+
+   ERR_FATAL_IF( i_eEvtId >= EVT_NB ) ;
+
+   byIdx = 0 ;
+   while ( ( byIdx < EVT_SUBSCR_MAX ) && ( l_afSubscr[i_eEvtId][byIdx] != NULL ) )
+   {
+      byIdx++ ;
+   }
+                                       /* the table is sized at compile time */
+   ERR_FATAL_IF( byIdx >= EVT_SUBSCR_MAX ) ;
+
+   l_afSubscr[i_eEvtId][byIdx] = i_fEvtProc ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Publish an event                                                           */
+/*    - i_eEvtId : event topic                                                */
+/*    - i_dwValue : new value                                                 */
+/*----------------------------------------------------------------------------*/
+
+void evt_Publish( e_evtId i_eEvtId, DWORD i_dwValue )
+{
+   DWORD dwPriMask ;
+   BYTE byIdxIn ;
+   BYTE byNextIdxIn ;
+
+   dwPriMask = __get_PRIMASK() ;       /* queue may be filled from interrupt */
+   __disable_irq() ;
+
+   byIdxIn = l_Queue.byIdxIn ;
+   byNextIdxIn = NEXTIDX( byIdxIn, l_Queue.aItem ) ;
+
+   if ( byNextIdxIn != l_Queue.byIdxOut )
+   {
+      l_Queue.aItem[byIdxIn].byEvtId = (BYTE)i_eEvtId ;
+      l_Queue.aItem[byIdxIn].dwValue = i_dwValue ;
+      l_Queue.byIdxIn = byNextIdxIn ;
+   }
+   else
+   {
+      l_Queue.dwNbLost++ ;
+   }
+
+   __set_PRIMASK( dwPriMask ) ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Read number of events lost because of full queue                           */
+/*----------------------------------------------------------------------------*/
+
+DWORD evt_GetNbLost( void )
+{
+   return l_Queue.dwNbLost ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Cyclic task ( called at the end of each main loop tick )                   */
+/*----------------------------------------------------------------------------*/
+
+void evt_TaskCyc( void )
+{
+   s_evtItem Item ;
+   BYTE byNbDispatch ;
+   BYTE byIdx ;
+   f_evtProc fEvtProc ;
+
+   byNbDispatch = 0 ;
+
+   while ( ( l_Queue.byIdxOut != l_Queue.byIdxIn ) &&
+           ( byNbDispatch < EVT_DISPATCH_MAX ) )
+   {
+      Item = l_Queue.aItem[l_Queue.byIdxOut] ;
+      l_Queue.byIdxOut = NEXTIDX( l_Queue.byIdxOut, l_Queue.aItem ) ;
+      byNbDispatch++ ;
+
+      if ( Item.byEvtId < EVT_NB )
+      {
+         for ( byIdx = 0 ; byIdx < EVT_SUBSCR_MAX ; byIdx++ )
+         {
+            fEvtProc = l_afSubscr[Item.byEvtId][byIdx] ;
+            if ( fEvtProc != NULL )
+            {
+               fEvtProc( (e_evtId)Item.byEvtId, Item.dwValue ) ;
+            }
+         }
+      }
+   }
+}
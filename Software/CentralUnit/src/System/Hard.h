@@ -135,19 +135,37 @@
 #define UWIFI_DMA_IRQPri   1           /* Wifi DMA UART */
 #define UWIFI_IRQPri       2           /* Wifi UART */
 #define UOEVSE_IRQPri      3           /* OpenEVSE UART */
+#define TIMLED_IRQPri      3           /* Leds patterns timer */
+#define BTN_IRQPri         3           /* button edge and timer */
 
 
 /*----------------------------------------------------------------------------*/
-/* definitions for system LED Timer (example)                                 */
+/* definitions for Leds patterns Timer                                        */
 /*----------------------------------------------------------------------------*/
 
-#define TIMSYSLED    TIM6              /* timer driver for system LED */
-                                       /* system Led timer clock enable/disable */
-#define TIMSYSLED_CLK_ENABLE()     __TIM6_CLK_ENABLE()
-#define TIMSYSLED_CLK_DISABLE()    __TIM6_CLK_DISABLE()
+#define TIMLED    TIM22                /* timer driver for Leds patterns */
+                                       /* Leds timer clock enable/disable */
+#define TIMLED_CLK_ENABLE()        __TIM22_CLK_ENABLE()
+#define TIMLED_CLK_DISABLE()       __TIM22_CLK_DISABLE()
 
-#define TIMSYSLED_IRQn             TIM6_IRQn
-#define TIMSYSLED_IRQHandler       TIM6_DAC_IRQHandler
+#define TIMLED_IRQn                TIM22_IRQn
+#define TIMLED_IRQHandler          TIM22_IRQHandler
+
+
+/*----------------------------------------------------------------------------*/
+/* definitions for button Timer and EXTI line                                 */
+/*----------------------------------------------------------------------------*/
+
+#define TIMBTN    TIM6                 /* one-shot timer for button debounce */
+                                       /* button timer clock enable/disable */
+#define TIMBTN_CLK_ENABLE()        __TIM6_CLK_ENABLE()
+#define TIMBTN_CLK_DISABLE()       __TIM6_CLK_DISABLE()
+
+#define TIMBTN_IRQn                TIM6_IRQn
+#define TIMBTN_IRQHandler          TIM6_DAC_IRQHandler
+                                       /* EXTI line of CSTATE_BUTTON_P2_PIN */
+#define BTN_EXTI_IRQn              EXTI2_3_IRQn
+#define BTN_EXTI_IRQHandler        EXTI2_3_IRQHandler
 
 
 /*----------------------------------------------------------------------------*/
@@ -250,4 +268,12 @@
 #define UOEVSE_DMA_TX_ISRIFCR( Value ) \
                                     DMA_MAKE_ISRIFCR( Value, UOEVSE_DMA_TX_CHANNEL )
 
+#define UOEVSE_DMA_RX               DMA1_Channel6
+#define UOEVSE_DMA_RX_CHANNEL       6
+#define UOEVSE_DMA_RX_REQ           DMA_REQUEST_5
+#define UOEVSE_DMA_RX_CSELR( Value ) \
+                                    DMA_MAKE_CSELR( Value, UOEVSE_DMA_RX_CHANNEL )
+#define UOEVSE_DMA_RX_ISRIFCR( Value ) \
+                                    DMA_MAKE_ISRIFCR( Value, UOEVSE_DMA_RX_CHANNEL )
+
 #endif /* __HARD_H */
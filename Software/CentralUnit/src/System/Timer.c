@@ -168,6 +168,16 @@ DWORD tim_GetRemainSecTmp( DWORD * io_pdwTempo, DWORD i_dwDelay )
 }
 
 
+/*----------------------------------------------------------------------------*/
+/* Get second counter value (seconds since start-up)                          */
+/*----------------------------------------------------------------------------*/
+
+DWORD tim_GetSecCnt( void )
+{
+   return l_dwSecCnt ;
+}
+
+
 /*============================================================================*/
 
 /*----------------------------------------------------------------------------*/
@@ -0,0 +1,188 @@
+/******************************************************************************/
+/*                                 HostTest.h                                 */
+/******************************************************************************/
+/*
+   host test common header
+
+   Copyright (C) 2018  Sylvain BASSET
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+   ------------
+   @version 1.0
+   @history 1.0, 19 oct. 2019, creation
+   @brief
+   Firmware modules are built and run on the host by RunTests.sh. Each test
+   driver (TestXxx.c) includes the source of the tested module, so static
+   data and functions are reachable, and gives stubs for the functions of
+   other modules. Peripheral registers or eeprom used by the tested code are
+   redirected to RAM variables before the module source is included (headers
+   are protected against recursive inclusion, so the redirection is kept).
+
+   Time is simulated : HAL_GetTick() gives l_dwTestTick, and test_Advance()
+   runs the SysTick handler, so System/Timer.c is included by every driver.
+
+   Stack use of a function is measured by test_StackUse() : the function
+   runs on a painted static stack (ucontext), and the bytes overwritten are
+   counted. Host frames are wider than target ones (64 bits registers and
+   pointers), so the value is an upper bound of the target one.
+
+   Note : DWORD is 64 bits wide on a 64 bits host, tests do not rely on 32
+   bits counters wrap.
+*/
+
+
+#ifndef __HOSTTEST_H                   /* to prevent recursive inclusion */
+#define __HOSTTEST_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ucontext.h>
+
+#include "Define.h"
+
+
+/*----------------------------------------------------------------------------*/
+/* Defines                                                                    */
+/*----------------------------------------------------------------------------*/
+
+                                       /* check a test condition */
+#define TEST_CHECK( Cond )   test_Check( (Cond), #Cond, __FILE__, __LINE__ )
+                                       /* newlib function, not in every host libc */
+#define strlcpy( Dst, Src, Size )      test_Strlcpy( (Dst), (Src), (Size) )
+
+#define TEST_STACK_SIZE      16384     /* painted stack of test_StackUse() */
+#define TEST_STACK_MARK       0xA5     /* stack paint pattern */
+
+
+/*----------------------------------------------------------------------------*/
+/* Variables                                                                  */
+/*----------------------------------------------------------------------------*/
+
+static volatile DWORD l_dwTestTick ;   /* simulated millisecond counter */
+static DWORD l_dwTestNbCheck ;         /* checks number */
+static DWORD l_dwTestNbFail ;          /* failed checks number */
+static BYTE l_abyTestStack [TEST_STACK_SIZE] ;   /* test_StackUse() stack */
+
+
+/*----------------------------------------------------------------------------*/
+/* Simulated HAL time base                                                    */
+/*----------------------------------------------------------------------------*/
+
+uint32_t HAL_GetTick( void )
+{
+   return l_dwTestTick ;
+}
+
+void HAL_IncTick( void )
+{
+   l_dwTestTick++ ;
+}
+
+void SysTick_Handler( void ) ;         /* System/Timer.c */
+
+
+/*----------------------------------------------------------------------------*/
+/* Advance simulated time of <i_dwMs> ms                                      */
+/*----------------------------------------------------------------------------*/
+
+static inline void test_Advance( DWORD i_dwMs )
+{
+   while ( i_dwMs != 0 )
+   {
+      SysTick_Handler() ;
+      i_dwMs-- ;
+   }
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Copy string with size limit (newlib strlcpy)                               */
+/*----------------------------------------------------------------------------*/
+
+static inline size_t test_Strlcpy( char * o_pszDst, char C* i_pszSrc, size_t i_Size )
+{
+   size_t Len ;
+
+   Len = strlen( i_pszSrc ) ;
+
+   if ( i_Size != 0 )
+   {
+      snprintf( o_pszDst, i_Size, "%s", i_pszSrc ) ;
+   }
+
+   return Len ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Stack use of <i_fFunc>, in bytes. The test calls the function once before  */
+/* (the host loader binds library functions at their first call)              */
+/*----------------------------------------------------------------------------*/
+
+static inline DWORD test_StackUse( void (*i_fFunc)( void ) )
+{
+   ucontext_t CtxTest ;
+   ucontext_t CtxFunc ;
+   DWORD dwIdx ;
+
+   memset( l_abyTestStack, TEST_STACK_MARK, sizeof(l_abyTestStack) ) ;
+
+   getcontext( &CtxFunc ) ;
+   CtxFunc.uc_stack.ss_sp = l_abyTestStack ;
+   CtxFunc.uc_stack.ss_size = sizeof(l_abyTestStack) ;
+   CtxFunc.uc_link = &CtxTest ;
+   makecontext( &CtxFunc, i_fFunc, 0 ) ;
+   swapcontext( &CtxTest, &CtxFunc ) ;
+                                       /* stack grows down : paint left at start */
+   for ( dwIdx = 0 ; ( dwIdx < sizeof(l_abyTestStack) ) &&
+                     ( l_abyTestStack[dwIdx] == TEST_STACK_MARK ) ; dwIdx++ )
+   {
+   }
+
+   return sizeof(l_abyTestStack) - dwIdx ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Check a test condition, failure is reported with its location              */
+/*----------------------------------------------------------------------------*/
+
+static inline void test_Check( BOOL i_bCond, char C* i_pszCond, char C* i_pszFile,
+                               int i_iLine )
+{
+   l_dwTestNbCheck++ ;
+
+   if ( ! i_bCond )
+   {
+      l_dwTestNbFail++ ;
+      printf( "%s:%d: check failed : %s\n", i_pszFile, i_iLine, i_pszCond ) ;
+   }
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Report test result, return process exit code                               */
+/*----------------------------------------------------------------------------*/
+
+static inline int test_End( char C* i_pszName )
+{
+   printf( "%s : %lu checks, %lu failed\n", i_pszName,
+           l_dwTestNbCheck, l_dwTestNbFail ) ;
+
+   return ( l_dwTestNbFail == 0 ) ? EXIT_SUCCESS : EXIT_FAILURE ;
+}
+
+#endif /* __HOSTTEST_H */
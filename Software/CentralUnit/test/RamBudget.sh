@@ -0,0 +1,192 @@
+# RAM budget of the firmware, measured on the host (see HostTest.h)
+# usage : sh RamBudget.sh
+#
+# Firmware and HAL sources are compiled for a 32 bits host (-m32 -Os, same
+# type sizes as the Cortex-M0+), to assembly only (ARM inline assembly is
+# never assembled) :
+#    - static RAM : sum of the writable objects (.data/.bss) of the firmware
+#      files, and of the HAL files with at least one function reachable from
+#      main() or an IRQ handler,
+#    - stack : worst path of the call graph (-fcallgraph-info=su) from
+#      main(), plus the deepest IRQ handler of each priority level (IRQ_LEVEL
+#      table below, from the *_IRQPri of Hard.h : only a higher level preempts)
+#      and the deepest system exception handler (NMI, HardFault), each with
+#      its 32 bytes exception frame.
+#      Indirect calls are resolved with the INDIRECT table below (function
+#      pointer targets of each caller).
+# Host frames differ from Thumb ones, and the C library RAM is not counted
+# (newlib, syscalls.c and tiny_printf.c), so the figures are estimates of the
+# target ones.
+
+cd "$(dirname "$0")"
+
+SRC=../src
+RAM_SIZE=8192
+BUILD=$(mktemp -d)
+                                       # host has no 32 bits C library : its
+mkdir -p "$BUILD/inc/gnu"              # headers are used, stubs excepted
+touch "$BUILD/inc/gnu/stubs-32.h"
+
+                                       # caller, targets (regular expression)
+INDIRECT="
+cstate_ProcessEvt        ^cstate_(Is|Entry|Exit)[A-Z]
+evt_TaskCyc              ^(cstate_EvtProc|cplan_EvtClockSec|cal_EvtClockSec|sysled_EvtError)$
+sfrm_WriteRes            ^[a-z]+_(Fmt|Get)[A-Za-z]*(Stat|State|Info|Plan|Tariff|Eoc|List|Oevse|Wifi)$
+sfrm_TaskCyc             ^(coevse_ReadHist|cstate_ReadHistRec|cstate_ReadSessRec)$
+coevse_TaskCyc           ^(coevse_Cmdresult[A-Z][A-Za-z]*|sfrm_TunnelData)$
+coevse_RxLineChar        ^coevse_Async[A-Z]
+coevse_CmdresultExtCmd   ^sfrm_ProcessResExt$
+cwifi_ProcessRec         ^(cwifi_WindCallBack[A-Z][A-Za-z]*|cwifi_CmdCallBack[A-Z][A-Za-z]*|html_ProcessCgi|sfrm_ProcessFrame|sfrm_ProcessResExt)$
+cwifi_WindCallBackInput  ^html_ProcessSsi$
+cwifi_CmdCallBackExt     ^sfrm_ProcessResExt$
+"
+
+                                       # IRQ handler, priority level (Hard.h)
+IRQ_LEVEL="
+TIM21_IRQHandler            0
+DMA1_Channel2_3_IRQHandler  1
+USART1_IRQHandler           2
+RNG_LPUART1_IRQHandler      3
+TIM22_IRQHandler            3
+TIM6_DAC_IRQHandler         3
+EXTI2_3_IRQHandler          3
+SysTick_Handler             3
+"
+
+CFLAGS="-m32 -mpreferred-stack-boundary=3 -Os -S -std=gnu11 -w -fcallgraph-info=su \
+        -DSTM32L053xx -DUSE_NUCLEO_L053R8 -I$BUILD/inc \
+        -idirafter /usr/include/x86_64-linux-gnu -I$SRC -I$SRC/System \
+        -I$SRC/_ST_Drivers/CMSIS/Include \
+        -I$SRC/_ST_Drivers/CMSIS/Device/ST/STM32L0xx/Include \
+        -I$SRC/_ST_Drivers/STM32L0xx_HAL_Driver/Inc"
+
+NB=0
+for FILE in $(find $SRC -name '*.c' -not -path '*/_ST_Drivers/*') \
+            $SRC/_ST_Drivers/STM32L0xx_HAL_Driver/Src/*.c
+do
+   case "$FILE" in
+      *_template.c|*/syscalls.c|*/tiny_printf.c) continue ;;
+   esac
+   NB=$((NB+1))
+   OUT=$BUILD/$NB
+   if ! gcc $CFLAGS "$FILE" -o "$OUT.s"
+   then
+      echo "$FILE : build failed"
+      rm -rf "$BUILD"
+      exit 1
+   fi
+   case "$FILE" in
+      */_ST_Drivers/*) KIND=HAL ;;
+      *)               KIND=FW ;;
+   esac
+                                       # writable objects : FILE KIND name size
+   awk -v f="$FILE" -v k="$KIND" '
+      /^\t\.(section|data|bss|text)/ { sec = $1 " " $2 }
+      /^\t\.comm\t/ { split( $2, a, "," ) ; print "OBJ", f, k, a[1], a[2] }
+      /^\t\.size\t/ && ( sec ~ /\.data|\.bss/ ) {
+         split( $2, a, "," ) ; sub( / /, "", a[2] )
+         if ( a[2] ~ /^[0-9]+$/ ) print "OBJ", f, k, a[1], a[2] }' \
+      "$OUT.s" >> "$BUILD/obj.txt"
+done
+
+cat "$BUILD"/*.ci > "$BUILD/graph.ci"
+
+echo "$INDIRECT" > "$BUILD/indirect.txt"
+echo "$IRQ_LEVEL" > "$BUILD/irq.txt"
+
+awk -v ram="$RAM_SIZE" '
+   function name( t ) { sub( /.*:/, "", t ) ; return t }
+   function base( t ) { t = name( t ) ; sub( /\..*/, "", t ) ; return t }
+   function depth( n,    i, d, m, c, t, dt ) {
+      if ( n in memo ) return memo[n]
+      if ( n in busy ) { cycle = 1 ; return 0 }
+      busy[n] = 1 ; m = 0
+      for ( i = 1 ; i <= nout[n] ; i++ )
+      {
+         c = out[n, i]
+         if ( c == "__indirect_call" )
+         {                             # deepest target of the caller
+            d = 0
+            if ( !( base( n ) in ind ) ) unres[base( n )] = 1
+            else for ( t in def )
+               if ( base( t ) ~ ind[base( n )] )
+               {
+                  dt = depth( t ) ; if ( dt > d ) { d = dt ; c = t }
+               }
+         }
+         else d = depth( resolve( c ) )
+         if ( d > m ) { m = d ; via[n] = c }
+      }
+      delete busy[n]
+      memo[n] = stk[n] + m
+      return memo[n]
+   }
+   function resolve( t ) { return ( t in def ) ? t : ( ( t in glob ) ? glob[t] : t ) }
+   function path( n,    s ) {
+      s = name( n )
+      while ( n in via ) { n = resolve( via[n] ) ; s = s " > " name( n ) }
+      return s
+   }
+   FILENAME ~ /indirect.txt$/ { if ( NF == 2 ) ind[$1] = $2 ; next }
+   FILENAME ~ /irq.txt$/ { if ( NF == 2 ) lvl[$1] = $2 ; next }
+   FILENAME ~ /obj.txt$/ { obj[$2, $4] = $5 ; objk[$2, $4] = $3 ; next }
+   /^node:/ && /bytes/ {
+      match( $0, /title: "[^"]*"/ ) ; t = substr( $0, RSTART + 8, RLENGTH - 9 )
+      match( $0, /\\n[0-9]+ bytes/ ) ; b = substr( $0, RSTART + 2, RLENGTH - 8 ) + 0
+      def[t] = 1 ; stk[t] = b
+      match( $0, /\\n[^\\]*:[0-9]+:[0-9]+\\n/ ) ; f = substr( $0, RSTART + 2, RLENGTH - 4 )
+      sub( /:[0-9]+:[0-9]+$/, "", f ) ; file[t] = f
+      n = name( t ) ; if ( !( n in glob ) || ( b > stk[glob[n]] ) ) glob[n] = t
+      next
+   }
+   /^edge:/ {
+      match( $0, /sourcename: "[^"]*"/ ) ; s = substr( $0, RSTART + 13, RLENGTH - 14 )
+      match( $0, /targetname: "[^"]*"/ ) ; d = substr( $0, RSTART + 13, RLENGTH - 14 )
+      out[s, ++nout[s]] = d ; called[d] = 1
+   }
+   END {
+      for ( t in def ) if ( ( t in called ) || ( name( t ) in called ) ) hascall[t] = 1
+      for ( t in def ) if ( name( t ) == "main" ) root = t
+      mainstk = depth( root )
+      mainpath = path( root )
+                                       # IRQ : one per level, exception : one
+      sysstk = 0
+      for ( t in def )
+         if ( ( name( t ) ~ /Handler$/ ) && !( t in hascall ) && ( file[t] !~ /_ST_Drivers/ ) )
+         {
+            d = depth( t ) + 32
+            if ( name( t ) in lvl )
+            {
+               l = lvl[name( t )]
+               if ( d > irq[l] ) { irq[l] = d ; irqp[l] = path( t ) }
+            }
+            else if ( name( t ) ~ /IRQHandler$/ ) unlvl[name( t )] = 1
+            else if ( d > sysstk ) { sysstk = d ; syspath = path( t ) }
+         }
+      irqstk = sysstk
+      for ( l in irq ) irqstk += irq[l]
+                                       # files linked : firmware, used HAL
+      for ( t in memo ) used[file[t]] = 1
+      for ( k in obj )
+      {
+         split( k, a, SUBSEP ) ; f = a[1]
+         if ( ( objk[k] == "FW" ) || ( f in used ) ) { fs[f] += obj[k] ; st += obj[k] }
+      }
+      for ( f in fs ) printf "RamBudget : static %5d B  %s\n", fs[f], f | "sort -n -k4"
+      close( "sort -n -k4" )
+      printf "RamBudget : static RAM %d B\n", st
+      printf "RamBudget : main stack %d B : %s\n", mainstk, mainpath
+      for ( l = 0 ; l <= 3 ; l++ ) if ( l in irq )
+         printf "RamBudget : IRQ level %d stack %d B : %s\n", l, irq[l], irqp[l]
+      printf "RamBudget : exception stack %d B : %s\n", sysstk, syspath
+      printf "RamBudget : worst stack %d B%s\n", mainstk + irqstk,
+             cycle ? " (recursion ignored)" : ""
+      printf "RamBudget : free RAM %d B of %d B\n", ram - st - mainstk - irqstk, ram
+      for ( t in unres ) { printf "RamBudget : unresolved indirect call in %s\n", t ; ret = 1 }
+      for ( t in unlvl ) { printf "RamBudget : no priority level for %s\n", t ; ret = 1 }
+      exit ret
+   }' "$BUILD/indirect.txt" "$BUILD/irq.txt" "$BUILD/obj.txt" "$BUILD/graph.ci"
+RET=$?
+
+rm -rf "$BUILD"
+exit $RET
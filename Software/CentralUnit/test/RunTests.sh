@@ -0,0 +1,29 @@
+# Build and run host tests of firmware modules (see HostTest.h)
+# usage : sh RunTests.sh [TestXxx.c ...]
+
+cd "$(dirname "$0")"
+
+SRC=../src
+CFLAGS="-std=gnu11 -O1 -g -Wall -Wextra -Wno-unused-parameter -DSTM32L053xx -DUSE_NUCLEO_L053R8 -I. -I$SRC \
+        -I$SRC/System -isystem $SRC/_ST_Drivers/CMSIS/Include \
+        -isystem $SRC/_ST_Drivers/CMSIS/Device/ST/STM32L0xx/Include \
+        -isystem $SRC/_ST_Drivers/STM32L0xx_HAL_Driver/Inc"
+
+BUILD=$(mktemp -d)
+TESTS=${*:-Test*.c}
+RET=0
+
+for TEST in $TESTS
+do
+   EXE=$BUILD/$(basename "$TEST" .c)
+   if gcc $CFLAGS "$TEST" -o "$EXE" -lm
+   then
+      "$EXE" || RET=1
+   else
+      echo "$TEST : build failed"
+      RET=1
+   fi
+done
+
+rm -rf "$BUILD"
+exit $RET
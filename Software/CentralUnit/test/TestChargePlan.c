@@ -0,0 +1,248 @@
+/******************************************************************************/
+/*                              TestChargePlan.c                              */
+/******************************************************************************/
+/*
+   ChargePlan.c host benchmark
+
+   Copyright (C) 2018  Sylvain BASSET
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+   ------------
+   @version 1.0
+   @history 1.0, 19 oct. 2019, creation
+   @brief
+   cplan_Compute() is run on its worst case : 7 days horizon of 15 minutes
+   slots (CPLAN_HORIZON_MAX), the CPLAN_TARIFF_NB periods set with distinct
+   prices, and CPLAN_ENERGY_MAX target energy. Run time, stack use and
+   static RAM are reported against the 8 KB RAM of the STM32L053 :
+      - run time is measured on the host, the firmware reports its own
+        computation time on target (cplan_FmtPlan()),
+      - stack use is measured by test_StackUse() (see HostTest.h). Host
+        frames are wider than target ones (64 bits registers and pointers),
+        as static data (DWORD is 64 bits wide on the host), so both values
+        are upper bounds of the target ones.
+
+   The plan decisions are then checked along a week, with the planner run
+   at each second tick as in the firmware.
+*/
+
+
+#include <time.h>
+
+#include "HostTest.h"
+#include "System.h"
+
+
+/*----------------------------------------------------------------------------*/
+/* Simulated eeprom                                                           */
+/*----------------------------------------------------------------------------*/
+
+static s_DataEeprom l_TestEeprom ;
+
+#undef g_sDataEeprom
+#define g_sDataEeprom       ( &l_TestEeprom )
+
+
+#include "System/Timer.c"
+#include "Control/ChargePlan.c"
+
+
+/*----------------------------------------------------------------------------*/
+/* Defines                                                                    */
+/*----------------------------------------------------------------------------*/
+
+#define TEST_RAM_SIZE          8192    /* STM32L053 RAM (bytes) */
+#define TEST_RAM_MODULE         512    /* planner share of RAM (bytes) */
+#define TEST_USER_CAP            16    /* user capacity (A) */
+#define TEST_BENCH_LOOP        1000    /* timed computations */
+
+
+/*----------------------------------------------------------------------------*/
+/* Variables                                                                  */
+/*----------------------------------------------------------------------------*/
+
+static BYTE l_byTestPlanCap ;          /* capacity given to load management (A) */
+static DWORD l_dwTestEnergy ;          /* openEVSE energy counter (Wh) */
+static s_DateTime l_TestDateTime ;     /* simulated date/time */
+static BYTE l_byTestWeekday ;
+
+
+/*----------------------------------------------------------------------------*/
+/* Stubs                                                                      */
+/*----------------------------------------------------------------------------*/
+
+void err_FatalError( void ) { abort() ; }
+void evt_Subscribe( e_evtId i_eEvtId, f_evtProc i_fEvtProc ) {}
+BOOL clk_IsDateTimeLost( void ) { return FALSE ; }
+BYTE lmgt_GetUserCap( void ) { return TEST_USER_CAP ; }
+void lmgt_SetPlanCap( BYTE i_byCurrent ) { l_byTestPlanCap = i_byCurrent ; }
+DWORD coevse_GetEnergy( void ) { return l_dwTestEnergy ; }
+
+void eep_write( DWORD i_dwAddress, DWORD i_dwValue )
+{
+   *(DWORD*)i_dwAddress = i_dwValue ;
+}
+
+void clk_GetDateTime( s_DateTime * o_psDateTime, BYTE * o_pbyWeekday )
+{
+   *o_psDateTime = l_TestDateTime ;
+   *o_pbyWeekday = l_byTestWeekday ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Tariff : 8 periods with distinct prices, default price the highest one     */
+/*----------------------------------------------------------------------------*/
+
+static void test_SetTariff( void )
+{
+   memset( &l_TestEeprom, 0, sizeof(l_TestEeprom) ) ;
+
+   cplan_SetPriceDef( 200 ) ;
+   cplan_SetTariff( 0, 0x1F, 88, 24, 100 ) ;   /* week nights 22:00-06:00 */
+   cplan_SetTariff( 1, 0x60,  0, 96, 80 ) ;    /* week-end */
+   cplan_SetTariff( 2, 0x1F, 48, 56, 150 ) ;   /* week days 12:00-14:00 */
+   cplan_SetTariff( 3, 0x01, 56, 64, 120 ) ;   /* Monday 14:00-16:00 */
+   cplan_SetTariff( 4, 0x02, 56, 64, 125 ) ;
+   cplan_SetTariff( 5, 0x04, 56, 64, 130 ) ;
+   cplan_SetTariff( 6, 0x08, 56, 64, 135 ) ;
+   cplan_SetTariff( 7, 0x10, 56, 64, 140 ) ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Worst case computation                                                     */
+/*----------------------------------------------------------------------------*/
+
+static void __attribute__((noinline)) test_Compute( void )
+{
+   cplan_Compute( 0, 0 ) ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Benchmark on a 7 days horizon                                              */
+/*----------------------------------------------------------------------------*/
+
+static void test_Bench( void )
+{
+   clock_t Start ;
+   double fdNs ;
+   DWORD dwLoop ;
+   DWORD dwStack ;
+   DWORD dwStatic ;
+
+   test_SetTariff() ;
+   cplan_Init() ;
+   l_Plan.bActive = TRUE ;
+   l_Plan.dwRemainWh = CPLAN_ENERGY_MAX ;
+   l_Plan.wNbSlot = CPLAN_HORIZON_MAX ;
+                                       /* stack use, after a first call that */
+   test_Compute() ;                    /* binds library calls (host loader)  */
+   dwStack = test_StackUse( &test_Compute ) ;
+
+   TEST_CHECK( ! l_Plan.bShort ) ;     /* week-end level is enough */
+   TEST_CHECK( l_Plan.wPriceThr == 80 ) ;
+                                       /* run time */
+   Start = clock() ;
+   for ( dwLoop = 0 ; dwLoop < TEST_BENCH_LOOP ; dwLoop++ )
+   {
+      test_Compute() ;
+   }
+   fdNs = ( (double)( clock() - Start ) * 1e9 ) / CLOCKS_PER_SEC / TEST_BENCH_LOOP ;
+
+   dwStatic = sizeof(l_Plan) ;
+
+   TEST_CHECK( dwStack != 0 ) ;
+   TEST_CHECK( dwStack + dwStatic <= TEST_RAM_MODULE ) ;
+
+   printf( "TestChargePlan : %u slots horizon, %u tariff periods : %.0f ns (host), "
+           "stack %lu B, static %lu B, %.1f %% of %u B RAM\n",
+           CPLAN_HORIZON_MAX, CPLAN_TARIFF_NB, fdNs, dwStack, dwStatic,
+           ( ( dwStack + dwStatic ) * 100.0 ) / TEST_RAM_SIZE, TEST_RAM_SIZE ) ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Week plan : slots above the threshold price are never charged, and the     */
+/* target is reached before departure                                         */
+/*----------------------------------------------------------------------------*/
+
+static void test_WeekPlan( void )
+{
+   DWORD dwSec ;
+   DWORD dwNbCharged ;
+   DWORD dwEnergyMWh ;
+   DWORD dwNbThrErr ;
+
+   test_SetTariff() ;
+   cplan_Init() ;
+   memset( &l_TestDateTime, 0, sizeof(l_TestDateTime) ) ;
+   l_byTestWeekday = 0 ;               /* Monday 00:00 */
+   l_dwTestEnergy = 0 ;
+   dwEnergyMWh = 0 ;
+   dwNbCharged = 0 ;
+   dwNbThrErr = 0 ;
+                                       /* 60 kWh within the week */
+   TEST_CHECK( cplan_Start( 60000, CPLAN_DUR_MAX ) == OK ) ;
+
+   for ( dwSec = 0 ; ( dwSec < CPLAN_DUR_MAX * 60 ) && cplan_IsActive() ; dwSec++ )
+   {
+      test_Advance( 1000 ) ;
+      l_TestDateTime.sTime.bySeconds = dwSec % 60 ;
+      l_TestDateTime.sTime.byMinutes = ( dwSec / 60 ) % 60 ;
+      l_TestDateTime.sTime.byHours = ( dwSec / 3600 ) % 24 ;
+      l_byTestWeekday = ( dwSec / 86400 ) % NB_DAYS_WEEK ;
+
+      cplan_EvtClockSec( EVT_CLOCK_SEC, 0 ) ;
+
+      if ( cplan_IsChargeSlot() )
+      {                                /* EV draws the plan current */
+         dwEnergyMWh += ( l_byTestPlanCap * CPLAN_VOLTAGE * 1000lu ) / 3600 ;
+         l_dwTestEnergy = dwEnergyMWh / 1000 ;
+
+         if ( ( dwSec % CPLAN_SLOT_DUR ) == 0 )
+         {
+            dwNbCharged++ ;
+            if ( cplan_GetPrice( l_byTestWeekday,
+                                 (BYTE)( ( dwSec % 86400 ) / CPLAN_SLOT_DUR ) ) >
+                 l_Plan.wPriceThr )
+            {
+               dwNbThrErr++ ;
+            }
+         }
+      }
+   }
+
+   TEST_CHECK( ! cplan_IsActive() ) ;
+   TEST_CHECK( l_dwTestEnergy >= 60000 ) ;
+   TEST_CHECK( dwSec < CPLAN_DUR_MAX * 60 ) ;
+   TEST_CHECK( dwNbThrErr == 0 ) ;
+   TEST_CHECK( l_byTestPlanCap == 0 ) ;
+
+   printf( "TestChargePlan : week plan 60 kWh, %lu charged slots, ended after %lu h\n",
+           dwNbCharged, dwSec / 3600 ) ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+
+int main( void )
+{
+   test_Bench() ;
+   test_WeekPlan() ;
+
+   return test_End( "TestChargePlan" ) ;
+}
@@ -0,0 +1,586 @@
+/******************************************************************************/
+/*                             TestChargeState.c                              */
+/******************************************************************************/
+/*
+   ChargeState.c host test
+
+   Copyright (C) 2018  Sylvain BASSET
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+   ------------
+   @version 1.0
+   @history 1.0, 19 oct. 2019, creation
+   @brief
+   Event sequences are replayed through the event bus callback, so through
+   cstate_ProcessEvt() : each step gives the delay before the event (one
+   EVT_CLOCK_SEC per second, as Clock.c), the event, the EV current during
+   the delay, then the expected FSM state and openEVSE charge enable.
+
+   The simulated openEVSE integrates its energy counter (Wh) from the EV
+   current. The eeprom is a RAM structure, written by eep_write().
+
+   End of charge detection is checked with current traces given as constant
+   current segments, replayed during charge : a brief current dip and a
+   charge pause must not be taken for an end of charge (averaging and dwell
+   time), nor a battery balancing phase below the low limit where energy is
+   still delivered (energy delta), while the true end of charge is detected
+   after the dwell time.
+
+   Session records writes are logged : the sequence number must be cleared
+   first and written last. A reset is simulated after each write of a
+   record (eeprom writes ignored from then), and the ring scan at start-up
+   must ignore the cut record and resume on the newest complete one.
+
+   The CSTATE_CHAIN_MAX bound is checked with an openEVSE state flapping at
+   each energy read (charging period start and stop), which would make the
+   ON_WAIT / CHARGING transitions loop forever.
+*/
+
+
+#include "HostTest.h"
+#include "System.h"
+#include "System/Hard.h"
+
+
+/*----------------------------------------------------------------------------*/
+/* Simulated eeprom                                                           */
+/*----------------------------------------------------------------------------*/
+
+static s_DataEeprom l_TestEeprom ;
+
+#undef g_sDataEeprom
+#define g_sDataEeprom       ( &l_TestEeprom )
+
+
+#include "System/Timer.c"
+#include "Control/ChargeState.c"
+
+
+/*----------------------------------------------------------------------------*/
+/* Defines                                                                    */
+/*----------------------------------------------------------------------------*/
+
+#define TEST_VOLTAGE            230    /* mains voltage (V) */
+#define TEST_MIN_STOP             2    /* charge current low limit (A) */
+
+typedef struct                         /* replayed event */
+{
+   DWORD dwDelaySec ;                  /* delay before event (sec) */
+   SDWORD sdwCurrent ;                 /* EV current from the delay start (mA) */
+   e_evtId eEvtId ;                    /* event */
+   DWORD dwValue ;                     /* event value */
+   e_cstateChargeSt eState ;           /* expected state after event */
+   BOOL bEnable ;                      /* expected openEVSE charge enable */
+} s_TestStep ;
+
+#define _S( Delay, Current, Evt, Value, State, Enable ) \
+   { (Delay), (Current), EVT_##Evt, (Value), CSTATE_##State, (Enable) }
+
+typedef struct                         /* current trace segment */
+{
+   DWORD dwSec ;                       /* segment duration (sec) */
+   SDWORD sdwCurrent ;                 /* EV current (mA) */
+} s_TestTrace ;
+
+
+/*----------------------------------------------------------------------------*/
+/* Event sequences                                                            */
+/*----------------------------------------------------------------------------*/
+
+static s_TestStep const k_aCalCharge [] =   /* calendar charge, EV pause */
+{
+   _S(   0,     0, CHARGE_ENABLE, TRUE,                   ON_WAIT,  TRUE  ),
+   _S(   5,     0, EVSE_STATE,    COEVSE_STATE_CONNECTED, ON_WAIT,  TRUE  ),
+   _S(   5, 16000, EVSE_STATE,    COEVSE_STATE_CHARGING,  CHARGING, TRUE  ),
+   _S( 600, 16000, CLOCK_SEC,     0,                      CHARGING, TRUE  ),
+   _S(   0,     0, EVSE_STATE,    COEVSE_STATE_CONNECTED, ON_WAIT,  TRUE  ),
+   _S(  10, 16000, EVSE_STATE,    COEVSE_STATE_CHARGING,  CHARGING, TRUE  ),
+   _S(  60, 16000, CHARGE_ENABLE, FALSE,                  OFF,      FALSE ),
+   _S(   5,     0, EVSE_STATE,    COEVSE_STATE_CONNECTED, OFF,      FALSE ),
+} ;
+
+static s_TestStep const k_aForceEoc [] =    /* forced charge, end of charge */
+{
+   _S(   0,     0, BUTTON,        BTN_PRESS,              FORCE_WAIT, TRUE  ),
+   _S(   5, 16000, EVSE_STATE,    COEVSE_STATE_CHARGING,  CHARGING,   TRUE  ),
+                                       /* calendar end ignored when forced */
+   _S( 300, 16000, CHARGE_ENABLE, FALSE,                  CHARGING,   TRUE  ),
+                                       /* CHARGING -> EOC_LOWCUR -> OFF */
+   _S( 100,   500, CLOCK_SEC,     0,                      OFF,        FALSE ),
+   _S(   2,     0, EVSE_STATE,    COEVSE_STATE_CONNECTED, OFF,        FALSE ),
+   _S(  60,     0, CHARGE_ENABLE, TRUE,                   ON_WAIT,    TRUE  ),
+   _S(   5, 16000, EVSE_STATE,    COEVSE_STATE_CHARGING,  CHARGING,   TRUE  ),
+   _S( 100,   500, CLOCK_SEC,     0,                      EOC_LOWCUR, FALSE ),
+   _S(   2,     0, EVSE_STATE,    COEVSE_STATE_CONNECTED, EOC_LOWCUR, FALSE ),
+   _S(  60,     0, CHARGE_ENABLE, FALSE,                  OFF,        FALSE ),
+} ;
+
+static s_TestStep const k_aPlug [] =        /* plugging wake-up */
+{
+   _S(   0,     0, EVSE_STATE,    COEVSE_STATE_CONNECTED, OFF, FALSE ),
+   _S(  10,     0, PLUG,          0,                      OFF, TRUE  ),
+   _S(  CSTATE_PLUGING_DELAY - 1,
+                0, CLOCK_SEC,     0,                      OFF, TRUE  ),
+   _S(   1,     0, CLOCK_SEC,     0,                      OFF, FALSE ),
+} ;
+
+static s_TestStep const k_aBoost [] =       /* boost, stored force restored */
+{
+   _S(   0,     0, BUTTON,        BTN_DOUBLE_PRESS,       FORCE_WAIT, TRUE  ),
+   _S(   0,     0, BUTTON,        BTN_LONG_PRESS,         FORCE_WAIT, TRUE  ),
+   _S( CSTATE_BOOST_DUR - 1,
+                0, CLOCK_SEC,     0,                      FORCE_WAIT, TRUE  ),
+   _S(   1,     0, CLOCK_SEC,     0,                      OFF,        FALSE ),
+} ;
+
+static s_TestStep const k_aChain [] =       /* chained transitions */
+{
+   _S(   0, 16000, EVSE_STATE,    COEVSE_STATE_CHARGING,  OFF,      FALSE ),
+                                       /* OFF -> FORCE_WAIT -> CHARGING */
+   _S(   5, 16000, BUTTON,        BTN_PRESS,              CHARGING, TRUE  ),
+                                       /* force cleared by charge end : */
+                                       /* CHARGING -> ON_WAIT -> OFF    */
+   _S( 300, 16000, EVSE_STATE,    COEVSE_STATE_CONNECTED, OFF,      FALSE ),
+                                       /* OFF -> ON_WAIT -> CHARGING */
+   _S(  60, 16000, EVSE_STATE,    COEVSE_STATE_CHARGING,  OFF,      FALSE ),
+   _S(   5, 16000, CHARGE_ENABLE, TRUE,                   CHARGING, TRUE  ),
+} ;
+
+/*----------------------------------------------------------------------------*/
+/* End of charge current traces                                               */
+/*----------------------------------------------------------------------------*/
+
+static s_TestTrace const k_aTraceDip [] =     /* brief dips, contactor bounce */
+{
+   { 120, 16000 }, {   4,     0 }, { 120, 16000 }, {   2,  1000 },
+   {  60, 16000 }, {   6,  3000 }, {  60, 16000 },
+} ;
+
+static s_TestTrace const k_aTracePause [] =   /* EV pause shorter than dwell */
+{
+   { 120, 16000 }, {  45,     0 }, { 120, 16000 },
+} ;
+
+static s_TestTrace const k_aTraceBalance [] = /* balancing below low limit, */
+{                                             /* then true end of charge    */
+   { 300, 16000 }, { 200, 10000 }, { 600,  7000 }, { 300,   500 },
+} ;
+
+#define TEST_BAL_MIN_STOP         8    /* low limit for k_aTraceBalance (A) */
+#define TEST_BAL_END_SEC       1100    /* k_aTraceBalance balancing end (sec) */
+
+#define TEST_SESS_WRITE           7    /* eeprom writes for a record (ring full) */
+
+
+/*----------------------------------------------------------------------------*/
+/* Variables                                                                  */
+/*----------------------------------------------------------------------------*/
+
+static BOOL l_bTestEnable ;            /* openEVSE charge enable */
+static SDWORD l_sdwTestCurrent ;       /* EV current (mA) */
+static DWORD l_dwTestEnergyMWh ;       /* openEVSE energy counter (mWh) */
+static BOOL l_bTestFlap ;              /* openEVSE state flaps at each energy read */
+static BOOL l_bTestMaint ;             /* maintenance mode request */
+static BOOL l_bTestEepCut ;            /* eeprom writes are cut */
+static DWORD l_dwTestEepLeft ;         /* eeprom writes left before the cut */
+static DWORD l_adwTestEepAddr [TEST_SESS_WRITE] ;  /* last eeprom writes log */
+static DWORD l_adwTestEepVal [TEST_SESS_WRITE] ;
+static DWORD l_dwTestEepNb ;
+
+
+/*----------------------------------------------------------------------------*/
+/* Stubs                                                                      */
+/*----------------------------------------------------------------------------*/
+
+void err_FatalError( void ) { abort() ; }
+void evt_Subscribe( e_evtId i_eEvtId, f_evtProc i_fEvtProc ) {}
+void sysled_SetPattern( e_sysledLed i_eLed, e_sysledPat i_ePat ) {}
+void HAL_GPIO_Init( GPIO_TypeDef * GPIOx, GPIO_InitTypeDef * GPIO_Init ) {}
+void HAL_GPIO_WritePin( GPIO_TypeDef * GPIOx, uint16_t GPIO_Pin,
+                        GPIO_PinState PinState ) {}
+BOOL cwifi_IsConnected( void ) { return FALSE ; }
+void cwifi_SetMaintMode( BOOL i_bMaintmode ) { l_bTestMaint = i_bMaintmode ; }
+BOOL clk_IsDateTimeLost( void ) { return FALSE ; }
+
+void clk_GetDateTime( s_DateTime * o_psDateTime, BYTE * o_pbyWeekday )
+{
+   memset( o_psDateTime, 0, sizeof(s_DateTime) ) ;
+   *o_pbyWeekday = 0 ;
+}
+
+void eep_write( DWORD i_dwAddress, DWORD i_dwValue )
+{
+   if ( l_dwTestEepNb < TEST_SESS_WRITE )
+   {
+      l_adwTestEepAddr[l_dwTestEepNb] = i_dwAddress ;
+      l_adwTestEepVal[l_dwTestEepNb] = i_dwValue ;
+      l_dwTestEepNb++ ;
+   }
+
+   if ( l_bTestEepCut )
+   {
+      if ( l_dwTestEepLeft == 0 )
+      {
+         return ;                      /* reset : write never done */
+      }
+      l_dwTestEepLeft-- ;
+   }
+
+   *(DWORD*)i_dwAddress = i_dwValue ;
+}
+
+void coevse_SetChargeEnable( BOOL i_bEnable )
+{
+   l_bTestEnable = i_bEnable ;
+}
+
+SDWORD coevse_GetCurrent( void )
+{
+   return l_sdwTestCurrent ;
+}
+
+DWORD coevse_GetEnergy( void )
+{
+   if ( l_bTestFlap )
+   {
+      l_Data.eEvseState = ( l_Data.eEvseState == COEVSE_STATE_CHARGING ) ?
+                          COEVSE_STATE_CONNECTED : COEVSE_STATE_CHARGING ;
+   }
+
+   return l_dwTestEnergyMWh / 1000 ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Module start-up, with <i_pEeprom> eeprom content (NULL : erased)           */
+/*----------------------------------------------------------------------------*/
+
+static void test_Init( s_DataEeprom C* i_pEeprom )
+{
+   if ( i_pEeprom != NULL )
+   {
+      l_TestEeprom = *i_pEeprom ;
+   }
+   else
+   {
+      memset( &l_TestEeprom, 0, sizeof(l_TestEeprom) ) ;
+      l_TestEeprom.sChargeStateData.dwCurrentMinStop = TEST_MIN_STOP ;
+   }
+
+   memset( &l_Data, 0, sizeof(l_Data) ) ;
+   memset( &l_Hist, 0, sizeof(l_Hist) ) ;
+   memset( &l_Eoc, 0, sizeof(l_Eoc) ) ;
+   l_bTestEnable = BYTE_MAX ;
+   l_sdwTestCurrent = 0 ;
+   l_bTestFlap = FALSE ;
+   l_bTestMaint = FALSE ;
+   l_bTestEepCut = FALSE ;
+
+   cstate_Init() ;
+   cstate_TaskCyc() ;                  /* first FSM evaluation */
+
+   TEST_CHECK( l_Data.eChargeState == CSTATE_OFF ) ;
+   TEST_CHECK( l_bTestEnable == FALSE ) ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Run <i_dwSec> seconds with EV current <i_sdwCurrent> (mA)                  */
+/*----------------------------------------------------------------------------*/
+
+static void test_Run( DWORD i_dwSec, SDWORD i_sdwCurrent )
+{
+   l_sdwTestCurrent = i_sdwCurrent ;
+
+   while ( i_dwSec != 0 )
+   {
+      test_Advance( 1000 ) ;
+      if ( l_sdwTestCurrent > 0 )
+      {
+         l_dwTestEnergyMWh += ( l_sdwTestCurrent * TEST_VOLTAGE ) / 3600 ;
+      }
+      cstate_EvtProc( EVT_CLOCK_SEC, 0 ) ;
+      i_dwSec-- ;
+   }
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Replay <i_byNbStep> steps of sequence <i_pStep>                            */
+/*----------------------------------------------------------------------------*/
+
+static void test_Replay( s_TestStep C* i_pStep, BYTE i_byNbStep, char C* i_pszName )
+{
+   BYTE byStep ;
+   DWORD dwNbFail ;
+
+   dwNbFail = l_dwTestNbFail ;
+   test_Init( NULL ) ;
+
+   for ( byStep = 0 ; byStep < i_byNbStep ; byStep++ )
+   {
+      test_Run( i_pStep[byStep].dwDelaySec, i_pStep[byStep].sdwCurrent ) ;
+      cstate_EvtProc( i_pStep[byStep].eEvtId, i_pStep[byStep].dwValue ) ;
+
+      TEST_CHECK( l_Data.eChargeState == i_pStep[byStep].eState ) ;
+      TEST_CHECK( l_bTestEnable == i_pStep[byStep].bEnable ) ;
+   }
+
+   if ( l_dwTestNbFail != dwNbFail )
+   {
+      printf( "TestChargeState : sequence '%s' failed\n", i_pszName ) ;
+   }
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Event sequences                                                            */
+/*----------------------------------------------------------------------------*/
+
+static void test_Sequences( void )
+{
+   test_Replay( k_aCalCharge, ARRAY_SIZE(k_aCalCharge), "calendar charge" ) ;
+   TEST_CHECK( l_Hist.aStat[CSTATE_CHARGING].dwNbEnter == 2 ) ;
+   TEST_CHECK( l_Sess.bPaused ) ;      /* session waits for resume */
+
+   test_Replay( k_aForceEoc, ARRAY_SIZE(k_aForceEoc), "force, end of charge" ) ;
+   TEST_CHECK( l_Data.eForceState == CSTATE_FORCE_NONE ) ;
+   TEST_CHECK( l_TestEeprom.sChargeStateData.dwForceState == CSTATE_FORCE_NONE ) ;
+   TEST_CHECK( l_Eoc.dwNbEoc == 2 ) ;
+   TEST_CHECK( l_Hist.aStat[CSTATE_EOC_LOWCUR].dwNbEnter == 2 ) ;
+
+   test_Replay( k_aPlug, ARRAY_SIZE(k_aPlug), "plugging" ) ;
+   TEST_CHECK( cstate_GetHistRec( l_Hist.byNbRec - 1 )->byReason == CSTATE_REASON_PLUG ) ;
+
+   test_Replay( k_aBoost, ARRAY_SIZE(k_aBoost), "boost" ) ;
+   TEST_CHECK( l_bTestMaint ) ;
+   TEST_CHECK( ! l_Data.bBoost ) ;
+   TEST_CHECK( l_Data.eForceState == CSTATE_FORCE_NONE ) ;
+
+   test_Replay( k_aChain, ARRAY_SIZE(k_aChain), "chained transitions" ) ;
+   TEST_CHECK( l_Hist.aStat[CSTATE_FORCE_WAIT].dwNbEnter == 1 ) ;
+   TEST_CHECK( l_Hist.aStat[CSTATE_FORCE_WAIT].dwMaxSec == 0 ) ;
+   TEST_CHECK( l_Hist.aStat[CSTATE_ON_WAIT].dwNbEnter == 2 ) ;
+   TEST_CHECK( cstate_GetHistRec( l_Hist.byNbRec - 1 )->byReason == CSTATE_REASON_EV_CHARGE ) ;
+   TEST_CHECK( cstate_GetHistRec( l_Hist.byNbRec - 2 )->byReason == CSTATE_REASON_CAL_ON ) ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Replay <i_byNb> segments of current trace <i_pTrace> during charge, until  */
+/* the end of charge. Return the end of charge time (sec from charge start),  */
+/* 0 if not detected, and in <o_pbLow> if the low current dwell was started   */
+/*----------------------------------------------------------------------------*/
+
+static DWORD test_Trace( s_TestTrace C* i_pTrace, BYTE i_byNb, BOOL * o_pbLow )
+{
+   BYTE bySeg ;
+   DWORD dwIdx ;
+   DWORD dwSec ;
+   DWORD dwEocSec ;
+
+   cstate_EvtProc( EVT_CHARGE_ENABLE, TRUE ) ;
+   l_sdwTestCurrent = i_pTrace[0].sdwCurrent ;
+   cstate_EvtProc( EVT_EVSE_STATE, COEVSE_STATE_CHARGING ) ;
+   TEST_CHECK( l_Data.eChargeState == CSTATE_CHARGING ) ;
+
+   *o_pbLow = FALSE ;
+   dwEocSec = 0 ;
+   dwSec = 0 ;
+
+   for ( bySeg = 0 ; ( bySeg < i_byNb ) && ( dwEocSec == 0 ) ; bySeg++ )
+   {
+      for ( dwIdx = 0 ; ( dwIdx < i_pTrace[bySeg].dwSec ) && ( dwEocSec == 0 ) ;
+            dwIdx++ )
+      {
+         test_Run( 1, i_pTrace[bySeg].sdwCurrent ) ;
+         dwSec++ ;
+         *o_pbLow |= l_Eoc.bLow ;
+
+         if ( l_Data.eChargeState != CSTATE_CHARGING )
+         {
+            dwEocSec = dwSec ;
+         }
+      }
+   }
+
+   return dwEocSec ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* End of charge false positives                                              */
+/*----------------------------------------------------------------------------*/
+
+static void test_EndOfCharge( void )
+{
+   s_DataEeprom Eeprom ;
+   DWORD dwEocSec ;
+   BOOL bLow ;
+                                       /* averaging : dips never seen low */
+   test_Init( NULL ) ;
+   dwEocSec = test_Trace( k_aTraceDip, ARRAY_SIZE(k_aTraceDip), &bLow ) ;
+   TEST_CHECK( dwEocSec == 0 ) ;
+   TEST_CHECK( ! bLow ) ;
+   TEST_CHECK( l_Data.eChargeState == CSTATE_CHARGING ) ;
+                                       /* dwell : pause seen low, not ended */
+   test_Init( NULL ) ;
+   dwEocSec = test_Trace( k_aTracePause, ARRAY_SIZE(k_aTracePause), &bLow ) ;
+   TEST_CHECK( dwEocSec == 0 ) ;
+   TEST_CHECK( bLow ) ;
+   TEST_CHECK( ! l_Eoc.bLow ) ;
+   TEST_CHECK( l_Eoc.dwNbEoc == 0 ) ;
+                                       /* energy delta : balancing restarts */
+   memset( &Eeprom, 0, sizeof(Eeprom) ) ;
+   Eeprom.sChargeStateData.dwCurrentMinStop = TEST_BAL_MIN_STOP ;
+   test_Init( &Eeprom ) ;
+   dwEocSec = test_Trace( k_aTraceBalance, ARRAY_SIZE(k_aTraceBalance), &bLow ) ;
+   TEST_CHECK( dwEocSec > TEST_BAL_END_SEC ) ;
+   TEST_CHECK( dwEocSec <= TEST_BAL_END_SEC + 2 * CSTATE_EOC_DWELL_DEF ) ;
+   TEST_CHECK( l_Eoc.dwNbRestart >= 600 / CSTATE_EOC_DWELL_DEF - 1 ) ;
+   TEST_CHECK( l_Eoc.dwNbEoc == 1 ) ;
+   TEST_CHECK( l_Data.eChargeState == CSTATE_EOC_LOWCUR ) ;
+   TEST_CHECK( l_bTestEnable == FALSE ) ;
+
+   printf( "TestChargeState : balancing trace, %lu dwell restarts, end of charge "
+           "%lu s after balancing\n", l_Eoc.dwNbRestart, dwEocSec - TEST_BAL_END_SEC ) ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* One charge session, recorded after the merge delay                         */
+/*----------------------------------------------------------------------------*/
+
+static void test_Session( void )
+{
+   cstate_EvtProc( EVT_CHARGE_ENABLE, TRUE ) ;
+   test_Run( 1, 16000 ) ;
+   cstate_EvtProc( EVT_EVSE_STATE, COEVSE_STATE_CHARGING ) ;
+   test_Run( 60, 16000 ) ;
+   cstate_EvtProc( EVT_EVSE_STATE, COEVSE_STATE_CONNECTED ) ;
+
+   l_dwTestEepNb = 0 ;
+   test_Run( CSTATE_SESS_MERGE_DUR + 1, 0 ) ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Session record cut by a reset after each of its eeprom writes              */
+/*----------------------------------------------------------------------------*/
+
+static void test_SessCut( void )
+{
+   s_DataEeprom Eeprom ;
+   s_DataEeprom EepromFull ;
+   s_ChargeSessRec C* pRec ;
+   DWORD dwSeq ;
+   BYTE byIdx ;
+   DWORD dwLeft ;
+
+   test_Init( NULL ) ;                 /* ring full, and wrapped */
+   for ( byIdx = 0 ; byIdx < CSTATE_SESS_NB + 2 ; byIdx++ )
+   {
+      test_Session() ;
+   }
+   TEST_CHECK( l_Sess.dwSeq == CSTATE_SESS_NB + 2 ) ;
+   TEST_CHECK( l_Sess.byNbRec == CSTATE_SESS_NB ) ;
+                                       /* sequence cleared first, written last */
+   pRec = &l_TestEeprom.sChargeSessData.aRec[1] ;
+   TEST_CHECK( l_dwTestEepNb == TEST_SESS_WRITE ) ;
+   TEST_CHECK( l_adwTestEepAddr[0] == (DWORD)&pRec->dwSeq ) ;
+   TEST_CHECK( l_adwTestEepVal[0] == 0 ) ;
+   TEST_CHECK( l_adwTestEepAddr[TEST_SESS_WRITE - 1] == (DWORD)&pRec->dwSeq ) ;
+   TEST_CHECK( l_adwTestEepVal[TEST_SESS_WRITE - 1] == CSTATE_SESS_NB + 2 ) ;
+
+   EepromFull = l_TestEeprom ;
+   for ( dwLeft = 0 ; dwLeft <= TEST_SESS_WRITE ; dwLeft++ )
+   {
+      test_Init( &EepromFull ) ;       /* each cut from the full ring */
+      byIdx = l_Sess.byIdxIn ;
+      dwSeq = l_Sess.dwSeq ;
+
+      l_bTestEepCut = TRUE ;           /* record cut after <dwLeft> writes */
+      l_dwTestEepLeft = dwLeft ;
+      test_Session() ;
+      TEST_CHECK( l_dwTestEepNb == TEST_SESS_WRITE ) ;
+                                       /* reset, ring scan at start-up */
+      Eeprom = l_TestEeprom ;
+      test_Init( &Eeprom ) ;
+      pRec = &l_TestEeprom.sChargeSessData.aRec[byIdx] ;
+
+      if ( dwLeft == 0 )
+      {                                /* previous record untouched */
+         TEST_CHECK( pRec->dwSeq == dwSeq + 1 - CSTATE_SESS_NB ) ;
+         TEST_CHECK( l_Sess.dwSeq == dwSeq ) ;
+         TEST_CHECK( l_Sess.byIdxIn == byIdx ) ;
+         TEST_CHECK( l_Sess.byNbRec == CSTATE_SESS_NB ) ;
+      }
+      else if ( dwLeft < TEST_SESS_WRITE )
+      {                                /* cut record ignored, slot reused */
+         TEST_CHECK( pRec->dwSeq == 0 ) ;
+         TEST_CHECK( l_Sess.dwSeq == dwSeq ) ;
+         TEST_CHECK( l_Sess.byIdxIn == byIdx ) ;
+         TEST_CHECK( l_Sess.byNbRec == CSTATE_SESS_NB - 1 ) ;
+      }
+      else
+      {                                /* complete record */
+         TEST_CHECK( pRec->dwSeq == dwSeq + 1 ) ;
+         TEST_CHECK( l_Sess.dwSeq == dwSeq + 1 ) ;
+         TEST_CHECK( l_Sess.byIdxIn == NEXTIDX( byIdx, l_TestEeprom.sChargeSessData.aRec ) ) ;
+         TEST_CHECK( l_Sess.byNbRec == CSTATE_SESS_NB ) ;
+      }
+   }
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Successive transitions for one event are bounded by CSTATE_CHAIN_MAX       */
+/*----------------------------------------------------------------------------*/
+
+static void test_ChainMax( void )
+{
+   BYTE byNbRec ;
+
+   test_Init( NULL ) ;
+   cstate_EvtProc( EVT_CHARGE_ENABLE, TRUE ) ;
+   TEST_CHECK( l_Data.eChargeState == CSTATE_ON_WAIT ) ;
+   byNbRec = l_Hist.byNbRec ;
+                                       /* ON_WAIT <-> CHARGING loop */
+   l_bTestFlap = TRUE ;
+   cstate_EvtProc( EVT_EVSE_STATE, COEVSE_STATE_CHARGING ) ;
+   l_bTestFlap = FALSE ;
+
+   TEST_CHECK( l_Hist.byNbRec - byNbRec == CSTATE_CHAIN_MAX ) ;
+   TEST_CHECK( l_Hist.aStat[CSTATE_CHARGING].dwNbEnter == CSTATE_CHAIN_MAX / 2 ) ;
+   TEST_CHECK( l_Data.eChargeState == CSTATE_ON_WAIT ) ;
+   TEST_CHECK( l_bTestEnable == TRUE ) ;
+                                       /* next event is processed normally */
+   cstate_EvtProc( EVT_EVSE_STATE, COEVSE_STATE_CHARGING ) ;
+   TEST_CHECK( l_Data.eChargeState == CSTATE_CHARGING ) ;
+   TEST_CHECK( l_Hist.byNbRec - byNbRec == CSTATE_CHAIN_MAX + 1 ) ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+
+int main( void )
+{
+   test_Sequences() ;
+   test_EndOfCharge() ;
+   test_SessCut() ;
+   test_ChainMax() ;
+
+   return test_End( "TestChargeState" ) ;
+}
@@ -0,0 +1,690 @@
+/******************************************************************************/
+/*                               TestCommOEvse.c                              */
+/******************************************************************************/
+/*
+   CommOEvse.c host test
+
+   Copyright (C) 2018  Sylvain BASSET
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+   ------------
+   @version 1.0
+   @history 1.0, 19 oct. 2019, creation
+   @brief
+   OpenEVSE USART and DMA channels are RAM structures : the reception DMA is
+   simulated by writing l_RxFifo.abyData and CNDTR, and the character match
+   interrupt by calling UOEVSE_IRQHandler(), at any point between task reads.
+
+   The response parser is checked over RAPI lines built with their checksum,
+   and its cost per response is measured over recorded responses (host CPU
+   time, for comparison between versions only).
+*/
+
+
+#include <time.h>
+
+#include "HostTest.h"
+#include "System/Hard.h"
+
+
+/*----------------------------------------------------------------------------*/
+/* Simulated peripherals                                                      */
+/*----------------------------------------------------------------------------*/
+
+static USART_TypeDef l_TestUart ;
+static DMA_Channel_TypeDef l_TestDmaRx ;
+static DMA_Channel_TypeDef l_TestDmaTx ;
+static DMA_Request_TypeDef l_TestDmaCselr ;
+
+#undef UOEVSE
+#define UOEVSE              ( &l_TestUart )
+#undef UOEVSE_DMA_RX
+#define UOEVSE_DMA_RX       ( &l_TestDmaRx )
+#undef UOEVSE_DMA_TX
+#define UOEVSE_DMA_TX       ( &l_TestDmaTx )
+#undef UOEVSE_DMA_CSELR
+#define UOEVSE_DMA_CSELR    ( &l_TestDmaCselr )
+
+
+#include "System/Timer.c"
+#include "Lib/ConvAscii.c"
+#include "Communic/Transac.c"
+#include "Communic/CommOEvse.c"
+
+
+/*----------------------------------------------------------------------------*/
+/* Stubs                                                                      */
+/*----------------------------------------------------------------------------*/
+
+static DWORD l_dwDmaPos ;              /* simulated reception DMA position */
+
+void err_Set( e_ErrorId i_eErrorId ) {}
+void err_FatalError( void ) { abort() ; }
+void evt_Publish( e_evtId i_eEvtId, DWORD i_dwValue ) {}
+void HAL_GPIO_Init( GPIO_TypeDef * GPIOx, GPIO_InitTypeDef * GPIO_Init ) {}
+void HAL_NVIC_SetPriority( IRQn_Type IRQn, uint32_t PreemptPriority,
+                           uint32_t SubPriority ) {}
+void HAL_NVIC_EnableIRQ( IRQn_Type IRQn ) {}
+
+
+/*----------------------------------------------------------------------------*/
+/* Reset reception round buffer and simulated DMA                             */
+/*----------------------------------------------------------------------------*/
+
+static void test_RxReset( void )
+{
+   memset( &l_RxFifo, 0, sizeof(l_RxFifo) ) ;
+   memset( &l_TestUart, 0, sizeof(l_TestUart) ) ;
+   l_dwDmaPos = 0 ;
+   l_TestDmaRx.CNDTR = COEVSE_RX_FIFO_SIZE ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Simulated reception DMA : write <i_wNb> characters of <i_pszData>          */
+/*----------------------------------------------------------------------------*/
+
+static void test_DmaWrite( char C* i_pszData, WORD i_wNb )
+{
+   WORD wIdx ;
+
+   for ( wIdx = 0 ; wIdx < i_wNb ; wIdx++ )
+   {
+      l_RxFifo.abyData[l_dwDmaPos] = i_pszData[wIdx] ;
+      l_dwDmaPos = ( l_dwDmaPos + 1 ) % COEVSE_RX_FIFO_SIZE ;
+                                       /* counter reloaded in circular mode */
+      l_TestDmaRx.CNDTR = COEVSE_RX_FIFO_SIZE - l_dwDmaPos ;
+   }
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Task side : read all available characters                                  */
+/*----------------------------------------------------------------------------*/
+
+static WORD test_RxReadAll( char * o_pszData, WORD i_wSize )
+{
+   WORD wNb ;
+   BYTE byData ;
+
+   wNb = 0 ;
+   while ( ( wNb < i_wSize ) && coevse_RxFifoGet( &byData ) )
+   {
+      o_pszData[wNb] = byData ;
+      wNb++ ;
+   }
+
+   return wNb ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Characters are published by interrupt, and read in order by task           */
+/*----------------------------------------------------------------------------*/
+
+static void test_RxFifoOrder( void )
+{
+   char szRead [COEVSE_RX_FIFO_SIZE] ;
+   BYTE byData ;
+
+   test_RxReset() ;
+                                       /* written by DMA, not yet published */
+   test_DmaWrite( "$ST 2^xx\r", 9 ) ;
+   TEST_CHECK( ! coevse_RxFifoGet( &byData ) ) ;
+
+   UOEVSE_IRQHandler() ;
+   TEST_CHECK( l_RxFifo.dwNbIrq == 1 ) ;
+   TEST_CHECK( test_RxReadAll( szRead, sizeof(szRead) ) == 9 ) ;
+   TEST_CHECK( memcmp( szRead, "$ST 2^xx\r", 9 ) == 0 ) ;
+   TEST_CHECK( ! coevse_RxFifoGet( &byData ) ) ;
+   TEST_CHECK( l_RxFifo.dwNbLost == 0 ) ;
+   TEST_CHECK( ! coevse_RxFifoIsLost() ) ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Interleaving of DMA writes, interrupts and task reads over many buffer     */
+/* turns : the stream is received without loss while the buffer is never     */
+/* more than full                                                             */
+/*----------------------------------------------------------------------------*/
+
+static void test_RxFifoInterleave( void )
+{
+   char szSent [20000] ;
+   char szRead [20000] ;
+   DWORD dwNbSent ;
+   DWORD dwNbPub ;
+   DWORD dwNbRead ;
+   DWORD dwIdx ;
+   WORD wNb ;
+   DWORD dwSeed ;
+   BOOL bSame ;
+
+   test_RxReset() ;
+   dwSeed = 12345 ;
+
+   for ( dwIdx = 0 ; dwIdx < sizeof(szSent) ; dwIdx++ )
+   {
+      szSent[dwIdx] = (char)( 'A' + ( dwIdx % 26 ) ) ;
+   }
+
+   dwNbSent = 0 ;
+   dwNbPub = 0 ;
+   dwNbRead = 0 ;
+
+   while ( dwNbSent < ( sizeof(szSent) - COEVSE_RX_FIFO_SIZE ) )
+   {
+      dwSeed = dwSeed * 1103515245 + 12345 ;
+                                       /* DMA writes at most the free space */
+      wNb = ( dwSeed >> 16 ) % 48 ;
+      wNb = GETMIN( wNb, ( COEVSE_RX_FIFO_SIZE - 1 ) - ( dwNbSent - dwNbRead ) ) ;
+      test_DmaWrite( &szSent[dwNbSent], wNb ) ;
+      dwNbSent += wNb ;
+
+      if ( ISSET( dwSeed, 0x100 ) )    /* interrupt (character match) */
+      {
+         UOEVSE_IRQHandler() ;
+         dwNbPub = dwNbSent ;
+      }
+                                       /* task reads a part of published data */
+      wNb = ( dwSeed >> 8 ) % 40 ;
+      wNb = GETMIN( wNb, dwNbPub - dwNbRead ) ;
+      TEST_CHECK( test_RxReadAll( &szRead[dwNbRead], wNb ) == wNb ) ;
+      dwNbRead += wNb ;
+   }
+
+   UOEVSE_IRQHandler() ;
+   dwNbRead += test_RxReadAll( &szRead[dwNbRead], sizeof(szRead) - dwNbRead ) ;
+
+   bSame = ( memcmp( szSent, szRead, dwNbSent ) == 0 ) ;
+   TEST_CHECK( dwNbRead == dwNbSent ) ;
+   TEST_CHECK( bSame ) ;
+   TEST_CHECK( l_RxFifo.dwNbLost == 0 ) ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Full buffer : COEVSE_RX_FIFO_SIZE - 1 unread characters are kept, each     */
+/* character overwritten by DMA is counted as lost                           */
+/*----------------------------------------------------------------------------*/
+
+static void test_RxFifoFull( void )
+{
+   char szData [COEVSE_RX_FIFO_SIZE + 10] ;
+   char szRead [COEVSE_RX_FIFO_SIZE] ;
+
+   memset( szData, 'x', sizeof(szData) ) ;
+
+   test_RxReset() ;                    /* exactly full : no loss */
+   test_DmaWrite( szData, COEVSE_RX_FIFO_SIZE - 1 ) ;
+   UOEVSE_IRQHandler() ;
+   TEST_CHECK( l_RxFifo.dwNbLost == 0 ) ;
+   TEST_CHECK( ! coevse_RxFifoIsLost() ) ;
+   TEST_CHECK( test_RxReadAll( szRead, sizeof(szRead) ) == COEVSE_RX_FIFO_SIZE - 1 ) ;
+
+   test_RxReset() ;                    /* one over : one lost character */
+   test_DmaWrite( szData, COEVSE_RX_FIFO_SIZE - 1 ) ;
+   UOEVSE_IRQHandler() ;
+   test_DmaWrite( szData, 1 ) ;
+   UOEVSE_IRQHandler() ;
+   TEST_CHECK( l_RxFifo.dwNbLost == 1 ) ;
+
+   test_RxReset() ;                    /* partly read buffer, 5 over */
+   test_DmaWrite( szData, 100 ) ;
+   UOEVSE_IRQHandler() ;
+   TEST_CHECK( test_RxReadAll( szRead, 20 ) == 20 ) ;
+   test_DmaWrite( szData, ( COEVSE_RX_FIFO_SIZE - 1 ) - 80 + 5 ) ;
+   UOEVSE_IRQHandler() ;
+   TEST_CHECK( l_RxFifo.dwNbLost == 5 ) ;
+                                       /* loss is seen once by task */
+   TEST_CHECK( coevse_RxFifoIsLost() ) ;
+   TEST_CHECK( ! coevse_RxFifoIsLost() ) ;
+
+   coevse_RxFifoFlush() ;              /* flush drops pending characters */
+   TEST_CHECK( test_RxReadAll( szRead, sizeof(szRead) ) == 0 ) ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* UART overrun is counted as lost character, and fails pending response      */
+/*----------------------------------------------------------------------------*/
+
+static void test_RxFifoOverrun( void )
+{
+   test_RxReset() ;
+   memset( &l_Result, 0, sizeof(l_Result) ) ;
+
+   test_DmaWrite( "$OK", 3 ) ;
+   l_TestUart.ISR = USART_ISR_ORE ;
+   UOEVSE_IRQHandler() ;
+   TEST_CHECK( l_RxFifo.dwNbLost == 1 ) ;
+
+   coevse_ProcessRx() ;
+   TEST_CHECK( l_Result.bError ) ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Simulated OpenEVSE line : written by DMA, then character match interrupt   */
+/*----------------------------------------------------------------------------*/
+
+static void test_RxLine( char C* i_pszLine )
+{
+   test_DmaWrite( i_pszLine, strlen( i_pszLine ) ) ;
+   UOEVSE_IRQHandler() ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Link ready, nothing queued                                                 */
+/*----------------------------------------------------------------------------*/
+
+static void test_LinkReset( void )
+{
+   BYTE byLane ;
+
+   test_RxReset() ;
+   memset( &l_Tunnel, 0, sizeof(l_Tunnel) ) ;
+   memset( &l_Poll, 0, sizeof(l_Poll) ) ;
+   memset( &l_Status, 0, sizeof(l_Status) ) ;
+   for ( byLane = 0 ; byLane < COEVSE_LANE_NB ; byLane++ )
+   {
+      trs_InitQueue( &l_aCmdQueue[byLane], l_aCmdItems[byLane],
+                     sizeof(s_CmdFifoData), ARRAY_SIZE(l_aCmdItems[byLane]) ) ;
+   }
+   trs_Init( &l_Trs, &k_TrsPolicy, l_aTrsStat, ARRAY_SIZE(l_aTrsStat),
+             l_aCmdQueue, COEVSE_LANE_NB ) ;
+   coevse_CmdEnd() ;
+   l_eRxLine = COEVSE_RX_NONE ;
+   l_bOpenEvseRdy = TRUE ;
+   l_TestDmaTx.CNDTR = 0 ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Control commands are sent during tunnel, between tunnel exchanges, and     */
+/* monitoring commands are held                                               */
+/*----------------------------------------------------------------------------*/
+
+static void test_TunnelCtrl( void )
+{
+   test_LinkReset() ;
+
+   TEST_CHECK( coevse_StartTunnel( 0 ) == OK ) ;
+   coevse_TaskCyc() ;
+   TEST_CHECK( l_Tunnel.bActive ) ;
+   TEST_CHECK( l_Tunnel.dwTimeout == COEVSE_TUNNEL_TIMEOUT_DEF ) ;
+                                       /* timeout is capped */
+   TEST_CHECK( COEVSE_TUNNEL_TIMEOUT_MAX <= 60 ) ;
+
+   coevse_AddCmdFifo( COEVSE_CMD_GETFAULT, NULL, 0 ) ;
+   TEST_CHECK( coevse_TunnelSend( "$GS\r\n" ) == OK ) ;
+   coevse_SetCurrentCap( 10 ) ;        /* during a tunnel exchange */
+   test_Advance( 50 ) ;
+   l_TestDmaTx.CNDTR = 0 ;
+   coevse_TaskCyc() ;
+   TEST_CHECK( ! l_Tunnel.bSuspend ) ;
+   TEST_CHECK( l_eCmd == COEVSE_CMD_NONE ) ;
+                                       /* tunnel response is forwarded */
+   test_RxLine( "$OK 1 0^xx\r" ) ;
+   coevse_TaskCyc() ;
+   TEST_CHECK( ! l_Tunnel.bSuspend ) ;
+                                       /* exchange over : control command sent */
+   test_Advance( COEVSE_TUNNEL_GAP ) ;
+   coevse_TaskCyc() ;
+   TEST_CHECK( l_Tunnel.bActive && l_Tunnel.bSuspend ) ;
+   TEST_CHECK( l_eCmd == COEVSE_CMD_SETCURRENTCAP ) ;
+   TEST_CHECK( strncmp( l_szStrCmdBuffer, "$SC 10^", 7 ) == 0 ) ;
+                                       /* tunnel data held during suspension */
+   TEST_CHECK( coevse_TunnelSend( "$GE" ) == OK ) ;
+   TEST_CHECK( l_Tunnel.bTxPending ) ;
+
+   l_TestDmaTx.CNDTR = 0 ;
+   test_Advance( 5 ) ;
+   test_RxLine( "$OK^20\r" ) ;
+   coevse_TaskCyc() ;                  /* response : $GE read back is queued */
+   TEST_CHECK( l_eCmd == COEVSE_CMD_NONE ) ;
+   TEST_CHECK( coevse_GetQueueDepth() == 2 ) ;
+
+   coevse_TaskCyc() ;                  /* tunnel resumes, monitoring is held */
+   TEST_CHECK( l_Tunnel.bActive && ( ! l_Tunnel.bSuspend ) ) ;
+   TEST_CHECK( ! l_Tunnel.bTxPending ) ;
+   TEST_CHECK( l_TestDmaTx.CNDTR == 4 ) ;
+   TEST_CHECK( l_eCmd == COEVSE_CMD_NONE ) ;
+                                       /* monitoring commands after tunnel end */
+   coevse_StopTunnel() ;
+   test_Advance( 1 ) ;
+   coevse_TaskCyc() ;
+   TEST_CHECK( l_eCmd == COEVSE_CMD_GETFAULT ) ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Build RAPI line : <i_pszBody> followed by its checksum and '\r'            */
+/*----------------------------------------------------------------------------*/
+
+static void test_RapiLine( char * o_pszLine, WORD i_wSize, char C* i_pszBody )
+{
+   char szCk [3] ;
+
+   coevse_GetChecksum( szCk, sizeof(szCk), i_pszBody ) ;
+   snprintf( o_pszLine, i_wSize, "%s^%s\r", i_pszBody, szCk ) ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Receive <i_pszLine> as response of command <i_eCmd>                        */
+/* Return the checksum and status check result                                */
+/*----------------------------------------------------------------------------*/
+
+static RESULT test_Response( e_CmdId i_eCmd, char C* i_pszLine )
+{
+   coevse_CmdStart( i_eCmd ) ;
+   test_RxLine( i_pszLine ) ;
+   coevse_ProcessRx() ;
+
+   TEST_CHECK( ! l_Result.bWaitResponse ) ;
+
+   return coevse_CheckRes( &l_Result, TRUE ) ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* A retry sends again the failed command, even if a higher priority command  */
+/* is queued during the backoff delay, and lane statistics are kept           */
+/*----------------------------------------------------------------------------*/
+
+static void test_RetryLatch( void )
+{
+   DWORD dwLatLast ;
+   char szLine [32] ;
+
+   test_LinkReset() ;
+
+   coevse_AddCmdFifo( COEVSE_CMD_GETFAULT, NULL, 0 ) ;
+   test_Advance( 3 ) ;
+   coevse_TaskCyc() ;                  /* monitoring command sent */
+   TEST_CHECK( l_eCmd == COEVSE_CMD_GETFAULT ) ;
+   TEST_CHECK( trs_IsSelected( &l_Trs ) && ( l_Trs.byQueueCur == COEVSE_LANE_MONIT ) ) ;
+   dwLatLast = l_aCmdQueue[COEVSE_LANE_MONIT].dwLatLast ;
+   TEST_CHECK( dwLatLast == 3 ) ;
+                                       /* no response */
+   test_Advance( COEVSE_TIMEOUT + 1 ) ;
+   coevse_TaskCyc() ;
+   TEST_CHECK( l_eCmd == COEVSE_CMD_NONE ) ;
+   TEST_CHECK( trs_IsSelected( &l_Trs ) ) ;
+                                       /* control command during backoff */
+   coevse_SetCurrentCap( 10 ) ;
+   test_Advance( COEVSE_BACKOFF_MAX ) ;
+   coevse_TaskCyc() ;                  /* retry : same command */
+   TEST_CHECK( l_eCmd == COEVSE_CMD_GETFAULT ) ;
+   TEST_CHECK( l_Trs.byQueueCur == COEVSE_LANE_MONIT ) ;
+   TEST_CHECK( strcmp( l_szStrCmdBuffer, "$GF^25\r" ) == 0 ) ;
+   TEST_CHECK( l_Trs.byNbPrioSent == 0 ) ;
+   TEST_CHECK( l_aCmdQueue[COEVSE_LANE_MONIT].dwLatLast == dwLatLast ) ;
+   TEST_CHECK( trs_GetNbRetry( &l_Trs ) == 1 ) ;
+                                       /* success : latch released */
+   test_RapiLine( szLine, sizeof(szLine), "$OK 0 0 0" ) ;
+   test_RxLine( szLine ) ;
+   coevse_TaskCyc() ;
+   TEST_CHECK( l_eCmd == COEVSE_CMD_NONE ) ;
+   TEST_CHECK( ! trs_IsSelected( &l_Trs ) ) ;
+
+   coevse_TaskCyc() ;                  /* then the control command */
+   TEST_CHECK( l_eCmd == COEVSE_CMD_SETCURRENTCAP ) ;
+   TEST_CHECK( l_Trs.byQueueCur == COEVSE_LANE_CTRL ) ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Send queued control commands, return their strings in <o_pszSent>          */
+/*----------------------------------------------------------------------------*/
+
+static void test_SendCtrl( char * o_pszSent, WORD i_wSize )
+{
+   char szLine [32] ;
+
+   o_pszSent[0] = '\0' ;
+
+   coevse_TaskCyc() ;
+   while ( l_eCmd != COEVSE_CMD_NONE )
+   {
+      strncat( o_pszSent, l_szStrCmdBuffer, i_wSize - strlen( o_pszSent ) - 1 ) ;
+      test_RapiLine( szLine, sizeof(szLine), "$OK" ) ;
+      test_RxLine( szLine ) ;
+      coevse_TaskCyc() ;               /* response */
+      coevse_TaskCyc() ;               /* next command */
+   }
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Current capacity setters are sent in queuing order : a setter replaces the */
+/* parameters of the same command only if it is the last one of the lane      */
+/*----------------------------------------------------------------------------*/
+
+static void test_CoalCurrent( void )
+{
+   char szSent [64] ;
+
+   test_LinkReset() ;
+                                       /* load management, then user capacity */
+   coevse_SetCurrentVol( 10 ) ;
+   coevse_SetCurrentCap( 16 ) ;
+   coevse_SetCurrentVol( 8 ) ;
+   TEST_CHECK( trs_GetQueueDepth( &l_Trs ) == 3 ) ;
+   TEST_CHECK( l_aCmdQueue[COEVSE_LANE_CTRL].dwNbCoalesced == 0 ) ;
+                                       /* last one : replaced */
+   coevse_SetCurrentVol( 6 ) ;
+   TEST_CHECK( trs_GetQueueDepth( &l_Trs ) == 3 ) ;
+   TEST_CHECK( l_aCmdQueue[COEVSE_LANE_CTRL].dwNbCoalesced == 1 ) ;
+
+   test_SendCtrl( szSent, sizeof(szSent) ) ;
+   TEST_CHECK( strncmp( szSent, "$SC 10 V^", 9 ) == 0 ) ;
+   TEST_CHECK( strstr( szSent, "\r$SC 16^" ) != NULL ) ;
+   TEST_CHECK( strstr( szSent, "\r$SC 6 V^" ) != NULL ) ;
+   TEST_CHECK( strstr( szSent, "$SC 16^" ) < strstr( szSent, "$SC 6 V^" ) ) ;
+   TEST_CHECK( strstr( szSent, "$SC 8 V" ) == NULL ) ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Response fields : decimal, hexadecimal, negative and invalid numbers       */
+/*----------------------------------------------------------------------------*/
+
+static void test_ParseFields( void )
+{
+   char szLine [40] ;
+   s_coevseResFields C* pFields ;
+
+   test_LinkReset() ;
+   pFields = &l_Result.Fields ;
+
+   test_RapiLine( szLine, sizeof(szLine), "$OK 16000 230000" ) ;
+   TEST_CHECK( test_Response( COEVSE_CMD_GETCHARGPARAM, szLine ) == OK ) ;
+   TEST_CHECK( pFields->byNb == 2 ) ;
+   TEST_CHECK( COEVSE_IS_DEC( pFields, 0 ) && ( pFields->asdwDec[0] == 16000 ) ) ;
+   TEST_CHECK( COEVSE_IS_DEC( pFields, 1 ) && ( pFields->asdwDec[1] == 230000 ) ) ;
+   TEST_CHECK( COEVSE_IS_HEX( pFields, 0 ) && ( pFields->adwHex[0] == 0x16000 ) ) ;
+   TEST_CHECK( strcmp( (char*)l_Result.abyDataRes, "$OK 16000 230000" ) == 0 ) ;
+
+   test_RapiLine( szLine, sizeof(szLine), "$OK -5 ab 0A" ) ;
+   TEST_CHECK( test_Response( COEVSE_CMD_GETFAULT, szLine ) == OK ) ;
+   TEST_CHECK( pFields->byNb == 3 ) ;
+   TEST_CHECK( COEVSE_IS_DEC( pFields, 0 ) && ( pFields->asdwDec[0] == -5 ) ) ;
+   TEST_CHECK( ! COEVSE_IS_HEX( pFields, 0 ) ) ;
+   TEST_CHECK( ! COEVSE_IS_DEC( pFields, 1 ) ) ;
+   TEST_CHECK( COEVSE_IS_HEX( pFields, 1 ) && ( pFields->adwHex[1] == 0xAB ) ) ;
+   TEST_CHECK( COEVSE_IS_HEX( pFields, 2 ) && ( pFields->adwHex[2] == 0x0A ) ) ;
+   TEST_CHECK( COEVSE_IS_DEC( pFields, 2 ) == FALSE ) ;
+                                       /* fields over the maximum are ignored */
+   test_RapiLine( szLine, sizeof(szLine), "$OK 1 2 3 4 5 6" ) ;
+   TEST_CHECK( test_Response( COEVSE_CMD_GETFAULT, szLine ) == OK ) ;
+   TEST_CHECK( pFields->byNb == COEVSE_RES_FIELD_MAX ) ;
+   TEST_CHECK( pFields->asdwDec[COEVSE_RES_FIELD_MAX-1] == COEVSE_RES_FIELD_MAX ) ;
+
+   test_RapiLine( szLine, sizeof(szLine), "$OK" ) ;
+   TEST_CHECK( test_Response( COEVSE_CMD_SETLOCK, szLine ) == OK ) ;
+   TEST_CHECK( pFields->byNb == 0 ) ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Wrong checksum, status and line length                                     */
+/*----------------------------------------------------------------------------*/
+
+static void test_ParseErrors( void )
+{
+   char szLine [60] ;
+
+   test_LinkReset() ;
+
+   TEST_CHECK( test_Response( COEVSE_CMD_GETFAULT, "$OK 1^00\r" ) == ERR ) ;
+   TEST_CHECK( test_Response( COEVSE_CMD_GETFAULT, "$OK 1^1\r" ) == ERR ) ;
+   TEST_CHECK( test_Response( COEVSE_CMD_GETFAULT, "$OK 1^1g\r" ) == ERR ) ;
+   TEST_CHECK( test_Response( COEVSE_CMD_GETFAULT, "$OK 1\r" ) == ERR ) ;
+                                       /* checksum of "$OK 1" with a third digit */
+   test_RapiLine( szLine, sizeof(szLine), "$OK 1" ) ;
+   TEST_CHECK( test_Response( COEVSE_CMD_GETFAULT, szLine ) == OK ) ;
+   strcpy( &szLine[strlen(szLine)-1], "0\r" ) ;
+   TEST_CHECK( test_Response( COEVSE_CMD_GETFAULT, szLine ) == ERR ) ;
+
+   test_RapiLine( szLine, sizeof(szLine), "$NK" ) ;
+   TEST_CHECK( test_Response( COEVSE_CMD_SETLOCK, szLine ) == ERR ) ;
+                                       /* line over response buffer */
+   test_RapiLine( szLine, sizeof(szLine), "$OK 1 2 3 4 5 6 7 8 9 10 11 12 13 14 15" ) ;
+   TEST_CHECK( test_Response( COEVSE_CMD_GETFAULT, szLine ) == ERR ) ;
+   TEST_CHECK( l_Result.bError ) ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* EVSE state is hexadecimal in both $GS response and $ST message             */
+/*----------------------------------------------------------------------------*/
+
+static void test_ParseState( void )
+{
+   char szLine [40] ;
+   char szBody [20] ;
+   BYTE byIdx ;
+   char C* apszState [] = { "1", "2", "3", "fe", "ff", "0a" } ;
+   e_coevseEvseState C aeState [] =
+   {
+      COEVSE_STATE_NOTCONNECTED, COEVSE_STATE_CONNECTED, COEVSE_STATE_CHARGING,
+      COEVSE_STATE_UNKNOWN, COEVSE_STATE_UNKNOWN, COEVSE_STATE_UNKNOWN,
+   } ;
+   DWORD C adwState [] = { 1, 2, 3, 0xFE, 0xFF, 0x0A } ;
+   e_coevseEvseState eGs ;
+   DWORD dwGs ;
+
+   test_LinkReset() ;
+
+   for ( byIdx = 0 ; byIdx < ARRAY_SIZE(apszState) ; byIdx++ )
+   {
+      snprintf( szBody, sizeof(szBody), "$OK %s 120", apszState[byIdx] ) ;
+      test_RapiLine( szLine, sizeof(szLine), szBody ) ;
+      TEST_CHECK( test_Response( COEVSE_CMD_GETEVSESTATE, szLine ) == OK ) ;
+      coevse_CmdresultGetEVSEState( "", &l_Result.Fields ) ;
+      eGs = l_Status.eEvseState ;
+      dwGs = l_Result.Fields.adwHex[0] ;
+      TEST_CHECK( dwGs == adwState[byIdx] ) ;
+      TEST_CHECK( eGs == aeState[byIdx] ) ;
+
+      l_Status.eEvseState = COEVSE_STATE_UNKNOWN ;
+      snprintf( szBody, sizeof(szBody), "$ST %s", apszState[byIdx] ) ;
+      test_RapiLine( szLine, sizeof(szLine), szBody ) ;
+      test_RxLine( szLine ) ;
+      coevse_ProcessRx() ;             /* same state from notification */
+      TEST_CHECK( l_Status.byAsyncState == (BYTE)adwState[byIdx] ) ;
+      TEST_CHECK( l_Status.eEvseState == eGs ) ;
+   }
+                                       /* notification while response is awaited */
+   l_Status.eEvseState = COEVSE_STATE_NOTCONNECTED ;
+   coevse_CmdStart( COEVSE_CMD_GETCHARGPARAM ) ;
+   test_RapiLine( szLine, sizeof(szLine), "$ST 2" ) ;
+   test_RxLine( szLine ) ;
+   test_RapiLine( szLine, sizeof(szLine), "$OK 6000 240000" ) ;
+   test_RxLine( szLine ) ;
+   coevse_ProcessRx() ;
+   TEST_CHECK( l_Status.eEvseState == COEVSE_STATE_CONNECTED ) ;
+   TEST_CHECK( l_Status.bPlugEvent ) ;
+   TEST_CHECK( coevse_CheckRes( &l_Result, TRUE ) == OK ) ;
+   TEST_CHECK( l_Result.Fields.asdwDec[0] == 6000 ) ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Parser cost per response over recorded responses (host CPU)                */
+/*----------------------------------------------------------------------------*/
+
+static void test_ParseBench( void )
+{
+   static char C* k_apszRec [] =       /* recorded polling responses */
+   {
+      "$OK 3 4521", "$OK 15980 238000", "$OK 9136044 1534", "$OK 0 0 0",
+      "$OK 16 0", "$OK 1 4521", "$OK 0 238000", "$OK 0 1534",
+   } ;
+   char aszLine [ARRAY_SIZE(k_apszRec)][40] ;
+   DWORD dwNbLoop ;
+   DWORD dwNbRes ;
+   BYTE byIdx ;
+   clock_t Start ;
+   double fdNs ;
+
+   test_LinkReset() ;
+   for ( byIdx = 0 ; byIdx < ARRAY_SIZE(k_apszRec) ; byIdx++ )
+   {
+      test_RapiLine( aszLine[byIdx], sizeof(aszLine[byIdx]), k_apszRec[byIdx] ) ;
+   }
+
+   dwNbRes = 0 ;
+   Start = clock() ;
+   for ( dwNbLoop = 0 ; dwNbLoop < 100000 ; dwNbLoop++ )
+   {
+      byIdx = dwNbLoop % ARRAY_SIZE(k_apszRec) ;
+      coevse_CmdStart( COEVSE_CMD_GETCHARGPARAM ) ;
+      test_RxLine( aszLine[byIdx] ) ;
+      coevse_ProcessRx() ;
+      if ( coevse_CheckRes( &l_Result, TRUE ) == OK )
+      {
+         coevse_CmdresultGetChargParam( "", &l_Result.Fields ) ;
+         dwNbRes++ ;
+      }
+   }
+   fdNs = ( (double)( clock() - Start ) * 1e9 ) / CLOCKS_PER_SEC / dwNbLoop ;
+
+   TEST_CHECK( dwNbRes == dwNbLoop ) ;
+   printf( "TestCommOEvse : response reception and parsing %.0f ns (host)\n", fdNs ) ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+
+int main( void )
+{
+   test_RxFifoOrder() ;
+   test_RxFifoInterleave() ;
+   test_RxFifoFull() ;
+   test_RxFifoOverrun() ;
+   test_TunnelCtrl() ;
+   test_RetryLatch() ;
+   test_CoalCurrent() ;
+   test_ParseFields() ;
+   test_ParseErrors() ;
+   test_ParseState() ;
+   test_ParseBench() ;
+
+   return test_End( "TestCommOEvse" ) ;
+}
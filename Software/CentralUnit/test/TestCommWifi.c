@@ -0,0 +1,347 @@
+/******************************************************************************/
+/*                               TestCommWifi.c                               */
+/******************************************************************************/
+/*
+   CommWifi.c host test
+
+   Copyright (C) 2018  Sylvain BASSET
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+   ------------
+   @version 1.0
+   @history 1.0, 19 oct. 2019, creation
+   @brief
+   The UartWifi.c functions are replaced by a simulated wifi module : sent
+   commands are recorded, and the module answers each command waiting for a
+   response with "OK", "ERROR", or nothing (lost response), as set by the
+   test. Wind messages are given to the link as module output lines.
+
+   The eeprom is a RAM structure. The module hardware reset (busy wait) is
+   not run, cwifi_Init() is replaced by test_WifiInit().
+*/
+
+
+#include "HostTest.h"
+#include "System.h"
+#include "System/Hard.h"
+
+
+/*----------------------------------------------------------------------------*/
+/* Simulated eeprom                                                           */
+/*----------------------------------------------------------------------------*/
+
+static s_DataEeprom l_TestEeprom ;
+
+#undef g_sDataEeprom
+#define g_sDataEeprom       ( &l_TestEeprom )
+
+
+#include "System/Timer.c"
+#include "Communic/Transac.c"
+#include "Communic/CommWifi.c"
+
+
+/*----------------------------------------------------------------------------*/
+/* Defines                                                                    */
+/*----------------------------------------------------------------------------*/
+
+#define TEST_PEER_NB         32        /* recorded commands, output lines number */
+#define TEST_PEER_LEN       128        /* recorded command, output line length */
+
+typedef enum                           /* simulated module answer */
+{
+   TEST_ANS_OK = 0,                    /* "OK" */
+   TEST_ANS_ERR,                       /* "ERROR" */
+   TEST_ANS_LOST,                      /* no response */
+} e_TestAns ;
+
+
+/*----------------------------------------------------------------------------*/
+/* Variables                                                                  */
+/*----------------------------------------------------------------------------*/
+
+static char l_aszPeerCmd [TEST_PEER_NB][TEST_PEER_LEN] ;   /* received commands */
+static BYTE l_byPeerNbCmd ;
+static char l_aszPeerOut [TEST_PEER_NB][TEST_PEER_LEN] ;   /* output lines */
+static BYTE l_byPeerOutIn ;
+static BYTE l_byPeerOutOut ;
+static e_TestAns l_ePeerAns ;          /* answer to next commands */
+static char l_szPostRes [128] ;        /* external commands responses */
+
+
+/*----------------------------------------------------------------------------*/
+/* Stubs                                                                      */
+/*----------------------------------------------------------------------------*/
+
+void err_FatalError( void ) { abort() ; }
+void evt_Publish( e_evtId i_eEvtId, DWORD i_dwValue ) {}
+void HAL_GPIO_Init( GPIO_TypeDef * GPIOx, GPIO_InitTypeDef * GPIO_Init ) {}
+void HAL_GPIO_WritePin( GPIO_TypeDef * GPIOx, uint16_t GPIO_Pin,
+                        GPIO_PinState PinState ) {}
+BOOL clk_IsValidStr( CHAR C* i_pszDateTime, s_DateTime * o_psDateTime ) { return FALSE ; }
+void clk_SetDateTime( s_DateTime C* i_psDateTime, BYTE i_byErrorSecMax ) {}
+
+
+/*----------------------------------------------------------------------------*/
+/* Simulated module : output line                                             */
+/*----------------------------------------------------------------------------*/
+
+static void test_PeerOut( char C* i_pszLine )
+{
+   snprintf( l_aszPeerOut[l_byPeerOutIn], TEST_PEER_LEN, "%s", i_pszLine ) ;
+   l_byPeerOutIn = ( l_byPeerOutIn + 1 ) % TEST_PEER_NB ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Simulated module : UartWifi.c functions                                    */
+/*----------------------------------------------------------------------------*/
+
+void uwifi_Init( void ) {}
+void uwifi_SetErrorDetection( BOOL i_bEnable ) {}
+BOOL uwifi_IsSendDone( void ) { return TRUE ; }
+DWORD uwifi_GetRemainingSend( void ) { return 0 ; }
+
+BOOL uwifi_Send( void C* i_pvData, DWORD i_dwSize )
+{
+   char * pszCmd ;
+
+   if ( l_byPeerNbCmd < TEST_PEER_NB )
+   {
+      pszCmd = l_aszPeerCmd[l_byPeerNbCmd] ;
+      snprintf( pszCmd, TEST_PEER_LEN, "%.*s", (int)i_dwSize, (char C*)i_pvData ) ;
+      l_byPeerNbCmd++ ;
+                                       /* commands with a response */
+      if ( ( strncmp( pszCmd, "AT+CFUN", 7 ) != 0 ) && ( strcmp( pszCmd, "AT+S.\r" ) != 0 ) )
+      {
+         if ( l_ePeerAns == TEST_ANS_OK )
+         {
+            test_PeerOut( "OK\r\n" ) ;
+         }
+         else if ( l_ePeerAns == TEST_ANS_ERR )
+         {
+            test_PeerOut( "ERROR: Invalid command\r\n" ) ;
+         }
+      }
+   }
+
+   return TRUE ;
+}
+
+WORD uwifi_Read( BYTE * o_pbyData, WORD i_dwMaxSize, BOOL i_bGetPending )
+{
+   WORD wSize ;
+
+   wSize = 0 ;
+                                       /* only complete lines */
+   if ( ( ! i_bGetPending ) && ( l_byPeerOutOut != l_byPeerOutIn ) )
+   {
+      wSize = snprintf( (char*)o_pbyData, i_dwMaxSize, "%s", l_aszPeerOut[l_byPeerOutOut] ) ;
+      l_byPeerOutOut = ( l_byPeerOutOut + 1 ) % TEST_PEER_NB ;
+   }
+
+   return wSize ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* External command response callback                                         */
+/*----------------------------------------------------------------------------*/
+
+static void test_PostRes( char C* i_pszData, BOOL i_bLastCall )
+{
+   strncat( l_szPostRes, i_pszData, sizeof(l_szPostRes) - strlen(l_szPostRes) - 1 ) ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Link initialization, without hardware, module ready                        */
+/*----------------------------------------------------------------------------*/
+
+static void test_WifiInit( void )
+{
+   trs_InitQueue( &l_CmdQueue, l_aCmdItems, sizeof(s_CmdItem), ARRAY_SIZE(l_aCmdItems) ) ;
+   trs_Init( &l_Trs, &k_TrsPolicy, l_aTrsStat, ARRAY_SIZE(l_aTrsStat), &l_CmdQueue, 1 ) ;
+   cwifi_ResetVar() ;
+   l_bMaintMode = FALSE ;
+   l_bConfigDone = FALSE ;
+   cwifi_RegisterScktFunc( NULL, test_PostRes ) ;
+
+   l_byPeerNbCmd = 0 ;
+   l_byPeerOutIn = 0 ;
+   l_byPeerOutOut = 0 ;
+   l_ePeerAns = TEST_ANS_OK ;
+   l_szPostRes[0] = '\0' ;
+
+   snprintf( l_TestEeprom.sWifiConInfo.szWifiSSID,
+             sizeof(l_TestEeprom.sWifiConInfo.szWifiSSID), "home" ) ;
+   snprintf( l_TestEeprom.sWifiConInfo.szWifiPassword,
+             sizeof(l_TestEeprom.sWifiConInfo.szWifiPassword), "secret" ) ;
+   l_TestEeprom.sWifiConInfo.dwWifiSecurity = 2 ;
+
+   test_PeerOut( "+WIND:0:Console active\r\n" ) ;
+   test_PeerOut( "+WIND:1:Poweron (SPWF01S-170111)\r\n" ) ;
+   test_PeerOut( "+WIND:32:WiFi Hardware Started\r\n" ) ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Run link task during <i_dwMs> ms                                           */
+/*----------------------------------------------------------------------------*/
+
+static void test_WifiRun( DWORD i_dwMs )
+{
+   DWORD dwMs ;
+
+   for ( dwMs = 0 ; dwMs < i_dwMs ; dwMs += 10 )
+   {
+      cwifi_TaskCyc() ;
+      test_Advance( 10 ) ;
+   }
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Configuration commands are sent in order, one at a time                    */
+/*----------------------------------------------------------------------------*/
+
+static void test_WifiConfig( void )
+{
+   static char C* k_apszCmd [] =
+   {
+      "AT\r", "AT+S.SCFG=wifi_priv_mode,2\r", "AT+S.SCFG=wifi_mode,1\r",
+      "AT+S.SCFG=wifi_wpa_psk_text,secret\r", "AT+S.SSIDTXT=home\r", "AT&W\r",
+      "AT+CFUN=0\r",
+   } ;
+   BYTE byIdx ;
+
+   test_WifiInit() ;
+   test_WifiRun( 200 ) ;
+
+   TEST_CHECK( l_eWifiState == CWIFI_STATE_CONNECTING ) ;
+   TEST_CHECK( l_byPeerNbCmd == ARRAY_SIZE(k_apszCmd) ) ;
+   for ( byIdx = 0 ; byIdx < ARRAY_SIZE(k_apszCmd) ; byIdx++ )
+   {
+      TEST_CHECK( strcmp( l_aszPeerCmd[byIdx], k_apszCmd[byIdx] ) == 0 ) ;
+   }
+   TEST_CHECK( cwifi_GetQueueDepth() == 0 ) ;
+   TEST_CHECK( ! trs_IsSelected( &l_Trs ) ) ;
+   TEST_CHECK( l_Trs.dwNbStart == 6 ) ;
+   TEST_CHECK( l_Trs.dwNbOk == 6 ) ;
+                                       /* connection : socket server */
+   test_PeerOut( "+WIND:24:WiFi Up:192.168.1.20\r\n" ) ;
+   test_WifiRun( 50 ) ;
+   TEST_CHECK( l_eWifiState == CWIFI_STATE_CONNECTED ) ;
+   TEST_CHECK( strcmp( l_aszPeerCmd[l_byPeerNbCmd - 1], "AT+S.SOCKD=15555\r" ) == 0 ) ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Lost response : no retry, the command is dropped after the timeout         */
+/*----------------------------------------------------------------------------*/
+
+static void test_WifiTimeout( void )
+{
+   test_WifiInit() ;
+   test_WifiRun( 200 ) ;
+   l_byPeerNbCmd = 0 ;
+
+   l_ePeerAns = TEST_ANS_LOST ;
+   TEST_CHECK( cwifi_AddExtCmd( "AT+S.STS\r" ) == OK ) ;
+   TEST_CHECK( cwifi_AddExtCmd( "AT+S.FSL\r" ) == OK ) ;
+   test_WifiRun( 20 ) ;
+   TEST_CHECK( l_byPeerNbCmd == 1 ) ;
+   TEST_CHECK( cwifi_GetQueueDepth() == 2 ) ;
+   l_ePeerAns = TEST_ANS_OK ;
+
+   test_WifiRun( CWIFI_CMD_TIMEOUT - 100 ) ;
+   TEST_CHECK( l_byPeerNbCmd == 1 ) ;
+   test_WifiRun( 200 ) ;
+   TEST_CHECK( strcmp( l_szPostRes, "ERROR: Timeout\r\nOK\r\n" ) == 0 ) ;
+   TEST_CHECK( l_Trs.dwNbFail == 1 ) ;
+                                       /* next command is sent */
+   TEST_CHECK( l_byPeerNbCmd == 2 ) ;
+   TEST_CHECK( strcmp( l_aszPeerCmd[1], "AT+S.FSL\r" ) == 0 ) ;
+   TEST_CHECK( cwifi_GetQueueDepth() == 0 ) ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Error response ends the command, next command is sent                      */
+/*----------------------------------------------------------------------------*/
+
+static void test_WifiError( void )
+{
+   test_WifiInit() ;
+   test_WifiRun( 200 ) ;
+   l_byPeerNbCmd = 0 ;
+
+   l_ePeerAns = TEST_ANS_ERR ;
+   cwifi_AddExtCmd( "AT+S.STS\r" ) ;
+   test_WifiRun( 20 ) ;
+   TEST_CHECK( l_Trs.dwNbErr == 1 ) ;
+   TEST_CHECK( cwifi_GetQueueDepth() == 0 ) ;
+   TEST_CHECK( ! trs_IsSelected( &l_Trs ) ) ;
+
+   l_ePeerAns = TEST_ANS_OK ;
+   cwifi_AddExtCmd( "AT+S.FSL\r" ) ;
+   test_WifiRun( 20 ) ;
+   TEST_CHECK( l_byPeerNbCmd == 2 ) ;
+   TEST_CHECK( l_Trs.dwNbOk == 7 ) ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Maintenance mode flushes the queue, the command in progress is kept until  */
+/* its response                                                               */
+/*----------------------------------------------------------------------------*/
+
+static void test_WifiFlush( void )
+{
+   test_WifiInit() ;
+   test_WifiRun( 200 ) ;
+   l_byPeerNbCmd = 0 ;
+
+   l_ePeerAns = TEST_ANS_LOST ;
+   cwifi_AddExtCmd( "AT+S.STS\r" ) ;
+   cwifi_AddExtCmd( "AT+S.FSL\r" ) ;
+   test_WifiRun( 20 ) ;
+   TEST_CHECK( l_byPeerNbCmd == 1 ) ;
+
+   cwifi_SetMaintMode( TRUE ) ;        /* queue : command in progress, CFUN */
+   TEST_CHECK( cwifi_GetQueueDepth() == 2 ) ;
+   TEST_CHECK( trs_IsSelected( &l_Trs ) ) ;
+
+   test_PeerOut( "OK\r\n" ) ;          /* late response */
+   l_ePeerAns = TEST_ANS_OK ;
+   test_WifiRun( 20 ) ;
+   TEST_CHECK( l_Trs.dwNbOk == 7 ) ;
+   TEST_CHECK( l_byPeerNbCmd == 2 ) ;
+   TEST_CHECK( strcmp( l_aszPeerCmd[1], "AT+CFUN=0\r" ) == 0 ) ;
+   TEST_CHECK( cwifi_GetQueueDepth() == 0 ) ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+
+int main( void )
+{
+   test_WifiConfig() ;
+   test_WifiTimeout() ;
+   test_WifiError() ;
+   test_WifiFlush() ;
+
+   return test_End( "TestCommWifi" ) ;
+}
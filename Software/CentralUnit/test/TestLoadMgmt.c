@@ -0,0 +1,454 @@
+/******************************************************************************/
+/*                               TestLoadMgmt.c                               */
+/******************************************************************************/
+/*
+   LoadMgmt.c host test
+
+   Copyright (C) 2018  Sylvain BASSET
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+   ------------
+   @version 1.0
+   @history 1.0, 19 oct. 2019, creation
+   @brief
+   lmgt_ComputeCap() and lmgt_StepCap() are checked directly, as the socket
+   frame power argument (a malformed one is not a measurement), then household
+   load profiles are replayed through the module, as in the firmware :
+   lmgt_TaskCyc() every LMGT_TASK_PER ms, house power pushed by the meter
+   every 5 to 15 s (EV included, rounded up), and a car drawing the OpenEVSE
+   capacity TEST_CAR_DELAY ms after it is set, up to its own maximum.
+
+   A profile is a list of appliances (start, duration, power, thermostat
+   on/off cycle) over a base load. Along the replay, the breaker current
+   (house + EV) is checked :
+      - right after each measurement is processed, house current plus the
+        capacity is within LMGT_MAIN_CURRENT minus LMGT_MARGIN_MA,
+      - a load switched on between two measurements exceeds the breaker
+        rating until the next measurement : this lasts no longer than the
+        measurement period plus the car response delay (LMGT_MES_TIMEOUT
+        more when the meter is lost), and stays below the breaker
+        conventional tripping current (1.45 times the rating, IEC 60898),
+      - capacity increases are limited to LMGT_STEP_UP every LMGT_UP_PERIOD.
+*/
+
+
+#include "HostTest.h"
+
+
+#include "System/Timer.c"
+#include "Lib/ConvAscii.c"
+#include "Control/LoadMgmt.c"
+
+
+/*----------------------------------------------------------------------------*/
+/* Defines                                                                    */
+/*----------------------------------------------------------------------------*/
+
+#define TEST_TASK_PER           100    /* as LMGT_TASK_PER (Main.c) */
+#define TEST_MES_PER_MIN       5000    /* meter push period (ms) */
+#define TEST_MES_PER_MAX      15000
+#define TEST_CAR_DELAY         2000    /* car response delay to capacity (ms) */
+#define TEST_HOUSE_MAX   ( ( LMGT_MAIN_CURRENT - COEVSE_CURRENT_CAPMAX_MIN ) * 1000 )
+#define TEST_LIMIT_MA    ( ( LMGT_MAIN_CURRENT * 1000 ) - LMGT_MARGIN_MA )
+#define TEST_TRIP_MA     ( LMGT_MAIN_CURRENT * 1450 )  /* conventional tripping */
+
+typedef struct                         /* household appliance of a load profile */
+{
+   WORD wStart ;                       /* start, minutes from profile start */
+   WORD wDuration ;                    /* duration, minutes */
+   WORD wPower ;                       /* power when on (W) */
+   WORD wCycle ;                       /* thermostat on/off period (s), 0 if steady */
+} s_TestLoad ;
+
+typedef struct                         /* household load profile */
+{
+   char C* pszName ;
+   WORD wBase ;                        /* base load (W) */
+   WORD wDuration ;                    /* profile duration, minutes */
+   BYTE byCarMax ;                     /* car maximum charge current (A) */
+   WORD wLossStart ;                   /* meter loss start, minutes, 0 if none */
+   WORD wLossDuration ;                /* meter loss duration, minutes */
+   s_TestLoad C* pLoads ;
+   BYTE byNbLoad ;
+} s_TestProfile ;
+
+
+/*----------------------------------------------------------------------------*/
+/* Load profiles                                                              */
+/*----------------------------------------------------------------------------*/
+
+static s_TestLoad const k_aEvening [] =
+{
+   {   0, 240, 1500, 900 },            /* electric heater */
+   {  10,  25, 2400,  60 },            /* cooking hob */
+   {  40,   3, 2000,   0 },            /* kettle */
+   {  45,  50, 2200, 180 },            /* oven */
+   { 100,  15, 2000,   0 },            /* washing machine heating */
+   { 120,   4, 1100,   0 },            /* microwave */
+   { 150,  20, 2100,   0 },            /* dishwasher heating */
+} ;
+
+static s_TestLoad const k_aMorning [] =
+{
+   {   0, 120, 1200, 1200 },           /* heat pump */
+   {   0,  20, 1800,   0 },            /* water heater, end of off-peak */
+   {   5,   2, 2000,   0 },            /* kettle */
+   {   8,   2,  900,   0 },            /* toaster */
+   {  10,   4, 1300,   0 },            /* coffee machine */
+   {  20,  10, 1800,   0 },            /* hair dryer */
+   {  40,  30, 1200,  30 },            /* iron */
+} ;
+
+static s_TestProfile const k_aProfile [] =
+{
+   { "evening", 300, 240, 16,  0,  0, k_aEvening, ARRAY_SIZE(k_aEvening) },
+   { "morning", 250, 120, 16,  0,  0, k_aMorning, ARRAY_SIZE(k_aMorning) },
+   { "evening, 13 A car, meter lost", 300, 240, 13, 60, 10,
+     k_aEvening, ARRAY_SIZE(k_aEvening) },
+} ;
+
+
+/*----------------------------------------------------------------------------*/
+/* Variables                                                                  */
+/*----------------------------------------------------------------------------*/
+
+static DWORD l_dwTestSeed = 1 ;        /* pseudo random generator state */
+
+static BYTE l_byEvseCap ;              /* OpenEVSE current capacity (A) */
+static DWORD l_dwEvseCapTick ;         /* last capacity setting time (ms) */
+static BYTE l_byCarCap ;               /* capacity followed by the car (A) */
+static SDWORD l_sdwEvCurrent ;         /* EV charge current (mA) */
+static DWORD l_dwNbRateErr ;           /* capacity increases above the rate limit */
+
+
+/*----------------------------------------------------------------------------*/
+/* Stubs                                                                      */
+/*----------------------------------------------------------------------------*/
+
+void err_FatalError( void ) { abort() ; }
+
+void coevse_SetCurrentCap( BYTE i_byCurrent )
+{
+   l_byEvseCap = i_byCurrent ;
+   l_dwEvseCapTick = HAL_GetTick() ;
+}
+
+void coevse_SetCurrentVol( BYTE i_byCurrent )
+{
+   if ( ( i_byCurrent > l_byEvseCap ) &&
+        ( ( i_byCurrent > l_byEvseCap + LMGT_STEP_UP ) ||
+          ( ( HAL_GetTick() - l_dwEvseCapTick ) < LMGT_UP_PERIOD ) ) )
+   {
+      l_dwNbRateErr++ ;
+   }
+   l_byEvseCap = i_byCurrent ;
+   l_dwEvseCapTick = HAL_GetTick() ;
+}
+
+DWORD coevse_GetCurrentCap( void )
+{
+   return l_byEvseCap ;
+}
+
+SDWORD coevse_GetCurrent( void )
+{
+   return l_sdwEvCurrent ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Pseudo random number lower than <i_dwMax> (reproducible)                   */
+/*----------------------------------------------------------------------------*/
+
+static DWORD test_Rand( DWORD i_dwMax )
+{
+   l_dwTestSeed = ( l_dwTestSeed * 1103515245 + 12345 ) & 0x7FFFFFFF ;
+
+   return ( l_dwTestSeed >> 8 ) % i_dwMax ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Household current (mA, EV excluded) of profile at <i_dwMs> ms              */
+/*----------------------------------------------------------------------------*/
+
+static DWORD test_HouseCurrent( s_TestProfile C* i_pProfile, DWORD i_dwMs )
+{
+   s_TestLoad C* pLoad ;
+   DWORD dwSec ;
+   DWORD dwPower ;
+   BYTE byIdx ;
+
+   dwSec = i_dwMs / 1000 ;
+   dwPower = i_pProfile->wBase ;
+
+   for ( byIdx = 0 ; byIdx < i_pProfile->byNbLoad ; byIdx++ )
+   {
+      pLoad = &i_pProfile->pLoads[byIdx] ;
+      if ( ( dwSec >= pLoad->wStart * 60lu ) &&
+           ( dwSec < ( pLoad->wStart + pLoad->wDuration ) * 60lu ) &&
+           ( ( pLoad->wCycle == 0 ) ||
+             ( ( ( dwSec - pLoad->wStart * 60lu ) % pLoad->wCycle ) <
+               ( pLoad->wCycle / 2 ) ) ) )
+      {
+         dwPower += pLoad->wPower ;
+      }
+   }
+
+   return ( dwPower * 1000 ) / LMGT_MAINS_VOLTAGE ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Capacity computation                                                       */
+/*----------------------------------------------------------------------------*/
+
+static void test_ComputeCap( void )
+{
+                                       /* light load : user capacity */
+   TEST_CHECK( lmgt_ComputeCap( 2300, 0, 16 ) == 16 ) ;
+   TEST_CHECK( lmgt_ComputeCap( 2300, 0, 10 ) == 10 ) ;
+                                       /* 10 A house + 16 A EV : 19 A left */
+   TEST_CHECK( lmgt_ComputeCap( 26 * 230, 16000, 32 ) == 19 ) ;
+                                       /* 20 A house : 9 A left */
+   TEST_CHECK( lmgt_ComputeCap( 20 * 230, 0, 16 ) == 9 ) ;
+   TEST_CHECK( lmgt_ComputeCap( 26 * 230, 6000, 16 ) == 9 ) ;
+                                       /* overload : pilot minimum */
+   TEST_CHECK( lmgt_ComputeCap( 27 * 230, 0, 16 ) == COEVSE_CURRENT_CAPMAX_MIN ) ;
+   TEST_CHECK( lmgt_ComputeCap( 99999, 16000, 16 ) == COEVSE_CURRENT_CAPMAX_MIN ) ;
+                                       /* meter below EV current (jitter) */
+   TEST_CHECK( lmgt_ComputeCap( 1000, 16000, 16 ) == 16 ) ;
+   TEST_CHECK( lmgt_ComputeCap( 0, -50, 16 ) == 16 ) ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Hysteresis and rate limit                                                  */
+/*----------------------------------------------------------------------------*/
+
+static void test_StepCap( void )
+{
+   s_lmgtState Lmgt ;
+
+   memset( &Lmgt, 0, sizeof(Lmgt) ) ;
+                                       /* first setting */
+   TEST_CHECK( lmgt_StepCap( &Lmgt, 12, 1000 ) ) ;
+   TEST_CHECK( Lmgt.byCap == 12 ) ;
+   TEST_CHECK( ! lmgt_StepCap( &Lmgt, 12, 2000 ) ) ;
+                                       /* decrease is immediate */
+   TEST_CHECK( lmgt_StepCap( &Lmgt, 8, 2100 ) ) ;
+   TEST_CHECK( Lmgt.byCap == 8 ) ;
+   TEST_CHECK( Lmgt.dwNbDecrease == 1 ) ;
+                                       /* increase waits LMGT_UP_PERIOD */
+   TEST_CHECK( ! lmgt_StepCap( &Lmgt, 16, 2100 + LMGT_UP_PERIOD - 1 ) ) ;
+   TEST_CHECK( Lmgt.byCap == 8 ) ;
+   TEST_CHECK( lmgt_StepCap( &Lmgt, 16, 2100 + LMGT_UP_PERIOD ) ) ;
+   TEST_CHECK( Lmgt.byCap == 8 + LMGT_STEP_UP ) ;
+   TEST_CHECK( Lmgt.dwNbIncrease == 1 ) ;
+                                       /* then one step per period */
+   TEST_CHECK( ! lmgt_StepCap( &Lmgt, 16, 2100 + 2 * LMGT_UP_PERIOD - 1 ) ) ;
+   TEST_CHECK( lmgt_StepCap( &Lmgt, 16, 2100 + 2 * LMGT_UP_PERIOD ) ) ;
+   TEST_CHECK( Lmgt.byCap == 8 + 2 * LMGT_STEP_UP ) ;
+                                       /* increase is bounded by target */
+   TEST_CHECK( lmgt_StepCap( &Lmgt, 13, 2100 + 3 * LMGT_UP_PERIOD ) ) ;
+   TEST_CHECK( Lmgt.byCap == 13 ) ;
+                                       /* a decrease restarts the period */
+   TEST_CHECK( lmgt_StepCap( &Lmgt, 12, 2100 + 4 * LMGT_UP_PERIOD ) ) ;
+   TEST_CHECK( ! lmgt_StepCap( &Lmgt, 16, 2100 + 5 * LMGT_UP_PERIOD - 1 ) ) ;
+   TEST_CHECK( Lmgt.dwNbDecrease == 2 ) ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Socket frame argument : no digit is not a 0 W measurement                  */
+/*----------------------------------------------------------------------------*/
+
+static void test_PowerStr( void )
+{
+   DWORD dwTickMes ;
+
+   lmgt_Init() ;
+   l_Lmgt.byUserCap = 16 ;
+                                       /* malformed frame does not engage */
+   TEST_CHECK( lmgt_SetHousePowerStr( "abc" ) == ERR ) ;
+   TEST_CHECK( lmgt_SetHousePowerStr( "-" ) == ERR ) ;
+   TEST_CHECK( ! l_Lmgt.bActive ) ;
+   TEST_CHECK( ! l_Lmgt.bMeter ) ;
+
+   TEST_CHECK( lmgt_SetHousePowerStr( "6900" ) == OK ) ;
+   TEST_CHECK( l_Lmgt.dwPower == 6900 ) ;
+   TEST_CHECK( lmgt_SetHousePowerStr( "0" ) == OK ) ;
+   TEST_CHECK( l_Lmgt.dwPower == 0 ) ;
+   TEST_CHECK( lmgt_SetHousePowerStr( "6900" ) == OK ) ;
+   dwTickMes = l_Lmgt.dwTickMes ;
+                                       /* meter lost : malformed frames do */
+   test_Advance( LMGT_MES_TIMEOUT + 1 ) ;   /* not reset the fallback      */
+   lmgt_TaskCyc() ;
+   TEST_CHECK( l_Lmgt.bStale ) ;
+   TEST_CHECK( l_Lmgt.byCap == COEVSE_CURRENT_CAPMAX_MIN ) ;
+
+   TEST_CHECK( lmgt_SetHousePowerStr( "abc" ) == ERR ) ;
+   TEST_CHECK( lmgt_SetHousePowerStr( "-" ) == ERR ) ;
+   test_Advance( LMGT_UP_PERIOD ) ;
+   lmgt_TaskCyc() ;
+   TEST_CHECK( l_Lmgt.dwPower == 6900 ) ;
+   TEST_CHECK( l_Lmgt.dwTickMes == dwTickMes ) ;
+   TEST_CHECK( l_Lmgt.bStale ) ;
+   TEST_CHECK( l_Lmgt.byCap == COEVSE_CURRENT_CAPMAX_MIN ) ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Replay of load profile <i_pProfile>                                        */
+/*----------------------------------------------------------------------------*/
+
+static void test_Replay( s_TestProfile C* i_pProfile )
+{
+   DWORD dwMs ;
+   DWORD dwEnd ;
+   DWORD dwNextMes ;
+   DWORD dwHouse ;
+   DWORD dwHouseMax ;
+   DWORD dwOverStart ;
+   DWORD dwOverMax ;
+   DWORD dwPeak ;
+   DWORD dwNbMes ;
+   DWORD dwNbLimitErr ;
+   DWORD dwCapSum ;
+   DWORD dwNbStep ;
+   BOOL bLoss ;
+   BOOL bOver ;
+
+   lmgt_Init() ;
+   l_byEvseCap = 0 ;
+   l_byCarCap = 0 ;
+   l_sdwEvCurrent = 0 ;
+   l_dwNbRateErr = 0 ;
+   lmgt_SetUserCap( 16 ) ;
+
+   dwEnd = i_pProfile->wDuration * 60000lu ;
+   dwNextMes = 0 ;
+   dwHouseMax = 0 ;
+   dwOverStart = 0 ;
+   dwOverMax = 0 ;
+   dwPeak = 0 ;
+   dwNbMes = 0 ;
+   dwNbLimitErr = 0 ;
+   dwCapSum = 0 ;
+   dwNbStep = 0 ;
+   bOver = FALSE ;
+
+   for ( dwMs = 0 ; dwMs < dwEnd ; dwMs += TEST_TASK_PER )
+   {
+      test_Advance( TEST_TASK_PER ) ;
+                                       /* car follows OpenEVSE capacity */
+      if ( ( HAL_GetTick() - l_dwEvseCapTick ) >= TEST_CAR_DELAY )
+      {
+         l_byCarCap = l_byEvseCap ;
+      }
+      l_sdwEvCurrent = GETMIN( l_byCarCap, i_pProfile->byCarMax ) * 1000 ;
+
+      dwHouse = test_HouseCurrent( i_pProfile, dwMs ) ;
+      dwHouseMax = GETMAX( dwHouseMax, dwHouse ) ;
+
+      bLoss = ( i_pProfile->wLossStart != 0 ) &&
+              ( dwMs >= i_pProfile->wLossStart * 60000lu ) &&
+              ( dwMs < ( i_pProfile->wLossStart + i_pProfile->wLossDuration ) * 60000lu ) ;
+
+      if ( dwMs >= dwNextMes )
+      {
+         dwNextMes = dwMs + TEST_MES_PER_MIN +
+                     test_Rand( TEST_MES_PER_MAX - TEST_MES_PER_MIN ) ;
+         if ( ! bLoss )
+         {
+            lmgt_SetHousePower( ( ( dwHouse + l_sdwEvCurrent ) *
+                                  LMGT_MAINS_VOLTAGE + 999 ) / 1000 ) ;
+            lmgt_TaskCyc() ;
+            dwNbMes++ ;
+                                       /* decision within breaker limit */
+            if ( ( l_byEvseCap != COEVSE_CURRENT_CAPMAX_MIN ) &&
+                 ( dwHouse + GETMIN( l_byEvseCap, i_pProfile->byCarMax ) * 1000lu >
+                   TEST_LIMIT_MA ) )
+            {
+               dwNbLimitErr++ ;
+            }
+         }
+      }
+      else
+      {
+         lmgt_TaskCyc() ;
+      }
+                                       /* breaker overload duration */
+      if ( dwHouse + l_sdwEvCurrent > LMGT_MAIN_CURRENT * 1000lu )
+      {
+         if ( ! bOver )
+         {
+            bOver = TRUE ;
+            dwOverStart = dwMs ;
+         }
+         dwOverMax = GETMAX( dwOverMax, dwMs + TEST_TASK_PER - dwOverStart ) ;
+         dwPeak = GETMAX( dwPeak, dwHouse + l_sdwEvCurrent ) ;
+      }
+      else
+      {
+         bOver = FALSE ;
+      }
+                                       /* meter lost : safe minimum */
+      if ( bLoss && ( dwMs >= i_pProfile->wLossStart * 60000lu +
+                               LMGT_MES_TIMEOUT + TEST_MES_PER_MAX ) )
+      {
+         TEST_CHECK( l_byEvseCap == COEVSE_CURRENT_CAPMAX_MIN ) ;
+      }
+
+      dwCapSum += l_byEvseCap ;
+      dwNbStep++ ;
+   }
+
+   TEST_CHECK( dwHouseMax <= TEST_HOUSE_MAX ) ;
+   TEST_CHECK( dwNbLimitErr == 0 ) ;
+   TEST_CHECK( dwOverMax <= TEST_MES_PER_MAX + TEST_CAR_DELAY + TEST_TASK_PER +
+                            ( ( i_pProfile->wLossStart != 0 ) ? LMGT_MES_TIMEOUT : 0 ) ) ;
+   TEST_CHECK( dwPeak < TEST_TRIP_MA ) ;
+   TEST_CHECK( l_dwNbRateErr == 0 ) ;
+   TEST_CHECK( l_Lmgt.dwNbDecrease > 0 ) ;
+   TEST_CHECK( l_Lmgt.dwNbIncrease > 0 ) ;
+   TEST_CHECK( l_Lmgt.dwNbStale == ( ( i_pProfile->wLossStart != 0 ) ? 1 : 0 ) ) ;
+
+   printf( "TestLoadMgmt : %s, %lu measurements, house max %lu mA, "
+           "capacity mean %lu.%lu A, %lu decreases, %lu increases, "
+           "longest overload %lu ms, peak %lu mA\n",
+           i_pProfile->pszName, dwNbMes, dwHouseMax, dwCapSum / dwNbStep,
+           ( ( dwCapSum * 10 ) / dwNbStep ) % 10, l_Lmgt.dwNbDecrease,
+           l_Lmgt.dwNbIncrease, dwOverMax, dwPeak ) ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+
+int main( void )
+{
+   BYTE byIdx ;
+
+   test_ComputeCap() ;
+   test_StepCap() ;
+   test_PowerStr() ;
+
+   for ( byIdx = 0 ; byIdx < ARRAY_SIZE(k_aProfile) ; byIdx++ )
+   {
+      test_Replay( &k_aProfile[byIdx] ) ;
+   }
+
+   return test_End( "TestLoadMgmt" ) ;
+}
@@ -0,0 +1,267 @@
+/******************************************************************************/
+/*                              TestScktFrame.c                               */
+/******************************************************************************/
+/*
+   ScktFrame.c host benchmark
+
+   Copyright (C) 2018  Sylvain BASSET
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+   ------------
+   @version 1.0
+   @history 1.0, 19 oct. 2019, creation
+   @brief
+   A "$12" reply (charge state history) is written into the CommWifi socket
+   buffer by the two ways of sending a response :
+      - copy path (responses before in place writing) : the history is
+        formatted in a payload stack buffer by sfrm_ExecCmd(), copied with
+        its response code in a response stack buffer by sfrm_SendRes(),
+        then copied into the socket buffer by cwifi_AddExtData(),
+      - in place path : sfrm_ExecCmd() gives the formatting function to
+        sfrm_WriteRes(), the response is written directly into the socket
+        buffer reserved by cwifi_ReserveData().
+   Both replies are checked to be the same, then stack use (test_StackUse())
+   and run time per reply are measured and reported for each path. Run time
+   is measured on the host.
+
+   The other modules used by ScktFrame.c are stubs, CommWifi.c is the
+   firmware one with the UartWifi.c functions replaced.
+*/
+
+
+#include <time.h>
+
+#include "HostTest.h"
+#include "System.h"
+#include "System/Hard.h"
+
+
+/*----------------------------------------------------------------------------*/
+/* Simulated eeprom                                                           */
+/*----------------------------------------------------------------------------*/
+
+static s_DataEeprom l_TestEeprom ;
+
+#undef g_sDataEeprom
+#define g_sDataEeprom       ( &l_TestEeprom )
+
+
+#include "System/Timer.c"
+#include "Lib/ConvAscii.c"
+#include "Communic/Transac.c"
+#include "Communic/CommWifi.c"
+#include "Communic/ScktFrame.c"
+
+
+/*----------------------------------------------------------------------------*/
+/* Defines                                                                    */
+/*----------------------------------------------------------------------------*/
+
+#define TEST_HIST_STATE    "1 2 3 2 1 2 3 4 2 1 "   /* CSTATE_HIST_LAST_NB states */
+#define TEST_BENCH_LOOP    100000      /* timed replies */
+
+
+/*----------------------------------------------------------------------------*/
+/* Stubs                                                                      */
+/*----------------------------------------------------------------------------*/
+
+void err_FatalError( void ) { abort() ; }
+void evt_Publish( e_evtId i_eEvtId, DWORD i_dwValue ) {}
+void HAL_GPIO_Init( GPIO_TypeDef * GPIOx, GPIO_InitTypeDef * GPIO_Init ) {}
+void HAL_GPIO_WritePin( GPIO_TypeDef * GPIOx, uint16_t GPIO_Pin,
+                        GPIO_PinState PinState ) {}
+BOOL clk_IsValidStr( CHAR C* i_pszDateTime, s_DateTime * o_psDateTime ) { return FALSE ; }
+void clk_SetDateTime( s_DateTime C* i_psDateTime, BYTE i_byErrorSecMax ) {}
+
+void uwifi_Init( void ) {}
+void uwifi_SetErrorDetection( BOOL i_bEnable ) {}
+BOOL uwifi_IsSendDone( void ) { return TRUE ; }
+DWORD uwifi_GetRemainingSend( void ) { return 0 ; }
+BOOL uwifi_Send( void C* i_pvData, DWORD i_dwSize ) { return TRUE ; }
+WORD uwifi_Read( BYTE * o_pbyData, WORD i_dwMaxSize, BOOL i_bGetPending ) { return 0 ; }
+
+RESULT coevse_AddExtCmd( char C* i_szStrCmd ) { return OK ; }
+void coevse_FmtInfo( CHAR * o_pszInfo, WORD i_wSize ) {}
+void coevse_FmtLinkStat( CHAR * o_pszStat, WORD i_wSize ) {}
+void coevse_GetAsyncState( CHAR * o_pszAsync, WORD i_wSize ) {}
+SDWORD coevse_GetCurrent( void ) { return 0 ; }
+DWORD coevse_GetEnergy( void ) { return 0 ; }
+e_coevseEvseState coevse_GetEvseState( void ) { return COEVSE_STATE_NOTCONNECTED ; }
+BYTE coevse_GetQueueDepth( void ) { return 0 ; }
+s_trsLink C* coevse_GetTrs( void ) { return &l_Trs ; }
+SDWORD coevse_GetVoltage( void ) { return 0 ; }
+BOOL coevse_IsTunnelActive( void ) { return FALSE ; }
+WORD coevse_ReadHist( DWORD i_dwOffset, CHAR * o_pszHistCmd, WORD i_wSize ) { return 0 ; }
+void coevse_RegisterRetScktFunc( f_PostResProc i_fPostResProc ) {}
+void coevse_RegisterTunnelFunc( f_TunnelRxProc i_fTunnelRxProc ) {}
+RESULT coevse_StartTunnel( DWORD i_dwTimeout ) { return OK ; }
+void coevse_StopTunnel( void ) {}
+RESULT coevse_TunnelSend( char C* i_pszData ) { return OK ; }
+
+void cplan_FmtPlan( CHAR * o_pszStr, WORD i_wSize ) {}
+void cplan_FmtTariff( CHAR * o_pszStr, WORD i_wSize ) {}
+void cplan_SetPriceDef( WORD i_wPrice ) {}
+RESULT cplan_SetTariff( BYTE i_byIdx, BYTE i_byDays, BYTE i_byStart,
+                        BYTE i_byEnd, WORD i_wPrice ) { return OK ; }
+RESULT cplan_Start( DWORD i_dwEnergyWh, DWORD i_dwDurMin ) { return OK ; }
+void cplan_Stop( void ) {}
+
+void cstate_FmtEoc( CHAR * o_pszStr, WORD i_wSize ) {}
+void cstate_FmtStateStat( CHAR * o_pszStat, WORD i_wSize ) {}
+e_cstateChargeSt cstate_GetChargeState( void ) { return CSTATE_OFF ; }
+WORD cstate_ReadHistRec( DWORD i_dwOffset, CHAR * o_pszHistRec, WORD i_wSize ) { return 0 ; }
+WORD cstate_ReadSessRec( DWORD i_dwOffset, CHAR * o_pszSessRec, WORD i_wSize ) { return 0 ; }
+void cstate_SetEocParam( DWORD i_dwDwellSec, DWORD i_dwEnergyWh, DWORD i_dwFilter ) {}
+
+RESULT eep_WriteWifiId( BOOL i_bIsSsid, char C* i_szParam ) { return OK ; }
+DWORD err_GetErrorList( BOOL * o_pbChange, BOOL i_bResetChange, CHAR * o_pszStr,
+                        WORD i_wSize ) { return 0 ; }
+char C* id_GetName( void ) { return "test" ; }
+void lmgt_FmtStat( CHAR * o_pszStr, WORD i_wSize ) {}
+RESULT lmgt_SetHousePowerStr( char C* i_pszArg ) { return OK ; }
+void main_FmtWdgStat( CHAR * o_pszStat, WORD i_wSize ) {}
+
+                                       /* last states, as cstate_GetHistState() */
+void cstate_GetHistState( CHAR * o_pszHistState, WORD i_wSize )
+{                                      /* no host printf : its stack use would */
+   WORD wLen ;                         /* hide the firmware one                */
+
+   wLen = GETMIN( (WORD)strlen( TEST_HIST_STATE ), (WORD)( i_wSize - 1 ) ) ;
+   memcpy( o_pszHistState, TEST_HIST_STATE, wLen ) ;
+   o_pszHistState[wLen] = '\0' ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Copy path : response sending before in place writing (sfrm_SendRes())      */
+/*----------------------------------------------------------------------------*/
+
+static void __attribute__((noinline)) test_SendResCopy( char C* i_szParam )
+{
+   s_FrameDesc C* pFrmDesc ;
+   char szRes [SFRM_DATA_PAYLOAD_SIZE + 5] ;
+   char * pszRes ;
+   WORD wResSize ;
+
+   if ( l_eFrmId != SFRM_ID_NULL )
+   {
+      pFrmDesc = &k_aFrameDesc[ ( l_eFrmId - SFRM_ID_FIRST ) ] ;
+
+      pszRes = szRes ;
+      wResSize = sizeof(szRes) ;
+
+      strncpy( pszRes, pFrmDesc->szRes, wResSize ) ;
+      pszRes += strlen( pFrmDesc->szRes ) ;
+      wResSize -= strlen( pFrmDesc->szRes ) ;
+
+      strncpy( pszRes, i_szParam, wResSize ) ;
+
+      szRes[ sizeof(szRes)-1 ] = '\0' ;
+
+      cwifi_AddExtData( szRes ) ;
+   }
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Copy path : "$12" command execution (sfrm_ExecCmd())                       */
+/*----------------------------------------------------------------------------*/
+
+static void __attribute__((noinline)) test_ExecCopy( void )
+{
+   char szStrInfo [SFRM_DATA_PAYLOAD_SIZE] ;
+
+   l_DataBuf.wNbChar = 0 ;
+   l_eFrmId = SFRM_ID_CHARGE_HISTSTATE ;
+
+   cstate_GetHistState( szStrInfo, sizeof(szStrInfo) ) ;
+   test_SendResCopy( szStrInfo ) ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* In place path : "$12" command execution by the firmware                    */
+/*----------------------------------------------------------------------------*/
+
+static void __attribute__((noinline)) test_ExecInPlace( void )
+{
+   l_DataBuf.wNbChar = 0 ;
+   l_eFrmId = SFRM_ID_CHARGE_HISTSTATE ;
+
+   sfrm_ExecCmd( "" ) ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Run time of <i_fExec> for one reply, ns                                    */
+/*----------------------------------------------------------------------------*/
+
+static double test_RunTime( void (*i_fExec)( void ) )
+{
+   clock_t Start ;
+   DWORD dwLoop ;
+
+   Start = clock() ;
+   for ( dwLoop = 0 ; dwLoop < TEST_BENCH_LOOP ; dwLoop++ )
+   {
+      (*i_fExec)() ;
+   }
+
+   return ( (double)( clock() - Start ) * 1e9 ) / CLOCKS_PER_SEC / TEST_BENCH_LOOP ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* "$12" reply : copy path against in place path                              */
+/*----------------------------------------------------------------------------*/
+
+static void test_BenchHistState( void )
+{
+   char szCopy [64] ;
+   DWORD dwStackCopy ;
+   DWORD dwStackInPlace ;
+   double fdNsCopy ;
+   double fdNsInPlace ;
+                                       /* same reply in socket buffer */
+   test_ExecCopy() ;
+   snprintf( szCopy, sizeof(szCopy), "%.*s", l_DataBuf.wNbChar, l_DataBuf.sDataBuf ) ;
+   TEST_CHECK( strcmp( szCopy, "$92:" TEST_HIST_STATE ) == 0 ) ;
+
+   test_ExecInPlace() ;
+   TEST_CHECK( l_DataBuf.wNbChar == strlen( szCopy ) ) ;
+   TEST_CHECK( strncmp( l_DataBuf.sDataBuf, szCopy, l_DataBuf.wNbChar ) == 0 ) ;
+
+   dwStackCopy = test_StackUse( &test_ExecCopy ) ;
+   dwStackInPlace = test_StackUse( &test_ExecInPlace ) ;
+   TEST_CHECK( dwStackInPlace < dwStackCopy ) ;
+
+   fdNsCopy = test_RunTime( &test_ExecCopy ) ;
+   fdNsInPlace = test_RunTime( &test_ExecInPlace ) ;
+
+   printf( "TestScktFrame : $12 reply, copy path : stack %lu B, %.0f ns (host)\n",
+           dwStackCopy, fdNsCopy ) ;
+   printf( "TestScktFrame : $12 reply, in place path : stack %lu B, %.0f ns (host)\n",
+           dwStackInPlace, fdNsInPlace ) ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+
+int main( void )
+{
+   test_BenchHistState() ;
+
+   return test_End( "TestScktFrame" ) ;
+}
@@ -0,0 +1,527 @@
+/******************************************************************************/
+/*                                TestTransac.c                               */
+/******************************************************************************/
+/*
+   Transac.c host test
+
+   Copyright (C) 2018  Sylvain BASSET
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+   ------------
+   @version 1.0
+   @history 1.0, 19 oct. 2019, creation
+   @brief
+   The queues and the selection of the transaction engine are checked
+   directly, then through two simulated links configured as the ones of the
+   firmware : openEVSE (3 priority queues, retries, monitoring starvation
+   protection) and wifi (1 queue, no retry). Commands are produced at random
+   times, and a simulated peer answers after a random delay or loses the
+   response. Each queued command carries a sequence number, so the peer side
+   checks that commands end in queuing order, once, and that a retry sends
+   the same command.
+*/
+
+
+#include "HostTest.h"
+
+
+#include "System/Timer.c"
+#include "Communic/Transac.c"
+
+
+/*----------------------------------------------------------------------------*/
+/* Stubs                                                                      */
+/*----------------------------------------------------------------------------*/
+
+void err_FatalError( void ) { abort() ; }
+
+
+/*----------------------------------------------------------------------------*/
+/* Defines                                                                    */
+/*----------------------------------------------------------------------------*/
+
+#define TEST_QUEUE_NB         3        /* maximum queues number of a link */
+#define TEST_ITEM_NB          6        /* items number of a queue table */
+#define TEST_CMD_NB           4        /* commands number of a link */
+
+typedef struct                         /* queued command */
+{
+   s_trsItem Hdr ;                     /* queue header */
+   DWORD dwSeq ;                       /* sequence number in its queue */
+} s_TestItem ;
+
+typedef struct                         /* simulated link and peer */
+{
+   s_trsLink Trs ;                     /* transaction engine data */
+   s_trsQueue aQueue [TEST_QUEUE_NB] ;
+   s_TestItem aaItems [TEST_QUEUE_NB][TEST_ITEM_NB] ;
+   s_trsCmdStat aStat [TEST_CMD_NB] ;
+   BYTE byNbQueue ;                    /* queues number */
+   WORD wPushPermil ;                  /* command production rate, per ms */
+   WORD wLossPermil ;                  /* peer response loss rate */
+
+   BOOL bSent ;                        /* a command is in flight */
+   BOOL bRetry ;                       /* last command has to be sent again */
+   s_TestItem Sent ;                   /* last sent command */
+   BYTE bySentQueue ;                  /* queue of last sent command */
+   DWORD dwRespTick ;                  /* peer response time, 0 if lost */
+
+   DWORD adwNbPush [TEST_QUEUE_NB] ;   /* queued commands (next sequence number) */
+   DWORD adwNbEnd [TEST_QUEUE_NB] ;    /* ended commands (next expected number) */
+   DWORD dwNbOk ;                      /* commands ended with a response */
+   DWORD dwNbFail ;                    /* commands ended after all retries */
+   DWORD dwNbDrop ;                    /* commands dropped (full queue) */
+   DWORD dwNbOrderErr ;                /* commands ended out of order */
+   DWORD dwNbRetryErr ;                /* retries of an other command */
+   BYTE byStarvRun ;                   /* consecutive commands with last queue waiting */
+   BYTE byStarvRunMax ;                /* maximum of byStarvRun */
+} s_TestLink ;
+
+
+/*----------------------------------------------------------------------------*/
+/* Variables                                                                  */
+/*----------------------------------------------------------------------------*/
+
+static s_trsPolicy const k_TestOEvsePolicy =   /* as CommOEvse.c */
+{
+   .dwTimeout = 400,
+   .byMaxRetry = 10,
+   .wBackoffMin = 20,
+   .wBackoffMax = 640,
+   .byStarvMax = 4,
+} ;
+
+static s_trsPolicy const k_TestWifiPolicy =    /* as CommWifi.c */
+{
+   .dwTimeout = 300,
+   .byMaxRetry = 0,
+   .wBackoffMin = 0,
+   .wBackoffMax = 0,
+   .byStarvMax = 0,
+} ;
+
+static DWORD l_dwTestSeed = 1 ;        /* pseudo random generator state */
+static s_TestLink l_Link ;
+
+
+/*----------------------------------------------------------------------------*/
+/* Pseudo random number lower than <i_dwMax> (reproducible)                   */
+/*----------------------------------------------------------------------------*/
+
+static DWORD test_Rand( DWORD i_dwMax )
+{
+   l_dwTestSeed = ( l_dwTestSeed * 1103515245 + 12345 ) & 0x7FFFFFFF ;
+
+   return ( l_dwTestSeed >> 8 ) % i_dwMax ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Link initialization                                                        */
+/*----------------------------------------------------------------------------*/
+
+static void test_LinkInit( s_TestLink * o_pLink, s_trsPolicy C* i_pPolicy,
+                           BYTE i_byNbQueue )
+{
+   BYTE byQueue ;
+
+   memset( o_pLink, 0, sizeof(s_TestLink) ) ;
+   o_pLink->byNbQueue = i_byNbQueue ;
+
+   for ( byQueue = 0 ; byQueue < i_byNbQueue ; byQueue++ )
+   {
+      trs_InitQueue( &o_pLink->aQueue[byQueue], o_pLink->aaItems[byQueue],
+                     sizeof(s_TestItem), TEST_ITEM_NB ) ;
+   }
+   trs_Init( &o_pLink->Trs, i_pPolicy, o_pLink->aStat, TEST_CMD_NB,
+             o_pLink->aQueue, i_byNbQueue ) ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Queue command <i_byCmdIdx> in queue <i_byQueue>, with its sequence number  */
+/*----------------------------------------------------------------------------*/
+
+static s_TestItem * test_Push( s_TestLink * io_pLink, BYTE i_byQueue, BYTE i_byCmdIdx )
+{
+   s_TestItem * pItem ;
+
+   pItem = trs_Push( &io_pLink->Trs, i_byQueue, i_byCmdIdx ) ;
+
+   if ( pItem != NULL )
+   {
+      pItem->dwSeq = io_pLink->adwNbPush[i_byQueue] ;
+      io_pLink->adwNbPush[i_byQueue]++ ;
+   }
+   else
+   {
+      io_pLink->dwNbDrop++ ;
+   }
+
+   return pItem ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* End of last sent command, checked against queuing order                    */
+/*----------------------------------------------------------------------------*/
+
+static void test_LinkEnd( s_TestLink * io_pLink, RESULT i_rRes )
+{
+   e_trsEnd eEnd ;
+   BYTE byQueue ;
+
+   eEnd = trs_End( &io_pLink->Trs, i_rRes ) ;
+   io_pLink->bSent = FALSE ;
+   io_pLink->bRetry = ( eEnd == TRS_END_RETRY ) ;
+
+   if ( eEnd != TRS_END_RETRY )
+   {
+      byQueue = io_pLink->bySentQueue ;
+      if ( io_pLink->Sent.dwSeq != io_pLink->adwNbEnd[byQueue] )
+      {
+         io_pLink->dwNbOrderErr++ ;
+      }
+      io_pLink->adwNbEnd[byQueue] = io_pLink->Sent.dwSeq + 1 ;
+
+      if ( eEnd == TRS_END_OK )
+      {
+         io_pLink->dwNbOk++ ;
+      }
+      else
+      {
+         io_pLink->dwNbFail++ ;
+      }
+   }
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* One millisecond of link life : production, sending, peer response         */
+/*----------------------------------------------------------------------------*/
+
+static void test_LinkStep( s_TestLink * io_pLink )
+{
+   s_TestItem * pItem ;
+   BYTE byLast ;
+   BOOL bLastQueued ;
+   BOOL bNew ;
+                                       /* command production */
+   if ( test_Rand( 1000 ) < io_pLink->wPushPermil )
+   {
+      test_Push( io_pLink, test_Rand( io_pLink->byNbQueue ), test_Rand( TEST_CMD_NB ) ) ;
+   }
+                                       /* sending */
+   if ( ( ! io_pLink->bSent ) && trs_IsReady( &io_pLink->Trs ) &&
+        trs_IsQueued( &io_pLink->Trs, io_pLink->byNbQueue ) )
+   {
+      byLast = io_pLink->byNbQueue - 1 ;
+      bLastQueued = ( io_pLink->aQueue[byLast].byIdxIn != io_pLink->aQueue[byLast].byIdxOut ) ;
+      bNew = ! trs_IsSelected( &io_pLink->Trs ) ;
+
+      pItem = trs_Select( &io_pLink->Trs, io_pLink->byNbQueue ) ;
+
+      if ( bNew )                      /* starvation of last queue */
+      {
+         if ( bLastQueued && ( io_pLink->Trs.byQueueCur != byLast ) )
+         {
+            io_pLink->byStarvRun++ ;
+            io_pLink->byStarvRunMax = GETMAX( io_pLink->byStarvRunMax, io_pLink->byStarvRun ) ;
+         }
+         else
+         {
+            io_pLink->byStarvRun = 0 ;
+         }
+      }
+      else if ( ( ! io_pLink->bRetry ) ||
+                ( io_pLink->Trs.byQueueCur != io_pLink->bySentQueue ) ||
+                ( pItem->dwSeq != io_pLink->Sent.dwSeq ) )
+      {
+         io_pLink->dwNbRetryErr++ ;    /* a retry sends the same command */
+      }
+
+      io_pLink->Sent = *pItem ;        /* sent to peer */
+      io_pLink->bySentQueue = io_pLink->Trs.byQueueCur ;
+      io_pLink->bSent = TRUE ;
+      trs_Start( &io_pLink->Trs, pItem->Hdr.byCmdIdx ) ;
+
+      if ( test_Rand( 1000 ) < io_pLink->wLossPermil )
+      {
+         io_pLink->dwRespTick = 0 ;
+      }
+      else
+      {
+         io_pLink->dwRespTick = HAL_GetTick() + 1 + test_Rand( 30 ) ;
+      }
+   }
+                                       /* peer response, or timeout */
+   if ( io_pLink->bSent )
+   {
+      if ( ( io_pLink->dwRespTick != 0 ) && ( HAL_GetTick() >= io_pLink->dwRespTick ) )
+      {
+         test_LinkEnd( io_pLink, OK ) ;
+      }
+      else if ( trs_IsTimeout( &io_pLink->Trs ) )
+      {
+         test_LinkEnd( io_pLink, ERR ) ;
+      }
+   }
+
+   test_Advance( 1 ) ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Run link during <i_dwMs> ms, then without production until queues are      */
+/* empty, and check that every queued command has ended once, in order        */
+/*----------------------------------------------------------------------------*/
+
+static void test_LinkRun( s_TestLink * io_pLink, DWORD i_dwMs )
+{
+   DWORD dwMs ;
+   DWORD dwNbPush ;
+   BYTE byQueue ;
+
+   for ( dwMs = 0 ; dwMs < i_dwMs ; dwMs++ )
+   {
+      test_LinkStep( io_pLink ) ;
+   }
+   io_pLink->wPushPermil = 0 ;
+   for ( dwMs = 0 ; ( dwMs < 600000 ) &&
+                    ( io_pLink->bSent || trs_IsQueued( &io_pLink->Trs, io_pLink->byNbQueue ) ) ; dwMs++ )
+   {
+      test_LinkStep( io_pLink ) ;
+   }
+
+   dwNbPush = 0 ;
+   for ( byQueue = 0 ; byQueue < io_pLink->byNbQueue ; byQueue++ )
+   {
+      TEST_CHECK( io_pLink->adwNbEnd[byQueue] == io_pLink->adwNbPush[byQueue] ) ;
+      dwNbPush += io_pLink->adwNbPush[byQueue] ;
+   }
+
+   TEST_CHECK( trs_GetQueueDepth( &io_pLink->Trs ) == 0 ) ;
+   TEST_CHECK( ! trs_IsSelected( &io_pLink->Trs ) ) ;
+   TEST_CHECK( io_pLink->dwNbOk + io_pLink->dwNbFail == dwNbPush ) ;
+   TEST_CHECK( io_pLink->dwNbOrderErr == 0 ) ;
+   TEST_CHECK( io_pLink->dwNbRetryErr == 0 ) ;
+   TEST_CHECK( io_pLink->Trs.dwNbOk == io_pLink->dwNbOk ) ;
+   TEST_CHECK( io_pLink->Trs.dwNbFail == io_pLink->dwNbFail ) ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Queue capacity, item header, coalescing search                             */
+/*----------------------------------------------------------------------------*/
+
+static void test_Queue( void )
+{
+   s_TestItem * pItem ;
+   BYTE byIdx ;
+
+   test_LinkInit( &l_Link, &k_TestOEvsePolicy, 3 ) ;
+   test_Advance( 7 ) ;
+
+   for ( byIdx = 0 ; byIdx < TEST_ITEM_NB - 1 ; byIdx++ )
+   {
+      TEST_CHECK( test_Push( &l_Link, 1, byIdx % 2 ) != NULL ) ;
+   }
+   TEST_CHECK( test_Push( &l_Link, 1, 0 ) == NULL ) ;
+   TEST_CHECK( l_Link.aQueue[1].dwNbDropped == 1 ) ;
+   TEST_CHECK( trs_GetQueueDepth( &l_Link.Trs ) == TEST_ITEM_NB - 1 ) ;
+   TEST_CHECK( trs_IsQueued( &l_Link.Trs, 2 ) && ( ! trs_IsQueued( &l_Link.Trs, 1 ) ) ) ;
+
+   pItem = trs_Find( &l_Link.Trs, 1, 1, FALSE ) ;
+   TEST_CHECK( ( pItem != NULL ) && ( pItem->dwSeq == 1 ) ) ;
+   TEST_CHECK( pItem->Hdr.dwTick == 7 ) ;
+   TEST_CHECK( trs_Find( &l_Link.Trs, 1, 3, FALSE ) == NULL ) ;
+   TEST_CHECK( trs_Find( &l_Link.Trs, 0, 1, FALSE ) == NULL ) ;
+                                       /* the selected command is not found */
+   pItem = trs_Select( &l_Link.Trs, 3 ) ;
+   TEST_CHECK( ( pItem != NULL ) && ( pItem->dwSeq == 0 ) ) ;
+   pItem = trs_Find( &l_Link.Trs, 1, 0, TRUE ) ;
+   TEST_CHECK( ( pItem != NULL ) && ( pItem->dwSeq == 2 ) ) ;
+   pItem = trs_Find( &l_Link.Trs, 1, 0, FALSE ) ;
+   TEST_CHECK( ( pItem != NULL ) && ( pItem->dwSeq == 0 ) ) ;
+                                       /* last command of a queue */
+   pItem = trs_GetLast( &l_Link.Trs, 1, TRUE ) ;
+   TEST_CHECK( ( pItem != NULL ) && ( pItem->dwSeq == TEST_ITEM_NB - 2 ) ) ;
+   TEST_CHECK( trs_GetLast( &l_Link.Trs, 0, TRUE ) == NULL ) ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Priority, starvation protection, restricted selection, latency            */
+/*----------------------------------------------------------------------------*/
+
+static void test_Select( void )
+{
+   s_TestItem * pItem ;
+   BYTE byIdx ;
+
+   test_LinkInit( &l_Link, &k_TestOEvsePolicy, 3 ) ;
+   TEST_CHECK( trs_Select( &l_Link.Trs, 3 ) == NULL ) ;
+
+   test_Push( &l_Link, 2, 0 ) ;        /* monitoring */
+   test_Push( &l_Link, 1, 1 ) ;        /* bridge */
+   test_Advance( 5 ) ;
+   for ( byIdx = 0 ; byIdx < 5 ; byIdx++ )
+   {
+      test_Push( &l_Link, 0, 2 ) ;     /* control */
+   }
+                                       /* restricted : only control queue */
+   pItem = trs_Select( &l_Link.Trs, 1 ) ;
+   TEST_CHECK( ( pItem != NULL ) && ( pItem->dwSeq == 0 ) ) ;
+   TEST_CHECK( l_Link.Trs.byQueueCur == 0 ) ;
+   TEST_CHECK( l_Link.aQueue[0].dwLatLast == 0 ) ;
+   TEST_CHECK( l_Link.Trs.byNbPrioSent == 0 ) ;
+   trs_End( &l_Link.Trs, OK ) ;        /* command without response */
+   TEST_CHECK( trs_GetQueueDepth( &l_Link.Trs ) == 6 ) ;
+                                       /* 4 higher priority commands, then monitoring */
+   for ( byIdx = 0 ; byIdx < 4 ; byIdx++ )
+   {
+      trs_Select( &l_Link.Trs, 3 ) ;
+      TEST_CHECK( l_Link.Trs.byQueueCur == 0 ) ;
+      trs_End( &l_Link.Trs, OK ) ;
+   }
+   TEST_CHECK( l_Link.Trs.byNbPrioSent == 4 ) ;
+   pItem = trs_Select( &l_Link.Trs, 3 ) ;
+   TEST_CHECK( ( pItem != NULL ) && ( pItem->dwSeq == 0 ) ) ;
+   TEST_CHECK( l_Link.Trs.byQueueCur == 2 ) ;
+   TEST_CHECK( l_Link.aQueue[2].dwLatLast == 5 ) ;
+   TEST_CHECK( l_Link.Trs.byNbPrioSent == 0 ) ;
+   trs_End( &l_Link.Trs, OK ) ;
+
+   pItem = trs_Select( &l_Link.Trs, 3 ) ;
+   TEST_CHECK( ( pItem != NULL ) && ( pItem->dwSeq == 0 ) ) ;
+   TEST_CHECK( l_Link.Trs.byQueueCur == 1 ) ;
+   trs_End( &l_Link.Trs, OK ) ;
+   TEST_CHECK( trs_GetQueueDepth( &l_Link.Trs ) == 0 ) ;
+                                       /* strict priority policy */
+   test_LinkInit( &l_Link, &k_TestWifiPolicy, 2 ) ;
+   test_Push( &l_Link, 1, 0 ) ;
+   for ( byIdx = 0 ; byIdx < 5 ; byIdx++ )
+   {
+      test_Push( &l_Link, 0, 1 ) ;
+   }
+   for ( byIdx = 0 ; byIdx < 5 ; byIdx++ )
+   {
+      trs_Select( &l_Link.Trs, 2 ) ;
+      TEST_CHECK( l_Link.Trs.byQueueCur == 0 ) ;
+      trs_End( &l_Link.Trs, OK ) ;
+   }
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Selected command : kept by retries, removed at failure, flush and reset   */
+/*----------------------------------------------------------------------------*/
+
+static void test_Retry( void )
+{
+   s_TestItem * pItem ;
+
+   test_LinkInit( &l_Link, &k_TestOEvsePolicy, 3 ) ;
+   test_Push( &l_Link, 2, 0 ) ;
+   test_Push( &l_Link, 2, 1 ) ;
+
+   pItem = trs_Select( &l_Link.Trs, 3 ) ;
+   trs_Start( &l_Link.Trs, pItem->Hdr.byCmdIdx ) ;
+   TEST_CHECK( trs_End( &l_Link.Trs, ERR ) == TRS_END_RETRY ) ;
+   TEST_CHECK( trs_IsSelected( &l_Link.Trs ) ) ;
+   TEST_CHECK( ! trs_IsReady( &l_Link.Trs ) ) ;
+                                       /* higher priority command during backoff */
+   test_Push( &l_Link, 0, 2 ) ;
+   test_Advance( k_TestOEvsePolicy.wBackoffMin ) ;
+   TEST_CHECK( trs_IsReady( &l_Link.Trs ) ) ;
+   TEST_CHECK( trs_Select( &l_Link.Trs, 3 ) == pItem ) ;
+   TEST_CHECK( l_Link.Trs.byQueueCur == 2 ) ;
+                                       /* flush : the selected command is kept */
+   trs_Flush( &l_Link.Trs ) ;
+   TEST_CHECK( trs_GetQueueDepth( &l_Link.Trs ) == 1 ) ;
+   TEST_CHECK( trs_Select( &l_Link.Trs, 3 ) == pItem ) ;
+   trs_Start( &l_Link.Trs, pItem->Hdr.byCmdIdx ) ;
+   TEST_CHECK( trs_End( &l_Link.Trs, OK ) == TRS_END_OK ) ;
+   TEST_CHECK( trs_GetQueueDepth( &l_Link.Trs ) == 0 ) ;
+                                       /* failure after all retries */
+   test_LinkInit( &l_Link, &k_TestWifiPolicy, 1 ) ;
+   test_Push( &l_Link, 0, 0 ) ;
+   test_Push( &l_Link, 0, 1 ) ;
+   pItem = trs_Select( &l_Link.Trs, 1 ) ;
+   trs_Start( &l_Link.Trs, pItem->Hdr.byCmdIdx ) ;
+   TEST_CHECK( trs_End( &l_Link.Trs, ERR ) == TRS_END_FAIL ) ;
+   TEST_CHECK( ! trs_IsSelected( &l_Link.Trs ) ) ;
+   TEST_CHECK( trs_GetQueueDepth( &l_Link.Trs ) == 1 ) ;
+                                       /* reset : the selected command is dropped */
+   pItem = trs_Select( &l_Link.Trs, 1 ) ;
+   TEST_CHECK( pItem->dwSeq == 1 ) ;
+   trs_Start( &l_Link.Trs, pItem->Hdr.byCmdIdx ) ;
+   trs_Reset( &l_Link.Trs ) ;
+   TEST_CHECK( ! trs_IsSelected( &l_Link.Trs ) ) ;
+   TEST_CHECK( trs_GetQueueDepth( &l_Link.Trs ) == 0 ) ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* openEVSE link : 3 queues, retries, 10 % of responses lost                  */
+/*----------------------------------------------------------------------------*/
+
+static void test_OEvseLink( void )
+{
+   test_LinkInit( &l_Link, &k_TestOEvsePolicy, 3 ) ;
+   l_Link.wPushPermil = 20 ;
+   l_Link.wLossPermil = 100 ;
+
+   test_LinkRun( &l_Link, 300000 ) ;
+
+   TEST_CHECK( l_Link.dwNbOk > 1000 ) ;
+   TEST_CHECK( l_Link.Trs.dwNbTimeout > 100 ) ;
+   TEST_CHECK( l_Link.byStarvRunMax <= k_TestOEvsePolicy.byStarvMax ) ;
+   printf( "TestTransac : openEVSE link %lu ok, %lu failed, %lu dropped, %lu timeouts\n",
+           l_Link.dwNbOk, l_Link.dwNbFail, l_Link.dwNbDrop, l_Link.Trs.dwNbTimeout ) ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Wifi link : 1 queue, no retry, 10 % of responses lost                      */
+/*----------------------------------------------------------------------------*/
+
+static void test_WifiLink( void )
+{
+   test_LinkInit( &l_Link, &k_TestWifiPolicy, 1 ) ;
+   l_Link.wPushPermil = 5 ;
+   l_Link.wLossPermil = 100 ;
+
+   test_LinkRun( &l_Link, 300000 ) ;
+
+   TEST_CHECK( l_Link.dwNbOk > 500 ) ;
+   TEST_CHECK( l_Link.dwNbFail == l_Link.Trs.dwNbTimeout ) ;
+   printf( "TestTransac : wifi link %lu ok, %lu failed, %lu dropped\n",
+           l_Link.dwNbOk, l_Link.dwNbFail, l_Link.dwNbDrop ) ;
+}
+
+
+/*----------------------------------------------------------------------------*/
+
+int main( void )
+{
+   test_Queue() ;
+   test_Select() ;
+   test_Retry() ;
+   test_OEvseLink() ;
+   test_WifiLink() ;
+
+   return test_End( "TestTransac" ) ;
+}
@@ -0,0 +1,144 @@
+# -*- coding: Utf-8 -*-
+#------------------------------------------------------------------------------#
+# WallyLat : Wifi/OpenEVSE links latency histograms
+# Version : 0.1
+#------------------------------------------------------------------------------#
+
+
+import json
+from WallySocket import cSocketWB
+from optparse import OptionParser
+
+
+HIST_NB = 8                            # latency histogram buckets number (base 4)
+
+                                       # command names, in LIST_CMD() order
+WIFI_CMD = [ "AT", "SCFG", "GCFG", "SETSSID", "CFUN", "SAVE", "FACTRESET",
+             "PING", "SOCKD", "CMDTODATA", "FSL", "SCAN", "HTTPGET", "EXT" ]
+
+OEVSE_CMD = [ "ENABLE", "DISABLE", "SETLOCK", "SETCURRENTCAP", "SETCURRENTVOL",
+              "GETEVSESTATE", "GETCURRENTCAP", "GETFAULT", "GETCHARGPARAM",
+              "GETENERGYCNT", "GETVERSION", "EXTCMD" ]
+
+LINKS = [ ( "Wifi", WIFI_CMD ), ( "OpenEVSE", OEVSE_CMD ) ]
+
+
+#---------------------------------------------------------------------------#
+def Request( SockWB, StrCmd, StrRes ):
+
+   SockWB.Send( StrCmd + "\r\n" )
+
+   buf = ""
+   while( "\r\n" not in buf ) :
+      buf = buf + SockWB.Receive(10).decode("utf-8")
+
+   for Line in buf.splitlines() :
+      if Line.startswith( StrRes ) :
+         return Line[len(StrRes):]
+
+   raise ValueError( "bad response : %s"%buf )
+
+
+#---------------------------------------------------------------------------#
+def ParseHist( StrHist ):
+
+   Fields = StrHist.split()
+   Hist = { "depth" : int( Fields[0] ), "cmd" : {} }
+
+   for Field in Fields[1:] :
+      Idx, Values = Field.split( ":" )
+      Values = [ int( Val ) for Val in Values.split( "/" ) ]
+      Hist["cmd"][int( Idx )] = { "hist" : Values[:HIST_NB],
+                                  "timeout" : Values[HIST_NB],
+                                  "retry" : Values[HIST_NB+1] }
+   return Hist
+
+
+#---------------------------------------------------------------------------#
+def BucketLabel( Idx ):
+
+   if Idx < HIST_NB - 1 :
+      return "<%d" % ( 4 ** ( Idx + 1 ) )
+   else :
+      return ">=%d" % ( 4 ** Idx )
+
+
+#---------------------------------------------------------------------------#
+def Median( HistValues ):
+
+   Total = sum( HistValues )
+   Acc = 0
+   for Idx, Val in enumerate( HistValues ) :
+      Acc += Val
+      if Acc * 2 >= Total :
+         return Idx
+   return None
+
+
+#---------------------------------------------------------------------------#
+def Render( Name, CmdNames, Hist, Ref = None ):
+
+   print( "%s (queue depth %d)" % ( Name, Hist["depth"] ) )
+   print( "   %-14s" % "ms" + "".join( "%8s" % BucketLabel( Idx ) for Idx in range( HIST_NB ) ) +
+          "%8s%8s" % ( "tmo", "retry" ) )
+
+   for Idx in sorted( Hist["cmd"] ) :
+      Cmd = Hist["cmd"][Idx]
+      if Idx < len( CmdNames ) :
+         CmdName = CmdNames[Idx]
+      else :
+         CmdName = "#%d" % Idx
+
+      Line = "   %-14s" % CmdName + "".join( "%8d" % Val for Val in Cmd["hist"] ) + \
+             "%8d%8d" % ( Cmd["timeout"], Cmd["retry"] )
+
+      if Ref and ( str( Idx ) in Ref["cmd"] ) :
+         MedNew = Median( Cmd["hist"] )
+         MedRef = Median( Ref["cmd"][str( Idx )]["hist"] )
+         if ( MedNew is not None ) and ( MedRef is not None ) and ( MedNew > MedRef ) :
+            Line += "   <- slower (median %s, was %s)" % ( BucketLabel( MedNew ), BucketLabel( MedRef ) )
+
+      print( Line )
+   print( "" )
+
+
+#---------------------------------------------------------------------------#
+if __name__ == "__main__" :
+
+   Parser = OptionParser()
+   Parser.add_option( "-i", "--ip", dest="Ip", help="device IP (default : search)" )
+   Parser.add_option( "-s", "--save", dest="Save", help="save histograms to file" )
+   Parser.add_option( "-c", "--compare", dest="Compare", help="compare with saved histograms" )
+   ( Options, Args ) = Parser.parse_args()
+
+   SockWB = cSocketWB()
+   if Options.Ip :
+      SockWB.Connect( Options.Ip )
+   else :
+      SockWB.SearchAndConnect()
+
+   Ref = None
+   if Options.Compare :
+      with open( Options.Compare, "r" ) as f :
+         Ref = json.load( f )
+
+   print( "Transactions (sent, ok, err, timeout, fail, last ms, max ms) :" )
+   Stat = Request( SockWB, "$21:", "$A1:" ).split( ";" )
+   for LinkIdx, ( Name, CmdNames ) in enumerate( LINKS ) :
+      print( "   %-10s %s" % ( Name, Stat[LinkIdx].strip() ) )
+   print( "" )
+
+   Saved = []
+   for LinkIdx, ( Name, CmdNames ) in enumerate( LINKS ) :
+      Hist = ParseHist( Request( SockWB, "$23:%d" % LinkIdx, "$A3:" ) )
+      if Ref :
+         Render( Name, CmdNames, Hist, Ref[LinkIdx] )
+      else :
+         Render( Name, CmdNames, Hist )
+      Saved.append( Hist )
+
+   if Options.Save :
+      with open( Options.Save, "w" ) as f :
+         json.dump( Saved, f )
+
+   SockWB.Close()